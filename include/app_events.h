@@ -0,0 +1,145 @@
+// ========================================
+// v3.1: App Events and Timer Rules
+// ========================================
+// Event types, app states and the rules that map timer deadlines to events, shared by
+// src/main.cpp and the host tests (test/test_app_events, pio test -e native). Nothing in
+// here touches hardware or Arduino APIs.
+
+#ifndef PAPERSPECIMEN_APP_EVENTS_H
+#define PAPERSPECIMEN_APP_EVENTS_H
+
+const unsigned long FULL_REFRESH_TIMEOUT_MS = 10000; // 10 seconds from first partial
+const unsigned long DEEP_SLEEP_TIMEOUT_MS = 10000;   // 10 seconds from last full refresh
+const unsigned long SETTLE_QUIET_MS = 600;           // Input quiet time before the grayscale upgrade
+const unsigned long PREFETCH_IDLE_MS = 1500;         // Idle time before prefetching neighbour fonts
+
+enum AppState {
+    STATE_IDLE,        // Waiting for input or a timer deadline
+    STATE_RENDERING,   // FreeType render + EPD push for a user action
+    STATE_REFRESHING,  // Ghosting cleanup (GC16 full refresh)
+    STATE_PREFETCHING, // Reading neighbour fonts into the RAM cache while idle
+    STATE_SLEEPING     // Entering deep sleep / shutdown (never returns)
+};
+
+enum AppEventType {
+    EVT_NONE,
+    EVT_NEXT_FONT,         // BtnR / tap right
+    EVT_PREV_FONT,         // BtnL / tap left
+    EVT_RANDOM_GLYPH,      // BtnP short press / tap center
+    EVT_TOGGLE_MODE,       // BtnP long press / long press center
+    EVT_SHUTDOWN,          // BtnP held for 5s
+    EVT_SETTLE_DUE,        // Timer: input quiet, upgrade the DU preview to grayscale
+    EVT_FULL_REFRESH_DUE,  // Timer: partial refreshes need a GC16 cleanup
+    EVT_PREFETCH_DUE,      // Timer: user idle, warm the font cache
+    EVT_SLEEP_DUE,         // Timer: auto-wake done or idle timeout reached
+    EVT_SHOW_LATENCY       // Debug mode: long press left/right zone, latency histogram screen
+};
+
+enum AppEventSource {
+    SRC_BUTTON,
+    SRC_TOUCH,
+    SRC_TIMER
+};
+
+struct AppEvent {
+    AppEventType type;
+    AppEventSource source;
+    unsigned long timestamp; // millis() at edge detection / deadline
+};
+
+inline const char* appEventName(AppEventType type) {
+    switch (type) {
+        case EVT_NEXT_FONT:        return "NEXT_FONT";
+        case EVT_PREV_FONT:        return "PREV_FONT";
+        case EVT_RANDOM_GLYPH:     return "RANDOM_GLYPH";
+        case EVT_TOGGLE_MODE:      return "TOGGLE_MODE";
+        case EVT_SHUTDOWN:         return "SHUTDOWN";
+        case EVT_SETTLE_DUE:       return "SETTLE_DUE";
+        case EVT_FULL_REFRESH_DUE: return "FULL_REFRESH_DUE";
+        case EVT_PREFETCH_DUE:     return "PREFETCH_DUE";
+        case EVT_SLEEP_DUE:        return "SLEEP_DUE";
+        case EVT_SHOW_LATENCY:     return "SHOW_LATENCY";
+        default:                   return "NONE";
+    }
+}
+
+inline bool isUserInputEvent(AppEventType type) {
+    return type == EVT_NEXT_FONT || type == EVT_PREV_FONT ||
+           type == EVT_RANDOM_GLYPH || type == EVT_TOGGLE_MODE || type == EVT_SHUTDOWN ||
+           type == EVT_SHOW_LATENCY;
+}
+
+// State the machine is in while handling an event (pure)
+inline AppState appStateForEvent(AppEventType type) {
+    switch (type) {
+        case EVT_NEXT_FONT:
+        case EVT_PREV_FONT:
+        case EVT_RANDOM_GLYPH:
+        case EVT_TOGGLE_MODE:
+        case EVT_SHOW_LATENCY:     return STATE_RENDERING;
+        case EVT_SETTLE_DUE:
+        case EVT_FULL_REFRESH_DUE: return STATE_REFRESHING;
+        case EVT_PREFETCH_DUE:     return STATE_PREFETCHING;
+        case EVT_SHUTDOWN:
+        case EVT_SLEEP_DUE:        return STATE_SLEEPING;
+        default:                   return STATE_IDLE;
+    }
+}
+
+// Inputs for timer evaluation (snapshot of refresh/power state)
+struct TimerSnapshot {
+    unsigned long now;
+    unsigned long lastFullRefreshTime;
+    unsigned long firstPartialAfterFullTime;
+    unsigned long lastButtonActivityTime;
+    unsigned long lastPreviewTime;
+    bool hasPartialSinceLastFull;
+    bool isAutoWakeSession;
+    bool prefetchPending;
+    bool settlePending;
+};
+
+// Decide which timer deadline (if any) has expired (pure)
+// Priority: grayscale settle > ghosting cleanup > sleep > prefetch
+inline AppEventType evaluateTimers(const TimerSnapshot& t) {
+    unsigned long timeSinceFirstPartial = t.now - t.firstPartialAfterFullTime;
+    unsigned long timeSinceLastFull = t.now - t.lastFullRefreshTime;
+
+    // DU preview on screen and input quiet: upgrade to 16 levels before anything else
+    if (t.settlePending &&
+        t.now - t.lastPreviewTime >= SETTLE_QUIET_MS &&
+        t.now - t.lastButtonActivityTime >= SETTLE_QUIET_MS) {
+        return EVT_SETTLE_DUE;
+    }
+
+    // Auto full refresh after 10s timeout if there was at least 1 partial
+    // AND at least 10s passed since last full refresh
+    if (t.hasPartialSinceLastFull &&
+        timeSinceFirstPartial >= FULL_REFRESH_TIMEOUT_MS &&
+        timeSinceLastFull >= FULL_REFRESH_TIMEOUT_MS) {
+        return EVT_FULL_REFRESH_DUE;
+    }
+
+    // Auto-wake session (timer wake): sleep as soon as the refresh had time to complete
+    // (1000ms covers the double full refresh of the first render after wake)
+    if (t.isAutoWakeSession && timeSinceLastFull >= 1000) {
+        return EVT_SLEEP_DUE;
+    }
+
+    // Interactive session: sleep 10s after last full refresh if no button activity since
+    if (!t.isAutoWakeSession &&
+        timeSinceLastFull >= DEEP_SLEEP_TIMEOUT_MS &&
+        t.lastButtonActivityTime <= t.lastFullRefreshTime) {
+        return EVT_SLEEP_DUE;
+    }
+
+    // User idle: warm the cache for the next BtnL/BtnR press
+    if (!t.isAutoWakeSession && t.prefetchPending &&
+        t.now - t.lastButtonActivityTime >= PREFETCH_IDLE_MS) {
+        return EVT_PREFETCH_DUE;
+    }
+
+    return EVT_NONE;
+}
+
+#endif // PAPERSPECIMEN_APP_EVENTS_H
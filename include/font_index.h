@@ -0,0 +1,590 @@
+// ========================================
+// v3.1: Font Index (sfnt parsing)
+// ========================================
+// Unicode ranges, the catalog record and everything that fills it from a font file: Font
+// ID, name/head/maxp/OS-2 metadata and cmap coverage. Shared by src/main.cpp and the host
+// tests (test/test_font_index, pio test -e native). Reads go through FontSource, so
+// nothing in here touches SD, logging or Arduino APIs.
+
+#ifndef PAPERSPECIMEN_FONT_INDEX_H
+#define PAPERSPECIMEN_FONT_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+// ========================================
+// v2.2: Unicode Ranges
+// ========================================
+// Unicode ranges for random glyph selection
+struct UnicodeRange {
+    uint32_t start;
+    uint32_t end;
+    const char* name;
+    uint8_t os2Bit;   // v3.1: OS/2 ulUnicodeRange bit of the enclosing block (script detection)
+};
+
+// v2.2: Expanded Unicode ranges (28 total, user-customizable)
+const UnicodeRange glyphRanges[] = {
+    // Original 6 ranges (enabled by default)
+    {0x0041, 0x005A, "Latin Uppercase (U+0041-005A)", 0},
+    {0x0061, 0x007A, "Latin Lowercase (U+0061-007A)", 0},
+    {0x0030, 0x0039, "Digits (U+0030-0039)", 0},
+    {0x0021, 0x002F, "Basic Punctuation (U+0021-002F)", 0},
+    {0x00A1, 0x00BF, "Latin-1 Punctuation (U+00A1-00BF)", 1},
+    {0x00C0, 0x00FF, "Latin-1 Letters (U+00C0-00FF)", 1},
+
+    // New ranges (22 additional - disabled by default)
+    {0x0100, 0x017F, "Latin Extended-A (U+0100-017F)", 2},
+    {0x0180, 0x024F, "Latin Extended-B (U+0180-024F)", 3},
+    {0x0370, 0x03FF, "Greek and Coptic (U+0370-03FF)", 7},
+    {0x0400, 0x04FF, "Cyrillic (U+0400-04FF)", 9},
+    {0x0590, 0x05FF, "Hebrew (U+0590-05FF)", 11},
+    {0x0600, 0x06FF, "Arabic (U+0600-06FF)", 13},
+    {0x0900, 0x097F, "Devanagari (U+0900-097F)", 15},
+    {0x0E00, 0x0E7F, "Thai (U+0E00-0E7F)", 24},
+    {0x10A0, 0x10FF, "Georgian (U+10A0-10FF)", 26},
+    {0x3040, 0x309F, "Hiragana (U+3040-309F)", 49},
+    {0x30A0, 0x30FF, "Katakana (U+30A0-30FF)", 50},
+    {0x4E00, 0x9FFF, "CJK Ideographs (U+4E00-9FFF)", 59},
+    {0xAC00, 0xD7AF, "Hangul (U+AC00-D7AF)", 56},
+    {0x2000, 0x206F, "General Punctuation (U+2000-206F)", 31},
+    {0x20A0, 0x20CF, "Currency Symbols (U+20A0-20CF)", 33},
+    {0x2100, 0x214F, "Letterlike Symbols (U+2100-214F)", 35},
+    {0x2190, 0x21FF, "Arrows (U+2190-21FF)", 37},
+    {0x2200, 0x22FF, "Mathematical Operators (U+2200-22FF)", 38},
+    {0x2500, 0x257F, "Box Drawing (U+2500-257F)", 43},
+    {0x2580, 0x259F, "Block Elements (U+2580-259F)", 44},
+    {0x25A0, 0x25FF, "Geometric Shapes (U+25A0-25FF)", 45},
+    {0x2600, 0x26FF, "Miscellaneous Symbols (U+2600-26FF)", 46},
+};
+const int numGlyphRanges = sizeof(glyphRanges) / sizeof(glyphRanges[0]);
+
+// ========================================
+// v3.1: Font Catalog Records
+// ========================================
+// One fixed-size record per font in /.fontindex (file layout, paging and the active table:
+// see Font Catalog in src/main.cpp).
+
+const uint8_t FONT_INDEX_VERSION = 7;           // v2: + name/head/maxp/OS-2 metadata, v3: + cmap coverage, v4: + validity,
+                                                // v5: + OS/2 Unicode ranges, per-range counts, scripts,
+                                                // v6: scripts with the Letterlike Symbols bit fixed,
+                                                // v7: font ID over the path below /fonts
+const int FONT_PATH_MAX = 128;
+const uint8_t FONT_FLAG_ENABLED = 0x01;
+const uint8_t FONT_FLAG_COVERAGE = 0x02;   // rangeCoverage/bmpPages are valid (usable cmap found)
+// Validity: unusable fonts stay in the catalog (and the setup list) but out of the active
+// table. Index-time results are re-checked whenever the font is re-indexed. A runtime
+// failure skips the font for one session; FONT_LOAD_FAILURE_LIMIT sessions in a row set
+// FONT_FLAG_LOAD_FAILED, which holds until the file's size or mtime changes.
+const uint8_t FONT_FLAG_LOAD_FAILED = 0x04;  // Load error or no valid glyph (see loadFailures)
+const uint8_t FONT_FLAG_NO_OUTLINES = 0x08;  // No glyf/CFF/CFF2 table (bitmap-only or not sfnt)
+const uint8_t FONT_FLAG_EMPTY_CMAP = 0x10;   // No Unicode codepoint maps to a glyph
+const uint8_t FONT_FLAGS_UNUSABLE = FONT_FLAG_LOAD_FAILED | FONT_FLAG_NO_OUTLINES | FONT_FLAG_EMPTY_CMAP;
+const uint8_t FONT_LOAD_FAILURE_LIMIT = 2;
+
+struct FontCatalogRecord {
+    char path[FONT_PATH_MAX];
+    uint32_t size;
+    uint32_t mtime;   // File::getLastWrite()
+    uint32_t fontId;  // See Font ID
+    uint8_t flags;    // FONT_FLAG_*
+    uint8_t indexVersion;     // FONT_INDEX_VERSION the fields below were read with
+    uint8_t loadFailures;     // Sessions in a row with a runtime failure (0 after a render)
+    uint8_t reserved;
+    // Index v2: metadata (UTF-8, empty if the font has no usable name record)
+    char family[48];          // name ID 16, else 1
+    char subfamily[32];       // name ID 17, else 2
+    char designer[48];        // name ID 9
+    char license[64];         // name ID 13 (truncated)
+    uint16_t glyphCount;      // maxp.numGlyphs
+    uint16_t unitsPerEm;      // head.unitsPerEm
+    uint16_t weightClass;     // OS/2.usWeightClass
+    uint16_t reserved2;
+    // Index v3: cmap coverage (see Font Indexing)
+    uint32_t rangeCoverage;   // Bit i: glyphRanges[i] has at least one mapped codepoint
+    uint8_t bmpPages[32];     // Bit p: U+pp00-U+ppFF has at least one mapped codepoint
+    uint32_t codepointCount;  // Mapped codepoints
+    uint16_t variationSequences; // Unicode variation sequences (cmap format 14)
+    uint16_t reserved3;
+    // Index v5: script detection (see Font Indexing)
+    uint32_t unicodeRanges[4];   // OS/2 ulUnicodeRange1-4 (0 without OS/2)
+    uint16_t rangeGlyphs[32];    // Mapped codepoints per glyphRanges entry
+    uint32_t scriptRanges;       // Bit i: the font supports glyphRanges[i]
+};
+
+// ========================================
+// v3.1: Font ID
+// ========================================
+// FNV-1a over the path below /fonts ("Inter.ttf", "sans/Inter.ttf"), file size and the sfnt
+// table directory (tag, checksum, offset and length of every table). The path keeps two
+// identical copies in different folders apart. Config flags, rtcState, the RAM font cache and pre-rendered
+// frames use it instead of the position in the scan, so adding or removing a file in
+// /fonts neither shifts the flags of other fonts nor restores the wrong font after sleep.
+// Only the first FONT_ID_MAX_TABLES directory entries are hashed. 0 means "no ID".
+
+const uint32_t FNV_OFFSET_BASIS = 2166136261u;
+const uint32_t FNV_PRIME = 16777619u;
+const int FONT_ID_MAX_TABLES = 31;
+const int SFNT_MAX_TABLES = 64;
+
+#define SFNT_TAG(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+
+struct SfntTableEntry {
+    uint32_t tag;
+    uint32_t offset;
+    uint32_t length;
+};
+
+struct SfntDirectory {
+    int numTables;
+    SfntTableEntry tables[SFNT_MAX_TABLES];
+};
+
+inline uint16_t readBE16(const uint8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+inline uint32_t readBE32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+inline const SfntTableEntry* findSfntTable(const SfntDirectory& dir, uint32_t tag) {
+    for (int i = 0; i < dir.numTables; i++) {
+        if (dir.tables[i].tag == tag) return &dir.tables[i];
+    }
+    return nullptr;
+}
+
+// Where the indexer reads a font from: an SD file on the device (sdFontSource), a memory
+// buffer or a host file in the tests
+struct FontSource {
+    void* handle;
+    uint32_t size;                  // File size
+    size_t (*read)(void* handle, uint32_t offset, uint8_t* out, size_t len);
+};
+
+// Bytes at a file offset; returns how many could be read
+inline size_t readFontSpan(FontSource& src, uint32_t offset, uint8_t* out, size_t len) {
+    return src.read(src.handle, offset, out, len);
+}
+
+inline bool readFontBytes(FontSource& src, uint32_t offset, uint8_t* out, size_t len) {
+    return readFontSpan(src, offset, out, len) == len;
+}
+
+// Offset table: sfntVersion(4) numTables(2) searchRange/entrySelector/rangeShift(6)
+inline bool isSfntHeader(const uint8_t* header, size_t len) {
+    return len == 12 && (memcmp(header, "\x00\x01\x00\x00", 4) == 0 ||
+                         memcmp(header, "OTTO", 4) == 0 || memcmp(header, "true", 4) == 0);
+}
+
+// Table records (tag, checksum, offset, length) -> dir
+inline void parseSfntDirectory(const uint8_t* entries, size_t bytes, SfntDirectory& dir) {
+    dir.numTables = std::min(bytes / 16, (size_t)SFNT_MAX_TABLES);
+    for (int i = 0; i < dir.numTables; i++) {
+        const uint8_t* entry = entries + i * 16;
+        dir.tables[i] = {readBE32(entry), readBE32(entry + 8), readBE32(entry + 12)};
+    }
+}
+
+inline uint32_t fnv1aUpdate(uint32_t hash, const uint8_t* data, size_t len) {
+    while (len--) {
+        hash ^= *data++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// Font ID of a font at relPath (below /fonts); also returns its table directory (empty if
+// not sfnt)
+inline uint32_t computeFontId(FontSource& src, const char* relPath, SfntDirectory& dir) {
+    uint32_t hash = fnv1aUpdate(FNV_OFFSET_BASIS, (const uint8_t*)relPath, strlen(relPath));
+    uint32_t size = src.size;
+    hash = fnv1aUpdate(hash, (const uint8_t*)&size, sizeof(size));
+
+    uint8_t directory[12 + 16 * SFNT_MAX_TABLES];
+    size_t len = readFontSpan(src, 0, directory, 12);
+    dir.numTables = 0;
+    if (isSfntHeader(directory, len)) {
+        int numTables = std::min((int)readBE16(directory + 4), SFNT_MAX_TABLES);
+        size_t entries = readFontSpan(src, 12, directory + 12, numTables * 16);
+        parseSfntDirectory(directory + 12, entries, dir);
+        len += std::min(entries, (size_t)(16 * FONT_ID_MAX_TABLES));
+    }
+    hash = fnv1aUpdate(hash, directory, len);
+    return hash != 0 ? hash : 1;
+}
+
+// ========================================
+// v3.1: Font Indexing (sfnt tables)
+// ========================================
+// Reads what the catalog keeps per font straight from the file, without a FreeType face:
+// name (family, subfamily, designer, license), head (unitsPerEm), maxp (glyph count),
+// OS/2 (weight class) and cmap coverage. A few small reads per font, done only when a font
+// is new, changed or was indexed by an older FONT_INDEX_VERSION.
+
+// Encode a Unicode codepoint as UTF-8 into out (at least 5 bytes), returns the byte count
+inline size_t codepointToUtf8(uint32_t codepoint, char* out) {
+    size_t len = 0;
+
+    if (codepoint <= 0x7F) {
+        // 1-byte UTF-8
+        out[len++] = (char)codepoint;
+    } else if (codepoint <= 0x7FF) {
+        // 2-byte UTF-8
+        out[len++] = (char)(0xC0 | (codepoint >> 6));
+        out[len++] = (char)(0x80 | (codepoint & 0x3F));
+    } else if (codepoint <= 0xFFFF) {
+        // 3-byte UTF-8
+        out[len++] = (char)(0xE0 | (codepoint >> 12));
+        out[len++] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[len++] = (char)(0x80 | (codepoint & 0x3F));
+    } else if (codepoint <= 0x10FFFF) {
+        // 4-byte UTF-8
+        out[len++] = (char)(0xF0 | (codepoint >> 18));
+        out[len++] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+        out[len++] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+        out[len++] = (char)(0x80 | (codepoint & 0x3F));
+    }
+
+    out[len] = '\0';
+    return len;
+}
+
+const uint16_t NAME_FAMILY = 1;
+const uint16_t NAME_SUBFAMILY = 2;
+const uint16_t NAME_DESIGNER = 9;
+const uint16_t NAME_LICENSE = 13;
+const uint16_t NAME_TYPO_FAMILY = 16;
+const uint16_t NAME_TYPO_SUBFAMILY = 17;
+const int NAME_RECORDS_PER_READ = 16;
+
+struct NameChoice {
+    int score;            // 0 = none
+    uint16_t platform;
+    uint16_t length;
+    uint16_t offset;      // From the string storage
+};
+
+// Windows/Unicode English > Windows/Unicode other language > Mac Roman
+inline int nameRecordScore(uint16_t platform, uint16_t encoding, uint16_t language) {
+    if (platform == 3 && (encoding == 1 || encoding == 10)) return language == 0x0409 ? 3 : 2;
+    if (platform == 0) return 2;
+    if (platform == 1 && encoding == 0 && language == 0) return 1;
+    return 0;
+}
+
+// Name string -> UTF-8 (UTF-16BE, or the ASCII subset of Mac Roman)
+inline void copyFontName(FontSource& src, uint32_t storage, const NameChoice& choice, char* out, size_t outSize) {
+    out[0] = '\0';
+    if (choice.score == 0) return;
+    uint8_t raw[128];
+    size_t len = std::min((size_t)choice.length, sizeof(raw));
+    if (!readFontBytes(src, storage + choice.offset, raw, len)) return;
+
+    size_t pos = 0;
+    for (size_t i = 0; i < len; ) {
+        uint32_t codepoint;
+        if (choice.platform == 1) {
+            codepoint = raw[i] < 0x80 ? raw[i] : '?';
+            i++;
+        } else {
+            if (i + 1 >= len) break;
+            codepoint = readBE16(raw + i);
+            i += 2;
+            if (codepoint >= 0xD800 && codepoint < 0xDC00 && i + 1 < len) {
+                codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (readBE16(raw + i) - 0xDC00);
+                i += 2;
+            }
+        }
+        char utf8[5];
+        size_t n = codepointToUtf8(codepoint, utf8);
+        if (pos + n >= outSize) break;
+        memcpy(out + pos, utf8, n);
+        pos += n;
+    }
+    out[pos] = '\0';
+}
+
+inline void readFontNames(FontSource& src, const SfntTableEntry& table, FontCatalogRecord& record) {
+    uint8_t header[6];
+    if (table.length < 6 || !readFontBytes(src, table.offset, header, sizeof(header))) return;
+    int count = readBE16(header + 2);
+    uint32_t storage = table.offset + readBE16(header + 4);
+
+    const uint16_t wanted[] = {NAME_FAMILY, NAME_SUBFAMILY, NAME_DESIGNER, NAME_LICENSE,
+                               NAME_TYPO_FAMILY, NAME_TYPO_SUBFAMILY};
+    const int WANTED = sizeof(wanted) / sizeof(wanted[0]);
+    NameChoice best[WANTED];
+    memset(best, 0, sizeof(best));
+
+    uint8_t records[NAME_RECORDS_PER_READ * 12];
+    for (int start = 0; start < count; start += NAME_RECORDS_PER_READ) {
+        int n = std::min(NAME_RECORDS_PER_READ, count - start);
+        if (!readFontBytes(src, table.offset + 6 + start * 12, records, n * 12)) break;
+        for (int i = 0; i < n; i++) {
+            const uint8_t* r = records + i * 12;
+            int score = nameRecordScore(readBE16(r), readBE16(r + 2), readBE16(r + 4));
+            uint16_t nameId = readBE16(r + 6);
+            for (int k = 0; k < WANTED; k++) {
+                if (wanted[k] == nameId && score > best[k].score) {
+                    best[k] = {score, readBE16(r), readBE16(r + 8), readBE16(r + 10)};
+                }
+            }
+        }
+    }
+
+    // Typographic family/subfamily (16/17) win over the legacy four-style names (1/2)
+    copyFontName(src, storage, best[4].score ? best[4] : best[0], record.family, sizeof(record.family));
+    copyFontName(src, storage, best[5].score ? best[5] : best[1], record.subfamily, sizeof(record.subfamily));
+    copyFontName(src, storage, best[2], record.designer, sizeof(record.designer));
+    copyFontName(src, storage, best[3], record.license, sizeof(record.license));
+}
+
+// cmap coverage: one streaming pass over the best Unicode subtable (format 12, else 4) in
+// small chunks, plus the format 14 variation sequences. Codepoints that map to glyph 0
+// do not count. Only the records are read, never the glyph data, so indexing costs a few
+// KB of SD reads however large the font is.
+const int CMAP_CHUNK = 32;        // Segments/groups per read
+
+inline void coverCodepoints(FontCatalogRecord& record, uint32_t first, uint32_t last) {
+    if (first > last) return;
+    record.codepointCount += last - first + 1;
+    for (uint32_t page = first >> 8; page <= (last >> 8) && page < 256; page++) {
+        record.bmpPages[page / 8] |= 1 << (page % 8);
+    }
+    for (int i = 0; i < numGlyphRanges; i++) {
+        if (first <= glyphRanges[i].end && last >= glyphRanges[i].start) {
+            record.rangeCoverage |= 1UL << i;
+            record.rangeGlyphs[i] += std::min(last, glyphRanges[i].end) - std::max(first, glyphRanges[i].start) + 1;
+        }
+    }
+}
+
+// Format 4 segment mapped through glyphIdArray: cover the runs of non-zero glyphs
+inline bool coverFormat4Indirect(FontSource& src, uint32_t address, uint16_t start, uint16_t end, uint16_t delta,
+                          FontCatalogRecord& record) {
+    uint8_t ids[CMAP_CHUNK * 2];
+    uint32_t runStart = 0;
+    bool inRun = false;
+    for (uint32_t c = start; c <= end; c += CMAP_CHUNK) {
+        int n = std::min((uint32_t)CMAP_CHUNK, end - c + 1);
+        if (!readFontBytes(src, address + (c - start) * 2, ids, n * 2)) return false;
+        for (int k = 0; k < n; k++) {
+            uint16_t glyph = readBE16(ids + k * 2);
+            bool mapped = glyph != 0 && ((glyph + delta) & 0xFFFF) != 0;
+            if (mapped && !inRun) runStart = c + k;
+            if (!mapped && inRun) coverCodepoints(record, runStart, c + k - 1);
+            inRun = mapped;
+        }
+    }
+    if (inRun) coverCodepoints(record, runStart, end);
+    return true;
+}
+
+inline bool readCmapFormat4(FontSource& src, uint32_t offset, FontCatalogRecord& record) {
+    uint8_t header[14];
+    if (!readFontBytes(src, offset, header, sizeof(header))) return false;
+    int segCount = readBE16(header + 6) / 2;
+    uint32_t ends = offset + 14;
+    uint32_t starts = ends + segCount * 2 + 2; // reservedPad
+    uint32_t deltas = starts + segCount * 2;
+    uint32_t rangeOffsets = deltas + segCount * 2;
+
+    uint8_t endCodes[CMAP_CHUNK * 2], startCodes[CMAP_CHUNK * 2];
+    uint8_t idDeltas[CMAP_CHUNK * 2], idRangeOffsets[CMAP_CHUNK * 2];
+    for (int seg = 0; seg < segCount; seg += CMAP_CHUNK) {
+        int n = std::min(CMAP_CHUNK, segCount - seg);
+        if (!readFontBytes(src, ends + seg * 2, endCodes, n * 2) ||
+            !readFontBytes(src, starts + seg * 2, startCodes, n * 2) ||
+            !readFontBytes(src, deltas + seg * 2, idDeltas, n * 2) ||
+            !readFontBytes(src, rangeOffsets + seg * 2, idRangeOffsets, n * 2)) {
+            return false;
+        }
+        for (int k = 0; k < n; k++) {
+            uint16_t start = readBE16(startCodes + k * 2);
+            uint16_t end = readBE16(endCodes + k * 2);
+            uint16_t delta = readBE16(idDeltas + k * 2);
+            uint16_t rangeOffset = readBE16(idRangeOffsets + k * 2);
+            if (start > end || start == 0xFFFF) continue; // Final 0xFFFF segment
+            if (rangeOffset == 0) {
+                // glyph = c + delta; only c == -delta lands on glyph 0
+                uint16_t notdef = (0x10000 - delta) & 0xFFFF;
+                if (notdef >= start && notdef <= end) {
+                    if (notdef > start) coverCodepoints(record, start, notdef - 1);
+                    if (notdef < end) coverCodepoints(record, notdef + 1, end);
+                } else {
+                    coverCodepoints(record, start, end);
+                }
+            } else {
+                uint32_t address = rangeOffsets + (seg + k) * 2 + rangeOffset;
+                if (!coverFormat4Indirect(src, address, start, end, delta, record)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+inline bool readCmapFormat12(FontSource& src, uint32_t offset, FontCatalogRecord& record) {
+    uint8_t header[16];
+    if (!readFontBytes(src, offset, header, sizeof(header))) return false;
+    uint32_t numGroups = readBE32(header + 12);
+    uint8_t groups[CMAP_CHUNK * 12];
+    for (uint32_t g = 0; g < numGroups; g += CMAP_CHUNK) {
+        int n = std::min((uint32_t)CMAP_CHUNK, numGroups - g);
+        if (!readFontBytes(src, offset + 16 + g * 12, groups, n * 12)) return false;
+        for (int k = 0; k < n; k++) {
+            uint32_t first = readBE32(groups + k * 12);
+            uint32_t last = std::min(readBE32(groups + k * 12 + 4), (uint32_t)0x10FFFF);
+            if (readBE32(groups + k * 12 + 8) == 0) first++; // First codepoint maps to glyph 0
+            coverCodepoints(record, first, last);
+        }
+    }
+    return true;
+}
+
+// Format 14: count default (ranges) and non-default (mappings) variation sequences
+inline bool readCmapFormat14(FontSource& src, uint32_t offset, FontCatalogRecord& record) {
+    uint8_t header[10];
+    if (!readFontBytes(src, offset, header, sizeof(header))) return false;
+    uint32_t numSelectors = readBE32(header + 6);
+    uint32_t sequences = 0;
+    uint8_t selector[11];
+    uint8_t count[4];
+    uint8_t ranges[CMAP_CHUNK * 4];
+    for (uint32_t i = 0; i < numSelectors; i++) {
+        if (!readFontBytes(src, offset + 10 + i * 11, selector, sizeof(selector))) return false;
+        uint32_t defaultOffset = readBE32(selector + 3);
+        uint32_t nonDefaultOffset = readBE32(selector + 7);
+        if (defaultOffset != 0) {
+            if (!readFontBytes(src, offset + defaultOffset, count, 4)) return false;
+            uint32_t numRanges = readBE32(count);
+            for (uint32_t r = 0; r < numRanges; r += CMAP_CHUNK) {
+                int n = std::min((uint32_t)CMAP_CHUNK, numRanges - r);
+                if (!readFontBytes(src, offset + defaultOffset + 4 + r * 4, ranges, n * 4)) return false;
+                for (int k = 0; k < n; k++) sequences += ranges[k * 4 + 3] + 1; // additionalCount + 1
+            }
+        }
+        if (nonDefaultOffset != 0) {
+            if (!readFontBytes(src, offset + nonDefaultOffset, count, 4)) return false;
+            sequences += readBE32(count);
+        }
+    }
+    record.variationSequences = std::min(sequences, (uint32_t)0xFFFF);
+    return true;
+}
+
+// Unicode subtables by preference: full repertoire (format 12), BMP (format 4)
+inline int cmapSubtableScore(uint16_t platform, uint16_t encoding, uint16_t format) {
+    if (format == 12 && ((platform == 3 && encoding == 10) || (platform == 0 && (encoding == 4 || encoding == 6)))) return 2;
+    if (format == 4 && ((platform == 3 && encoding == 1) || (platform == 0 && encoding <= 3))) return 1;
+    return 0;
+}
+
+inline void readFontCoverage(FontSource& src, const SfntTableEntry& table, FontCatalogRecord& record) {
+    uint8_t header[4];
+    if (table.length < 4 || !readFontBytes(src, table.offset, header, sizeof(header))) return;
+    int numTables = readBE16(header + 2);
+
+    uint32_t best = 0, variations = 0;
+    int bestScore = 0, bestFormat = 0;
+    uint8_t encoding[8];
+    uint8_t format[2];
+    for (int i = 0; i < numTables; i++) {
+        if (!readFontBytes(src, table.offset + 4 + i * 8, encoding, sizeof(encoding))) return;
+        uint32_t subtable = table.offset + readBE32(encoding + 4);
+        if (!readFontBytes(src, subtable, format, sizeof(format))) continue;
+        uint16_t platform = readBE16(encoding);
+        uint16_t encodingId = readBE16(encoding + 2);
+        uint16_t subtableFormat = readBE16(format);
+        if (subtableFormat == 14 && platform == 0 && encodingId == 5) variations = subtable;
+        int score = cmapSubtableScore(platform, encodingId, subtableFormat);
+        if (score > bestScore) {
+            best = subtable;
+            bestScore = score;
+            bestFormat = subtableFormat;
+        }
+    }
+
+    bool ok = bestFormat == 12 ? readCmapFormat12(src, best, record)
+            : bestFormat == 4 ? readCmapFormat4(src, best, record) : false;
+    if (ok) {
+        record.flags |= FONT_FLAG_COVERAGE;
+    } else {
+        record.rangeCoverage = 0;
+        record.codepointCount = 0;
+        memset(record.bmpPages, 0, sizeof(record.bmpPages));
+        memset(record.rangeGlyphs, 0, sizeof(record.rangeGlyphs));
+    }
+    if (variations) readCmapFormat14(src, variations, record);
+}
+
+// Can the font map this codepoint? (true when unknown: no coverage or outside the BMP)
+inline bool fontMayCover(const FontCatalogRecord* record, uint32_t codepoint) {
+    if (!record || !(record->flags & FONT_FLAG_COVERAGE) || codepoint > 0xFFFF) return true;
+    uint32_t page = codepoint >> 8;
+    return record->bmpPages[page / 8] & (1 << (page % 8));
+}
+
+// Font ID and metadata of a new or changed font. Only touches src and record (no
+// logging): it also runs in the background scan task.
+inline void indexFontFile(FontSource& src, const char* relPath, FontCatalogRecord& record) {
+    // A changed font is re-indexed into its old record: every index field starts over
+    memset((uint8_t*)&record + offsetof(FontCatalogRecord, family), 0,
+           sizeof(record) - offsetof(FontCatalogRecord, family));
+    SfntDirectory dir;
+    record.fontId = computeFontId(src, relPath, dir);
+    record.indexVersion = FONT_INDEX_VERSION;
+    record.flags &= ~(FONT_FLAG_COVERAGE | FONT_FLAG_NO_OUTLINES | FONT_FLAG_EMPTY_CMAP);
+
+    uint8_t field[2];
+    const SfntTableEntry* head = findSfntTable(dir, SFNT_TAG('h', 'e', 'a', 'd'));
+    if (head && head->length >= 20 && readFontBytes(src, head->offset + 18, field, 2)) {
+        record.unitsPerEm = readBE16(field);
+    }
+    const SfntTableEntry* maxp = findSfntTable(dir, SFNT_TAG('m', 'a', 'x', 'p'));
+    if (maxp && maxp->length >= 6 && readFontBytes(src, maxp->offset + 4, field, 2)) {
+        record.glyphCount = readBE16(field);
+    }
+    const SfntTableEntry* os2 = findSfntTable(dir, SFNT_TAG('O', 'S', '/', '2'));
+    if (os2 && os2->length >= 6 && readFontBytes(src, os2->offset + 4, field, 2)) {
+        record.weightClass = readBE16(field);
+    }
+    uint8_t unicodeRanges[16];
+    if (os2 && os2->length >= 58 && readFontBytes(src, os2->offset + 42, unicodeRanges, sizeof(unicodeRanges))) {
+        for (int i = 0; i < 4; i++) record.unicodeRanges[i] = readBE32(unicodeRanges + i * 4);
+    }
+    const SfntTableEntry* names = findSfntTable(dir, SFNT_TAG('n', 'a', 'm', 'e'));
+    if (names) {
+        readFontNames(src, *names, record);
+    }
+    const SfntTableEntry* cmap = findSfntTable(dir, SFNT_TAG('c', 'm', 'a', 'p'));
+    if (cmap) {
+        readFontCoverage(src, *cmap, record);
+    }
+
+    // Validity: outlines to draw, and at least one Unicode codepoint that reaches them
+    if (!findSfntTable(dir, SFNT_TAG('g', 'l', 'y', 'f')) && !findSfntTable(dir, SFNT_TAG('C', 'F', 'F', ' ')) &&
+        !findSfntTable(dir, SFNT_TAG('C', 'F', 'F', '2'))) {
+        record.flags |= FONT_FLAG_NO_OUTLINES;
+    }
+    if (record.codepointCount == 0) {
+        record.flags |= FONT_FLAG_EMPTY_CMAP;
+    }
+
+    // Scripts: glyph ranges with mapped codepoints that OS/2 declares, or that are at least
+    // half covered (OS/2 range bits are often incomplete). A random pick in a supported
+    // range lands on or near a real glyph.
+    for (int i = 0; i < numGlyphRanges; i++) {
+        if (record.rangeGlyphs[i] == 0) continue;
+        uint8_t bit = glyphRanges[i].os2Bit;
+        bool declared = record.unicodeRanges[bit / 32] & (1UL << (bit % 32));
+        bool dense = record.rangeGlyphs[i] * 2 >= glyphRanges[i].end - glyphRanges[i].start + 1;
+        if (declared || dense) record.scriptRanges |= 1UL << i;
+    }
+}
+
+
+#endif // PAPERSPECIMEN_FONT_INDEX_H
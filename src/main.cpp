@@ -3,13 +3,162 @@
 #include <SD.h>
 #include <vector>
 #include <esp_sleep.h>
+#include <Preferences.h>
 
 // FreeType headers for outline access and bitmap rendering
 #include "freetype/freetype.h"
 #include "freetype/ftoutln.h"
 #include "freetype/ftglyph.h"
 #include "freetype/ftbitmap.h"
+#include "freetype/ftsizes.h"
 #include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <freertos/semphr.h>
+
+#include "app_events.h"  // Event types and timer rules (pure, host-tested)
+#include "font_index.h"  // Unicode ranges, catalog record, sfnt/cmap indexing (pure, host-tested)
+
+// ========================================
+// v3.1: Logging
+// ========================================
+// LOG_E/W/I/D/V replace direct Serial.printf/println calls. A message is formatted only if
+// its level passes both the compile-time LOG_LEVEL (set per build in platformio.ini, calls
+// above it are removed entirely) and the runtime logLevel (LOG_LEVEL_NONE whenever Serial
+// is off, e.g. normal-mode wakes). With LOG_BINARY=1 nothing is formatted on the device:
+// each call sends the format string address plus raw arguments, and the format string
+// itself once, the first time it is used. tools/binlog_decode.py rebuilds the text.
+
+#define LOG_LEVEL_NONE    0
+#define LOG_LEVEL_ERROR   1
+#define LOG_LEVEL_WARN    2
+#define LOG_LEVEL_INFO    3
+#define LOG_LEVEL_DEBUG   4
+#define LOG_LEVEL_VERBOSE 5
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_VERBOSE
+#endif
+#ifndef LOG_BINARY
+#define LOG_BINARY 0
+#endif
+
+uint8_t logLevel = LOG_LEVEL_NONE; // Runtime level, set in setup() once Serial is decided
+
+#if LOG_BINARY
+// Frame: 0x00 'L' <len> <level> <fmt address:4> <millis:4> <args>
+// Format definition: 0x00 'F' <len> <fmt address:4> <text>
+// Args: 'i' int32 | 'q' int64 | 'd' double | 's' <len> <bytes>, all little-endian
+const size_t BINLOG_STRING_MAX = 96; // Longest string argument (a QR dump row is 87 bytes)
+
+struct BinLogFrame {
+    uint8_t buf[200];
+    size_t len = 0;
+    void put(const void* data, size_t n) {
+        if (len + n > sizeof(buf)) return; // Truncate: the decoder stops at the frame end
+        memcpy(buf + len, data, n);
+        len += n;
+    }
+    void tag(char t) { put(&t, 1); }
+};
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type
+binLogArg(BinLogFrame& f, T value) {
+    if (sizeof(T) > 4) {
+        int64_t v = (int64_t)value;
+        f.tag('q');
+        f.put(&v, 8);
+    } else {
+        int32_t v = (int32_t)value;
+        f.tag('i');
+        f.put(&v, 4);
+    }
+}
+
+inline void binLogArg(BinLogFrame& f, double value) {
+    f.tag('d');
+    f.put(&value, 8);
+}
+
+inline void binLogArg(BinLogFrame& f, const char* text) {
+    uint8_t n = text ? min(strlen(text), BINLOG_STRING_MAX) : 0;
+    f.tag('s');
+    f.put(&n, 1);
+    f.put(text, n);
+}
+
+inline void binLogArg(BinLogFrame& f, const String& text) { binLogArg(f, text.c_str()); }
+
+// Format strings already sent (open addressing on the address; full table = resend)
+const int BINLOG_FORMAT_SLOTS = 512;
+const char* binLogSentFormats[BINLOG_FORMAT_SLOTS];
+
+void binLogDefineFormat(const char* fmt) {
+    uint32_t slot = ((uint32_t)(uintptr_t)fmt >> 2) % BINLOG_FORMAT_SLOTS;
+    for (int probe = 0; probe < 8; probe++) {
+        const char*& entry = binLogSentFormats[(slot + probe) % BINLOG_FORMAT_SLOTS];
+        if (entry == fmt) return;
+        if (entry == nullptr) {
+            entry = fmt;
+            break;
+        }
+    }
+    uint32_t addr = (uint32_t)(uintptr_t)fmt;
+    uint8_t n = min(strlen(fmt), (size_t)250);
+    uint8_t header[3] = {0x00, 'F', (uint8_t)(n + 4)};
+    Serial.write(header, 3);
+    Serial.write((const uint8_t*)&addr, 4);
+    Serial.write((const uint8_t*)fmt, n);
+}
+
+template <typename... Args>
+void binLog(uint8_t level, const char* fmt, Args... args) {
+    binLogDefineFormat(fmt);
+    BinLogFrame f;
+    uint32_t addr = (uint32_t)(uintptr_t)fmt;
+    uint32_t now = millis();
+    f.put(&level, 1);
+    f.put(&addr, 4);
+    f.put(&now, 4);
+    int unused[] = {0, (binLogArg(f, args), 0)...};
+    (void)unused;
+    uint8_t header[3] = {0x00, 'L', (uint8_t)f.len};
+    Serial.write(header, 3);
+    Serial.write(f.buf, f.len);
+}
+
+#define LOG_EMIT(level, ...) binLog(level, __VA_ARGS__)
+#else
+void logWrite(const char* fmt, ...) {
+    char buf[256];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (len > 0) Serial.write((const uint8_t*)buf, min(len, (int)sizeof(buf) - 1));
+}
+
+#define LOG_EMIT(level, ...) logWrite(__VA_ARGS__)
+#endif
+
+// v3.1: One message at a time while the cold-boot font scan task logs too (binary frames
+// and the format table must not interleave). Only exists while that task runs; recursive,
+// as log arguments may call functions that log.
+SemaphoreHandle_t logMutex = nullptr;
+
+struct LogLock {
+    LogLock() { if (logMutex) xSemaphoreTakeRecursive(logMutex, portMAX_DELAY); }
+    ~LogLock() { if (logMutex) xSemaphoreGiveRecursive(logMutex); }
+};
+
+#define LOG_AT(level, ...) \
+    do { if (LOG_LEVEL >= (level) && logLevel >= (level)) { LogLock logLock; LOG_EMIT(level, __VA_ARGS__); } } while (0)
+#define LOG_E(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_W(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_I(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_D(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_V(...) LOG_AT(LOG_LEVEL_VERBOSE, __VA_ARGS__)
 
 // Canvas for rendering
 M5EPD_Canvas canvas(&M5.EPD);  // Single full screen canvas for everything
@@ -52,3322 +201,6480 @@ const uint8_t qrcode_data[] PROGMEM = {
 };
 
 // ========================================
-// v2.2: Unicode Ranges
+// v3.1: Wake-Phase Profiler
 // ========================================
-// Unicode ranges for random glyph selection
-struct UnicodeRange {
-    uint32_t start;
-    uint32_t end;
-    const char* name;
+// micros() timestamps around the expensive phases of a wake. Every completed phase is one
+// sample; min/avg/max accumulate in RTC memory across sleeps (and in the NVS power-off
+// record). In debug mode the table is printed after setup() and written to /.profile.
+
+enum WakePhase {
+    PHASE_M5_BEGIN = 0,
+    PHASE_SD_BEGIN,
+    PHASE_SCAN_FONTS,
+    PHASE_LOAD_CONFIG,
+    PHASE_LOAD_FONT,
+    PHASE_RENDER,       // Canvas drawing (FreeType/outline), up to the EPD push
+    PHASE_PUSH,         // Canvas transfer + update command (pushFrame)
+    PHASE_UPDATE_FULL,  // Extra GC16 passes (epdUpdateFull)
+    PHASE_SLEEP_ENTRY,  // enterDeepSleep() until power-off / deep sleep
+    PHASE_WAKE_TOTAL,   // setup() start to end (wakes only, cold boot waits for the user)
+    PHASE_COUNT
 };
 
-// v2.2: Expanded Unicode ranges (28 total, user-customizable)
-const UnicodeRange glyphRanges[] = {
-    // Original 6 ranges (enabled by default)
-    {0x0041, 0x005A, "Latin Uppercase (U+0041-005A)"},
-    {0x0061, 0x007A, "Latin Lowercase (U+0061-007A)"},
-    {0x0030, 0x0039, "Digits (U+0030-0039)"},
-    {0x0021, 0x002F, "Basic Punctuation (U+0021-002F)"},
-    {0x00A1, 0x00BF, "Latin-1 Punctuation (U+00A1-00BF)"},
-    {0x00C0, 0x00FF, "Latin-1 Letters (U+00C0-00FF)"},
-
-    // New ranges (22 additional - disabled by default)
-    {0x0100, 0x017F, "Latin Extended-A (U+0100-017F)"},
-    {0x0180, 0x024F, "Latin Extended-B (U+0180-024F)"},
-    {0x0370, 0x03FF, "Greek and Coptic (U+0370-03FF)"},
-    {0x0400, 0x04FF, "Cyrillic (U+0400-04FF)"},
-    {0x0590, 0x05FF, "Hebrew (U+0590-05FF)"},
-    {0x0600, 0x06FF, "Arabic (U+0600-06FF)"},
-    {0x0900, 0x097F, "Devanagari (U+0900-097F)"},
-    {0x0E00, 0x0E7F, "Thai (U+0E00-0E7F)"},
-    {0x10A0, 0x10FF, "Georgian (U+10A0-10FF)"},
-    {0x3040, 0x309F, "Hiragana (U+3040-309F)"},
-    {0x30A0, 0x30FF, "Katakana (U+30A0-30FF)"},
-    {0x4E00, 0x9FFF, "CJK Ideographs (U+4E00-9FFF)"},
-    {0xAC00, 0xD7AF, "Hangul (U+AC00-D7AF)"},
-    {0x2000, 0x206F, "General Punctuation (U+2000-206F)"},
-    {0x20A0, 0x20CF, "Currency Symbols (U+20A0-20CF)"},
-    {0x2100, 0x214F, "Letterlike Symbols (U+2100-214F)"},
-    {0x2190, 0x21FF, "Arrows (U+2190-21FF)"},
-    {0x2200, 0x22FF, "Mathematical Operators (U+2200-22FF)"},
-    {0x2500, 0x257F, "Box Drawing (U+2500-257F)"},
-    {0x2580, 0x259F, "Block Elements (U+2580-259F)"},
-    {0x25A0, 0x25FF, "Geometric Shapes (U+25A0-25FF)"},
-    {0x2600, 0x26FF, "Miscellaneous Symbols (U+2600-26FF)"},
+const char* const WAKE_PHASE_NAMES[PHASE_COUNT] = {
+    "M5.begin", "SD.begin", "scanFonts", "loadConfig", "loadFont",
+    "render", "push", "updateFull", "sleepEntry", "wakeTotal"
 };
-const int numGlyphRanges = sizeof(glyphRanges) / sizeof(glyphRanges[0]);
 
-// ========================================
-// v2.1: Configuration Structure
-// ========================================
-struct AppConfig {
-    uint8_t wakeIntervalMinutes;  // 5, 10, or 15
-    std::vector<bool> fontEnabled; // Per-font enable/disable flags
-    bool allowDifferentFont;       // Allow random font on wake (default: true)
-    bool allowDifferentMode;       // Allow random mode (outline/bitmap) on wake (default: true)
-    std::vector<bool> rangeEnabled; // v2.2: Per-range enable flags (28 total)
+struct PhaseStats {
+    uint32_t count;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint64_t totalUs;
 };
 
-// Global config instance
-AppConfig config;
-const char* CONFIG_FILE = "/paperspecimen.cfg";
+RTC_DATA_ATTR PhaseStats wakeProfile[PHASE_COUNT];
+uint32_t phaseStartUs[PHASE_COUNT];  // 0 = phase not running
 
-// ========================================
-// Font File Cache (for battery optimization)
-// ========================================
-#define MAX_FONT_CACHE_SIZE (1500000)  // 1.5MB total cache
+void profileBegin(WakePhase phase) {
+    phaseStartUs[phase] = micros() | 1; // Never 0 while running
+}
 
-struct FontCacheEntry {
-    int fontIndex;
-    uint8_t* data;
-    size_t size;
+// One sample measured elsewhere (the font scan task times SD.begin itself: only the loop
+// task writes the profile)
+void profileRecord(WakePhase phase, uint32_t elapsed) {
+    PhaseStats& st = wakeProfile[phase];
+    if (st.count == 0 || elapsed < st.minUs) st.minUs = elapsed;
+    if (elapsed > st.maxUs) st.maxUs = elapsed;
+    st.totalUs += elapsed;
+    st.count++;
+}
+
+void profileEnd(WakePhase phase) {
+    if (phaseStartUs[phase] == 0) return;
+    uint32_t elapsed = micros() - phaseStartUs[phase];
+    phaseStartUs[phase] = 0;
+    profileRecord(phase, elapsed);
+}
+
+// Times the enclosing function (for functions with several return paths)
+struct WakePhaseScope {
+    WakePhase phase;
+    explicit WakePhaseScope(WakePhase p) : phase(p) { profileBegin(p); }
+    ~WakePhaseScope() { profileEnd(phase); }
 };
 
-std::vector<FontCacheEntry> fontCache;
-size_t totalCacheSize = 0;
+void dumpWakeProfile(Print& out) {
+    out.println("phase        count    min ms    avg ms    max ms");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        const PhaseStats& st = wakeProfile[i];
+        if (st.count == 0) continue;
+        out.printf("%-11s %6lu %9.1f %9.1f %9.1f\n", WAKE_PHASE_NAMES[i], st.count,
+                   st.minUs / 1000.0, st.totalUs / 1000.0 / st.count, st.maxUs / 1000.0);
+    }
+}
+
+void writeWakeProfileToSD() {
+    File file = SD.open("/.profile", FILE_WRITE);
+    if (!file) {
+        LOG_W("WARNING: Could not open .profile file\n");
+        return;
+    }
+    dumpWakeProfile(file);
+    file.close();
+}
 
 // ========================================
-// View Mode (for display glyph rendering)
+// v3.1: Input Latency Histograms
 // ========================================
-enum ViewMode {
-    BITMAP,    // Bitmap rendering (filled glyph)
-    OUTLINE    // Vector outline with control points and construction lines
+// Every BtnL/BtnR/BtnP press and touch gesture is timed from edge detection (the
+// AppEvent timestamp) through the handler (stepFont()/randomGlyph()/renderGlyph(),
+// EPD push included) to the end of the panel update. Samples go into per-action,
+// per-stage histograms kept in RTC memory. The edge-to-pixels stage waits for the
+// IT8951 to finish the update, which blocks the loop, so it is only measured in debug mode.
+// In debug mode a long press on the left or right touch zone shows them (showLatencyScreen()).
+
+enum LatencyAction {
+    LAT_BTN_L = 0,
+    LAT_BTN_R,
+    LAT_BTN_P,
+    LAT_BTN_P_LONG,
+    LAT_TAP_LEFT,
+    LAT_TAP_RIGHT,
+    LAT_TAP_CENTER,
+    LAT_TOUCH_LONG,
+    LAT_ACTION_COUNT
 };
 
-// RTC memory structure to persist state across deep sleep
-RTC_DATA_ATTR struct {
-    bool isValid;
-    int currentFontIndex;
-    uint32_t currentGlyphCodepoint;
-    ViewMode viewMode;  // STEP 5: Persist view mode across sleep
-    uint64_t totalMillis; // Total uptime in milliseconds since last reset (accumulated across sleep cycles)
-    bool debugMode;  // Debug mode: enables Serial output and battery logging (persists across wake, resets on cold boot)
-} rtcState = {false, 0, 0x0041, BITMAP, 0, false};  // Default: BITMAP mode, 0 uptime, normal mode (debugMode=false)
+enum LatencyStage {
+    LAT_STAGE_QUEUE = 0,  // Edge detection → handler start
+    LAT_STAGE_HANDLER,    // Handler start → handler end (render + EPD push issued)
+    LAT_STAGE_PIXELS,     // Edge detection → panel update finished (debug mode only)
+    LAT_STAGE_COUNT
+};
 
-// ========================================
-// v2.2.1: Config File I/O Functions (Flash + SD)
-// ========================================
+const char* const LATENCY_ACTION_NAMES[LAT_ACTION_COUNT] = {
+    "BtnL", "BtnR", "BtnP", "BtnP-L", "TapL", "TapR", "TapC", "Touch-L"
+};
 
-// Forward declaration
-bool loadConfigFromFile(File& file);
+// Upper bucket bounds in ms; the last bucket collects everything slower
+const int LATENCY_BUCKETS = 8;
+const uint16_t LATENCY_BUCKET_LIMITS_MS[LATENCY_BUCKETS - 1] = {25, 50, 100, 200, 400, 800, 1600};
 
-// Load config from SD
-bool loadConfig() {
-    Serial.println("\n=== Loading Config from SD ===");
+struct LatencyHistogram {
+    uint16_t buckets[LATENCY_BUCKETS];
+    uint16_t count;
+    uint32_t maxMs;
+    uint32_t totalMs;
+};
 
-    if (!SD.exists(CONFIG_FILE)) {
-        Serial.println("Config file not found - will run first-time setup");
-        return false;
+RTC_DATA_ATTR LatencyHistogram latencyStats[LAT_ACTION_COUNT][LAT_STAGE_COUNT];
+
+void recordLatency(int action, LatencyStage stage, unsigned long ms) {
+    LatencyHistogram& h = latencyStats[action][stage];
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && ms >= LATENCY_BUCKET_LIMITS_MS[bucket]) bucket++;
+    if (h.count == UINT16_MAX) return; // Saturated: keep the distribution as is
+    h.buckets[bucket]++;
+    h.count++;
+    h.totalMs += ms;
+    if (ms > h.maxMs) h.maxMs = ms;
+}
+
+// Upper bound (ms) of the bucket holding the given percentile, 0 if empty
+uint32_t latencyPercentile(const LatencyHistogram& h, int percent) {
+    if (h.count == 0) return 0;
+    uint32_t target = ((uint32_t)h.count * percent + 99) / 100;
+    uint32_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS - 1; i++) {
+        seen += h.buckets[i];
+        if (seen >= target) return LATENCY_BUCKET_LIMITS_MS[i];
     }
+    return h.maxMs;
+}
 
-    File file = SD.open(CONFIG_FILE, FILE_READ);
-    if (!file) {
-        Serial.println("ERROR: Cannot open config file for reading");
-        return false;
+void dumpLatencyStats(Print& out) {
+    out.println("action   stage     n   p50   p90   max   avg (ms)");
+    for (int a = 0; a < LAT_ACTION_COUNT; a++) {
+        for (int st = 0; st < LAT_STAGE_COUNT; st++) {
+            const LatencyHistogram& h = latencyStats[a][st];
+            if (h.count == 0) continue;
+            static const char* const stageNames[LAT_STAGE_COUNT] = {"queue", "handler", "pixels"};
+            out.printf("%-8s %-7s %5u %5lu %5lu %5lu %5lu\n", LATENCY_ACTION_NAMES[a], stageNames[st],
+                       h.count, latencyPercentile(h, 50), latencyPercentile(h, 90),
+                       h.maxMs, h.totalMs / h.count);
+        }
     }
+}
 
-    bool success = loadConfigFromFile(file);
-    file.close();
+// ========================================
+// v3.1: Metrics Registry
+// ========================================
+// Named counters and gauges for cache sizing and I/O decisions. Values live in RTC memory
+// (and in the power-off NVS record), so they accumulate across wakes until a cold boot.
+// Counters are bumped in place with METRIC_INC/METRIC_ADD; gauges are sampled by
+// sampleMetricGauges() before a dump. Debug mode appends one CSV line per sleep to
+// /.metrics and dumps the table on 'm' from the serial console. Build with
+// METRICS_ENABLED=0 and every macro compiles to nothing.
+
+#ifndef METRICS_ENABLED
+#define METRICS_ENABLED 1
+#endif
+
+enum Metric {
+    // Counters
+    M_FONT_CACHE_HIT = 0,
+    M_FONT_CACHE_MISS,
+    M_FONT_CACHE_EVICT,
+    M_FONT_PREFETCHED,
+    M_FONT_LOAD_ERRORS,
+    M_SD_BYTES_READ,       // Font files and pre-rendered frames
+    M_FT_ERRORS,           // FreeType calls that returned an error
+    M_RENDERS,
+    M_RENDERS_CANCELLED,
+    M_EPD_PUSHES,
+    M_EPD_PACKED_PUSHES,   // 1bpp/2bpp transfers (subset of M_EPD_PUSHES)
+    M_EPD_PARTIAL_UPDATES,
+    M_EPD_FULL_UPDATES,    // epdUpdateFull() passes
+    M_WAKES,
+    M_NOALLOC_VIOLATIONS,  // Heap allocations inside NoAllocScope blocks (ALLOC_COUNTER builds)
+    // Gauges (last sampled value)
+    M_HEAP_FREE,
+    M_HEAP_MIN_FREE,
+    M_PSRAM_FREE,
+    M_PSRAM_LARGEST_BLOCK,
+    M_FONT_CACHE_BYTES,
+    M_FONT_CACHE_FONTS,
+    M_RENDER_ALLOCS,       // Heap allocations during the last renderGlyph() (ALLOC_COUNTER builds)
+    METRIC_COUNT
+};
 
-    if (success) {
-        Serial.println("=== Config Loaded from SD Successfully ===\n");
-    }
+const int METRIC_FIRST_GAUGE = M_HEAP_FREE;
 
-    return success;
+const char* const METRIC_NAMES[METRIC_COUNT] = {
+    "cache_hit", "cache_miss", "cache_evict", "prefetched", "font_load_err",
+    "sd_bytes", "ft_err", "renders", "renders_cancel", "epd_push", "epd_packed",
+    "epd_partial", "epd_full", "wakes", "noalloc_viol",
+    "heap_free", "heap_min", "psram_free", "psram_block", "cache_bytes", "cache_fonts", "render_allocs"
+};
+
+#if METRICS_ENABLED
+RTC_DATA_ATTR uint32_t metricValues[METRIC_COUNT];
+portMUX_TYPE metricMux = portMUX_INITIALIZER_UNLOCKED; // The font scan task counts SD bytes too
+
+void metricAdd(int metric, uint32_t n) {
+    portENTER_CRITICAL(&metricMux);
+    metricValues[metric] += n;
+    portEXIT_CRITICAL(&metricMux);
 }
 
-// Helper function to load config from any File object (Flash or SD)
-bool loadConfigFromFile(File& file) {
+#define METRIC_INC(m)    metricAdd((m), 1)
+#define METRIC_ADD(m, n) metricAdd((m), (uint32_t)(n))
+#define METRIC_SET(m, v) (metricValues[(m)] = (uint32_t)(v))
+#else
+#define METRIC_INC(m)    ((void)0)
+#define METRIC_ADD(m, n) ((void)0)
+#define METRIC_SET(m, v) ((void)0)
+#endif
+
+// v3.1: Heap allocation counter. Builds with ALLOC_COUNTER=1 must also link with
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc (see the m5paper-debug env), which routes
+// every malloc/calloc/realloc (String, new, FreeType, ...) through the wrappers below.
+// Direct heap_caps_malloc() calls (PSRAM frame buffers) are not counted.
+#ifndef ALLOC_COUNTER
+#define ALLOC_COUNTER 0
+#endif
+
+#if ALLOC_COUNTER
+uint32_t heapAllocCount = 0;
 
-    // Read wake interval (first line)
-    String line = file.readStringUntil('\n');
-    line.trim();
-    config.wakeIntervalMinutes = line.toInt();
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
 
-    // v2.2.1: Allow 1/2/5/10/15 minutes (1/2 for debug mode)
-    if (config.wakeIntervalMinutes != 1 &&
-        config.wakeIntervalMinutes != 2 &&
-        config.wakeIntervalMinutes != 5 &&
-        config.wakeIntervalMinutes != 10 &&
-        config.wakeIntervalMinutes != 15) {
-        Serial.printf("ERROR: Invalid wake interval %d, expected 1/2/5/10/15\n", config.wakeIntervalMinutes);
-        file.close();
-        return false;
-    }
+void* __wrap_malloc(size_t size) {
+    __atomic_fetch_add(&heapAllocCount, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
 
-    Serial.printf("Wake interval: %d minutes\n", config.wakeIntervalMinutes);
+void* __wrap_calloc(size_t count, size_t size) {
+    __atomic_fetch_add(&heapAllocCount, 1, __ATOMIC_RELAXED);
+    return __real_calloc(count, size);
+}
 
-    // Read allowDifferentFont (second line)
-    line = file.readStringUntil('\n');
-    line.trim();
-    config.allowDifferentFont = (line == "1" || line == "true");
-    Serial.printf("Allow different font: %s\n", config.allowDifferentFont ? "yes" : "no");
+void* __wrap_realloc(void* ptr, size_t size) {
+    __atomic_fetch_add(&heapAllocCount, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+}
 
-    // Read allowDifferentMode (third line)
-    line = file.readStringUntil('\n');
-    line.trim();
-    config.allowDifferentMode = (line == "1" || line == "true");
-    Serial.printf("Allow different mode: %s\n", config.allowDifferentMode ? "yes" : "no");
+#define HEAP_ALLOC_COUNT() __atomic_load_n(&heapAllocCount, __ATOMIC_RELAXED)
+#else
+#define HEAP_ALLOC_COUNT() 0u
+#endif
 
-    // Read font enable flags (next N lines, where N = number of fonts)
-    config.fontEnabled.clear();
-    int fontIndex = 0;
-    while (file.available()) {
-        line = file.readStringUntil('\n');
-        line.trim();
-        if (line.length() > 0) {
-            // Check if this is a separator line (range flags follow)
-            if (line == "---") {
-                break; // Stop reading font flags, move to range flags
-            }
-            bool enabled = (line == "1" || line == "true");
-            config.fontEnabled.push_back(enabled);
-            fontIndex++;
-        }
+// Marks a block that must not touch the heap; allocations inside it are counted and logged
+struct NoAllocScope {
+    const char* name;
+    uint32_t start;
+    explicit NoAllocScope(const char* n) : name(n), start(HEAP_ALLOC_COUNT()) {}
+    ~NoAllocScope() {
+        uint32_t count = HEAP_ALLOC_COUNT() - start;
+        if (count == 0) return;
+        METRIC_ADD(M_NOALLOC_VIOLATIONS, count);
+        LOG_W("WARNING: %s made %lu heap allocations\n", name, count);
     }
+};
 
-    // v2.2: Read Unicode range enable flags (remaining lines, or use defaults if not present)
-    config.rangeEnabled.clear();
-    int rangeIndex = 0;
-    bool foundRangeFlags = false;
-    while (file.available()) {
-        line = file.readStringUntil('\n');
-        line.trim();
-        if (line.length() > 0) {
-            bool enabled = (line == "1" || line == "true");
-            config.rangeEnabled.push_back(enabled);
-            rangeIndex++;
-            foundRangeFlags = true;
-        }
+void dumpMetrics(Print& out) {
+#if METRICS_ENABLED
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        out.printf("%-15s %10lu%s\n", METRIC_NAMES[i], metricValues[i], i >= METRIC_FIRST_GAUGE ? " (gauge)" : "");
     }
+#else
+    out.println("Metrics disabled (METRICS_ENABLED=0)");
+#endif
+}
 
-    // If no range flags found in file (old config format), use defaults
-    if (!foundRangeFlags) {
-        Serial.println("No range flags in config - using defaults (first 6 enabled)");
-        for (int i = 0; i < numGlyphRanges; i++) {
-            config.rangeEnabled.push_back(i < 6);
+// One CSV line per call; the header is written when the file is created
+void appendMetricsToSD(uint32_t uptimeSeconds) {
+#if METRICS_ENABLED
+    bool newFile = !SD.exists("/.metrics");
+    File file = SD.open("/.metrics", FILE_APPEND);
+    if (!file) {
+        LOG_W("WARNING: Could not open .metrics file\n");
+        return;
+    }
+    if (newFile) {
+        file.print("uptime_s");
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            file.printf(",%s", METRIC_NAMES[i]);
         }
+        file.println();
     }
+    file.printf("%lu", uptimeSeconds);
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        file.printf(",%lu", metricValues[i]);
+    }
+    file.println();
+    file.close();
+#endif
+}
 
-    Serial.printf("Loaded %d font enable flags, %d range enable flags\n",
-                  config.fontEnabled.size(), config.rangeEnabled.size());
-    return true;
+// ========================================
+// v3.1: Scope Trace (CCOUNT)
+// ========================================
+// TRACE_SCOPE("name") times the enclosing block with the Xtensa cycle counter and records
+// it into a ring buffer when it closes. Start times come from micros() (CCOUNT wraps every
+// ~18s at 240MHz and is per core), durations from CCOUNT. Recording is on in debug mode
+// only; TRACE_ENABLED=0 removes the scopes and the buffer entirely. Scopes may close on
+// either core, so the ring index is updated under a spinlock. exportTraceJson() writes
+// Chrome trace-event JSON (chrome://tracing, Perfetto): serial command 't', or 'T' for
+// /.trace.json.
+
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+bool traceRecording = false;
+
+#if TRACE_ENABLED
+struct TraceEvent {
+    const char* name;      // String literal (never copied)
+    uint32_t startUs;
+    uint32_t cycles;
+    uint8_t core;
+};
+
+const int TRACE_BUFFER_SIZE = 512;
+TraceEvent traceBuffer[TRACE_BUFFER_SIZE];
+int traceNext = 0;      // Next slot to write
+int traceCount = 0;     // Valid events (oldest are overwritten)
+portMUX_TYPE traceMux = portMUX_INITIALIZER_UNLOCKED;
+
+void recordTraceEvent(const char* name, uint32_t startUs, uint32_t cycles) {
+    TraceEvent ev = {name, startUs, cycles, (uint8_t)xPortGetCoreID()};
+    portENTER_CRITICAL(&traceMux);
+    traceBuffer[traceNext] = ev;
+    traceNext = (traceNext + 1) % TRACE_BUFFER_SIZE;
+    if (traceCount < TRACE_BUFFER_SIZE) traceCount++;
+    portEXIT_CRITICAL(&traceMux);
 }
 
-// Save config to SD card
-bool saveConfig() {
-    Serial.println("\n=== Saving Config ===");
+struct TraceScope {
+    const char* name;
+    bool active;
+    uint32_t startUs = 0;
+    uint32_t startCycles = 0;
+    explicit TraceScope(const char* n) : name(n), active(traceRecording) {
+        if (!active) return;
+        startUs = micros();
+        startCycles = ESP.getCycleCount();
+    }
+    ~TraceScope() {
+        if (active) recordTraceEvent(name, startUs, ESP.getCycleCount() - startCycles);
+    }
+};
 
-    File file = SD.open(CONFIG_FILE, FILE_WRITE);
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+
+// Complete ("X") events, oldest first; one process, one thread per core
+void exportTraceJson(Print& out) {
+    portENTER_CRITICAL(&traceMux);
+    int count = traceCount;
+    int first = (traceNext - traceCount + TRACE_BUFFER_SIZE) % TRACE_BUFFER_SIZE;
+    portEXIT_CRITICAL(&traceMux);
+
+    float cyclesPerUs = ESP.getCpuFreqMHz();
+    out.print("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    for (int i = 0; i < count; i++) {
+        const TraceEvent& ev = traceBuffer[(first + i) % TRACE_BUFFER_SIZE];
+        out.printf("%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%lu,\"dur\":%.2f}",
+                   i == 0 ? "" : ",", ev.name, ev.core, ev.startUs, ev.cycles / cyclesPerUs);
+    }
+    out.println("\n]}");
+}
+
+void writeTraceToSD() {
+    File file = SD.open("/.trace.json", FILE_WRITE);
     if (!file) {
-        Serial.println("ERROR: Cannot open config file for writing");
-        return false;
+        LOG_W("WARNING: Could not open .trace.json file\n");
+        return;
     }
+    exportTraceJson(file);
+    file.close();
+    LOG_I("Trace: %d events written to /.trace.json\n", traceCount);
+}
+#else
+#define TRACE_SCOPE(name) ((void)0)
 
-    // Write wake interval
-    file.println(config.wakeIntervalMinutes);
-    Serial.printf("Saved wake interval: %d minutes\n", config.wakeIntervalMinutes);
+void exportTraceJson(Print& out) {
+    out.println("Trace compiled out (TRACE_ENABLED=0)");
+}
 
-    // Write allowDifferentFont
-    file.println(config.allowDifferentFont ? "1" : "0");
-    Serial.printf("Saved allow different font: %s\n", config.allowDifferentFont ? "yes" : "no");
+void writeTraceToSD() {
+    LOG_W("WARNING: Trace compiled out (TRACE_ENABLED=0)\n");
+}
+#endif
 
-    // Write allowDifferentMode
-    file.println(config.allowDifferentMode ? "1" : "0");
-    Serial.printf("Saved allow different mode: %s\n", config.allowDifferentMode ? "yes" : "no");
+// ========================================
+// v3.1: Packed EPD Transfer (1bpp/2bpp)
+// ========================================
+// pushCanvas() always sends 4bpp (259KB per full frame). Menus, QR screens and the
+// thresholded glyph preview only use 2 or 4 gray levels, so they can be loaded with the
+// IT8951's packed formats instead: 2bpp natively, 1bpp via the 8bpp load + UP1SR trick.
+// That is 2x / 4x less data over SPI. The canvas is rotated in software into panel
+// orientation (960x540) because the controller's load rotation works on whole words.
+
+enum FrameDepth {
+    FRAME_DEPTH_AUTO = 0,  // Scan the canvas and use the smallest lossless format
+    FRAME_DEPTH_1BPP = 1,  // Black/white (levels >= MONO_THRESHOLD become black)
+    FRAME_DEPTH_2BPP = 2,  // 4 levels (canvas 0/5/10/15)
+    FRAME_DEPTH_4BPP = 4   // Plain pushCanvas()
+};
 
-    // Write font enable flags
-    for (size_t i = 0; i < config.fontEnabled.size(); i++) {
-        file.println(config.fontEnabled[i] ? "1" : "0");
+const uint8_t MONO_THRESHOLD = 8;  // 4bpp level >= 8 becomes black when packing 1bpp
+
+// IT8951 host interface (same bus and pins as M5EPD_Driver)
+#define IT8951_PREAMBLE_CMD      0x6000
+#define IT8951_PREAMBLE_WRITE    0x0000
+#define IT8951_PREAMBLE_READ     0x1000
+#define IT8951_TCON_SYS_RUN      0x0001
+#define IT8951_TCON_REG_RD       0x0010
+#define IT8951_TCON_REG_WR       0x0011
+#define IT8951_TCON_LD_IMG_AREA  0x0021
+#define IT8951_TCON_LD_IMG_END   0x0022
+#define IT8951_CMD_GET_DEV_INFO  0x0302
+#define IT8951_REG_LISAR         0x0208  // Image buffer target address (low, +2 high)
+#define IT8951_REG_UP1SR         0x1138  // +2 bit2: 1bpp display mode
+#define IT8951_REG_BGVR          0x1250  // 1bpp foreground/background gray values
+#define IT8951_LDIMG_L_ENDIAN    0
+#define IT8951_PIXEL_2BPP        0
+#define IT8951_PIXEL_8BPP        3
+#define IT8951_ROTATE_90         1
+#define IT8951_ROTATE_270        3
+const uint32_t IT8951_SPI_HZ = 10000000;
+const unsigned long IT8951_READY_TIMEOUT_MS = 3000;
+
+const int PANEL_W = 960;  // Native panel orientation
+const int PANEL_H = 540;
+
+uint8_t* packedFrameBuffer = nullptr;  // Wire-order packed frame (PSRAM), up to 2bpp size
+uint8_t frameDepthClass[256];          // Packed canvas byte -> 1/2/4 (needed depth)
+uint32_t it8951ImageBufferAddr = 0;    // Read once from GET_DEV_INFO
+bool it8951OneBitMode = false;         // UP1SR 1bpp flag left set after last push
+
+// Cleared by every push; presentGlyphFrame() sets it again once a settled glyph is on screen
+bool displayShowsState = false;
+
+bool it8951WaitReady() {
+    unsigned long start = millis();
+    while (digitalRead(M5EPD_BUSY_PIN) == LOW) {
+        if (millis() - start > IT8951_READY_TIMEOUT_MS) {
+            LOG_W("WARNING: IT8951 not ready (timeout)\n");
+            return false;
+        }
     }
-    Serial.printf("Saved %d font enable flags\n", config.fontEnabled.size());
+    return true;
+}
 
-    // v2.2: Write separator and Unicode range enable flags
-    file.println("---");
-    for (size_t i = 0; i < config.rangeEnabled.size(); i++) {
-        file.println(config.rangeEnabled[i] ? "1" : "0");
+bool it8951WriteWord(uint16_t preamble, uint16_t word) {
+    digitalWrite(M5EPD_CS_PIN, LOW);
+    SPI.transfer16(preamble);
+    bool ok = it8951WaitReady();
+    if (ok) SPI.transfer16(word);
+    digitalWrite(M5EPD_CS_PIN, HIGH);
+    return ok;
+}
+
+bool it8951Command(uint16_t cmd) {
+    return it8951WaitReady() && it8951WriteWord(IT8951_PREAMBLE_CMD, cmd);
+}
+
+bool it8951Data(uint16_t data) {
+    return it8951WaitReady() && it8951WriteWord(IT8951_PREAMBLE_WRITE, data);
+}
+
+bool it8951ReadWords(uint16_t* out, int count) {
+    if (!it8951WaitReady()) return false;
+    digitalWrite(M5EPD_CS_PIN, LOW);
+    SPI.transfer16(IT8951_PREAMBLE_READ);
+    bool ok = it8951WaitReady();
+    if (ok) {
+        SPI.transfer16(0);  // Dummy word
+        ok = it8951WaitReady();
     }
-    Serial.printf("Saved %d range enable flags\n", config.rangeEnabled.size());
+    for (int i = 0; ok && i < count; i++) {
+        out[i] = SPI.transfer16(0);
+    }
+    digitalWrite(M5EPD_CS_PIN, HIGH);
+    return ok;
+}
 
-    file.close();
-    Serial.println("=== Config Saved Successfully ===\n");
+bool it8951WriteReg(uint16_t reg, uint16_t value) {
+    return it8951Command(IT8951_TCON_REG_WR) && it8951Data(reg) && it8951Data(value);
+}
+
+bool it8951ReadReg(uint16_t reg, uint16_t* value) {
+    return it8951Command(IT8951_TCON_REG_RD) && it8951Data(reg) && it8951ReadWords(value, 1);
+}
+
+// Set or clear the 1bpp display flag (UP1SR+2 bit2). Must not change during an update.
+bool it8951SetOneBitMode(bool enable) {
+    uint16_t up1sr;
+    if (!it8951ReadReg(IT8951_REG_UP1SR + 2, &up1sr)) return false;
+    up1sr = enable ? (up1sr | (1 << 2)) : (up1sr & ~(1 << 2));
+    if (!it8951WriteReg(IT8951_REG_UP1SR + 2, up1sr)) return false;
+    it8951OneBitMode = enable;
     return true;
 }
 
-// Initialize default config
-void initDefaultConfig(int numFonts) {
-    config.wakeIntervalMinutes = 15; // Default: 15 minutes
-    config.allowDifferentFont = true; // Default: allow random font
-    config.allowDifferentMode = true; // Default: allow random mode
-    config.fontEnabled.clear();
-    for (int i = 0; i < numFonts; i++) {
-        config.fontEnabled.push_back(true); // All fonts enabled by default
+// Must be called before anything loads 4bpp data through M5EPD (pushCanvas, Clear, ...)
+void epdLeaveOneBitMode() {
+    if (!it8951OneBitMode) return;
+    M5.EPD.CheckAFSR();  // Wait for the running 1bpp update to finish
+    SPI.beginTransaction(SPISettings(IT8951_SPI_HZ, MSBFIRST, SPI_MODE0));
+    if (!it8951SetOneBitMode(false)) {
+        LOG_W("WARNING: Failed to clear IT8951 1bpp mode\n");
     }
+    SPI.endTransaction();
+}
 
-    // v2.2: Initialize Unicode range flags (first 6 enabled by default)
-    config.rangeEnabled.clear();
-    for (int i = 0; i < numGlyphRanges; i++) {
-        config.rangeEnabled.push_back(i < 6); // First 6 ranges enabled, rest disabled
+// Which packed format loses nothing for this frame (1, 2 or 4 bits per pixel)
+FrameDepth detectFrameDepth(const uint8_t* gray, size_t bytes) {
+    FrameDepth depth = FRAME_DEPTH_1BPP;
+    for (size_t i = 0; i < bytes; i++) {
+        uint8_t c = frameDepthClass[gray[i]];
+        if (c > depth) {
+            depth = (FrameDepth)c;
+            if (depth == FRAME_DEPTH_4BPP) break;
+        }
     }
-
-    Serial.printf("Default config initialized: %d min, allow font=%s, allow mode=%s, %d fonts (all enabled), %d ranges (first 6 enabled)\n",
-                  config.wakeIntervalMinutes,
-                  config.allowDifferentFont ? "yes" : "no",
-                  config.allowDifferentMode ? "yes" : "no",
-                  numFonts, numGlyphRanges);
+    return depth;
 }
 
-// ========================================
-// v2.1: UI Framework for Setup Screens
-// ========================================
+// Pack the 540x960 canvas into panel orientation, LSB-first pixels, words byte-swapped
+// for the MSB-first SPI wire. Returns the number of bytes written.
+size_t packFrame(const uint8_t* gray, FrameDepth depth, uint8_t rotate) {
+    TRACE_SCOPE("packFrame");
+    const int canvasStride = 540 / 2;
+    const int pixelsPerByte = (depth == FRAME_DEPTH_1BPP) ? 8 : 4;
+    size_t out = 0;
+
+    for (int py = 0; py < PANEL_H; py++) {
+        // Panel row py is canvas column cx, walked along canvas y
+        int cx = (rotate == IT8951_ROTATE_90) ? py : (PANEL_H - 1 - py);
+        int shift = (cx & 1) ? 0 : 4;
+        const uint8_t* p;
+        int step;
+        if (rotate == IT8951_ROTATE_90) {
+            p = gray + (PANEL_W - 1) * canvasStride + cx / 2;  // px = 959 - cy
+            step = -canvasStride;
+        } else {
+            p = gray + cx / 2;                                 // px = cy
+            step = canvasStride;
+        }
 
-// UI Constants
-const int UI_TEXT_SIZE = 2;            // Font size for UI (bitmap font, 2 = 16px height)
-const int UI_LINE_HEIGHT = 40;         // Spacing between lines
-const int UI_TOP_MARGIN = 80;          // Top margin for first item
-const int UI_CHECKBOX_SIZE = 20;       // Size of checkbox/radio button
-const int UI_INDENT = 60;              // Indent for checkboxes
-const int UI_MAX_TEXT_WIDTH = 380;     // Max text width (540 - 100 left - 60 right = 380px)
+        for (int px = 0; px < PANEL_W; px += pixelsPerByte) {
+            uint8_t packed = 0;
+            for (int k = 0; k < pixelsPerByte; k++) {
+                uint8_t level = (*p >> shift) & 0x0F;
+                p += step;
+                if (depth == FRAME_DEPTH_1BPP) {
+                    if (level >= MONO_THRESHOLD) packed |= (1 << k);  // 1 = black (foreground)
+                } else {
+                    uint8_t v = 3 - (level * 3 + 7) / 15;              // 3 = white on IT8951
+                    packed |= v << (k * 2);
+                }
+            }
+            packedFrameBuffer[out ^ 1] = packed;  // Little-endian word, sent high byte first
+            out++;
+        }
+    }
+    return out;
+}
 
-// Menu item types
-enum MenuItemType {
-    MENU_CONFIRM,      // Confirm button
-    MENU_LABEL,        // Non-selectable label (e.g., "Refresh timer", "Select/Deselect all")
-    MENU_RADIO,        // Radio button (interval selection)
-    MENU_CHECKBOX,     // Checkbox (font selection)
-    MENU_SEPARATOR,    // 30px empty space
-    MENU_PAGE_NAV      // "…" for page navigation
-};
+// Load a packed frame into the controller image buffer and start the update.
+bool it8951PushPacked(FrameDepth depth, size_t bytes, m5epd_update_mode_t mode) {
+    // 1bpp is loaded as 8bpp with 1/8 width; the UP1SR flag expands bits at display time
+    uint16_t format = (depth == FRAME_DEPTH_1BPP) ? IT8951_PIXEL_8BPP : IT8951_PIXEL_2BPP;
+    uint16_t loadWidth = (depth == FRAME_DEPTH_1BPP) ? PANEL_W / 8 : PANEL_W;
+
+    if (!it8951Command(IT8951_TCON_SYS_RUN)) return false;
+
+    if (it8951ImageBufferAddr == 0) {
+        uint16_t info[20];
+        if (!it8951Command(IT8951_CMD_GET_DEV_INFO) || !it8951ReadWords(info, 20)) return false;
+        it8951ImageBufferAddr = ((uint32_t)info[3] << 16) | info[2];
+        LOG_I("IT8951: panel %ux%u, image buffer 0x%08X\n", info[0], info[1], it8951ImageBufferAddr);
+    }
+
+    // Changing the 1bpp flag under a running update corrupts it: wait for the LUT engine
+    bool wantOneBit = (depth == FRAME_DEPTH_1BPP);
+    if (wantOneBit != it8951OneBitMode) {
+        SPI.endTransaction();
+        M5.EPD.CheckAFSR();
+        SPI.beginTransaction(SPISettings(IT8951_SPI_HZ, MSBFIRST, SPI_MODE0));
+        if (!it8951SetOneBitMode(wantOneBit)) return false;
+        if (wantOneBit && !it8951WriteReg(IT8951_REG_BGVR, (0x00 << 8) | 0xF0)) return false;  // Black on white
+    }
+
+    if (!it8951WriteReg(IT8951_REG_LISAR + 2, it8951ImageBufferAddr >> 16) ||
+        !it8951WriteReg(IT8951_REG_LISAR, it8951ImageBufferAddr & 0xFFFF)) return false;
+
+    if (!it8951Command(IT8951_TCON_LD_IMG_AREA) ||
+        !it8951Data((IT8951_LDIMG_L_ENDIAN << 8) | (format << 4) | 0) ||  // Rotation done in software
+        !it8951Data(0) || !it8951Data(0) ||
+        !it8951Data(loadWidth) || !it8951Data(PANEL_H)) return false;
+
+    if (!it8951WaitReady()) return false;
+    digitalWrite(M5EPD_CS_PIN, LOW);
+    SPI.transfer16(IT8951_PREAMBLE_WRITE);
+    bool ok = it8951WaitReady();
+    if (ok) SPI.writeBytes(packedFrameBuffer, bytes);
+    digitalWrite(M5EPD_CS_PIN, HIGH);
+    if (!ok || !it8951Command(IT8951_TCON_LD_IMG_END)) return false;
+
+    // Display command goes through M5EPD (waits for the previous update, maps coordinates)
+    SPI.endTransaction();
+    M5.EPD.UpdateArea(0, 0, 540, 960, mode);
+    SPI.beginTransaction(SPISettings(IT8951_SPI_HZ, MSBFIRST, SPI_MODE0));
+    return true;
+}
 
-// Menu item structure
-struct MenuItem {
-    MenuItemType type;
-    String label;
-    String displayLabel;  // Pre-computed truncated label (empty = use label)
-    bool selected;     // For radio/checkbox
-    int value;         // For radio (5, 10, 15) or page navigation
-    int fontIndex;     // For font checkboxes (-1 for non-font items)
+// Push the full canvas with the smallest transfer format (drop-in for pushCanvas(0, 0, mode))
+void pushFrame(m5epd_update_mode_t mode, FrameDepth depth = FRAME_DEPTH_AUTO) {
+    TRACE_SCOPE("pushFrame");
+    WakePhaseScope phase(PHASE_PUSH);
+    const size_t frameBytes = 540 * 960 / 2;
+    const uint8_t* gray = (const uint8_t*)canvas.frameBuffer();
+    uint8_t rotate = M5.EPD.GetRotate();
+    displayShowsState = false;
+
+    static bool packInitDone = false;
+    if (depth != FRAME_DEPTH_4BPP && !packInitDone) {
+        packInitDone = true;
+        packedFrameBuffer = (uint8_t*)heap_caps_malloc(PANEL_W * PANEL_H / 4, MALLOC_CAP_SPIRAM);
+        if (!packedFrameBuffer) {
+            LOG_W("WARNING: No PSRAM for packed frame buffer, using 4bpp transfers\n");
+        }
+        for (int b = 0; b < 256; b++) {
+            uint8_t hi = b >> 4, lo = b & 0x0F;
+            bool mono = (hi == 0 || hi == 15) && (lo == 0 || lo == 15);
+            bool fourLevel = (hi % 5 == 0) && (lo % 5 == 0);
+            frameDepthClass[b] = mono ? FRAME_DEPTH_1BPP : (fourLevel ? FRAME_DEPTH_2BPP : FRAME_DEPTH_4BPP);
+        }
+    }
+
+    if (depth == FRAME_DEPTH_AUTO && packedFrameBuffer) {
+        depth = detectFrameDepth(gray, frameBytes);
+    }
+
+    // Packing relies on the 540x960 portrait canvas this firmware always uses
+    bool packable = packedFrameBuffer && depth != FRAME_DEPTH_4BPP && depth != FRAME_DEPTH_AUTO &&
+                    canvas.width() == 540 && canvas.height() == 960 &&
+                    (rotate == IT8951_ROTATE_90 || rotate == IT8951_ROTATE_270);
+
+    if (packable) {
+        size_t bytes = packFrame(gray, depth, rotate);
+        SPI.beginTransaction(SPISettings(IT8951_SPI_HZ, MSBFIRST, SPI_MODE0));
+        bool ok = it8951PushPacked(depth, bytes, mode);
+        SPI.endTransaction();
+        if (ok) {
+            METRIC_INC(M_EPD_PUSHES);
+            METRIC_INC(M_EPD_PACKED_PUSHES);
+            return;
+        }
+        LOG_W("WARNING: Packed EPD transfer failed, falling back to 4bpp\n");
+    }
+
+    epdLeaveOneBitMode();
+    canvas.pushCanvas(0, 0, mode);
+    METRIC_INC(M_EPD_PUSHES);
+}
+
+// UpdateFull (redisplay controller RAM) with wake-phase timing
+void epdUpdateFull(m5epd_update_mode_t mode) {
+    WakePhaseScope phase(PHASE_UPDATE_FULL);
+    M5.EPD.UpdateFull(mode);
+    METRIC_INC(M_EPD_FULL_UPDATES);
+}
+
+// Wait for the running update (GL16 settle, refresh) to finish, then put the IT8951 in
+// standby. Power must not be cut while a waveform is still driving the panel.
+bool epdStandingBy = false;
+void epdStandBy() {
+    if (epdStandingBy) return;
+    M5.EPD.CheckAFSR();
+    M5.EPD.StandBy();
+    epdStandingBy = true;
+    LOG_I("Display controller in StandBy\n");
+}
+
+// ========================================
+// v3.1: SPI Bus Lock
+// ========================================
+// The SD card and the IT8951 share one SPI bus (SCK 14, MISO 13, MOSI 12). While the
+// cold-boot font scan task runs, the bus is guarded by spiBusMutex: the task takes it for
+// the enumeration and then once per indexed font; from the catalog on, setup() holds it
+// (config import, setup screen frames, catalog reads) and lends it only while it waits for
+// input (spiBusIdle()). Without the task there is no mutex and these do nothing.
+SemaphoreHandle_t spiBusMutex = nullptr;
+
+void spiBusTake() {
+    if (spiBusMutex) xSemaphoreTake(spiBusMutex, portMAX_DELAY);
+}
+
+void spiBusGive() {
+    if (spiBusMutex) xSemaphoreGive(spiBusMutex);
+}
+
+// delay() during which the font scan task may use the bus
+void spiBusIdle(uint32_t ms) {
+    spiBusGive();
+    delay(ms);
+    spiBusTake();
+}
+
+// ========================================
+// v2.1: Configuration Structure
+// ========================================
+// v3.1: Wake schedule period, e.g. "period=22:00-07:00,0" (quiet) or "period=07:00-09:00,5"
+struct SchedulePeriod {
+    uint16_t startMinute;      // Minute of day (0-1439), inclusive
+    uint16_t endMinute;        // Minute of day, exclusive; end < start wraps past midnight
+    uint16_t intervalMinutes;  // Wake interval inside the period, 0 = quiet (no auto-wake)
 };
+#define MAX_SCHEDULE_PERIODS 8
 
-// Pagination state
-struct PaginationState {
-    int currentPage;
-    int totalPages;
-    int fontsPerPage;
+struct AppConfig {
+    uint8_t wakeIntervalMinutes;  // 5, 10, or 15
+    // v3.1: Per-font enable flags live in the font catalog (FONT_FLAG_ENABLED)
+    bool allowDifferentFont;       // Allow random font on wake (default: true)
+    bool allowDifferentMode;       // Allow random mode (outline/bitmap) on wake (default: true)
+    std::vector<bool> rangeEnabled; // v2.2: Per-range enable flags (28 total)
+    std::vector<SchedulePeriod> schedule; // v3.1: Options section, first matching period wins
+    uint16_t intervalOverrideMinutes;     // v3.1: "interval=N" (any 1-1440), 0 = use wakeIntervalMinutes
+    String pendingClockSet;               // v3.1: "clock=YYYY-MM-DD HH:MM", applied once on cold boot
 };
 
-// UI Helper: Shorten text if it exceeds max width, keeping equal chars before/after "..."
-// NOTE: This function uses bitmap font for measurement (FreeType fonts return textWidth=0)
-String shortenTextIfNeeded(const String& text, int maxWidth, int textSize = UI_TEXT_SIZE) {
-    // IMPORTANT: Unload FreeType font and use bitmap font for measurement
-    // FreeType canvas.textWidth() returns 0 because it's configured for glyph rendering, not labels
-    canvas.unloadFont();
-    canvas.setFreeFont(NULL);
-    canvas.setTextFont(1); // Font 1 = bitmap font
-    canvas.setTextSize(textSize);
+// Global config instance
+AppConfig config;
+const char* CONFIG_FILE = "/paperspecimen.cfg";
 
-    int textWidth = canvas.textWidth(text);
+// ========================================
+// Font File Cache (for battery optimization)
+// ========================================
+#define MAX_FONT_CACHE_SIZE (1500000)  // 1.5MB total cache
 
-    Serial.printf("shortenTextIfNeeded: text='%s' textWidth=%d maxWidth=%d textSize=%d\n",
-                  text.c_str(), textWidth, maxWidth, textSize);
+struct FontCacheEntry {
+    uint32_t fontId;   // v3.1: Stable font ID (see Font ID), not a catalog position
+    uint8_t* data;
+    size_t size;
+};
 
-    // If text fits, return as-is (textSize already set correctly)
-    if (textWidth <= maxWidth) {
-        Serial.println("  -> Text fits, no truncation needed");
-        return text;
-    }
+std::vector<FontCacheEntry> fontCache;
+size_t totalCacheSize = 0;
 
-    Serial.println("  -> Text too long, truncating...");
+// v3.1: Refresh the gauge entries of the metrics registry (heap and font cache)
+void sampleMetricGauges() {
+    METRIC_SET(M_HEAP_FREE, ESP.getFreeHeap());
+    METRIC_SET(M_HEAP_MIN_FREE, ESP.getMinFreeHeap());
+    METRIC_SET(M_PSRAM_FREE, ESP.getFreePsram());
+    METRIC_SET(M_PSRAM_LARGEST_BLOCK, heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM));
+    METRIC_SET(M_FONT_CACHE_BYTES, totalCacheSize);
+    METRIC_SET(M_FONT_CACHE_FONTS, fontCache.size());
+}
 
-    // Calculate how many characters to keep on each side
-    int textLen = text.length();
-    int ellipsisWidth = canvas.textWidth("...");
+// ========================================
+// v3.1: Font Catalog
+// ========================================
+// /.fontindex is the list of fonts: a header, fixed-size records sorted by path, then the
+// active table (record numbers of the enabled fonts, one uint16 slot per record, the first
+// activeCount valid). Records and active entries are read through one small page each, so
+// RAM use does not grow with the number of fonts. The enable flag lives in the record;
+// the setup UI, navigation and random selection all work on the file.
+// currentFontIndex is a position in the active table. Build and scan: see Font Scan.
+// New per-font data is appended to FontCatalogRecord (include/font_index.h) and bumps
+// FONT_INDEX_VERSION: a scan reads older (shorter) records, keeps their ID and flags and
+// re-indexes the font once.
+
+#define FONT_CATALOG_FILE "/.fontindex"
+const uint32_t FONT_CATALOG_MAGIC = 0x34584946; // "FIX4" (v2: + flags, active table, v3: + record size, v4: + stale flag)
+const uint32_t FONT_CATALOG_MAGIC_V3 = 0x33584946; // "FIX3": no stale flag (20-byte header)
+const uint32_t FONT_CATALOG_MAGIC_V2 = 0x32584946; // "FIX2": no record size, 144-byte records
+const int FONT_CATALOG_MAX = 65535;   // Active table entries are uint16
+const int FONT_CATALOG_PAGE = 8;      // Records per cached page (~3.5 KB)
+const int FONT_ACTIVE_PAGE = 64;      // Active table entries per cached page
+struct FontCatalogHeader {
+    uint32_t magic;
+    uint32_t recordSize;     // sizeof(FontCatalogRecord) of the writer
+    uint32_t count;          // Records
+    uint32_t enabledCount;   // Records with FONT_FLAG_ENABLED (usable or not)
+    uint32_t activeCount;    // Valid active table entries (enabledCount after a rebuild)
+    uint32_t activeStale;    // Record flags changed since the active table was written
+};
 
-    // Binary search to find optimal number of chars to keep on each side
-    int charsPerSide = 1;
-    int maxCharsPerSide = textLen / 2;
+File fontCatalog;                            // Open "r+" while fonts are in use
+std::vector<std::pair<uint32_t, uint16_t>> catalogIdIndex; // Font ID -> record, sorted (imports only)
+std::vector<int> legacyFontOrder;   // Record numbers in pre-ID firmware order (imports only)
+bool legacyFontOrderRead = false;
+FontCatalogHeader catalogHeader = {0, 0, 0, 0, 0, 0};
+FontCatalogRecord catalogPage[FONT_CATALOG_PAGE];
+int catalogPageStart = -1;
+uint16_t activePage[FONT_ACTIVE_PAGE];
+int activePageStart = -1;
+
+size_t catalogRecordOffset(int index) {
+    return sizeof(FontCatalogHeader) + (size_t)index * sizeof(FontCatalogRecord);
+}
 
-    for (int chars = maxCharsPerSide; chars >= 1; chars--) {
-        // Build shortened string: first N chars + "..." + last N chars
-        String shortened = text.substring(0, chars) + "..." + text.substring(textLen - chars);
-        int shortenedWidth = canvas.textWidth(shortened);
+size_t catalogActiveOffset(int index) {
+    return catalogRecordOffset(catalogHeader.count) + (size_t)index * sizeof(uint16_t);
+}
 
-        if (shortenedWidth <= maxWidth) {
-            return shortened; // textSize already set correctly
-        }
-    }
+int catalogFontCount() { return catalogHeader.count; }
+int catalogEnabledCount() { return catalogHeader.enabledCount; }
+int activeFontCount() { return catalogHeader.activeCount; }
 
-    // Fallback: just show "..." if even 1 char per side is too long
-    return "..."; // textSize already set correctly
+void closeFontCatalog() {
+    if (fontCatalog) fontCatalog.close();
+    catalogHeader = {0, 0, 0, 0, 0, 0};
+    std::vector<std::pair<uint32_t, uint16_t>>().swap(catalogIdIndex);
+    catalogPageStart = -1;
+    activePageStart = -1;
 }
 
-// UI Helper: Draw checkbox as ASCII ( ) or (*)
-void drawCheckbox(int x, int y, bool checked) {
-    canvas.setTextDatum(CL_DATUM);
-    if (checked) {
-        canvas.drawString("(*)", x, y + UI_LINE_HEIGHT/2);
-    } else {
-        canvas.drawString("( )", x, y + UI_LINE_HEIGHT/2);
+bool openFontCatalog() {
+    closeFontCatalog();
+    fontCatalog = SD.open(FONT_CATALOG_FILE, "r+");
+    if (!fontCatalog) return false;
+    FontCatalogHeader header;
+    bool ok = fontCatalog.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == FONT_CATALOG_MAGIC && header.recordSize == sizeof(FontCatalogRecord) &&
+              header.count <= FONT_CATALOG_MAX &&
+              header.activeCount <= header.count && header.enabledCount <= header.count;
+    if (ok) {
+        catalogHeader = header;
+        ok = fontCatalog.size() == catalogActiveOffset(header.count);
+    }
+    if (!ok) {
+        LOG_W("WARNING: Font catalog unreadable, rescanning\n");
+        closeFontCatalog();
+        return false;
     }
+    METRIC_ADD(M_SD_BYTES_READ, sizeof(header));
+    return true;
 }
 
-// UI Helper: Draw radio button as ASCII ( ) or (*)
-void drawRadioButton(int x, int y, bool selected) {
-    canvas.setTextDatum(CL_DATUM);
-    if (selected) {
-        canvas.drawString("(*)", x, y + UI_LINE_HEIGHT/2);
-    } else {
-        canvas.drawString("( )", x, y + UI_LINE_HEIGHT/2);
+// Record of the catalog (all fonts, sorted by path). Valid until the next catalog call.
+const FontCatalogRecord* catalogRecord(int index) {
+    if (!fontCatalog || index < 0 || index >= (int)catalogHeader.count) return nullptr;
+    if (catalogPageStart < 0 || index < catalogPageStart || index >= catalogPageStart + FONT_CATALOG_PAGE) {
+        int start = index - index % FONT_CATALOG_PAGE;
+        size_t bytes = min(FONT_CATALOG_PAGE, (int)catalogHeader.count - start) * sizeof(FontCatalogRecord);
+        catalogPageStart = -1;
+        if (!fontCatalog.seek(catalogRecordOffset(start)) ||
+            fontCatalog.read((uint8_t*)catalogPage, bytes) != bytes) {
+            LOG_E("ERROR: Font catalog read failed at record %d\n", index);
+            return nullptr;
+        }
+        METRIC_ADD(M_SD_BYTES_READ, bytes);
+        catalogPageStart = start;
     }
+    return &catalogPage[index - catalogPageStart];
 }
 
-// UI Helper: Draw menu item
-void drawMenuItem(int y, MenuItem& item, bool isCursor) {
-    int textX = 270; // Center X for text
-    int checkboxX = UI_INDENT; // Left margin for checkboxes
-
-    // Draw cursor indicator ">" for selected item
-    if (isCursor) {
-        canvas.setTextDatum(CL_DATUM);
-        canvas.drawString(">", 20, y + UI_LINE_HEIGHT/2);
+// Record number of the activeIndex-th enabled font, -1 if out of range
+int activeFontRecord(int activeIndex) {
+    if (!fontCatalog || activeIndex < 0 || activeIndex >= (int)catalogHeader.activeCount) return -1;
+    if (activePageStart < 0 || activeIndex < activePageStart || activeIndex >= activePageStart + FONT_ACTIVE_PAGE) {
+        int start = activeIndex - activeIndex % FONT_ACTIVE_PAGE;
+        size_t bytes = min(FONT_ACTIVE_PAGE, (int)catalogHeader.activeCount - start) * sizeof(uint16_t);
+        activePageStart = -1;
+        if (!fontCatalog.seek(catalogActiveOffset(start)) ||
+            fontCatalog.read((uint8_t*)activePage, bytes) != bytes) {
+            LOG_E("ERROR: Font catalog read failed at active entry %d\n", activeIndex);
+            return -1;
+        }
+        METRIC_ADD(M_SD_BYTES_READ, bytes);
+        activePageStart = start;
     }
+    return activePage[activeIndex - activePageStart];
+}
 
-    // Draw based on item type
-    switch (item.type) {
-        case MENU_CONFIRM:
-            // Draw invisible (*) for alignment, then "Confirm" button
-            canvas.setTextColor(0); // White (invisible)
-            canvas.setTextDatum(CL_DATUM);
-            canvas.drawString("(*)", checkboxX, y + UI_LINE_HEIGHT/2);
-            canvas.setTextColor(15); // Back to black
-            canvas.drawString(item.label, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
-            break;
+const FontCatalogRecord* activeFont(int activeIndex) {
+    return catalogRecord(activeFontRecord(activeIndex));
+}
 
-        case MENU_LABEL:
-            // Draw invisible (*) for alignment, then label text
-            canvas.setTextColor(0); // White (invisible)
-            canvas.setTextDatum(CL_DATUM);
-            canvas.drawString("(*)", checkboxX, y + UI_LINE_HEIGHT/2);
-            canvas.setTextColor(15); // Back to black
-            canvas.drawString(item.label, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
-            break;
+bool writeCatalogHeader() {
+    bool ok = fontCatalog.seek(0) &&
+              fontCatalog.write((const uint8_t*)&catalogHeader, sizeof(catalogHeader)) == sizeof(catalogHeader);
+    fontCatalog.flush();
+    return ok;
+}
 
-        case MENU_RADIO:
-            // Draw radio button + label with space
-            drawRadioButton(checkboxX, y, item.selected);
-            canvas.setTextDatum(CL_DATUM);
-            canvas.drawString(item.label, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
-            break;
+// Fonts that failed at runtime this session (load error, no valid glyph), by font ID. The
+// cause may be transient (SD read error, low memory, no FreeType face), so one failure only
+// skips the font until the next boot or wake. The record counts the sessions in a row that
+// failed (loadFailures); FONT_LOAD_FAILURE_LIMIT of them set FONT_FLAG_LOAD_FAILED.
+std::vector<uint32_t> sessionFailedFonts;
 
-        case MENU_CHECKBOX: {
-            // Draw checkbox + label with space
-            drawCheckbox(checkboxX, y, item.selected);
-            canvas.setTextDatum(CL_DATUM);
-            // Use pre-computed displayLabel if available, otherwise use label
-            String textToDisplay = item.displayLabel.isEmpty() ? item.label : item.displayLabel;
-            canvas.drawString(textToDisplay, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
-            break;
-        }
+bool fontFailedThisSession(uint32_t fontId) {
+    return std::find(sessionFailedFonts.begin(), sessionFailedFonts.end(), fontId) != sessionFailedFonts.end();
+}
 
-        case MENU_SEPARATOR:
-            // Empty space (30px height) - nothing to draw
-            break;
+bool fontUsable(const FontCatalogRecord* record) {
+    return record && !(record->flags & FONT_FLAGS_UNUSABLE) && !fontFailedThisSession(record->fontId);
+}
 
-        case MENU_PAGE_NAV:
-            // Draw "<<<" or ">>>" aligned left like fonts (with invisible marker for alignment)
-            canvas.setTextColor(0); // White (invisible)
-            canvas.setTextDatum(CL_DATUM);
-            canvas.drawString("(*)", checkboxX, y + UI_LINE_HEIGHT/2);
-            canvas.setTextColor(15); // Back to black
-            // item.value: -1 = previous page (<<<), 1 = next page (>>>)
-            String navSymbol = (item.value == -1) ? "<<<" : ">>>";
-            canvas.drawString(navSymbol, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
-            break;
-    }
+// Enabled and usable: what the active table holds
+bool fontActive(uint8_t flags) {
+    return (flags & FONT_FLAG_ENABLED) && !(flags & FONT_FLAGS_UNUSABLE);
 }
 
-// UI Helper: Reset menu refresh counters (call before first menu screen)
-void resetMenuRefresh() {
-    // Force a full refresh on next render by triggering the condition
-    // This is done by making static variables accessible via a reset function
-    // We'll handle this inline in the render function with a static firstRun flag
+// Rewrite the flags byte of a record in place. A change of fontActive() marks the active
+// table stale (in the header, written by the caller).
+bool writeFontFlags(int index, uint8_t flags) {
+    const FontCatalogRecord* record = catalogRecord(index);
+    if (!record) return false;
+    if (flags == record->flags) return true;
+    if (fontActive(flags) != fontActive(record->flags)) catalogHeader.activeStale = 1;
+    catalogPage[index - catalogPageStart].flags = flags;
+    return fontCatalog.seek(catalogRecordOffset(index) + offsetof(FontCatalogRecord, flags)) &&
+           fontCatalog.write(&flags, 1) == 1;
 }
 
-// UI Helper: Render full menu screen with smart refresh
-void renderMenuScreen(const String& title, std::vector<MenuItem>& items, int cursorIndex, int scrollOffset, bool forceFullRefresh = false) {
-    // Static variables for smart refresh tracking (menu-specific)
-    static uint8_t menuPartialCount = 0;
-    static unsigned long menuFirstPartialTime = 0;
-    static bool menuHasPartial = false;
+// Set or clear FONT_FLAG_ENABLED in place (the active table is rebuilt separately)
+bool writeFontEnabled(int index, bool enabled) {
+    const FontCatalogRecord* record = catalogRecord(index);
+    if (!record) return false;
+    uint8_t flags = enabled ? (record->flags | FONT_FLAG_ENABLED) : (record->flags & ~FONT_FLAG_ENABLED);
+    if (flags == record->flags) return true;
+    catalogHeader.enabledCount += enabled ? 1 : -1;
+    return writeFontFlags(index, flags);
+}
 
-    canvas.fillCanvas(0); // White background
-    canvas.setTextSize(UI_TEXT_SIZE);
-    canvas.setTextColor(15); // Black text
+// Rewrite the loadFailures byte of a record in place
+bool writeFontLoadFailures(int index, uint8_t failures) {
+    const FontCatalogRecord* record = catalogRecord(index);
+    if (!record) return false;
+    if (failures == record->loadFailures) return true;
+    catalogPage[index - catalogPageStart].loadFailures = failures;
+    bool ok = fontCatalog.seek(catalogRecordOffset(index) + offsetof(FontCatalogRecord, loadFailures)) &&
+              fontCatalog.write(&failures, 1) == 1;
+    fontCatalog.flush();
+    return ok;
+}
 
-    // Draw title at top (if provided)
-    if (title.length() > 0) {
-        canvas.setTextDatum(TC_DATUM);
-        canvas.drawString(title, 270, 30);
+// Record a runtime failure of an active font: it is skipped for the rest of the session
+// (see sessionFailedFonts) and, after FONT_LOAD_FAILURE_LIMIT sessions in a row, flagged
+// in the catalog. The active table keeps the font until the next rebuild.
+void markFontUnusable(int activeIndex, const char* problem) {
+    int index = activeFontRecord(activeIndex);
+    const FontCatalogRecord* record = catalogRecord(index);
+    if (!record || fontFailedThisSession(record->fontId)) return;
+    sessionFailedFonts.push_back(record->fontId);
+    uint8_t failures = record->loadFailures < 255 ? record->loadFailures + 1 : 255;
+    if (failures < FONT_LOAD_FAILURE_LIMIT) {
+        LOG_W("Font %s unusable this session (%s)\n", record->path, problem);
+        writeFontLoadFailures(index, failures);
+        return;
     }
+    LOG_W("Font %s unusable (%s, %u sessions in a row), flagged in the catalog\n",
+          record->path, problem, failures);
+    uint8_t flags = record->flags | FONT_FLAG_LOAD_FAILED;
+    bool ok = writeFontLoadFailures(index, failures);
+    ok = writeFontFlags(index, flags) && ok;
+    if (!(writeCatalogHeader() && ok)) LOG_E("ERROR: Font catalog write failed at record %d\n", index);
+}
 
-    // Calculate visible items (max items that fit on screen)
-    int maxVisibleItems = 8; // Conservative estimate for 540x960 screen
-    int startIdx = scrollOffset;
-    int endIdx = min((int)items.size(), scrollOffset + maxVisibleItems);
+// The current font rendered: earlier runtime failures were not consecutive
+void clearFontLoadFailures(int activeIndex) {
+    int index = activeFontRecord(activeIndex);
+    const FontCatalogRecord* record = catalogRecord(index);
+    if (record && record->loadFailures > 0) writeFontLoadFailures(index, 0);
+}
 
-    // Draw visible items
-    for (int i = startIdx; i < endIdx; i++) {
-        int relativeIdx = i - scrollOffset;
-        int y = UI_TOP_MARGIN + relativeIdx * UI_LINE_HEIGHT;
-        bool isCursor = (i == cursorIndex);
-        drawMenuItem(y, items[i], isCursor);
-    }
+bool fontEnabledAt(int index) {
+    const FontCatalogRecord* record = catalogRecord(index);
+    return record && (record->flags & FONT_FLAG_ENABLED);
+}
 
-    // Smart refresh logic (same as main program)
-    if (forceFullRefresh) {
-        // Force full refresh (e.g., first screen after boot)
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-        menuPartialCount = 0;
-        menuHasPartial = false;
-        Serial.println("Menu forced full refresh");
-    } else {
-        // Normal partial refresh
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GL16);
+bool setFontEnabled(int index, bool enabled) {
+    bool ok = writeFontEnabled(index, enabled);
+    return writeCatalogHeader() && ok;
+}
 
-        // Track first partial after full
-        if (!menuHasPartial) {
-            menuFirstPartialTime = millis();
-            menuHasPartial = true;
-        }
+void setAllFontsEnabled(bool enabled) {
+    for (int i = 0; i < (int)catalogHeader.count; i++) {
+        writeFontEnabled(i, enabled);
+    }
+    writeCatalogHeader();
+}
 
-        menuPartialCount++;
+// Rewrite the active table from the record flags (only if a flag change made it stale:
+// otherwise a wake would read every record and rewrite the table for nothing)
+void rebuildActiveFonts() {
+    if (!fontCatalog) return;
+    if (!catalogHeader.activeStale) {
+        LOG_D("Active font table current, no rebuild\n");
+        return;
+    }
+    uint16_t buffer[FONT_ACTIVE_PAGE];
+    int buffered = 0;
+    int active = 0;
+    int enabled = 0;
+    for (int i = 0; i <= (int)catalogHeader.count; i++) {
+        const FontCatalogRecord* record = i < (int)catalogHeader.count ? catalogRecord(i) : nullptr;
+        if (record && (record->flags & FONT_FLAG_ENABLED)) enabled++;
+        if (record && fontActive(record->flags)) {
+            buffer[buffered++] = i;
+        }
+        if (buffered > 0 && (buffered == FONT_ACTIVE_PAGE || i == (int)catalogHeader.count)) {
+            fontCatalog.seek(catalogActiveOffset(active));
+            fontCatalog.write((const uint8_t*)buffer, buffered * sizeof(uint16_t));
+            active += buffered;
+            buffered = 0;
+        }
+    }
+    catalogHeader.activeCount = active;
+    catalogHeader.enabledCount = enabled;
+    catalogHeader.activeStale = 0;
+    activePageStart = -1;
+    writeCatalogHeader();
+}
 
-        // Trigger full refresh if:
-        // A) 5 partials reached, OR
-        // B) 10 seconds passed since FIRST partial
-        unsigned long timeSinceFirstPartial = millis() - menuFirstPartialTime;
-        if (menuPartialCount >= 5 ||
-            (menuHasPartial && timeSinceFirstPartial >= 10000)) {
+// Record number of a font ID; tries hintIndex first (same order as the caller's list).
+// On a miss the catalog is read once into an ID-sorted index, so importing N flags stays
+// O(N log N); releaseCatalogIdIndex() frees it when the import is done.
+int catalogIndexForId(uint32_t id, int hintIndex) {
+    const FontCatalogRecord* hint = catalogRecord(hintIndex);
+    if (hint && hint->fontId == id) return hintIndex;
+    if (catalogIdIndex.empty()) {
+        catalogIdIndex.reserve(catalogHeader.count);
+        for (int i = 0; i < (int)catalogHeader.count; i++) {
+            const FontCatalogRecord* record = catalogRecord(i);
+            if (record) catalogIdIndex.push_back(std::make_pair(record->fontId, (uint16_t)i));
+        }
+        std::sort(catalogIdIndex.begin(), catalogIdIndex.end());
+    }
+    auto match = std::lower_bound(catalogIdIndex.begin(), catalogIdIndex.end(), std::make_pair(id, (uint16_t)0));
+    return match != catalogIdIndex.end() && match->first == id ? match->second : -1;
+}
 
-            Serial.printf("Menu full refresh (count=%d, time=%lums)\n", menuPartialCount, timeSinceFirstPartial);
-            M5.EPD.UpdateFull(UPDATE_MODE_GC16);
+// Record number of a path (binary search: records are sorted by path)
+int catalogIndexForPath(const char* path) {
+    int lo = 0, hi = (int)catalogHeader.count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const FontCatalogRecord* record = catalogRecord(mid);
+        if (!record) return -1;
+        int order = strcmp(record->path, path);
+        if (order == 0) return mid;
+        if (order < 0) lo = mid + 1; else hi = mid - 1;
+    }
+    return -1;
+}
 
-            // Reset counters
-            menuPartialCount = 0;
-            menuHasPartial = false;
+bool isFontFileName(const String& filename); // Font Scan
+
+// Record number of the font at a position in a config written before font IDs. That
+// firmware listed the font files directly in /fonts in openNextFile() order, skipping
+// "._" files; the list is rebuilt the same way once per import. -1 if out of range or
+// /fonts cannot be read (the flag is then ignored).
+int legacyFontIndex(int position) {
+    if (!legacyFontOrderRead) {
+        legacyFontOrderRead = true;
+        File dir = SD.open("/fonts");
+        File entry;
+        while (dir && (entry = dir.openNextFile())) {
+            String filename = String(entry.name());
+            if (!entry.isDirectory() && !filename.startsWith("._") && isFontFileName(filename)) {
+                char path[FONT_PATH_MAX];
+                snprintf(path, sizeof(path), "/fonts/%s", filename.c_str());
+                legacyFontOrder.push_back(catalogIndexForPath(path));
+            }
+            entry.close();
+        }
+        if (dir) {
+            dir.close();
+            LOG_I("Config font flags without IDs: matched to /fonts directory order (%d files)\n",
+                  (int)legacyFontOrder.size());
+        } else {
+            LOG_W("WARNING: Config font flags without IDs ignored (no /fonts) - select fonts on the setup screen\n");
         }
     }
+    return position < (int)legacyFontOrder.size() ? legacyFontOrder[position] : -1;
+}
+
+void releaseCatalogIdIndex() {
+    std::vector<std::pair<uint32_t, uint16_t>>().swap(catalogIdIndex);
+    std::vector<int>().swap(legacyFontOrder);
+    legacyFontOrderRead = false;
 }
 
 // ========================================
-// v2.2: Unicode Range Customization
+// View Mode (for display glyph rendering)
 // ========================================
+enum ViewMode {
+    BITMAP,    // Bitmap rendering (filled glyph)
+    OUTLINE    // Vector outline with control points and construction lines
+};
 
-// Forward declarations
-extern std::vector<String> fontPaths;
-String getFontName(const String& path); // Already defined earlier in the file
-
-// v3.0: Touch screen forward declarations
-extern bool touchEnabled;
-extern const int16_t TAP_MAX_MOVEMENT;
-void enableTouch();
-int getMenuItemAtTouch(int16_t touchY, const std::vector<MenuItem>& items);
-
-// Build menu items for current page
-void buildUnifiedMenu(std::vector<MenuItem>& items, PaginationState& pagination,
-                      int selectedInterval, const std::vector<bool>& fontEnabled,
-                      bool allowDifferentFont, bool allowDifferentMode) {
-    items.clear();
+// v3.1: Filtered battery state (see Battery Estimator), kept with rtcState
+struct BatteryEstimate {
+    bool valid;                  // At least one ADC sample taken since cold boot
+    uint8_t wakesSinceSample;    // ADC is only read every BATTERY_SAMPLE_EVERY_WAKES wakes
+    float filteredMv;            // EMA of sampled voltage
+    float sampledPct;            // Percent (discharge curve) at the last sample
+    float drainPctPerHour;       // EMA of discharge rate between samples, 0 = unknown/charging
+    uint32_t sampleTime;         // RTC seconds since 2000-01-01 at the last sample
+};
 
-    // 1. Confirm button (always first)
-    items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+// RTC memory structure to persist state across deep sleep
+RTC_DATA_ATTR struct {
+    bool isValid;
+    int currentFontIndex;
+    uint32_t currentFontId;  // v3.1: Stable ID of the current font, wins over the index on restore
+    uint32_t currentGlyphCodepoint;
+    ViewMode viewMode;  // STEP 5: Persist view mode across sleep
+    uint64_t totalMillis; // Total uptime in milliseconds since last reset (accumulated across sleep cycles)
+    bool debugMode;  // Debug mode: enables Serial output and battery logging (persists across wake, resets on cold boot)
+    bool displayMatchesState;     // v3.1: Panel shows exactly the saved font/glyph/mode (settled grayscale frame)
+    uint8_t wakeIntervalMinutes;  // v3.1: Config copy so a fast button wake can sleep again without SD
+    uint16_t intervalOverrideMinutes;                 // v3.1: Config copy (see AppConfig)
+    uint8_t scheduleCount;                            // v3.1: Config copy of the wake schedule
+    SchedulePeriod schedule[MAX_SCHEDULE_PERIODS];
+    uint32_t plannedSleepSeconds;                     // v3.1: Length of the last scheduled sleep (uptime accounting)
+    uint8_t powerTier;                                // v3.1: Energy governor tier (PowerTier), kept for hysteresis
+    uint8_t prerenderedCount;                         // v3.1: Pre-rendered auto-wake frames left on SD
+    uint8_t prerenderedNext;                          // v3.1: Next pre-rendered frame slot to show
+    BatteryEstimate battery;                          // v3.1: Filtered battery estimator state
+    bool fontRescanPending;                           // v3.1: A catalog font was missing, enumerate /fonts next wake
+} rtcState = {false, 0, 0, 0x0041, BITMAP, 0, false, false, 15, 0, 0, {}, 0, 0, 0, 0, {}};  // Default: BITMAP mode, 0 uptime, normal mode (debugMode=false)
+
+// v3.1: This boot is a power-on from a power-off sleep (rtcState restored from NVS)
+bool poweredOffWake = false;
 
-    // v2.2: Customize Unicode ranges (navigable button)
-    items.push_back({MENU_LABEL, "Customize Unicode ranges", "", false, 0, -5}); // fontIndex=-5 for Unicode ranges page
+// ========================================
+// v2.2.1: Config File I/O Functions (Flash + SD)
+// ========================================
 
-    // 2. Separator (30px)
-    items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+// v3.1: Config flag line -> font catalog record: by font ID (the export order matches the
+// catalog, so the record at the same position is tried first), or without an ID by its
+// position in the old firmware's /fonts order
+void importFontFlag(int position, uint32_t id, bool enabled) {
+    int index = id != 0 ? catalogIndexForId(id, position) : legacyFontIndex(position);
+    if (index >= 0) writeFontEnabled(index, enabled);
+}
 
-    // 3. "Refresh timer" label (non-selectable)
-    items.push_back({MENU_LABEL, "Refresh timer", "", false, 0, -1});
+// Forward declarations
+bool loadConfigFromFile(File& file);
+bool parseConfigOption(const String& line);
+String formatSchedulePeriod(const SchedulePeriod& period);
 
-    // 4. Radio buttons for intervals (different in debug mode)
-    if (rtcState.debugMode) {
-        // Debug mode: shorter intervals for testing (1, 2, 5 min)
-        items.push_back({MENU_RADIO, "5 min", "", selectedInterval == 5, 5, -1});
-        items.push_back({MENU_RADIO, "2 min", "", selectedInterval == 2, 2, -1});
-        items.push_back({MENU_RADIO, "1 min", "", selectedInterval == 1, 1, -1});
-    } else {
-        // Normal mode: standard intervals (5, 10, 15 min)
-        items.push_back({MENU_RADIO, "15 min", "", selectedInterval == 15, 15, -1});
-        items.push_back({MENU_RADIO, "10 min", "", selectedInterval == 10, 10, -1});
-        items.push_back({MENU_RADIO, "5 min", "", selectedInterval == 5, 5, -1});
+// Import config from the SD text file (cold boot, or migration when NVS has none)
+bool importConfigFromSD() {
+    LOG_I("\n=== Loading Config from SD ===\n");
+
+    if (!SD.exists(CONFIG_FILE)) {
+        LOG_I("Config file not found - will run first-time setup\n");
+        return false;
     }
 
-    // 5. Separator (30px)
-    items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+    File file = SD.open(CONFIG_FILE, FILE_READ);
+    if (!file) {
+        LOG_E("ERROR: Cannot open config file for reading\n");
+        return false;
+    }
 
-    // 6. "When in standby" label (non-selectable)
-    items.push_back({MENU_LABEL, "When in standby", "", false, 0, -1});
+    bool success = loadConfigFromFile(file);
+    file.close();
 
-    // 7. Checkboxes for standby behavior
-    items.push_back({MENU_CHECKBOX, "Allow different font", "", allowDifferentFont, 0, -3}); // fontIndex=-3 for allowDifferentFont
-    items.push_back({MENU_CHECKBOX, "Allow different mode", "", allowDifferentMode, 0, -4}); // fontIndex=-4 for allowDifferentMode
+    if (success) {
+        LOG_I("=== Config Loaded from SD Successfully ===\n\n");
+    }
 
-    // 8. Separator (30px)
-    items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+    return success;
+}
 
-    // 9. Font selection with pagination
-    // Strategy: Always show "Select/Deselect all" on every page
-    // Max 5 total items in font section: Select/Deselect all + up to 5 slots for fonts/dots
+// Helper function to load config from any File object (Flash or SD)
+bool loadConfigFromFile(File& file) {
 
-    int totalFonts = fontPaths.size();
+    // Read wake interval (first line)
+    String line = file.readStringUntil('\n');
+    line.trim();
+    config.wakeIntervalMinutes = line.toInt();
 
-    // Calculate fonts per page based on position
-    // Page 0: Select/Deselect all + up to 5 fonts (if ≤5 total, show all; otherwise show 4 + ">>>")
-    // Page 1+: Select/Deselect all + "<<<" + 3 fonts (+ ">>>" if more pages)
+    // v2.2.1: Allow 1/2/5/10/15 minutes (1/2 for debug mode)
+    if (config.wakeIntervalMinutes != 1 &&
+        config.wakeIntervalMinutes != 2 &&
+        config.wakeIntervalMinutes != 5 &&
+        config.wakeIntervalMinutes != 10 &&
+        config.wakeIntervalMinutes != 15) {
+        LOG_E("ERROR: Invalid wake interval %d, expected 1/2/5/10/15\n", config.wakeIntervalMinutes);
+        file.close();
+        return false;
+    }
 
-    int fontsThisPage;
-    int startFont;
+    LOG_I("Wake interval: %d minutes\n", config.wakeIntervalMinutes);
 
-    if (pagination.currentPage == 0) {
-        // First page: can show up to 5 fonts if ≤5 total, otherwise 4 + ">>>"
-        if (totalFonts <= 5) {
-            // Show all fonts in one page
-            fontsThisPage = totalFonts;
-            startFont = 0;
-            pagination.totalPages = 1;
-        } else {
-            // Show 4 fonts, reserve space for ">>>"
-            fontsThisPage = 4;
-            startFont = 0;
-            // Calculate total pages: first page 4 fonts, subsequent pages 3 fonts each
-            int remainingFonts = totalFonts - 4;
-            pagination.totalPages = 1 + (remainingFonts + 2) / 3; // Ceiling division
-        }
-    } else {
-        // Subsequent pages: "<<<" at top, then up to 3 fonts
-        startFont = 4 + (pagination.currentPage - 1) * 3;
-        int remainingFonts = totalFonts - startFont;
-        fontsThisPage = min(3, remainingFonts);
-    }
+    // Read allowDifferentFont (second line)
+    line = file.readStringUntil('\n');
+    line.trim();
+    config.allowDifferentFont = (line == "1" || line == "true");
+    LOG_I("Allow different font: %s\n", config.allowDifferentFont ? "yes" : "no");
 
-    int endFont = startFont + fontsThisPage;
+    // Read allowDifferentMode (third line)
+    line = file.readStringUntil('\n');
+    line.trim();
+    config.allowDifferentMode = (line == "1" || line == "true");
+    LOG_I("Allow different mode: %s\n", config.allowDifferentMode ? "yes" : "no");
 
-    // Select/Deselect all (ALWAYS first in font section, on every page)
-    bool allSelected = true;
-    for (bool enabled : fontEnabled) {
-        if (!enabled) {
-            allSelected = false;
-            break;
+    // Read font enable flags (next N lines, where N = number of fonts) into the font catalog
+    int fontIndex = 0;
+    while (file.available()) {
+        line = file.readStringUntil('\n');
+        line.trim();
+        if (line.length() > 0) {
+            // Check if this is a separator line (range flags follow)
+            if (line == "---") {
+                break; // Stop reading font flags, move to range flags
+            }
+            // v3.1: "<flag> <font ID in hex>"; older files have the flag only
+            int space = line.indexOf(' ');
+            String flag = space > 0 ? line.substring(0, space) : line;
+            bool enabled = (flag == "1" || flag == "true");
+            importFontFlag(fontIndex, space > 0 ? strtoul(line.c_str() + space + 1, nullptr, 16) : 0, enabled);
+            fontIndex++;
         }
     }
-    items.push_back({MENU_LABEL, "Select/Deselect all", "", allSelected, 0, -2}); // fontIndex=-2 special, clickable but no marker
+    releaseCatalogIdIndex();
+    if (fontCatalog) writeCatalogHeader();
 
-    // "..." prev page navigation (if not on first page) - AFTER Select/Deselect all
-    if (pagination.currentPage > 0) {
-        items.push_back({MENU_PAGE_NAV, "...", "", false, -1, -1}); // value=-1 means prev
+    // v2.2: Read Unicode range enable flags (remaining lines, or use defaults if not present)
+    config.rangeEnabled.clear();
+    int rangeIndex = 0;
+    bool foundRangeFlags = false;
+    while (file.available()) {
+        line = file.readStringUntil('\n');
+        line.trim();
+        if (line.length() > 0) {
+            // v3.1: Second separator starts the key=value options section
+            if (line == "---") {
+                break;
+            }
+            bool enabled = (line == "1" || line == "true");
+            config.rangeEnabled.push_back(enabled);
+            rangeIndex++;
+            foundRangeFlags = true;
+        }
     }
 
-    // Font checkboxes for current page - PRE-COMPUTE displayLabel to avoid recalculation on every cursor move
-    for (int i = startFont; i < endFont; i++) {
-        String fontName = getFontName(fontPaths[i]);
-        String displayName = shortenTextIfNeeded(fontName, UI_MAX_TEXT_WIDTH);
-        items.push_back({MENU_CHECKBOX, fontName, displayName, fontEnabled[i], 0, i});
+    // v3.1: Options section (key=value, optional)
+    config.schedule.clear();
+    config.intervalOverrideMinutes = 0;
+    config.pendingClockSet = "";
+    while (file.available()) {
+        line = file.readStringUntil('\n');
+        line.trim();
+        if (line.length() > 0 && !line.startsWith("#")) {
+            if (!parseConfigOption(line)) {
+                LOG_W("WARNING: Ignoring config option '%s'\n", line.c_str());
+            }
+        }
     }
 
-    // "..." next page navigation (if more pages available)
-    if (pagination.currentPage < pagination.totalPages - 1) {
-        items.push_back({MENU_PAGE_NAV, "...", "", false, 1, -1}); // value=1 means next
+    // If no range flags found in file (old config format), use defaults
+    if (!foundRangeFlags) {
+        LOG_I("No range flags in config - using defaults (first 6 enabled)\n");
+        for (int i = 0; i < numGlyphRanges; i++) {
+            config.rangeEnabled.push_back(i < 6);
+        }
     }
-}
 
-// Render unified setup screen with fixed headers/footers
-void renderUnifiedSetupScreen(std::vector<MenuItem>& items, int cursorIndex, bool forceFullRefresh = false) {
-    static uint8_t menuPartialCount = 0;
-    static unsigned long menuFirstPartialTime = 0;
-    static bool menuHasPartial = false;
+    LOG_I("Loaded %d font enable flags, %d range enable flags\n",
+          fontIndex, config.rangeEnabled.size());
+    return true;
+}
 
-    canvas.fillCanvas(0);
-    canvas.setTextSize(UI_TEXT_SIZE);
-    canvas.setTextColor(15);
+// Export config to the SD text file (import/export format, see Binary Config in NVS)
+bool exportConfigToSD() {
+    LOG_I("\n=== Saving Config ===\n");
 
-    // Fixed header: "PaperSpecimen" at Y=30
-    canvas.setTextDatum(TC_DATUM);
-    canvas.drawString("PaperSpecimen", 270, 30);
+    File file = SD.open(CONFIG_FILE, FILE_WRITE);
+    if (!file) {
+        LOG_E("ERROR: Cannot open config file for writing\n");
+        return false;
+    }
 
-    // Fixed footer: "v3.0.1" (or "v3.0.1*" in debug mode) at Y=930
-    canvas.setTextDatum(BC_DATUM);
-    canvas.drawString(rtcState.debugMode ? "v3.0.1*" : "v3.0.1", 270, 930);
+    // Write wake interval
+    file.println(config.wakeIntervalMinutes);
+    LOG_I("Saved wake interval: %d minutes\n", config.wakeIntervalMinutes);
 
-    // Calculate available space for menu items
-    const int headerBottom = 30 + 24; // Y=30 + text height
-    const int footerTop = 930 - 24;   // Y=930 - text height
-    const int availableHeight = footerTop - headerBottom;
+    // Write allowDifferentFont
+    file.println(config.allowDifferentFont ? "1" : "0");
+    LOG_I("Saved allow different font: %s\n", config.allowDifferentFont ? "yes" : "no");
 
-    // Calculate flex space (divide remaining space into 2 equal parts)
-    int totalItemHeight = items.size() * UI_LINE_HEIGHT;
-    int flexSpace = max(0, (availableHeight - totalItemHeight) / 2);
+    // Write allowDifferentMode
+    file.println(config.allowDifferentMode ? "1" : "0");
+    LOG_I("Saved allow different mode: %s\n", config.allowDifferentMode ? "yes" : "no");
 
-    // Draw menu items starting after header + flex space
-    int startY = headerBottom + flexSpace;
+    // Write font enable flags
+    for (int i = 0; i < catalogFontCount(); i++) {
+        const FontCatalogRecord* record = catalogRecord(i);
+        if (!record) break;
+        file.printf("%s %08lx\n", (record->flags & FONT_FLAG_ENABLED) ? "1" : "0", (unsigned long)record->fontId);
+    }
+    LOG_I("Saved %d font enable flags\n", catalogFontCount());
 
-    for (int i = 0; i < items.size(); i++) {
-        int y = startY + i * UI_LINE_HEIGHT;
-        bool isCursor = (i == cursorIndex);
-        drawMenuItem(y, items[i], isCursor);
+    // v2.2: Write separator and Unicode range enable flags
+    file.println("---");
+    for (size_t i = 0; i < config.rangeEnabled.size(); i++) {
+        file.println(config.rangeEnabled[i] ? "1" : "0");
     }
+    LOG_I("Saved %d range enable flags\n", config.rangeEnabled.size());
 
-    // Smart refresh
-    if (forceFullRefresh) {
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-        menuPartialCount = 0;
-        menuHasPartial = false;
-    } else {
-        canvas.pushCanvas(0, 0, UPDATE_MODE_A2); // Anti-aliased partial refresh
-        if (!menuHasPartial) {
-            menuFirstPartialTime = millis();
-            menuHasPartial = true;
+    // v3.1: Options section (only written when something is set; clock= is one-shot)
+    if (!config.schedule.empty() || config.intervalOverrideMinutes != 0) {
+        file.println("---");
+        if (config.intervalOverrideMinutes != 0) {
+            file.printf("interval=%u\n", config.intervalOverrideMinutes);
         }
-        menuPartialCount++;
-        unsigned long timeSinceFirstPartial = millis() - menuFirstPartialTime;
-        if (menuPartialCount >= 5 || (menuHasPartial && timeSinceFirstPartial >= 10000)) {
-            M5.EPD.UpdateFull(UPDATE_MODE_GC16);
-            menuPartialCount = 0;
-            menuHasPartial = false;
+        for (size_t i = 0; i < config.schedule.size(); i++) {
+            file.println("period=" + formatSchedulePeriod(config.schedule[i]));
         }
+        LOG_I("Saved %d schedule periods\n", config.schedule.size());
     }
+
+    file.close();
+    LOG_I("=== Config Saved Successfully ===\n\n");
+    return true;
 }
 
-// v2.2: Unicode Ranges Configuration Screen
-void setupUnicodeRanges() {
-    Serial.println("\n=== Unicode Ranges Configuration ===");
+// ========================================
+// v3.1: Binary Config in NVS
+// ========================================
+// The live config is a compact versioned blob in NVS (namespace "pspeccfg"), so a wake
+// reads about 1 KB without SD instead of parsing /paperspecimen.cfg line by line. The text
+// file stays as the import/export format: a cold boot imports it when present (hand edits,
+// one-shot clock=), saveConfig() writes both. If NVS has no valid blob (first boot after an
+// update, CRC mismatch) loadConfig() imports the text file and stores it.
+// Layout changes only append fields to ConfigBlobPayload and bump CONFIG_BLOB_VERSION:
+// a shorter blob from an older version loads with the new fields zeroed (0 = default).
+
+const char* CONFIG_NVS_NAMESPACE = "pspeccfg";
+const uint8_t CONFIG_BLOB_VERSION = 3;  // v2: + font IDs, v3: font flags moved to the font catalog
+const int CONFIG_MAX_FONTS = 256;   // v1/v2 blobs: flags beyond this were not stored
+const int CONFIG_MAX_RANGES = 64;
+
+const uint8_t CONFIG_FLAG_DIFFERENT_FONT = 0x01;
+const uint8_t CONFIG_FLAG_DIFFERENT_MODE = 0x02;
+
+struct ConfigBlobHeader {
+    uint8_t version;
+    uint8_t reserved;
+    uint16_t payloadSize;  // Payload bytes actually stored (older versions store fewer)
+    uint32_t crc;          // CRC-32 of the stored payload
+};
 
-    // Local copy of range flags
-    std::vector<bool> rangeEnabledLocal = config.rangeEnabled;
+struct ConfigBlobPayload {
+    uint8_t wakeIntervalMinutes;
+    uint8_t flags;                          // CONFIG_FLAG_*
+    uint16_t intervalOverrideMinutes;
+    uint16_t fontCount;                     // v1/v2 only (migrated to the catalog), 0 since v3
+    uint8_t rangeCount;
+    uint8_t scheduleCount;
+    uint8_t fontEnabled[CONFIG_MAX_FONTS / 8];    // Bitsets, LSB first
+    uint8_t rangeEnabled[CONFIG_MAX_RANGES / 8];
+    SchedulePeriod schedule[MAX_SCHEDULE_PERIODS];
+    uint32_t fontIds[CONFIG_MAX_FONTS];           // v2: Font ID per flag (0 in v1 blobs)
+};
 
-    // Ensure rangeEnabledLocal has correct size
-    if (rangeEnabledLocal.size() != numGlyphRanges) {
-        rangeEnabledLocal.clear();
-        for (int i = 0; i < numGlyphRanges; i++) {
-            rangeEnabledLocal.push_back(i < 6); // First 6 enabled by default
+// CRC-32 (IEEE, reflected), bitwise: config blobs are small
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc ^= *data++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
         }
     }
+    return ~crc;
+}
 
-    int cursorIndex = 0;
-    int currentPage = 0;
-    const int rangesPerPage = 14; // 14 ranges per page
-    const int totalPages = (numGlyphRanges + rangesPerPage - 1) / rangesPerPage;
+void packConfigBlob(ConfigBlobPayload& payload) {
+    memset(&payload, 0, sizeof(payload));
+    payload.wakeIntervalMinutes = config.wakeIntervalMinutes;
+    payload.flags = (config.allowDifferentFont ? CONFIG_FLAG_DIFFERENT_FONT : 0) |
+                    (config.allowDifferentMode ? CONFIG_FLAG_DIFFERENT_MODE : 0);
+    payload.intervalOverrideMinutes = config.intervalOverrideMinutes;
+    payload.rangeCount = min((int)config.rangeEnabled.size(), CONFIG_MAX_RANGES);
+    payload.scheduleCount = min((int)config.schedule.size(), MAX_SCHEDULE_PERIODS);
+    for (int i = 0; i < payload.rangeCount; i++) {
+        if (config.rangeEnabled[i]) payload.rangeEnabled[i / 8] |= 1 << (i % 8);
+    }
+    for (int i = 0; i < payload.scheduleCount; i++) {
+        payload.schedule[i] = config.schedule[i];
+    }
+}
 
-    // Build initial menu
-    std::vector<MenuItem> items;
+bool unpackConfigBlob(const ConfigBlobPayload& payload) {
+    uint8_t interval = payload.wakeIntervalMinutes;
+    if (interval != 1 && interval != 2 && interval != 5 && interval != 10 && interval != 15) {
+        LOG_E("ERROR: Invalid wake interval %d in NVS config\n", interval);
+        return false;
+    }
+    config.wakeIntervalMinutes = interval;
+    config.allowDifferentFont = payload.flags & CONFIG_FLAG_DIFFERENT_FONT;
+    config.allowDifferentMode = payload.flags & CONFIG_FLAG_DIFFERENT_MODE;
+    config.intervalOverrideMinutes = payload.intervalOverrideMinutes;
 
-    auto rebuildMenu = [&]() {
-        items.clear();
-        items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+    // v1/v2 blob: move the font flags into the catalog (scanFonts() runs before loadConfig())
+    for (int i = 0; i < min((int)payload.fontCount, CONFIG_MAX_FONTS); i++) {
+        importFontFlag(i, payload.fontIds[i], payload.fontEnabled[i / 8] & (1 << (i % 8)));
+    }
+    releaseCatalogIdIndex();
+    if (payload.fontCount > 0 && fontCatalog) writeCatalogHeader();
+    config.rangeEnabled.clear();
+    for (int i = 0; i < min((int)payload.rangeCount, CONFIG_MAX_RANGES); i++) {
+        config.rangeEnabled.push_back(payload.rangeEnabled[i / 8] & (1 << (i % 8)));
+    }
+    if (config.rangeEnabled.empty()) {
+        for (int i = 0; i < numGlyphRanges; i++) {
+            config.rangeEnabled.push_back(i < 6); // Same default as the text format
+        }
+    }
+    config.schedule.clear();
+    for (int i = 0; i < min((int)payload.scheduleCount, MAX_SCHEDULE_PERIODS); i++) {
+        config.schedule.push_back(payload.schedule[i]);
+    }
+    config.pendingClockSet = ""; // One-shot, text file only
+    return true;
+}
 
-        // Select/Deselect all (clickable label with fontIndex=-2, like in main config)
-        bool allSelected = true;
-        for (bool enabled : rangeEnabledLocal) {
-            if (!enabled) {
-                allSelected = false;
-                break;
-            }
-        }
-        items.push_back({MENU_LABEL, "Select/Deselect all", "", allSelected, 0, -2});
+bool storeConfigInNvs() {
+    uint8_t blob[sizeof(ConfigBlobHeader) + sizeof(ConfigBlobPayload)];
+    ConfigBlobPayload payload;
+    packConfigBlob(payload);
+    ConfigBlobHeader header = {CONFIG_BLOB_VERSION, 0, (uint16_t)sizeof(payload),
+                               crc32Update(0, (const uint8_t*)&payload, sizeof(payload))};
+    memcpy(blob, &header, sizeof(header));
+    memcpy(blob + sizeof(header), &payload, sizeof(payload));
+
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NVS_NAMESPACE, false)) {
+        LOG_E("ERROR: Cannot open NVS config namespace\n");
+        return false;
+    }
+    bool ok = prefs.putBytes("cfg", blob, sizeof(blob)) == sizeof(blob);
+    prefs.end();
+    LOG_I("Config stored in NVS: v%d, %d bytes, %s\n", CONFIG_BLOB_VERSION, sizeof(blob), ok ? "ok" : "FAILED");
+    return ok;
+}
 
-        items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+bool loadConfigFromNvs() {
+    Preferences prefs;
+    if (!prefs.begin(CONFIG_NVS_NAMESPACE, true)) return false; // Namespace missing: never stored
+
+    uint8_t blob[sizeof(ConfigBlobHeader) + sizeof(ConfigBlobPayload) + 64]; // Slack for newer layouts
+    size_t len = prefs.getBytesLength("cfg");
+    bool read = len >= sizeof(ConfigBlobHeader) && len <= sizeof(blob) &&
+                prefs.getBytes("cfg", blob, len) == len;
+    prefs.end();
+    if (!read) return false;
+
+    ConfigBlobHeader header;
+    memcpy(&header, blob, sizeof(header));
+    const uint8_t* stored = blob + sizeof(header);
+    if (header.version == 0 || header.version > CONFIG_BLOB_VERSION ||
+        header.payloadSize != len - sizeof(header)) {
+        LOG_W("WARNING: NVS config has unknown layout (v%d, %d bytes)\n", header.version, len);
+        return false;
+    }
+    if (crc32Update(0, stored, header.payloadSize) != header.crc) {
+        LOG_W("WARNING: NVS config CRC mismatch\n");
+        return false;
+    }
 
-        int startRange = currentPage * rangesPerPage;
-        int endRange = min(startRange + rangesPerPage, numGlyphRanges);
+    ConfigBlobPayload payload;
+    memset(&payload, 0, sizeof(payload)); // Fields newer than the stored version default to 0
+    memcpy(&payload, stored, min((size_t)header.payloadSize, sizeof(payload)));
+    if (!unpackConfigBlob(payload)) return false;
+    if (payload.fontCount > 0) {
+        storeConfigInNvs(); // Migrated font flags: store without them
+    }
+    return true;
+}
 
-        if (currentPage > 0) {
-            items.push_back({MENU_PAGE_NAV, "<<<", "", false, -1, -1});
-        }
+// Live config: NVS, or a one-time import of the SD text file (needs SD mounted)
+bool loadConfig() {
+    WakePhaseScope phase(PHASE_LOAD_CONFIG);
+    if (loadConfigFromNvs()) {
+        LOG_I("Config loaded from NVS (%d ranges, %d periods)\n",
+              config.rangeEnabled.size(), config.schedule.size());
+        return true;
+    }
+    LOG_I("No valid config in NVS - importing %s\n", CONFIG_FILE);
+    if (!importConfigFromSD()) return false;
+    storeConfigInNvs();
+    return true;
+}
 
-        for (int i = startRange; i < endRange; i++) {
-            items.push_back({MENU_CHECKBOX, glyphRanges[i].name, "", rangeEnabledLocal[i], 0, i});
-        }
+// Save the live config to NVS and export the text copy to SD
+bool saveConfig() {
+    bool ok = storeConfigInNvs();
+    if (!exportConfigToSD()) {
+        LOG_W("WARNING: Config text export failed (NVS copy is used on wake)\n");
+    }
+    return ok;
+}
 
-        if (currentPage < totalPages - 1) {
-            items.push_back({MENU_PAGE_NAV, ">>>", "", false, 1, -1});
-        }
-    };
+// Initialize default config
+void initDefaultConfig() {
+    config.wakeIntervalMinutes = 15; // Default: 15 minutes
+    config.allowDifferentFont = true; // Default: allow random font
+    config.allowDifferentMode = true; // Default: allow random mode
+    // Font enable flags stay in the font catalog (new fonts start enabled)
 
-    rebuildMenu();
+    // v2.2: Initialize Unicode range flags (first 6 enabled by default)
+    config.rangeEnabled.clear();
+    for (int i = 0; i < numGlyphRanges; i++) {
+        config.rangeEnabled.push_back(i < 6); // First 6 ranges enabled, rest disabled
+    }
 
-    // Initial render with full refresh
-    renderUnifiedSetupScreen(items, cursorIndex, true);
+    // v3.1: No schedule: fixed interval around the clock
+    config.schedule.clear();
+    config.intervalOverrideMinutes = 0;
+    config.pendingClockSet = "";
 
-    // v3.0: Touch state for Unicode ranges menu (touch already enabled in setupScreenUnified)
-    bool rangesTouchWasPressed = false;
-    bool rangesTouchStartValid = false;
-    int16_t rangesTouchStartX = 0;
-    int16_t rangesTouchStartY = 0;
-    unsigned long rangesTouchStartTime = 0;
+    LOG_I("Default config initialized: %d min, allow font=%s, allow mode=%s, %d ranges (first 6 enabled)\n",
+          config.wakeIntervalMinutes,
+          config.allowDifferentFont ? "yes" : "no",
+          config.allowDifferentMode ? "yes" : "no",
+          numGlyphRanges);
+}
 
-    bool exitRangesScreen = false;
+// ========================================
+// v3.1: Wake Schedule (quiet hours, per-period intervals)
+// ========================================
+// Options after a second "---" in /paperspecimen.cfg:
+//   interval=20                  any base interval in minutes (1-1440)
+//   period=22:30-07:00,0         quiet hours: no auto-wake inside
+//   period=07:00-09:00,5         different interval inside the period
+//   clock=2026-10-19 14:30       set the RTC once (cold boot)
+// Without a valid RTC clock or without periods, the fixed interval applies as before.
+
+const uint16_t MINUTES_PER_DAY = 1440;
+#define BM8563_REG_SECONDS 0x02
+#define BM8563_FLAG_VL     0x80  // Clock integrity not guaranteed (power loss, never set)
+
+bool parseClockMinute(const String& text, uint16_t* minuteOfDay) {
+    int colon = text.indexOf(':');
+    if (colon < 1) return false;
+    long h = text.substring(0, colon).toInt();
+    long m = text.substring(colon + 1).toInt();
+    if (h < 0 || h > 24 || m < 0 || m > 59 || (h == 24 && m != 0)) return false;
+    *minuteOfDay = (uint16_t)((h * 60 + m) % MINUTES_PER_DAY);
+    return true;
+}
 
-    while (!exitRangesScreen) {
-        // Wait for button press
-        M5.update();
-        delay(50);
+String formatSchedulePeriod(const SchedulePeriod& period) {
+    char text[24];
+    snprintf(text, sizeof(text), "%02u:%02u-%02u:%02u,%u",
+             period.startMinute / 60, period.startMinute % 60,
+             period.endMinute / 60, period.endMinute % 60, period.intervalMinutes);
+    return String(text);
+}
 
-        if (M5.BtnL.wasPressed()) {
-            // Move cursor up
-            do {
-                cursorIndex--;
-                if (cursorIndex < 0) cursorIndex = items.size() - 1;
-                // Skip separators and non-clickable labels (except fontIndex=-2 for Select/Deselect all)
-            } while (items[cursorIndex].type == MENU_SEPARATOR ||
-                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2));
-            renderUnifiedSetupScreen(items, cursorIndex, false);
+// Parse one key=value line of the options section into config
+bool parseConfigOption(const String& line) {
+    int eq = line.indexOf('=');
+    if (eq < 1) return false;
+    String key = line.substring(0, eq);
+    String value = line.substring(eq + 1);
+    key.trim();
+    value.trim();
+
+    if (key == "interval") {
+        long minutes = value.toInt();
+        if (minutes < 1 || minutes > MINUTES_PER_DAY) return false;
+        config.intervalOverrideMinutes = minutes;
+        LOG_I("Option: base interval %ld minutes\n", minutes);
+        return true;
+    }
+
+    if (key == "period") {
+        // HH:MM-HH:MM,minutes
+        int dash = value.indexOf('-');
+        int comma = value.indexOf(',');
+        if (dash < 1 || comma < dash) return false;
+        SchedulePeriod period;
+        long minutes = value.substring(comma + 1).toInt();
+        if (!parseClockMinute(value.substring(0, dash), &period.startMinute) ||
+            !parseClockMinute(value.substring(dash + 1, comma), &period.endMinute) ||
+            period.startMinute == period.endMinute ||
+            minutes < 0 || minutes > MINUTES_PER_DAY) {
+            return false;
         }
-
-        if (M5.BtnR.wasPressed()) {
-            // Move cursor down
-            do {
-                cursorIndex++;
-                if (cursorIndex >= items.size()) cursorIndex = 0;
-                // Skip separators and non-clickable labels (except fontIndex=-2 for Select/Deselect all)
-            } while (items[cursorIndex].type == MENU_SEPARATOR ||
-                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2));
-            renderUnifiedSetupScreen(items, cursorIndex, false);
+        if (config.schedule.size() >= MAX_SCHEDULE_PERIODS) {
+            LOG_W("WARNING: More than %d periods, ignoring the rest\n", MAX_SCHEDULE_PERIODS);
+            return true;
         }
+        period.intervalMinutes = minutes;
+        config.schedule.push_back(period);
+        LOG_I("Option: period %s%s\n", formatSchedulePeriod(period).c_str(),
+              minutes == 0 ? " (quiet)" : "");
+        return true;
+    }
 
-        if (M5.BtnP.wasPressed()) {
-            MenuItem& currentItem = items[cursorIndex];
-
-            if (currentItem.type == MENU_CONFIRM) {
-                // Save and return to main config
-                config.rangeEnabled = rangeEnabledLocal;
-                Serial.println("Unicode ranges configured");
-                exitRangesScreen = true;
+    if (key == "clock") {
+        config.pendingClockSet = value;
+        return true;
+    }
 
-            } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
-                // "Select/Deselect all" - update all range checkboxes without rebuilding menu
-                bool newState = !currentItem.selected;
-                for (size_t i = 0; i < rangeEnabledLocal.size(); i++) {
-                    rangeEnabledLocal[i] = newState;
-                }
-                // Update selected state of all range checkboxes AND the Select/Deselect all item itself
-                for (auto& item : items) {
-                    if (item.type == MENU_CHECKBOX) {
-                        item.selected = newState;
-                    } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                        item.selected = newState;
-                    }
-                }
-                Serial.printf("Select/Deselect all ranges: %s\n", newState ? "all selected" : "all deselected");
-                renderUnifiedSetupScreen(items, cursorIndex, false);
+    return false;
+}
 
-            } else if (currentItem.type == MENU_CHECKBOX) {
-                // Toggle range - update without rebuilding menu
-                int rangeIndex = currentItem.fontIndex;
-                rangeEnabledLocal[rangeIndex] = !rangeEnabledLocal[rangeIndex];
-                currentItem.selected = rangeEnabledLocal[rangeIndex];
-                Serial.printf("Toggled range %d (%s): %s\n",
-                             rangeIndex, glyphRanges[rangeIndex].name,
-                             rangeEnabledLocal[rangeIndex] ? "enabled" : "disabled");
+bool periodContains(const SchedulePeriod& period, uint16_t minuteOfDay) {
+    if (period.startMinute < period.endMinute) {
+        return minuteOfDay >= period.startMinute && minuteOfDay < period.endMinute;
+    }
+    return minuteOfDay >= period.startMinute || minuteOfDay < period.endMinute; // Wraps midnight
+}
 
-                // Update "Select/Deselect all" state based on whether all ranges are now selected
-                bool allSelected = true;
-                for (bool enabled : rangeEnabledLocal) {
-                    if (!enabled) {
-                        allSelected = false;
-                        break;
-                    }
-                }
-                for (auto& item : items) {
-                    if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                        item.selected = allSelected;
-                        break;
-                    }
-                }
-                renderUnifiedSetupScreen(items, cursorIndex, false);
+// Wake interval in effect at a minute of day (0 = quiet). Pure function.
+uint16_t scheduleIntervalAt(const SchedulePeriod* periods, int count, uint16_t baseInterval, uint16_t minuteOfDay) {
+    for (int i = 0; i < count; i++) {
+        if (periodContains(periods[i], minuteOfDay)) {
+            return periods[i].intervalMinutes;
+        }
+    }
+    return baseInterval;
+}
 
-            } else if (currentItem.type == MENU_PAGE_NAV) {
-                // Page navigation
-                if (currentItem.value == -1) {
-                    // Previous page
-                    currentPage--;
-                } else {
-                    // Next page
-                    currentPage++;
-                }
-                rebuildMenu();
+// Minutes from minuteOfDay to the next period edge (1..MINUTES_PER_DAY)
+uint32_t minutesToNextEdge(const SchedulePeriod* periods, int count, uint16_t minuteOfDay) {
+    uint32_t next = MINUTES_PER_DAY;
+    for (int i = 0; i < count; i++) {
+        uint16_t edges[2] = {periods[i].startMinute, periods[i].endMinute};
+        for (int e = 0; e < 2; e++) {
+            uint32_t d = (edges[e] + MINUTES_PER_DAY - minuteOfDay) % MINUTES_PER_DAY;
+            if (d == 0) d = MINUTES_PER_DAY;
+            if (d < next) next = d;
+        }
+    }
+    return next;
+}
 
-                // Position cursor on first range checkbox
-                // Structure: Confirm(0), Select/Deselect(1), Sep(2), [<<<(3)], ranges...
-                cursorIndex = 3; // Start at separator + 1
-                if (currentPage > 0) {
-                    cursorIndex = 4; // Skip "<<<" navigation item
-                }
+// Minutes until the next useful wake. Wakes early at period edges (the interval may get
+// shorter there) and skips over quiet periods entirely. Pure function.
+uint32_t minutesUntilNextWake(const SchedulePeriod* periods, int count, uint16_t baseInterval, uint16_t minuteOfDay) {
+    uint16_t interval = scheduleIntervalAt(periods, count, baseInterval, minuteOfDay);
+    uint32_t candidate = (interval > 0) ? interval : MINUTES_PER_DAY;
+    candidate = min(candidate, minutesToNextEdge(periods, count, minuteOfDay));
+
+    // Landed in quiet time: jump to the next edge until something is active (bounded)
+    for (int guard = 0; guard <= 2 * count; guard++) {
+        uint16_t at = (minuteOfDay + candidate) % MINUTES_PER_DAY;
+        if (scheduleIntervalAt(periods, count, baseInterval, at) != 0) {
+            return candidate;
+        }
+        candidate += minutesToNextEdge(periods, count, at);
+        if (candidate >= MINUTES_PER_DAY) break;
+    }
+    return MINUTES_PER_DAY; // Everything quiet: check back once a day
+}
 
-                renderUnifiedSetupScreen(items, cursorIndex, false);
-            }
+bool rtcClockValid() {
+    return (M5.RTC.readReg(BM8563_REG_SECONDS) & BM8563_FLAG_VL) == 0;
+}
 
-            delay(200);
+// Cold boot: apply a one-shot "clock=" option, or seed a lost clock from the build time
+void initScheduleClock() {
+    int year, month, day, hour, minute;
+    if (config.pendingClockSet.length() > 0) {
+        if (sscanf(config.pendingClockSet.c_str(), "%d-%d-%d %d:%d", &year, &month, &day, &hour, &minute) == 5) {
+            rtc_date_t date(year, month, day);
+            rtc_time_t time(hour, minute, 0);
+            M5.RTC.setDate(&date);
+            M5.RTC.setTime(&time);
+            LOG_I("RTC set from config: %s\n", config.pendingClockSet.c_str());
+        } else {
+            LOG_W("WARNING: Invalid clock option '%s'\n", config.pendingClockSet.c_str());
         }
+        config.pendingClockSet = "";
+        return;
+    }
 
-        // v3.0: Touch screen navigation (same logic as main setup)
-        if (touchEnabled && M5.TP.available()) {
-            if (!M5.TP.isFingerUp()) {
-                M5.TP.update();
-                tp_finger_t finger = M5.TP.readFinger(0);
+    if (!rtcClockValid()) {
+        static const char* months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+        char monthName[4] = {0};
+        int second;
+        sscanf(__DATE__, "%3s %d %d", monthName, &day, &year);
+        sscanf(__TIME__, "%d:%d:%d", &hour, &minute, &second);
+        month = (strstr(months, monthName) - months) / 3 + 1;
+        rtc_date_t date(year, month, day);
+        rtc_time_t time(hour, minute, second);
+        M5.RTC.setDate(&date);
+        M5.RTC.setTime(&time);
+        LOG_I("RTC clock was lost - set to build time %s %s (add clock= to config to correct)\n",
+              __DATE__, __TIME__);
+    }
+}
 
-                if (!rangesTouchWasPressed) {
-                    rangesTouchWasPressed = true;
-                    rangesTouchStartTime = millis();
-                    rangesTouchStartValid = false;
+// Copy the schedule into rtcState so sleeps without a config load (fast wake) still follow it
+void saveScheduleToRtc() {
+    rtcState.wakeIntervalMinutes = config.wakeIntervalMinutes;
+    rtcState.intervalOverrideMinutes = config.intervalOverrideMinutes;
+    rtcState.scheduleCount = min((int)config.schedule.size(), MAX_SCHEDULE_PERIODS);
+    for (int i = 0; i < rtcState.scheduleCount; i++) {
+        rtcState.schedule[i] = config.schedule[i];
+    }
+}
 
-                    if (finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
-                        rangesTouchStartX = finger.x;
-                        rangesTouchStartY = finger.y;
-                        rangesTouchStartValid = true;
-                    }
-                } else {
-                    if (!rangesTouchStartValid && finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
-                        rangesTouchStartX = finger.x;
-                        rangesTouchStartY = finger.y;
-                        rangesTouchStartValid = true;
-                    }
-                }
-            } else if (rangesTouchWasPressed) {
-                rangesTouchWasPressed = false;
+// Fast button wake: the schedule is needed before the config file is read
+void loadScheduleFromRtc() {
+    config.wakeIntervalMinutes = rtcState.wakeIntervalMinutes;
+    config.intervalOverrideMinutes = rtcState.intervalOverrideMinutes;
+    config.schedule.assign(rtcState.schedule, rtcState.schedule + rtcState.scheduleCount);
+}
 
-                if (!rangesTouchStartValid) {
-                    continue;
-                }
+// Seconds until the next scheduled auto-wake (from the rtcState copy of the schedule)
+uint32_t nextWakeSeconds() {
+    uint16_t baseInterval = rtcState.intervalOverrideMinutes ? rtcState.intervalOverrideMinutes
+                                                             : rtcState.wakeIntervalMinutes;
+    if (rtcState.scheduleCount == 0) {
+        return (uint32_t)baseInterval * 60;
+    }
+    if (!rtcClockValid()) {
+        LOG_W("WARNING: RTC clock invalid - ignoring schedule\n");
+        return (uint32_t)baseInterval * 60;
+    }
+
+    rtc_time_t now;
+    M5.RTC.getTime(&now);
+    uint16_t minuteOfDay = now.hour * 60 + now.min;
+    uint32_t minutes = minutesUntilNextWake(rtcState.schedule, rtcState.scheduleCount, baseInterval, minuteOfDay);
+    minutes = min(minutes, (uint32_t)MINUTES_PER_DAY - 1); // Daily RTC alarm must not match the current minute
+    uint32_t seconds = minutes * 60 - now.sec; // Align to the minute boundary
+    if (seconds < 60) seconds = 60;
+
+    LOG_I("Schedule: now %02d:%02d, next wake in %lu min (%s)\n", now.hour, now.min, minutes,
+          scheduleIntervalAt(rtcState.schedule, rtcState.scheduleCount, baseInterval, minuteOfDay) == 0
+              ? "quiet hours" : "active");
+    return seconds;
+}
 
-                M5.TP.update();
-                tp_finger_t finger = M5.TP.readFinger(0);
+// ========================================
+// v2.1: UI Framework for Setup Screens
+// ========================================
 
-                unsigned long touchDuration = millis() - rangesTouchStartTime;
-                int16_t deltaX = finger.x - rangesTouchStartX;
-                int16_t deltaY = finger.y - rangesTouchStartY;
+// UI Constants
+const int UI_TEXT_SIZE = 2;            // Font size for UI (bitmap font, 2 = 16px height)
+const int UI_LINE_HEIGHT = 40;         // Spacing between lines
+const int UI_TOP_MARGIN = 80;          // Top margin for first item
+const int UI_CHECKBOX_SIZE = 20;       // Size of checkbox/radio button
+const int UI_INDENT = 60;              // Indent for checkboxes
+const int UI_MAX_TEXT_WIDTH = 380;     // Max text width (540 - 100 left - 60 right = 380px)
 
-                if (touchDuration < 800 && abs(deltaX) < TAP_MAX_MOVEMENT && abs(deltaY) < TAP_MAX_MOVEMENT) {
-                    int tappedItem = getMenuItemAtTouch(rangesTouchStartY, items);
+// Menu item types
+enum MenuItemType {
+    MENU_CONFIRM,      // Confirm button
+    MENU_LABEL,        // Non-selectable label (e.g., "Refresh timer", "Select/Deselect all")
+    MENU_RADIO,        // Radio button (interval selection)
+    MENU_CHECKBOX,     // Checkbox (font selection)
+    MENU_SEPARATOR,    // 30px empty space
+    MENU_PAGE_NAV      // "…" for page navigation
+};
 
-                    if (tappedItem >= 0 && tappedItem < items.size()) {
-                        MenuItem& tappedMenuItem = items[tappedItem];
-                        if (tappedMenuItem.type == MENU_SEPARATOR ||
-                            (tappedMenuItem.type == MENU_LABEL && tappedMenuItem.fontIndex != -2)) {
-                            continue;
-                        }
+const size_t LABEL_TEXT_MAX = 96; // Font names / labels (longer names are cut before measuring)
 
-                        cursorIndex = tappedItem;
-                        MenuItem& currentItem = items[cursorIndex];
+// Menu item structure
+struct MenuItem {
+    MenuItemType type;
+    const char* label;    // Static text (literal or glyph range name); nullptr for fonts
+    char displayLabel[LABEL_TEXT_MAX];  // Pre-computed truncated font label (empty = use label)
+    bool selected;     // For radio/checkbox
+    int value;         // For radio (5, 10, 15) or page navigation
+    int fontIndex;     // For font checkboxes (-1 for non-font items)
+};
 
-                        if (currentItem.type == MENU_CONFIRM) {
-                            config.rangeEnabled = rangeEnabledLocal;
-                            exitRangesScreen = true;
+// Pagination state
+struct PaginationState {
+    int currentPage;
+    int totalPages;
+    int fontsPerPage;
+};
 
-                        } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
-                            bool newState = !currentItem.selected;
-                            for (size_t i = 0; i < rangeEnabledLocal.size(); i++) {
-                                rangeEnabledLocal[i] = newState;
-                            }
-                            for (auto& item : items) {
-                                if (item.type == MENU_CHECKBOX) {
-                                    item.selected = newState;
-                                } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                                    item.selected = newState;
-                                }
-                            }
-                            renderUnifiedSetupScreen(items, cursorIndex, false);
+// UI Helper: Shorten text if it exceeds max width, keeping equal chars before/after "..."
+// Writes into a caller buffer (no heap allocation, candidates are built in place).
+// NOTE: This function uses bitmap font for measurement (FreeType fonts return textWidth=0)
+void shortenTextInto(const char* text, int maxWidth, int textSize, char* out, size_t outSize) {
+    TRACE_SCOPE("shortenTextInto");
+    // IMPORTANT: Unload FreeType font and use bitmap font for measurement
+    // FreeType canvas.textWidth() returns 0 because it's configured for glyph rendering, not labels
+    canvas.unloadFont();
+    canvas.setFreeFont(NULL);
+    canvas.setTextFont(1); // Font 1 = bitmap font
+    canvas.setTextSize(textSize);
 
-                        } else if (currentItem.type == MENU_CHECKBOX) {
-                            int rangeIndex = currentItem.fontIndex;
-                            rangeEnabledLocal[rangeIndex] = !rangeEnabledLocal[rangeIndex];
-                            currentItem.selected = rangeEnabledLocal[rangeIndex];
+    strlcpy(out, text, outSize);
+    int textWidth = canvas.textWidth(out);
 
-                            bool allSelected = true;
-                            for (bool enabled : rangeEnabledLocal) {
-                                if (!enabled) {
-                                    allSelected = false;
-                                    break;
-                                }
-                            }
-                            for (auto& item : items) {
-                                if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                                    item.selected = allSelected;
-                                    break;
-                                }
-                            }
-                            renderUnifiedSetupScreen(items, cursorIndex, false);
+    LOG_D("shortenTextInto: text='%s' textWidth=%d maxWidth=%d textSize=%d\n",
+          out, textWidth, maxWidth, textSize);
 
-                        } else if (currentItem.type == MENU_PAGE_NAV) {
-                            if (currentItem.value == -1) {
-                                currentPage--;
-                            } else {
-                                currentPage++;
-                            }
-                            rebuildMenu();
-                            cursorIndex = 3;
-                            if (currentPage > 0) {
-                                cursorIndex = 4;
-                            }
-                            renderUnifiedSetupScreen(items, cursorIndex, false);
-                        }
+    // If text fits, return as-is (textSize already set correctly)
+    if (textWidth <= maxWidth) {
+        LOG_D("  -> Text fits, no truncation needed\n");
+        return;
+    }
 
-                        delay(200);
-                    }
-                }
-            }
+    LOG_D("  -> Text too long, truncating...\n");
+
+    // Calculate how many characters to keep on each side (bounded by the output buffer)
+    int textLen = strlen(text);
+    int maxCharsPerSide = min(textLen / 2, (int)(outSize - 4) / 2);
+
+    for (int chars = maxCharsPerSide; chars >= 1; chars--) {
+        // Build shortened string in place: first N chars + "..." + last N chars
+        snprintf(out, outSize, "%.*s...%s", chars, text, text + textLen - chars);
+        if (canvas.textWidth(out) <= maxWidth) {
+            return; // textSize already set correctly
         }
     }
 
-    Serial.println("=== Unicode Ranges Configuration Complete ===\n");
+    // Fallback: just show "..." if even 1 char per side is too long
+    strlcpy(out, "...", outSize); // textSize already set correctly
 }
 
-// Unified setup screen - combines interval and font selection
-void setupScreenUnified() {
-    Serial.println("\n=== Unified Setup Screen ===");
+// Text a menu item shows: its font label, or its static label
+const char* menuItemText(const MenuItem& item) {
+    return item.displayLabel[0] != '\0' ? item.displayLabel : item.label;
+}
 
-    // Initialize state
-    // Default interval depends on debug mode
-    int selectedInterval = rtcState.debugMode ? 1 : 15; // Debug: 1 min, Normal: 15 min
-    std::vector<bool> fontEnabledLocal = config.fontEnabled; // All fonts enabled by default
-    bool allowDifferentFontLocal = config.allowDifferentFont;
-    bool allowDifferentModeLocal = config.allowDifferentMode;
+// UI Helper: Draw checkbox as ASCII ( ) or (*)
+void drawCheckbox(int x, int y, bool checked) {
+    canvas.setTextDatum(CL_DATUM);
+    if (checked) {
+        canvas.drawString("(*)", x, y + UI_LINE_HEIGHT/2);
+    } else {
+        canvas.drawString("( )", x, y + UI_LINE_HEIGHT/2);
+    }
+}
 
-    PaginationState pagination = {0, 1, 4}; // page 0, will calculate totalPages
-    std::vector<MenuItem> items;
+// UI Helper: Draw radio button as ASCII ( ) or (*)
+void drawRadioButton(int x, int y, bool selected) {
+    canvas.setTextDatum(CL_DATUM);
+    if (selected) {
+        canvas.drawString("(*)", x, y + UI_LINE_HEIGHT/2);
+    } else {
+        canvas.drawString("( )", x, y + UI_LINE_HEIGHT/2);
+    }
+}
 
-    // Build initial menu
-    buildUnifiedMenu(items, pagination, selectedInterval, fontEnabledLocal, allowDifferentFontLocal, allowDifferentModeLocal);
+// UI Helper: Draw menu item
+void drawMenuItem(int y, MenuItem& item, bool isCursor) {
+    int textX = 270; // Center X for text
+    int checkboxX = UI_INDENT; // Left margin for checkboxes
 
-    int cursorIndex = 0; // Start at "Confirm"
+    // Draw cursor indicator ">" for selected item
+    if (isCursor) {
+        canvas.setTextDatum(CL_DATUM);
+        canvas.drawString(">", 20, y + UI_LINE_HEIGHT/2);
+    }
 
-    // Initial render with full refresh
-    renderUnifiedSetupScreen(items, cursorIndex, true);
+    // Draw based on item type
+    switch (item.type) {
+        case MENU_CONFIRM:
+            // Draw invisible (*) for alignment, then "Confirm" button
+            canvas.setTextColor(0); // White (invisible)
+            canvas.setTextDatum(CL_DATUM);
+            canvas.drawString("(*)", checkboxX, y + UI_LINE_HEIGHT/2);
+            canvas.setTextColor(15); // Back to black
+            canvas.drawString(item.label, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
+            break;
 
-    // v3.0: Enable touch for setup navigation
-    enableTouch();
+        case MENU_LABEL:
+            // Draw invisible (*) for alignment, then label text
+            canvas.setTextColor(0); // White (invisible)
+            canvas.setTextDatum(CL_DATUM);
+            canvas.drawString("(*)", checkboxX, y + UI_LINE_HEIGHT/2);
+            canvas.setTextColor(15); // Back to black
+            canvas.drawString(item.label, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
+            break;
 
-    // Touch state for setup menu
-    bool setupTouchWasPressed = false;
-    bool setupTouchStartValid = false;
-    int16_t setupTouchStartX = 0;
-    int16_t setupTouchStartY = 0;
-    unsigned long setupTouchStartTime = 0;
+        case MENU_RADIO:
+            // Draw radio button + label with space
+            drawRadioButton(checkboxX, y, item.selected);
+            canvas.setTextDatum(CL_DATUM);
+            canvas.drawString(item.label, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
+            break;
 
-    // Auto-confirm timeout: 60 seconds of inactivity
-    unsigned long lastActivityTime = millis();
-    const unsigned long AUTO_CONFIRM_TIMEOUT = 60000; // 60 seconds
+        case MENU_CHECKBOX: {
+            // Draw checkbox + label with space
+            drawCheckbox(checkboxX, y, item.selected);
+            canvas.setTextDatum(CL_DATUM);
+            // Use pre-computed displayLabel if available, otherwise use label
+            canvas.drawString(menuItemText(item), checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
+            break;
+        }
 
-    // Navigation loop
-    bool confirmed = false;
-    while (!confirmed) {
-        M5.update();
+        case MENU_SEPARATOR:
+            // Empty space (30px height) - nothing to draw
+            break;
 
-        // Check for auto-confirm timeout (60 seconds without button press)
-        if (millis() - lastActivityTime >= AUTO_CONFIRM_TIMEOUT) {
-            Serial.println("Auto-confirm: 60 seconds timeout - proceeding with current settings");
-            confirmed = true;
+        case MENU_PAGE_NAV:
+            // Draw "<<<" or ">>>" aligned left like fonts (with invisible marker for alignment)
+            canvas.setTextColor(0); // White (invisible)
+            canvas.setTextDatum(CL_DATUM);
+            canvas.drawString("(*)", checkboxX, y + UI_LINE_HEIGHT/2);
+            canvas.setTextColor(15); // Back to black
+            // item.value: -1 = previous page (<<<), 1 = next page (>>>)
+            const char* navSymbol = (item.value == -1) ? "<<<" : ">>>";
+            canvas.drawString(navSymbol, checkboxX + 40, y + UI_LINE_HEIGHT/2); // +40 for "(*) " + space
+            break;
+    }
+}
 
-            // Apply fallback if no fonts selected
-            bool anyFontSelected = false;
-            for (bool enabled : fontEnabledLocal) {
-                if (enabled) {
-                    anyFontSelected = true;
-                    break;
-                }
-            }
-            if (!anyFontSelected) {
-                Serial.println("No fonts selected - enabling all fonts as fallback");
-                for (size_t i = 0; i < fontEnabledLocal.size(); i++) {
-                    fontEnabledLocal[i] = true;
-                }
-            }
+// UI Helper: Reset menu refresh counters (call before first menu screen)
+void resetMenuRefresh() {
+    // Force a full refresh on next render by triggering the condition
+    // This is done by making static variables accessible via a reset function
+    // We'll handle this inline in the render function with a static firstRun flag
+}
 
-            config.wakeIntervalMinutes = selectedInterval;
-            config.fontEnabled = fontEnabledLocal;
-            break; // Exit loop
-        }
+// UI Helper: Render full menu screen with smart refresh
+void renderMenuScreen(const String& title, std::vector<MenuItem>& items, int cursorIndex, int scrollOffset, bool forceFullRefresh = false) {
+    TRACE_SCOPE("renderMenuScreen");
+    // Static variables for smart refresh tracking (menu-specific)
+    static uint8_t menuPartialCount = 0;
+    static unsigned long menuFirstPartialTime = 0;
+    static bool menuHasPartial = false;
 
-        // Button UP (BtnL): Move cursor up
-        if (M5.BtnL.wasPressed()) {
-            lastActivityTime = millis(); // Reset timeout
-            Serial.println("BtnL pressed - moving up");
-            do {
-                cursorIndex--;
-                if (cursorIndex < 0) {
-                    cursorIndex = items.size() - 1; // Wrap to last item
-                }
-                // Skip separators and non-clickable labels (but not "Select/Deselect all" fontIndex=-2 or "Customize Unicode ranges" fontIndex=-5)
-            } while (items[cursorIndex].type == MENU_SEPARATOR ||
-                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2 && items[cursorIndex].fontIndex != -5));
-            renderUnifiedSetupScreen(items, cursorIndex);
-            delay(200);
-        }
+    canvas.fillCanvas(0); // White background
+    canvas.setTextSize(UI_TEXT_SIZE);
+    canvas.setTextColor(15); // Black text
 
-        // Button DOWN (BtnR): Move cursor down
-        if (M5.BtnR.wasPressed()) {
-            lastActivityTime = millis(); // Reset timeout
-            Serial.println("BtnR pressed - moving down");
-            do {
-                cursorIndex++;
-                if (cursorIndex >= items.size()) {
-                    cursorIndex = 0; // Wrap to Confirm
-                }
-                // Skip separators and non-clickable labels (but not "Select/Deselect all" fontIndex=-2 or "Customize Unicode ranges" fontIndex=-5)
-            } while (items[cursorIndex].type == MENU_SEPARATOR ||
-                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2 && items[cursorIndex].fontIndex != -5));
-            renderUnifiedSetupScreen(items, cursorIndex);
-            delay(200);
-        }
+    // Draw title at top (if provided)
+    if (title.length() > 0) {
+        canvas.setTextDatum(TC_DATUM);
+        canvas.drawString(title, 270, 30);
+    }
 
-        // Button CENTER (BtnP): Select/Confirm
-        if (M5.BtnP.wasPressed()) {
-            lastActivityTime = millis(); // Reset timeout
-            MenuItem& currentItem = items[cursorIndex];
+    // Calculate visible items (max items that fit on screen)
+    int maxVisibleItems = 8; // Conservative estimate for 540x960 screen
+    int startIdx = scrollOffset;
+    int endIdx = min((int)items.size(), scrollOffset + maxVisibleItems);
 
-            if (currentItem.type == MENU_CONFIRM) {
-                // Confirm pressed - check if at least one font is selected
-                bool anyFontSelected = false;
-                for (bool enabled : fontEnabledLocal) {
-                    if (enabled) {
-                        anyFontSelected = true;
-                        break;
-                    }
-                }
+    // Draw visible items
+    for (int i = startIdx; i < endIdx; i++) {
+        int relativeIdx = i - scrollOffset;
+        int y = UI_TOP_MARGIN + relativeIdx * UI_LINE_HEIGHT;
+        bool isCursor = (i == cursorIndex);
+        drawMenuItem(y, items[i], isCursor);
+    }
 
-                // Fallback: if no fonts selected, select all
-                if (!anyFontSelected) {
-                    Serial.println("No fonts selected - enabling all fonts as fallback");
-                    for (size_t i = 0; i < fontEnabledLocal.size(); i++) {
-                        fontEnabledLocal[i] = true;
-                    }
-                }
+    // Smart refresh logic (same as main program)
+    if (forceFullRefresh) {
+        // Force full refresh (e.g., first screen after boot)
+        pushFrame(UPDATE_MODE_GC16);
+        menuPartialCount = 0;
+        menuHasPartial = false;
+        LOG_D("Menu forced full refresh\n");
+    } else {
+        // Normal partial refresh
+        pushFrame(UPDATE_MODE_GL16);
 
-                // Save and exit
-                confirmed = true;
-                config.wakeIntervalMinutes = selectedInterval;
-                config.fontEnabled = fontEnabledLocal;
-                config.allowDifferentFont = allowDifferentFontLocal;
-                config.allowDifferentMode = allowDifferentModeLocal;
-                Serial.printf("Setup confirmed: %d min, allow font=%s, allow mode=%s, fonts configured\n",
-                             selectedInterval,
-                             config.allowDifferentFont ? "yes" : "no",
-                             config.allowDifferentMode ? "yes" : "no");
+        // Track first partial after full
+        if (!menuHasPartial) {
+            menuFirstPartialTime = millis();
+            menuHasPartial = true;
+        }
 
-            } else if (currentItem.type == MENU_RADIO) {
-                // Radio button: update selected state without rebuilding menu
-                selectedInterval = currentItem.value;
+        menuPartialCount++;
+
+        // Trigger full refresh if:
+        // A) 5 partials reached, OR
+        // B) 10 seconds passed since FIRST partial
+        unsigned long timeSinceFirstPartial = millis() - menuFirstPartialTime;
+        if (menuPartialCount >= 5 ||
+            (menuHasPartial && timeSinceFirstPartial >= 10000)) {
+
+            LOG_D("Menu full refresh (count=%d, time=%lums)\n", menuPartialCount, timeSinceFirstPartial);
+            epdUpdateFull(UPDATE_MODE_GC16);
+
+            // Reset counters
+            menuPartialCount = 0;
+            menuHasPartial = false;
+        }
+    }
+}
+
+// ========================================
+// v2.2: Unicode Range Customization
+// ========================================
+
+// Forward declarations
+void fontDisplayName(const FontCatalogRecord* record, char* out, size_t outSize);
+void fontMenuLabel(const FontCatalogRecord* record, char* out, size_t outSize);
+
+// v3.0: Touch screen forward declarations
+extern bool touchEnabled;
+extern const int16_t TAP_MAX_MOVEMENT;
+void enableTouch();
+int getMenuItemAtTouch(int16_t touchY, const std::vector<MenuItem>& items);
+
+// Build menu items for current page
+void buildUnifiedMenu(std::vector<MenuItem>& items, PaginationState& pagination,
+                      int selectedInterval, bool allowDifferentFont, bool allowDifferentMode) {
+    items.clear();
+
+    // 1. Confirm button (always first)
+    items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+
+    // v2.2: Customize Unicode ranges (navigable button)
+    items.push_back({MENU_LABEL, "Customize Unicode ranges", "", false, 0, -5}); // fontIndex=-5 for Unicode ranges page
+
+    // 2. Separator (30px)
+    items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+
+    // 3. "Refresh timer" label (non-selectable)
+    items.push_back({MENU_LABEL, "Refresh timer", "", false, 0, -1});
+
+    // 4. Radio buttons for intervals (different in debug mode)
+    if (rtcState.debugMode) {
+        // Debug mode: shorter intervals for testing (1, 2, 5 min)
+        items.push_back({MENU_RADIO, "5 min", "", selectedInterval == 5, 5, -1});
+        items.push_back({MENU_RADIO, "2 min", "", selectedInterval == 2, 2, -1});
+        items.push_back({MENU_RADIO, "1 min", "", selectedInterval == 1, 1, -1});
+    } else {
+        // Normal mode: standard intervals (5, 10, 15 min)
+        items.push_back({MENU_RADIO, "15 min", "", selectedInterval == 15, 15, -1});
+        items.push_back({MENU_RADIO, "10 min", "", selectedInterval == 10, 10, -1});
+        items.push_back({MENU_RADIO, "5 min", "", selectedInterval == 5, 5, -1});
+    }
+
+    // 5. Separator (30px)
+    items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+
+    // 6. "When in standby" label (non-selectable)
+    items.push_back({MENU_LABEL, "When in standby", "", false, 0, -1});
+
+    // 7. Checkboxes for standby behavior
+    items.push_back({MENU_CHECKBOX, "Allow different font", "", allowDifferentFont, 0, -3}); // fontIndex=-3 for allowDifferentFont
+    items.push_back({MENU_CHECKBOX, "Allow different mode", "", allowDifferentMode, 0, -4}); // fontIndex=-4 for allowDifferentMode
+
+    // 8. Separator (30px)
+    items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+
+    // 9. Font selection with pagination
+    // Strategy: Always show "Select/Deselect all" on every page
+    // Max 5 total items in font section: Select/Deselect all + up to 5 slots for fonts/dots
+
+    int totalFonts = catalogFontCount(); // v3.1: Pages are read from the font catalog
+
+    // Calculate fonts per page based on position
+    // Page 0: Select/Deselect all + up to 5 fonts (if ≤5 total, show all; otherwise show 4 + ">>>")
+    // Page 1+: Select/Deselect all + "<<<" + 3 fonts (+ ">>>" if more pages)
+
+    int fontsThisPage;
+    int startFont;
+
+    if (pagination.currentPage == 0) {
+        // First page: can show up to 5 fonts if ≤5 total, otherwise 4 + ">>>"
+        if (totalFonts <= 5) {
+            // Show all fonts in one page
+            fontsThisPage = totalFonts;
+            startFont = 0;
+            pagination.totalPages = 1;
+        } else {
+            // Show 4 fonts, reserve space for ">>>"
+            fontsThisPage = 4;
+            startFont = 0;
+            // Calculate total pages: first page 4 fonts, subsequent pages 3 fonts each
+            int remainingFonts = totalFonts - 4;
+            pagination.totalPages = 1 + (remainingFonts + 2) / 3; // Ceiling division
+        }
+    } else {
+        // Subsequent pages: "<<<" at top, then up to 3 fonts
+        startFont = 4 + (pagination.currentPage - 1) * 3;
+        int remainingFonts = totalFonts - startFont;
+        fontsThisPage = min(3, remainingFonts);
+    }
+
+    int endFont = startFont + fontsThisPage;
+
+    // Select/Deselect all (ALWAYS first in font section, on every page)
+    bool allSelected = catalogEnabledCount() == totalFonts;
+    items.push_back({MENU_LABEL, "Select/Deselect all", "", allSelected, 0, -2}); // fontIndex=-2 special, clickable but no marker
+
+    // "..." prev page navigation (if not on first page) - AFTER Select/Deselect all
+    if (pagination.currentPage > 0) {
+        items.push_back({MENU_PAGE_NAV, "...", "", false, -1, -1}); // value=-1 means prev
+    }
+
+    // Font checkboxes for current page - PRE-COMPUTE displayLabel to avoid recalculation on every cursor move
+    for (int i = startFont; i < endFont; i++) {
+        const FontCatalogRecord* record = catalogRecord(i);
+        if (!record) break;
+        bool enabled = record->flags & FONT_FLAG_ENABLED;
+        items.push_back({MENU_CHECKBOX, nullptr, "", enabled, 0, i});
+        fontMenuLabel(record, items.back().displayLabel, LABEL_TEXT_MAX);
+    }
+
+    // "..." next page navigation (if more pages available)
+    if (pagination.currentPage < pagination.totalPages - 1) {
+        items.push_back({MENU_PAGE_NAV, "...", "", false, 1, -1}); // value=1 means next
+    }
+}
+
+// Render unified setup screen with fixed headers/footers
+void renderUnifiedSetupScreen(std::vector<MenuItem>& items, int cursorIndex, bool forceFullRefresh = false) {
+    TRACE_SCOPE("renderUnifiedSetupScreen");
+    static uint8_t menuPartialCount = 0;
+    static unsigned long menuFirstPartialTime = 0;
+    static bool menuHasPartial = false;
+
+    canvas.fillCanvas(0);
+    canvas.setTextSize(UI_TEXT_SIZE);
+    canvas.setTextColor(15);
+
+    // Fixed header: "PaperSpecimen" at Y=30
+    canvas.setTextDatum(TC_DATUM);
+    canvas.drawString("PaperSpecimen", 270, 30);
+
+    // Fixed footer: "v3.0.1" (or "v3.0.1*" in debug mode) at Y=930
+    canvas.setTextDatum(BC_DATUM);
+    canvas.drawString(rtcState.debugMode ? "v3.0.1*" : "v3.0.1", 270, 930);
+
+    // Calculate available space for menu items
+    const int headerBottom = 30 + 24; // Y=30 + text height
+    const int footerTop = 930 - 24;   // Y=930 - text height
+    const int availableHeight = footerTop - headerBottom;
+
+    // Calculate flex space (divide remaining space into 2 equal parts)
+    int totalItemHeight = items.size() * UI_LINE_HEIGHT;
+    int flexSpace = max(0, (availableHeight - totalItemHeight) / 2);
+
+    // Draw menu items starting after header + flex space
+    int startY = headerBottom + flexSpace;
+
+    for (int i = 0; i < items.size(); i++) {
+        int y = startY + i * UI_LINE_HEIGHT;
+        bool isCursor = (i == cursorIndex);
+        drawMenuItem(y, items[i], isCursor);
+    }
+
+    // Smart refresh
+    if (forceFullRefresh) {
+        pushFrame(UPDATE_MODE_GC16);
+        menuPartialCount = 0;
+        menuHasPartial = false;
+    } else {
+        pushFrame(UPDATE_MODE_A2); // Anti-aliased partial refresh
+        if (!menuHasPartial) {
+            menuFirstPartialTime = millis();
+            menuHasPartial = true;
+        }
+        menuPartialCount++;
+        unsigned long timeSinceFirstPartial = millis() - menuFirstPartialTime;
+        if (menuPartialCount >= 5 || (menuHasPartial && timeSinceFirstPartial >= 10000)) {
+            epdUpdateFull(UPDATE_MODE_GC16);
+            menuPartialCount = 0;
+            menuHasPartial = false;
+        }
+    }
+}
+
+// v2.2: Unicode Ranges Configuration Screen
+void setupUnicodeRanges() {
+    LOG_I("\n=== Unicode Ranges Configuration ===\n");
+
+    // Local copy of range flags
+    std::vector<bool> rangeEnabledLocal = config.rangeEnabled;
+
+    // Ensure rangeEnabledLocal has correct size
+    if (rangeEnabledLocal.size() != numGlyphRanges) {
+        rangeEnabledLocal.clear();
+        for (int i = 0; i < numGlyphRanges; i++) {
+            rangeEnabledLocal.push_back(i < 6); // First 6 enabled by default
+        }
+    }
+
+    int cursorIndex = 0;
+    int currentPage = 0;
+    const int rangesPerPage = 14; // 14 ranges per page
+    const int totalPages = (numGlyphRanges + rangesPerPage - 1) / rangesPerPage;
+
+    // Build initial menu
+    std::vector<MenuItem> items;
+
+    auto rebuildMenu = [&]() {
+        items.clear();
+        items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+
+        // Select/Deselect all (clickable label with fontIndex=-2, like in main config)
+        bool allSelected = true;
+        for (bool enabled : rangeEnabledLocal) {
+            if (!enabled) {
+                allSelected = false;
+                break;
+            }
+        }
+        items.push_back({MENU_LABEL, "Select/Deselect all", "", allSelected, 0, -2});
+
+        items.push_back({MENU_SEPARATOR, "", "", false, 0, -1});
+
+        int startRange = currentPage * rangesPerPage;
+        int endRange = min(startRange + rangesPerPage, numGlyphRanges);
+
+        if (currentPage > 0) {
+            items.push_back({MENU_PAGE_NAV, "<<<", "", false, -1, -1});
+        }
+
+        for (int i = startRange; i < endRange; i++) {
+            items.push_back({MENU_CHECKBOX, glyphRanges[i].name, "", rangeEnabledLocal[i], 0, i});
+        }
+
+        if (currentPage < totalPages - 1) {
+            items.push_back({MENU_PAGE_NAV, ">>>", "", false, 1, -1});
+        }
+    };
+
+    rebuildMenu();
+
+    // Initial render with full refresh
+    renderUnifiedSetupScreen(items, cursorIndex, true);
+
+    // v3.0: Touch state for Unicode ranges menu (touch already enabled in setupScreenUnified)
+    bool rangesTouchWasPressed = false;
+    bool rangesTouchStartValid = false;
+    int16_t rangesTouchStartX = 0;
+    int16_t rangesTouchStartY = 0;
+    unsigned long rangesTouchStartTime = 0;
+
+    bool exitRangesScreen = false;
+
+    while (!exitRangesScreen) {
+        // Wait for button press
+        M5.update();
+        spiBusIdle(50); // Font indexing continues while nothing is pressed
+
+        if (M5.BtnL.wasPressed()) {
+            // Move cursor up
+            do {
+                cursorIndex--;
+                if (cursorIndex < 0) cursorIndex = items.size() - 1;
+                // Skip separators and non-clickable labels (except fontIndex=-2 for Select/Deselect all)
+            } while (items[cursorIndex].type == MENU_SEPARATOR ||
+                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2));
+            renderUnifiedSetupScreen(items, cursorIndex, false);
+        }
+
+        if (M5.BtnR.wasPressed()) {
+            // Move cursor down
+            do {
+                cursorIndex++;
+                if (cursorIndex >= items.size()) cursorIndex = 0;
+                // Skip separators and non-clickable labels (except fontIndex=-2 for Select/Deselect all)
+            } while (items[cursorIndex].type == MENU_SEPARATOR ||
+                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2));
+            renderUnifiedSetupScreen(items, cursorIndex, false);
+        }
+
+        if (M5.BtnP.wasPressed()) {
+            MenuItem& currentItem = items[cursorIndex];
+
+            if (currentItem.type == MENU_CONFIRM) {
+                // Save and return to main config
+                config.rangeEnabled = rangeEnabledLocal;
+                LOG_I("Unicode ranges configured\n");
+                exitRangesScreen = true;
+
+            } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
+                // "Select/Deselect all" - update all range checkboxes without rebuilding menu
+                bool newState = !currentItem.selected;
+                for (size_t i = 0; i < rangeEnabledLocal.size(); i++) {
+                    rangeEnabledLocal[i] = newState;
+                }
+                // Update selected state of all range checkboxes AND the Select/Deselect all item itself
+                for (auto& item : items) {
+                    if (item.type == MENU_CHECKBOX) {
+                        item.selected = newState;
+                    } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                        item.selected = newState;
+                    }
+                }
+                LOG_I("Select/Deselect all ranges: %s\n", newState ? "all selected" : "all deselected");
+                renderUnifiedSetupScreen(items, cursorIndex, false);
+
+            } else if (currentItem.type == MENU_CHECKBOX) {
+                // Toggle range - update without rebuilding menu
+                int rangeIndex = currentItem.fontIndex;
+                rangeEnabledLocal[rangeIndex] = !rangeEnabledLocal[rangeIndex];
+                currentItem.selected = rangeEnabledLocal[rangeIndex];
+                LOG_I("Toggled range %d (%s): %s\n",
+                     rangeIndex, glyphRanges[rangeIndex].name,
+                     rangeEnabledLocal[rangeIndex] ? "enabled" : "disabled");
+
+                // Update "Select/Deselect all" state based on whether all ranges are now selected
+                bool allSelected = true;
+                for (bool enabled : rangeEnabledLocal) {
+                    if (!enabled) {
+                        allSelected = false;
+                        break;
+                    }
+                }
+                for (auto& item : items) {
+                    if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                        item.selected = allSelected;
+                        break;
+                    }
+                }
+                renderUnifiedSetupScreen(items, cursorIndex, false);
+
+            } else if (currentItem.type == MENU_PAGE_NAV) {
+                // Page navigation
+                if (currentItem.value == -1) {
+                    // Previous page
+                    currentPage--;
+                } else {
+                    // Next page
+                    currentPage++;
+                }
+                rebuildMenu();
+
+                // Position cursor on first range checkbox
+                // Structure: Confirm(0), Select/Deselect(1), Sep(2), [<<<(3)], ranges...
+                cursorIndex = 3; // Start at separator + 1
+                if (currentPage > 0) {
+                    cursorIndex = 4; // Skip "<<<" navigation item
+                }
+
+                renderUnifiedSetupScreen(items, cursorIndex, false);
+            }
+
+            spiBusIdle(200);
+        }
+
+        // v3.0: Touch screen navigation (same logic as main setup)
+        if (touchEnabled && M5.TP.available()) {
+            if (!M5.TP.isFingerUp()) {
+                M5.TP.update();
+                tp_finger_t finger = M5.TP.readFinger(0);
+
+                if (!rangesTouchWasPressed) {
+                    rangesTouchWasPressed = true;
+                    rangesTouchStartTime = millis();
+                    rangesTouchStartValid = false;
+
+                    if (finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
+                        rangesTouchStartX = finger.x;
+                        rangesTouchStartY = finger.y;
+                        rangesTouchStartValid = true;
+                    }
+                } else {
+                    if (!rangesTouchStartValid && finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
+                        rangesTouchStartX = finger.x;
+                        rangesTouchStartY = finger.y;
+                        rangesTouchStartValid = true;
+                    }
+                }
+            } else if (rangesTouchWasPressed) {
+                rangesTouchWasPressed = false;
+
+                if (!rangesTouchStartValid) {
+                    continue;
+                }
+
+                M5.TP.update();
+                tp_finger_t finger = M5.TP.readFinger(0);
+
+                unsigned long touchDuration = millis() - rangesTouchStartTime;
+                int16_t deltaX = finger.x - rangesTouchStartX;
+                int16_t deltaY = finger.y - rangesTouchStartY;
+
+                if (touchDuration < 800 && abs(deltaX) < TAP_MAX_MOVEMENT && abs(deltaY) < TAP_MAX_MOVEMENT) {
+                    int tappedItem = getMenuItemAtTouch(rangesTouchStartY, items);
+
+                    if (tappedItem >= 0 && tappedItem < items.size()) {
+                        MenuItem& tappedMenuItem = items[tappedItem];
+                        if (tappedMenuItem.type == MENU_SEPARATOR ||
+                            (tappedMenuItem.type == MENU_LABEL && tappedMenuItem.fontIndex != -2)) {
+                            continue;
+                        }
+
+                        cursorIndex = tappedItem;
+                        MenuItem& currentItem = items[cursorIndex];
+
+                        if (currentItem.type == MENU_CONFIRM) {
+                            config.rangeEnabled = rangeEnabledLocal;
+                            exitRangesScreen = true;
+
+                        } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
+                            bool newState = !currentItem.selected;
+                            for (size_t i = 0; i < rangeEnabledLocal.size(); i++) {
+                                rangeEnabledLocal[i] = newState;
+                            }
+                            for (auto& item : items) {
+                                if (item.type == MENU_CHECKBOX) {
+                                    item.selected = newState;
+                                } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                                    item.selected = newState;
+                                }
+                            }
+                            renderUnifiedSetupScreen(items, cursorIndex, false);
+
+                        } else if (currentItem.type == MENU_CHECKBOX) {
+                            int rangeIndex = currentItem.fontIndex;
+                            rangeEnabledLocal[rangeIndex] = !rangeEnabledLocal[rangeIndex];
+                            currentItem.selected = rangeEnabledLocal[rangeIndex];
+
+                            bool allSelected = true;
+                            for (bool enabled : rangeEnabledLocal) {
+                                if (!enabled) {
+                                    allSelected = false;
+                                    break;
+                                }
+                            }
+                            for (auto& item : items) {
+                                if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                                    item.selected = allSelected;
+                                    break;
+                                }
+                            }
+                            renderUnifiedSetupScreen(items, cursorIndex, false);
+
+                        } else if (currentItem.type == MENU_PAGE_NAV) {
+                            if (currentItem.value == -1) {
+                                currentPage--;
+                            } else {
+                                currentPage++;
+                            }
+                            rebuildMenu();
+                            cursorIndex = 3;
+                            if (currentPage > 0) {
+                                cursorIndex = 4;
+                            }
+                            renderUnifiedSetupScreen(items, cursorIndex, false);
+                        }
+
+                        spiBusIdle(200);
+                    }
+                }
+            }
+        }
+    }
+
+    LOG_I("=== Unicode Ranges Configuration Complete ===\n\n");
+}
+
+// Unified setup screen - combines interval and font selection
+void setupScreenUnified() {
+    LOG_I("\n=== Unified Setup Screen ===\n");
+
+    // Initialize state
+    // Default interval depends on debug mode
+    int selectedInterval = rtcState.debugMode ? 1 : 15; // Debug: 1 min, Normal: 15 min
+    // v3.1: Font checkboxes write straight to the font catalog
+    bool allowDifferentFontLocal = config.allowDifferentFont;
+    bool allowDifferentModeLocal = config.allowDifferentMode;
+
+    PaginationState pagination = {0, 1, 4}; // page 0, will calculate totalPages
+    std::vector<MenuItem> items;
+
+    // Build initial menu
+    buildUnifiedMenu(items, pagination, selectedInterval, allowDifferentFontLocal, allowDifferentModeLocal);
+
+    int cursorIndex = 0; // Start at "Confirm"
+
+    // Initial render with full refresh
+    renderUnifiedSetupScreen(items, cursorIndex, true);
+
+    // v3.0: Enable touch for setup navigation
+    enableTouch();
+
+    // Touch state for setup menu
+    bool setupTouchWasPressed = false;
+    bool setupTouchStartValid = false;
+    int16_t setupTouchStartX = 0;
+    int16_t setupTouchStartY = 0;
+    unsigned long setupTouchStartTime = 0;
+
+    // Auto-confirm timeout: 60 seconds of inactivity
+    unsigned long lastActivityTime = millis();
+    const unsigned long AUTO_CONFIRM_TIMEOUT = 60000; // 60 seconds
+
+    // Navigation loop
+    bool confirmed = false;
+    while (!confirmed) {
+        M5.update();
+
+        // Check for auto-confirm timeout (60 seconds without button press)
+        if (millis() - lastActivityTime >= AUTO_CONFIRM_TIMEOUT) {
+            LOG_I("Auto-confirm: 60 seconds timeout - proceeding with current settings\n");
+            confirmed = true;
+
+            // Apply fallback if no fonts selected
+            if (catalogEnabledCount() == 0) {
+                LOG_I("No fonts selected - enabling all fonts as fallback\n");
+                setAllFontsEnabled(true);
+            }
+
+            config.wakeIntervalMinutes = selectedInterval;
+            break; // Exit loop
+        }
+
+        // Button UP (BtnL): Move cursor up
+        if (M5.BtnL.wasPressed()) {
+            lastActivityTime = millis(); // Reset timeout
+            LOG_I("BtnL pressed - moving up\n");
+            do {
+                cursorIndex--;
+                if (cursorIndex < 0) {
+                    cursorIndex = items.size() - 1; // Wrap to last item
+                }
+                // Skip separators and non-clickable labels (but not "Select/Deselect all" fontIndex=-2 or "Customize Unicode ranges" fontIndex=-5)
+            } while (items[cursorIndex].type == MENU_SEPARATOR ||
+                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2 && items[cursorIndex].fontIndex != -5));
+            renderUnifiedSetupScreen(items, cursorIndex);
+            spiBusIdle(200);
+        }
+
+        // Button DOWN (BtnR): Move cursor down
+        if (M5.BtnR.wasPressed()) {
+            lastActivityTime = millis(); // Reset timeout
+            LOG_I("BtnR pressed - moving down\n");
+            do {
+                cursorIndex++;
+                if (cursorIndex >= items.size()) {
+                    cursorIndex = 0; // Wrap to Confirm
+                }
+                // Skip separators and non-clickable labels (but not "Select/Deselect all" fontIndex=-2 or "Customize Unicode ranges" fontIndex=-5)
+            } while (items[cursorIndex].type == MENU_SEPARATOR ||
+                     (items[cursorIndex].type == MENU_LABEL && items[cursorIndex].fontIndex != -2 && items[cursorIndex].fontIndex != -5));
+            renderUnifiedSetupScreen(items, cursorIndex);
+            spiBusIdle(200);
+        }
+
+        // Button CENTER (BtnP): Select/Confirm
+        if (M5.BtnP.wasPressed()) {
+            lastActivityTime = millis(); // Reset timeout
+            MenuItem& currentItem = items[cursorIndex];
+
+            if (currentItem.type == MENU_CONFIRM) {
+                // Confirm pressed - check if at least one font is selected
+                // Fallback: if no fonts selected, select all
+                if (catalogEnabledCount() == 0) {
+                    LOG_I("No fonts selected - enabling all fonts as fallback\n");
+                    setAllFontsEnabled(true);
+                }
+
+                // Save and exit
+                confirmed = true;
+                config.wakeIntervalMinutes = selectedInterval;
+                config.allowDifferentFont = allowDifferentFontLocal;
+                config.allowDifferentMode = allowDifferentModeLocal;
+                LOG_I("Setup confirmed: %d min, allow font=%s, allow mode=%s, fonts configured\n",
+                     selectedInterval,
+                     config.allowDifferentFont ? "yes" : "no",
+                     config.allowDifferentMode ? "yes" : "no");
+
+            } else if (currentItem.type == MENU_RADIO) {
+                // Radio button: update selected state without rebuilding menu
+                selectedInterval = currentItem.value;
                 // Update only the selected field of radio buttons
                 for (auto& item : items) {
                     if (item.type == MENU_RADIO) {
                         item.selected = (item.value == selectedInterval);
                     }
                 }
-                Serial.printf("Selected interval: %d min\n", selectedInterval);
-                renderUnifiedSetupScreen(items, cursorIndex);
-
-            } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -5) {
-                // v2.2: "Customize Unicode ranges" - open Unicode ranges configuration
-                Serial.println("Opening Unicode ranges configuration...");
-                setupUnicodeRanges();
-                // Return to main config, rebuild menu
-                buildUnifiedMenu(items, pagination, selectedInterval, fontEnabledLocal, allowDifferentFontLocal, allowDifferentModeLocal);
-                renderUnifiedSetupScreen(items, cursorIndex, true);
-                lastActivityTime = millis(); // Reset timeout
+                LOG_I("Selected interval: %d min\n", selectedInterval);
+                renderUnifiedSetupScreen(items, cursorIndex);
+
+            } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -5) {
+                // v2.2: "Customize Unicode ranges" - open Unicode ranges configuration
+                LOG_I("Opening Unicode ranges configuration...\n");
+                setupUnicodeRanges();
+                // Return to main config, rebuild menu
+                buildUnifiedMenu(items, pagination, selectedInterval, allowDifferentFontLocal, allowDifferentModeLocal);
+                renderUnifiedSetupScreen(items, cursorIndex, true);
+                lastActivityTime = millis(); // Reset timeout
+
+            } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
+                // "Select/Deselect all" - update all font checkboxes without rebuilding menu
+                bool newState = !currentItem.selected;
+                setAllFontsEnabled(newState);
+                // Update selected state of all font checkboxes AND the Select/Deselect all item itself
+                for (auto& item : items) {
+                    if (item.type == MENU_CHECKBOX && item.fontIndex >= 0) {
+                        item.selected = newState;
+                    } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                        item.selected = newState;
+                    }
+                }
+                LOG_I("Select/Deselect all: %s\n", newState ? "all selected" : "all deselected");
+                renderUnifiedSetupScreen(items, cursorIndex);
+
+            } else if (currentItem.type == MENU_CHECKBOX) {
+                if (currentItem.fontIndex == -2) {
+                    // "Select/Deselect all" special checkbox (deprecated, now using MENU_LABEL)
+                    bool newState = !currentItem.selected;
+                    setAllFontsEnabled(newState);
+                    LOG_I("Select/Deselect all: %s\n", newState ? "all selected" : "all deselected");
+                } else if (currentItem.fontIndex == -3) {
+                    // "Allow different font" checkbox - toggle without rebuilding menu
+                    allowDifferentFontLocal = !allowDifferentFontLocal;
+                    currentItem.selected = allowDifferentFontLocal;
+                    LOG_I("Toggled allow different font: %s\n", allowDifferentFontLocal ? "yes" : "no");
+                } else if (currentItem.fontIndex == -4) {
+                    // "Allow different mode" checkbox - toggle without rebuilding menu
+                    allowDifferentModeLocal = !allowDifferentModeLocal;
+                    currentItem.selected = allowDifferentModeLocal;
+                    LOG_I("Toggled allow different mode: %s\n", allowDifferentModeLocal ? "yes" : "no");
+                } else if (currentItem.fontIndex >= 0) {
+                    // Individual font checkbox - toggle without rebuilding menu
+                    setFontEnabled(currentItem.fontIndex, !currentItem.selected);
+                    currentItem.selected = fontEnabledAt(currentItem.fontIndex);
+                    LOG_I("Toggled font %d: %s\n", currentItem.fontIndex,
+                         currentItem.selected ? "enabled" : "disabled");
+
+                    // Update "Select/Deselect all" state based on whether all fonts are now selected
+                    bool allSelected = catalogEnabledCount() == catalogFontCount();
+                    for (auto& item : items) {
+                        if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                            item.selected = allSelected;
+                            break;
+                        }
+                    }
+                }
+                renderUnifiedSetupScreen(items, cursorIndex);
+
+            } else if (currentItem.type == MENU_PAGE_NAV) {
+                // Page navigation "..."
+                if (currentItem.value == -1) {
+                    // Previous page
+                    pagination.currentPage--;
+                } else {
+                    // Next page
+                    pagination.currentPage++;
+                }
+                buildUnifiedMenu(items, pagination, selectedInterval, allowDifferentFontLocal, allowDifferentModeLocal);
+
+                // Position cursor on first item AFTER "Select/Deselect all" in font section
+                // Items: Confirm(0), Sep, Refresh, 15min, 10min, 5min, Sep, When, AllowFont, AllowMode, Sep, Select/Deselect(11), ...
+                // So first item after Select/Deselect is always at index 12
+                cursorIndex = 12;
+
+                LOG_I("Page navigation: now on page %d/%d, cursor at item %d\n", pagination.currentPage + 1, pagination.totalPages, cursorIndex);
+                renderUnifiedSetupScreen(items, cursorIndex);
+            }
+
+            spiBusIdle(200);
+        }
+
+        // v3.0: Touch screen navigation
+        if (touchEnabled && M5.TP.available()) {
+            if (!M5.TP.isFingerUp()) {
+                M5.TP.update();
+                tp_finger_t finger = M5.TP.readFinger(0);
+
+                if (!setupTouchWasPressed) {
+                    // Touch started
+                    setupTouchWasPressed = true;
+                    setupTouchStartTime = millis();
+                    setupTouchStartValid = false;
+
+                    if (finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
+                        setupTouchStartX = finger.x;
+                        setupTouchStartY = finger.y;
+                        setupTouchStartValid = true;
+                    }
+                } else {
+                    // Touch held - update coordinates if not valid yet
+                    if (!setupTouchStartValid && finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
+                        setupTouchStartX = finger.x;
+                        setupTouchStartY = finger.y;
+                        setupTouchStartValid = true;
+                    }
+                }
+            } else if (setupTouchWasPressed) {
+                // Touch released - process tap
+                setupTouchWasPressed = false;
 
-            } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
-                // "Select/Deselect all" - update all font checkboxes without rebuilding menu
-                bool newState = !currentItem.selected;
-                for (size_t i = 0; i < fontEnabledLocal.size(); i++) {
-                    fontEnabledLocal[i] = newState;
+                if (!setupTouchStartValid) {
+                    continue; // No valid coordinates
                 }
-                // Update selected state of all font checkboxes AND the Select/Deselect all item itself
-                for (auto& item : items) {
-                    if (item.type == MENU_CHECKBOX && item.fontIndex >= 0) {
-                        item.selected = newState;
-                    } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                        item.selected = newState;
+
+                M5.TP.update();
+                tp_finger_t finger = M5.TP.readFinger(0);
+
+                unsigned long touchDuration = millis() - setupTouchStartTime;
+                int16_t deltaX = finger.x - setupTouchStartX;
+                int16_t deltaY = finger.y - setupTouchStartY;
+
+                // Check for tap (short duration, minimal movement)
+                if (touchDuration < 800 && abs(deltaX) < TAP_MAX_MOVEMENT && abs(deltaY) < TAP_MAX_MOVEMENT) {
+                    lastActivityTime = millis(); // Reset timeout
+
+                    // Find which menu item was tapped
+                    int tappedItem = getMenuItemAtTouch(setupTouchStartY, items);
+
+                    if (tappedItem >= 0 && tappedItem < items.size()) {
+                        // Skip if tapped item is separator or non-clickable label
+                        MenuItem& tappedMenuItem = items[tappedItem];
+                        if (tappedMenuItem.type == MENU_SEPARATOR ||
+                            (tappedMenuItem.type == MENU_LABEL && tappedMenuItem.fontIndex != -2 && tappedMenuItem.fontIndex != -5)) {
+                            LOG_I("Touch tap ignored: separator or non-clickable label at index %d\n", tappedItem);
+                            continue;
+                        }
+
+                        // Move cursor to tapped item and execute action
+                        cursorIndex = tappedItem;
+                        LOG_I("Touch tap: item %d selected\n", tappedItem);
+
+                        // Execute the same action as BtnP would (duplicate logic from above)
+                        MenuItem& currentItem = items[cursorIndex];
+
+                        if (currentItem.type == MENU_CONFIRM) {
+                            // Same as button confirm logic
+                            if (catalogEnabledCount() == 0) {
+                                setAllFontsEnabled(true);
+                            }
+                            confirmed = true;
+                            config.wakeIntervalMinutes = selectedInterval;
+                            config.allowDifferentFont = allowDifferentFontLocal;
+                            config.allowDifferentMode = allowDifferentModeLocal;
+
+                        } else if (currentItem.type == MENU_RADIO) {
+                            selectedInterval = currentItem.value;
+                            for (auto& item : items) {
+                                if (item.type == MENU_RADIO) {
+                                    item.selected = (item.value == selectedInterval);
+                                }
+                            }
+                            renderUnifiedSetupScreen(items, cursorIndex);
+
+                        } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -5) {
+                            setupUnicodeRanges();
+                            buildUnifiedMenu(items, pagination, selectedInterval, allowDifferentFontLocal, allowDifferentModeLocal);
+                            renderUnifiedSetupScreen(items, cursorIndex, true);
+                            lastActivityTime = millis();
+
+                        } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
+                            bool newState = !currentItem.selected;
+                            setAllFontsEnabled(newState);
+                            for (auto& item : items) {
+                                if (item.type == MENU_CHECKBOX && item.fontIndex >= 0) {
+                                    item.selected = newState;
+                                } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                                    item.selected = newState;
+                                }
+                            }
+                            renderUnifiedSetupScreen(items, cursorIndex);
+
+                        } else if (currentItem.type == MENU_CHECKBOX) {
+                            if (currentItem.fontIndex == -3) {
+                                allowDifferentFontLocal = !allowDifferentFontLocal;
+                                currentItem.selected = allowDifferentFontLocal;
+                            } else if (currentItem.fontIndex == -4) {
+                                allowDifferentModeLocal = !allowDifferentModeLocal;
+                                currentItem.selected = allowDifferentModeLocal;
+                            } else if (currentItem.fontIndex >= 0) {
+                                setFontEnabled(currentItem.fontIndex, !currentItem.selected);
+                                currentItem.selected = fontEnabledAt(currentItem.fontIndex);
+
+                                bool allSelected = catalogEnabledCount() == catalogFontCount();
+                                for (auto& item : items) {
+                                    if (item.type == MENU_LABEL && item.fontIndex == -2) {
+                                        item.selected = allSelected;
+                                        break;
+                                    }
+                                }
+                            }
+                            renderUnifiedSetupScreen(items, cursorIndex);
+
+                        } else if (currentItem.type == MENU_PAGE_NAV) {
+                            if (currentItem.value == -1) {
+                                pagination.currentPage--;
+                            } else {
+                                pagination.currentPage++;
+                            }
+                            buildUnifiedMenu(items, pagination, selectedInterval, allowDifferentFontLocal, allowDifferentModeLocal);
+                            cursorIndex = 12;
+                            renderUnifiedSetupScreen(items, cursorIndex);
+                        }
+
+                        spiBusIdle(200);
                     }
                 }
-                Serial.printf("Select/Deselect all: %s\n", newState ? "all selected" : "all deselected");
-                renderUnifiedSetupScreen(items, cursorIndex);
+            }
+        }
+
+        spiBusIdle(50); // Font indexing continues while nothing is pressed
+    }
+
+    LOG_I("=== Unified Setup Complete ===\n\n");
+}
+
+// ========================================
+// v2.1: Setup Screen - Interval Selection (OLD - DEPRECATED)
+// ========================================
+
+// Interactive interval selection screen
+// Returns: selected interval in minutes (5, 10, or 15)
+int setupScreenIntervalSelection() {
+    LOG_I("\n=== Setup Screen: Interval Selection ===\n");
+
+    // Build menu items
+    std::vector<MenuItem> items;
+
+    // Item 0: Confirm button
+    items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+
+    // Items 1-3: Radio buttons for intervals (different in debug mode)
+    if (rtcState.debugMode) {
+        // Debug mode: shorter intervals for testing (5, 2, 1 min)
+        items.push_back({MENU_RADIO, "5 min", "", false, 5, -1});
+        items.push_back({MENU_RADIO, "2 min", "", false, 2, -1});
+        items.push_back({MENU_RADIO, "1 min", "", true, 1, -1}); // Default: 1 min
+    } else {
+        // Normal mode: standard intervals (15, 10, 5 min)
+        items.push_back({MENU_RADIO, "5 min", "", false, 5, -1});
+        items.push_back({MENU_RADIO, "10 min", "", false, 10, -1});
+        items.push_back({MENU_RADIO, "15 min", "", true, 15, -1}); // Default: 15 min
+    }
+
+    int cursorIndex = 0; // Start at "Confirm"
+    int scrollOffset = 0; // No scroll needed (only 4 items)
+    int selectedIntervalIndex = 3; // Default interval (last option)
+
+    // Initial render with full refresh to clear boot screen
+    renderMenuScreen("", items, cursorIndex, scrollOffset, true);
+
+    // Navigation loop
+    bool confirmed = false;
+    while (!confirmed) {
+        M5.update();
+
+        // Button UP (BtnL): Move cursor up
+        if (M5.BtnL.wasPressed()) {
+            LOG_I("BtnL pressed - moving up\n");
+            cursorIndex--;
+            if (cursorIndex < 0) {
+                cursorIndex = items.size() - 1; // Wrap around to bottom
+            }
+            renderMenuScreen("", items, cursorIndex, scrollOffset);
+            delay(200);
+        }
+
+        // Button DOWN (BtnR): Move cursor down
+        if (M5.BtnR.wasPressed()) {
+            LOG_I("BtnR pressed - moving down\n");
+            cursorIndex++;
+            if (cursorIndex >= items.size()) {
+                cursorIndex = 0; // Wrap around to top
+            }
+            renderMenuScreen("", items, cursorIndex, scrollOffset);
+            delay(200);
+        }
+
+        // Button CENTER (BtnP): Select/Confirm
+        if (M5.BtnP.wasPressed()) {
+            if (cursorIndex == 0) {
+                // Confirm button pressed - exit
+                confirmed = true;
+                LOG_I("Confirm pressed - exiting interval selection\n");
+            } else {
+                // Radio button pressed - deselect all, select current
+                for (int i = 1; i < items.size(); i++) {
+                    items[i].selected = false;
+                }
+                items[cursorIndex].selected = true;
+                selectedIntervalIndex = cursorIndex;
+                renderMenuScreen("", items, cursorIndex, scrollOffset);
+                LOG_I("Selected: %s\n", menuItemText(items[cursorIndex]));
+            }
+            delay(200);
+        }
+
+        delay(50);
+    }
+
+    int selectedInterval = items[selectedIntervalIndex].value;
+    LOG_I("Interval selection confirmed: %d minutes\n", selectedInterval);
+    return selectedInterval;
+}
+
+// ========================================
+// v2.1: Setup Screen - Font Selection
+// ========================================
+
+// Extract font name from path ("/fonts/Inter-Bold.ttf" -> "Inter-Bold") into a caller buffer
+void fontNameFromPath(const char* path, char* out, size_t outSize) {
+    const char* slash = strrchr(path, '/');
+    const char* name = slash ? slash + 1 : path;
+    const char* dot = strrchr(name, '.');
+    size_t len = (dot && dot > name) ? (size_t)(dot - name) : strlen(name);
+    len = min(len, outSize - 1);
+    memcpy(out, name, len);
+    out[len] = '\0';
+}
+
+// v3.1: Setup list label: the display name plus a marker for fonts the catalog found
+// unusable (they can be ticked but stay out of the active table)
+void fontMenuLabel(const FontCatalogRecord* record, char* out, size_t outSize) {
+    char name[LABEL_TEXT_MAX];
+    fontDisplayName(record, name, sizeof(name));
+    const char* marker = "";
+    if (record->flags & FONT_FLAG_NO_OUTLINES) marker = " (no outlines)";
+    else if (record->flags & FONT_FLAG_EMPTY_CMAP) marker = " (no glyphs)";
+    else if (record->flags & FONT_FLAG_LOAD_FAILED) marker = " (broken)";
+    canvas.setTextSize(UI_TEXT_SIZE);
+    int markerWidth = canvas.textWidth(marker);
+    size_t markerLen = strlen(marker);
+    shortenTextInto(name, UI_MAX_TEXT_WIDTH - markerWidth, UI_TEXT_SIZE, out, outSize - markerLen);
+    strlcat(out, marker, outSize);
+}
+
+// v3.1: Label for a catalog font: "Family Subfamily" from the name table ("Regular" left
+// out), or the file name if the font has no family name or one the bitmap label font
+// cannot draw (non-ASCII)
+void fontDisplayName(const FontCatalogRecord* record, char* out, size_t outSize) {
+    out[0] = '\0';
+    if (!record) return;
+    bool ascii = record->family[0] != '\0';
+    for (const char* c = record->family; *c && ascii; c++) ascii = (uint8_t)*c < 0x80;
+    for (const char* c = record->subfamily; *c && ascii; c++) ascii = (uint8_t)*c < 0x80;
+    if (!ascii) {
+        fontNameFromPath(record->path, out, outSize);
+    } else if (record->subfamily[0] != '\0' && strcmp(record->subfamily, "Regular") != 0) {
+        snprintf(out, outSize, "%s %s", record->family, record->subfamily);
+    } else {
+        strlcpy(out, record->family, outSize);
+    }
+}
+
+// Interactive font selection screen with scroll
+// Writes the font catalog enable flags based on user selection
+void setupScreenFontSelection() {
+    LOG_I("\n=== Setup Screen: Font Selection ===\n");
+
+    // Build menu items
+    std::vector<MenuItem> items;
+
+    // Item 0: Confirm button
+    items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+
+    // Items 1..N: Checkboxes for each font (all enabled by default)
+    for (int i = 0; i < catalogFontCount(); i++) {
+        // Extract font name from path
+        const FontCatalogRecord* record = catalogRecord(i);
+        if (!record) break;
+        bool enabled = record->flags & FONT_FLAG_ENABLED;
+        items.push_back({MENU_CHECKBOX, nullptr, "", enabled, 0, i});
+        fontMenuLabel(record, items.back().displayLabel, LABEL_TEXT_MAX);
+    }
+
+    int cursorIndex = 0; // Start at "Confirm"
+    int scrollOffset = 0;
+    const int maxVisibleItems = 8; // Max items visible on screen
+    bool firstMove = true; // Flag to detect first cursor move
+
+    // Initial render with full refresh to clear previous screen
+    renderMenuScreen("", items, cursorIndex, scrollOffset, true);
 
-            } else if (currentItem.type == MENU_CHECKBOX) {
-                if (currentItem.fontIndex == -2) {
-                    // "Select/Deselect all" special checkbox (deprecated, now using MENU_LABEL)
-                    bool newState = !currentItem.selected;
-                    for (size_t i = 0; i < fontEnabledLocal.size(); i++) {
-                        fontEnabledLocal[i] = newState;
-                    }
-                    Serial.printf("Select/Deselect all: %s\n", newState ? "all selected" : "all deselected");
-                } else if (currentItem.fontIndex == -3) {
-                    // "Allow different font" checkbox - toggle without rebuilding menu
-                    allowDifferentFontLocal = !allowDifferentFontLocal;
-                    currentItem.selected = allowDifferentFontLocal;
-                    Serial.printf("Toggled allow different font: %s\n", allowDifferentFontLocal ? "yes" : "no");
-                } else if (currentItem.fontIndex == -4) {
-                    // "Allow different mode" checkbox - toggle without rebuilding menu
-                    allowDifferentModeLocal = !allowDifferentModeLocal;
-                    currentItem.selected = allowDifferentModeLocal;
-                    Serial.printf("Toggled allow different mode: %s\n", allowDifferentModeLocal ? "yes" : "no");
-                } else if (currentItem.fontIndex >= 0) {
-                    // Individual font checkbox - toggle without rebuilding menu
-                    fontEnabledLocal[currentItem.fontIndex] = !fontEnabledLocal[currentItem.fontIndex];
-                    currentItem.selected = fontEnabledLocal[currentItem.fontIndex];
-                    Serial.printf("Toggled font %d: %s\n", currentItem.fontIndex,
-                                 fontEnabledLocal[currentItem.fontIndex] ? "enabled" : "disabled");
+    // Navigation loop
+    bool confirmed = false;
+    while (!confirmed) {
+        M5.update();
 
-                    // Update "Select/Deselect all" state based on whether all fonts are now selected
-                    bool allSelected = true;
-                    for (bool enabled : fontEnabledLocal) {
-                        if (!enabled) {
-                            allSelected = false;
-                            break;
-                        }
-                    }
-                    for (auto& item : items) {
-                        if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                            item.selected = allSelected;
-                            break;
-                        }
-                    }
-                }
-                renderUnifiedSetupScreen(items, cursorIndex);
+        bool cursorMoved = false;
 
-            } else if (currentItem.type == MENU_PAGE_NAV) {
-                // Page navigation "..."
-                if (currentItem.value == -1) {
-                    // Previous page
-                    pagination.currentPage--;
-                } else {
-                    // Next page
-                    pagination.currentPage++;
+        // Button UP (BtnL): Move cursor up
+        if (M5.BtnL.wasPressed()) {
+            LOG_I("BtnL pressed - moving up\n");
+
+            // First move away from Confirm: deselect all fonts
+            if (firstMove && cursorIndex == 0) {
+                LOG_I("First move from Confirm - deselecting all fonts\n");
+                for (size_t i = 1; i < items.size(); i++) {
+                    items[i].selected = false;
                 }
-                buildUnifiedMenu(items, pagination, selectedInterval, fontEnabledLocal, allowDifferentFontLocal, allowDifferentModeLocal);
+                firstMove = false;
+            }
 
-                // Position cursor on first item AFTER "Select/Deselect all" in font section
-                // Items: Confirm(0), Sep, Refresh, 15min, 10min, 5min, Sep, When, AllowFont, AllowMode, Sep, Select/Deselect(11), ...
-                // So first item after Select/Deselect is always at index 12
-                cursorIndex = 12;
+            cursorIndex--;
+            if (cursorIndex < 0) {
+                cursorIndex = items.size() - 1; // Wrap to last item
+            }
+            cursorMoved = true;
+            delay(200);
+        }
 
-                Serial.printf("Page navigation: now on page %d/%d, cursor at item %d\n", pagination.currentPage + 1, pagination.totalPages, cursorIndex);
-                renderUnifiedSetupScreen(items, cursorIndex);
+        // Button DOWN (BtnR): Move cursor down
+        if (M5.BtnR.wasPressed()) {
+            LOG_I("BtnR pressed - moving down\n");
+
+            // First move away from Confirm: deselect all fonts
+            if (firstMove && cursorIndex == 0) {
+                LOG_I("First move from Confirm - deselecting all fonts\n");
+                for (size_t i = 1; i < items.size(); i++) {
+                    items[i].selected = false;
+                }
+                firstMove = false;
+            }
+
+            cursorIndex++;
+            // Wrap around: if at last item, go back to Confirm
+            if (cursorIndex >= items.size()) {
+                cursorIndex = 0;
             }
 
+            cursorMoved = true;
             delay(200);
         }
 
-        // v3.0: Touch screen navigation
-        if (touchEnabled && M5.TP.available()) {
-            if (!M5.TP.isFingerUp()) {
-                M5.TP.update();
-                tp_finger_t finger = M5.TP.readFinger(0);
+        // Update scroll offset if cursor moved
+        if (cursorMoved) {
+            // Auto-scroll logic: keep cursor in visible area
+            if (cursorIndex < scrollOffset) {
+                // Cursor moved above visible area - scroll up
+                scrollOffset = cursorIndex;
+            } else if (cursorIndex >= scrollOffset + maxVisibleItems) {
+                // Cursor moved below visible area - scroll down
+                scrollOffset = cursorIndex - maxVisibleItems + 1;
+            }
 
-                if (!setupTouchWasPressed) {
-                    // Touch started
-                    setupTouchWasPressed = true;
-                    setupTouchStartTime = millis();
-                    setupTouchStartValid = false;
+            renderMenuScreen("", items, cursorIndex, scrollOffset);
+        }
 
-                    if (finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
-                        setupTouchStartX = finger.x;
-                        setupTouchStartY = finger.y;
-                        setupTouchStartValid = true;
-                    }
-                } else {
-                    // Touch held - update coordinates if not valid yet
-                    if (!setupTouchStartValid && finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
-                        setupTouchStartX = finger.x;
-                        setupTouchStartY = finger.y;
-                        setupTouchStartValid = true;
-                    }
-                }
-            } else if (setupTouchWasPressed) {
-                // Touch released - process tap
-                setupTouchWasPressed = false;
+        // Button CENTER (BtnP): Toggle checkbox or confirm
+        if (M5.BtnP.wasPressed()) {
+            if (cursorIndex == 0) {
+                // Confirm button pressed - save and exit
+                confirmed = true;
+                LOG_I("Confirm pressed - saving font selections\n");
 
-                if (!setupTouchStartValid) {
-                    continue; // No valid coordinates
+                // Update the catalog flags from items
+                for (size_t i = 1; i < items.size(); i++) {
+                    writeFontEnabled(items[i].fontIndex, items[i].selected); // item 0 is Confirm
                 }
+                writeCatalogHeader();
+                LOG_I("Fonts enabled: %d/%d\n", catalogEnabledCount(), catalogFontCount());
 
-                M5.TP.update();
-                tp_finger_t finger = M5.TP.readFinger(0);
+            } else {
+                // Checkbox pressed - toggle
+                items[cursorIndex].selected = !items[cursorIndex].selected;
+                renderMenuScreen("", items, cursorIndex, scrollOffset);
+                LOG_I("Toggled: %s -> %s\n",
+                     menuItemText(items[cursorIndex]),
+                     items[cursorIndex].selected ? "enabled" : "disabled");
+            }
+            delay(200);
+        }
+
+        delay(50);
+    }
+
+    LOG_I("=== Font Selection Complete ===\n\n");
+}
+
+// ========================================
+// FT_Face Access Workaround
+// ========================================
+// M5EPD_Canvas inherits from TFT_eSPI which has protected static _font_face
+// We use external symbol access to bypass protected access control
+
+// External declarations to access TFT_eSPI protected statics
+// This is a memory hack but works without modifying the library
+extern "C" {
+    // These symbols exist in TFT_eSPI compiled code
+    // We're just accessing them directly via linker
+}
+
+// Helper struct matching font_face_t from font_render.h
+struct font_face_accessor {
+    FT_Face ft_face;
+    uint16_t pixel_size;
+};
+
+// Access function using symbol name mangling knowledge
+FT_Face getFontFaceFromCanvas() {
+    // TFT_eSPI::_font_face is a static member
+    // We can access it via external linkage using the mangled name
+    // But this is compiler-specific and fragile
+
+    // ALTERNATIVE: Use the canvas object directly as a memory accessor
+    // Cast canvas to access its parent class protected members
+    // This works because M5EPD_Canvas IS-A TFT_eSPI
+
+    // SIMPLEST WORKAROUND: Access via canvas's internal methods
+    // The font is already loaded, we just need the FT_Face pointer
+
+    // For now, use a friend class hack via template specialization
+    // Actually, let's try the reinterpret_cast approach
+
+    // HACK: Get pointer to TFT_eSPI's static _font_face via memory layout
+    // This assumes the symbol is accessible via linker (it should be)
+
+    // Import the external symbol (defined in TFT_eSPI compiled code)
+    extern font_face_t _ZN8TFT_eSPI10_font_faceE; // mangled name for TFT_eSPI::_font_face
+
+    return _ZN8TFT_eSPI10_font_faceE.ft_face;
+}
+
+// Refresh logic state
+uint8_t partialRefreshCount = 0;
+unsigned long firstPartialAfterFullTime = 0;
+bool hasPartialSinceLastFull = false;
+const uint8_t MAX_PARTIAL_BEFORE_FULL = 5;
+
+// Power management state
+unsigned long lastFullRefreshTime = 0;
+unsigned long lastButtonActivityTime = 0;
+bool isAutoWakeSession = false; // Flag: if true, skip idle wait and sleep immediately after render
+bool isFirstRenderAfterWake = false; // Flag: if true, do double full refresh to eliminate wake artifacts
+
+// Touch screen state (v3.0)
+bool touchEnabled = false; // Touch is enabled only when device is awake (not during auto-wake, boot, shutdown)
+int16_t touchStartX = 0;
+int16_t touchStartY = 0;
+unsigned long touchStartTime = 0;
+bool touchWasPressed = false;
+bool touchStartValid = false; // Flag to track if we have valid start coordinates (filter GT911 spurious (0,0))
+bool longPressFired = false; // Prevent multiple toggle on single long press
+
+// Touch gesture thresholds (v3.0)
+const int16_t TAP_MAX_MOVEMENT = 20;           // Maximum movement for tap
+const unsigned long LONG_PRESS_DURATION = 800; // 800ms for mode toggle
+
+// Screen divided into 3 vertical zones (180px each), with 90px margins top/bottom for labels
+const int16_t ZONE_TOP_MARGIN = 90;            // Leave top area free for labels
+const int16_t ZONE_BOTTOM_MARGIN = 870;        // 960 - 90 = 870, leave bottom area free
+const int16_t ZONE_LEFT_MIN = 0;
+const int16_t ZONE_LEFT_MAX = 180;
+const int16_t ZONE_CENTER_MIN = 180;
+const int16_t ZONE_CENTER_MAX = 360;
+const int16_t ZONE_RIGHT_MIN = 360;
+const int16_t ZONE_RIGHT_MAX = 540;
+
+// View mode enumeration
+// Font management
+int currentFontIndex = 0;  // v3.1: Position in the active table of the font catalog
+bool fontLoaded = false;
+
+// Glyph rendering
+const int GLYPH_SIZE = 375; // Balanced size for specimen display
+uint32_t currentGlyphCodepoint = 0x0041; // Start with 'A'
+
+// STEP 5: Current view mode
+ViewMode currentViewMode = BITMAP;  // Start in bitmap mode (default)
+
+// ========================================
+// v3.1: Font ID
+// ========================================
+// Font ID and the sfnt/cmap indexing live in include/font_index.h; the device feeds them
+// SD files through sdFontSource().
+
+size_t readSdFontBytes(void* handle, uint32_t offset, uint8_t* out, size_t len) {
+    File* file = (File*)handle;
+    if (!file->seek(offset)) return 0;
+    size_t got = file->read(out, len);
+    METRIC_ADD(M_SD_BYTES_READ, got);
+    return got;
+}
+
+FontSource sdFontSource(File& file) {
+    return {&file, (uint32_t)file.size(), readSdFontBytes};
+}
+
+// Position of a font in the active table, -1 if it is not enabled
+int fontIndexForId(uint32_t id) {
+    for (int i = 0; i < activeFontCount(); i++) {
+        const FontCatalogRecord* record = activeFont(i);
+        if (record && record->fontId == id) return i;
+    }
+    return -1;
+}
+
+// ID of the current font (the saved one while the catalog is not open yet)
+uint32_t currentFontId() {
+    const FontCatalogRecord* record = activeFont(currentFontIndex);
+    return record ? record->fontId : rtcState.currentFontId;
+}
+
+// Saved font after sleep: the saved index if it still holds the saved ID, else by ID,
+// else the saved index if still in range, else font 0
+int savedFontIndex() {
+    const FontCatalogRecord* record = activeFont(rtcState.currentFontIndex);
+    if (record && record->fontId == rtcState.currentFontId) return rtcState.currentFontIndex;
+    int index = fontIndexForId(rtcState.currentFontId);
+    if (index >= 0) return index;
+    if (rtcState.currentFontIndex >= 0 && rtcState.currentFontIndex < activeFontCount()) {
+        LOG_W("WARNING: Saved font %08lx not found, keeping index %d\n",
+              (unsigned long)rtcState.currentFontId, rtcState.currentFontIndex);
+        return rtcState.currentFontIndex;
+    }
+    LOG_W("WARNING: Saved font index out of range, resetting to 0\n");
+    return 0;
+}
+
+// ========================================
+// v3.1: Font Scan
+// ========================================
+// Builds the font catalog from /fonts (subdirectories included) in two steps. The
+// enumeration only opens directory entries: font IDs are computed for new or changed
+// files, unchanged fonts keep their record, new fonts start enabled, and the catalog is
+// rewritten if something changed. Then the fonts still lacking metadata and coverage are
+// indexed and the catalog is written once more. Between the
+// steps the catalog is complete except for names and coverage, which is all a cold boot
+// needs to import the config and show the setup screen (see Background Font Scan). The
+// scan holds the record lists in RAM while it runs; afterwards only the catalog pages
+// stay resident.
+// FAT has no reliable directory change stamp, so auto-wakes use the catalog without
+// enumerating /fonts at all. Cold boots and button wakes enumerate (the user may have
+// changed the card), as does the next wake after a catalog font was missing.
+
+const int FONT_SCAN_MAX_DEPTH = 4;
+
+bool fontRecordLess(const FontCatalogRecord& a, const FontCatalogRecord& b) {
+    return strcmp(a.path, b.path) < 0;
+}
+
+// All catalog records (scan only). Records of an older, shorter layout (including "FIX2"
+// catalogs) load with the newer fields zeroed, so their indexVersion makes the scan
+// re-index them while IDs and flags carry over.
+bool readCatalogRecords(std::vector<FontCatalogRecord>& records) {
+    records.clear();
+    File file = SD.open(FONT_CATALOG_FILE);
+    if (!file) return false;
+    FontCatalogHeader header;
+    bool ok = file.read((uint8_t*)&header.magic, sizeof(header.magic)) == sizeof(header.magic);
+    if (ok && header.magic == FONT_CATALOG_MAGIC_V2) {
+        header.recordSize = offsetof(FontCatalogRecord, family);
+        ok = file.read((uint8_t*)&header.count, 12) == 12;
+    } else if (ok && header.magic == FONT_CATALOG_MAGIC_V3) {
+        ok = file.read((uint8_t*)&header.recordSize, 16) == 16;
+    } else if (ok) {
+        ok = file.read((uint8_t*)&header.recordSize, sizeof(header) - 4) == sizeof(header) - 4 &&
+             header.magic == FONT_CATALOG_MAGIC;
+    }
+    ok = ok && header.count <= FONT_CATALOG_MAX &&
+         header.recordSize >= offsetof(FontCatalogRecord, family) &&
+         header.recordSize <= sizeof(FontCatalogRecord);
+    if (ok) {
+        records.resize(header.count);
+        memset(records.data(), 0, records.size() * sizeof(FontCatalogRecord));
+        for (size_t i = 0; ok && i < records.size(); i++) {
+            ok = file.read((uint8_t*)&records[i], header.recordSize) == header.recordSize;
+        }
+        METRIC_ADD(M_SD_BYTES_READ, header.count * header.recordSize);
+    }
+    file.close();
+    if (!ok) records.clear();
+    return ok;
+}
+
+// Write a new catalog (records sorted by path) with its active table
+bool writeFontCatalog(const std::vector<FontCatalogRecord>& records) {
+    closeFontCatalog();
+    File file = SD.open(FONT_CATALOG_FILE, FILE_WRITE);
+    if (!file) {
+        LOG_E("ERROR: Cannot write font catalog\n");
+        return false;
+    }
+    FontCatalogHeader header = {FONT_CATALOG_MAGIC, sizeof(FontCatalogRecord), (uint32_t)records.size(), 0, 0, 0};
+    for (const FontCatalogRecord& record : records) {
+        if (record.flags & FONT_FLAG_ENABLED) header.enabledCount++;
+        if (fontActive(record.flags)) header.activeCount++;
+    }
+    size_t bytes = records.size() * sizeof(FontCatalogRecord);
+    bool ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              file.write((const uint8_t*)records.data(), bytes) == bytes;
+    // Active table: enabled, usable record numbers, then unused slots
+    for (size_t i = 0; ok && i < records.size(); i++) {
+        uint16_t slot = i;
+        if (fontActive(records[i].flags)) {
+            ok = file.write((const uint8_t*)&slot, sizeof(slot)) == sizeof(slot);
+        }
+    }
+    for (size_t i = header.activeCount; ok && i < records.size(); i++) {
+        uint16_t unused = 0;
+        ok = file.write((const uint8_t*)&unused, sizeof(unused)) == sizeof(unused);
+    }
+    file.close();
+    return ok && openFontCatalog();
+}
 
-                unsigned long touchDuration = millis() - setupTouchStartTime;
-                int16_t deltaX = finger.x - setupTouchStartX;
-                int16_t deltaY = finger.y - setupTouchStartY;
+bool isFontFileName(const String& filename) {
+    return filename.endsWith(".ttf") || filename.endsWith(".otf") ||
+           filename.endsWith(".TTF") || filename.endsWith(".OTF");
+}
 
-                // Check for tap (short duration, minimal movement)
-                if (touchDuration < 800 && abs(deltaX) < TAP_MAX_MOVEMENT && abs(deltaY) < TAP_MAX_MOVEMENT) {
-                    lastActivityTime = millis(); // Reset timeout
+// Path below /fonts, which the font ID hashes ("/fonts/sans/Inter.ttf" -> "sans/Inter.ttf")
+const char* fontRelativePath(const char* path) {
+    return strncmp(path, "/fonts/", 7) == 0 ? path + 7 : path;
+}
 
-                    // Find which menu item was tapped
-                    int tappedItem = getMenuItemAtTouch(setupTouchStartY, items);
+// Font ID only (header read); the full index follows in indexPendingFonts()
+uint32_t fontIdOfFile(File& file, const char* path) {
+    FontSource src = sdFontSource(file);
+    SfntDirectory dir;
+    return computeFontId(src, fontRelativePath(path), dir);
+}
 
-                    if (tappedItem >= 0 && tappedItem < items.size()) {
-                        // Skip if tapped item is separator or non-clickable label
-                        MenuItem& tappedMenuItem = items[tappedItem];
-                        if (tappedMenuItem.type == MENU_SEPARATOR ||
-                            (tappedMenuItem.type == MENU_LABEL && tappedMenuItem.fontIndex != -2 && tappedMenuItem.fontIndex != -5)) {
-                            Serial.printf("Touch tap ignored: separator or non-clickable label at index %d\n", tappedItem);
-                            continue;
-                        }
+// Enumerate one directory level into records, reusing index data and flags from the sorted previous catalog
+void scanFontDir(File& dir, const char* dirPath, int depth,
+                 const std::vector<FontCatalogRecord>& previous,
+                 std::vector<FontCatalogRecord>& records, int& reused, int& changed, int& cleared) {
+    File entry;
+    while (entry = dir.openNextFile()) {
+        String filename = String(entry.name());
+        // Skip macOS metadata (._*) and other hidden files and folders
+        if (filename.startsWith(".")) {
+            LOG_I("  Skipping hidden file: %s\n", filename.c_str());
+            entry.close();
+            continue;
+        }
 
-                        // Move cursor to tapped item and execute action
-                        cursorIndex = tappedItem;
-                        Serial.printf("Touch tap: item %d selected\n", tappedItem);
+        FontCatalogRecord item;
+        memset(&item, 0, sizeof(item));
+        int pathLen = snprintf(item.path, FONT_PATH_MAX, "%s/%s", dirPath, filename.c_str());
+        if (pathLen >= FONT_PATH_MAX) {
+            LOG_W("  Skipping path longer than %d bytes: %s\n", FONT_PATH_MAX - 1, filename.c_str());
+        } else if (entry.isDirectory()) {
+            if (depth < FONT_SCAN_MAX_DEPTH) {
+                scanFontDir(entry, item.path, depth + 1, previous, records, reused, changed, cleared);
+            }
+        } else if (isFontFileName(filename) && records.size() < FONT_CATALOG_MAX) {
+            item.size = entry.size();
+            item.mtime = (uint32_t)entry.getLastWrite();
+            item.flags = FONT_FLAG_ENABLED;
+            auto match = std::lower_bound(previous.begin(), previous.end(), item, fontRecordLess);
+            bool samePath = match != previous.end() && strcmp(match->path, item.path) == 0;
+            if (samePath) item.flags = match->flags & FONT_FLAG_ENABLED; // Validity is re-checked
+            if (samePath && match->size == item.size && match->mtime == item.mtime &&
+                match->indexVersion == FONT_INDEX_VERSION) {
+                item = *match;
+                reused++;
+                // A runtime empty cmap flag written by older firmware; FONT_FLAG_LOAD_FAILED
+                // and loadFailures stay while size and mtime do
+                if (item.codepointCount > 0 && (item.flags & FONT_FLAG_EMPTY_CMAP)) {
+                    item.flags &= ~FONT_FLAG_EMPTY_CMAP;
+                    cleared++;
+                }
+                records.push_back(item);
+            } else {
+                if (samePath) changed++;
+                item.fontId = fontIdOfFile(entry, item.path);
+                records.push_back(item); // indexVersion 0: indexed by indexPendingFonts()
+            }
+        }
+        entry.close();
+    }
+}
 
-                        // Execute the same action as BtnP would (duplicate logic from above)
-                        MenuItem& currentItem = items[cursorIndex];
+// Enumerated records while fonts are waiting to be indexed (between beginFontScan() and
+// finishFontScan())
+std::vector<FontCatalogRecord> scanRecords;
+int scanPending = 0;
+
+// Open the font catalog, enumerating /fonts first if requested (or if there is none).
+// Fonts that need indexing are left in scanRecords.
+void beginFontScan(bool enumerate) {
+    scanRecords.clear();
+    scanPending = 0;
+    bool haveCatalog = openFontCatalog();
+    if (haveCatalog && !enumerate && !rtcState.fontRescanPending) {
+        LOG_I("\n=== Fonts from catalog (%d, no directory scan) ===\n", catalogFontCount());
+        return;
+    }
+    File fontsDir = SD.open("/fonts");
+    if (!fontsDir) {
+        LOG_E("ERROR: Cannot open /fonts directory\n");
+        closeFontCatalog();
+        return;
+    }
 
-                        if (currentItem.type == MENU_CONFIRM) {
-                            // Same as button confirm logic
-                            bool anyFontSelected = false;
-                            for (bool enabled : fontEnabledLocal) {
-                                if (enabled) {
-                                    anyFontSelected = true;
-                                    break;
-                                }
-                            }
-                            if (!anyFontSelected) {
-                                for (size_t i = 0; i < fontEnabledLocal.size(); i++) {
-                                    fontEnabledLocal[i] = true;
-                                }
-                            }
-                            confirmed = true;
-                            config.wakeIntervalMinutes = selectedInterval;
-                            config.fontEnabled = fontEnabledLocal;
-                            config.allowDifferentFont = allowDifferentFontLocal;
-                            config.allowDifferentMode = allowDifferentModeLocal;
+    LOG_I("\n=== Scanning for fonts ===\n");
+    std::vector<FontCatalogRecord> previous;
+    readCatalogRecords(previous);
+    int reused = 0;
+    int changed = 0;
+    int cleared = 0;
+    scanFontDir(fontsDir, "/fonts", 1, previous, scanRecords, reused, changed, cleared);
+    fontsDir.close();
+    std::sort(scanRecords.begin(), scanRecords.end(), fontRecordLess);
+    rtcState.fontRescanPending = false;
 
-                        } else if (currentItem.type == MENU_RADIO) {
-                            selectedInterval = currentItem.value;
-                            for (auto& item : items) {
-                                if (item.type == MENU_RADIO) {
-                                    item.selected = (item.value == selectedInterval);
-                                }
-                            }
-                            renderUnifiedSetupScreen(items, cursorIndex);
+    int added = scanRecords.size() - reused - changed;
+    int removed = previous.size() - reused - changed;
+    LOG_I("Fonts: %d unchanged, %d changed or re-indexed, %d new, %d removed\n", reused, changed, added, removed);
+    if (cleared > 0) LOG_I("Cleared runtime empty cmap flags of %d fonts\n", cleared);
+    if (!haveCatalog || changed > 0 || added > 0 || removed > 0 || cleared > 0) {
+        writeFontCatalog(scanRecords);
+    }
+    scanPending = changed + added;
+    if (scanPending == 0) {
+        std::vector<FontCatalogRecord>().swap(scanRecords);
+    }
+    LOG_I("Total fonts found: %d (%d enabled)\n", catalogFontCount(), catalogEnabledCount());
+}
 
-                        } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -5) {
-                            setupUnicodeRanges();
-                            buildUnifiedMenu(items, pagination, selectedInterval, fontEnabledLocal, allowDifferentFontLocal, allowDifferentModeLocal);
-                            renderUnifiedSetupScreen(items, cursorIndex, true);
-                            lastActivityTime = millis();
+void logIndexedFont(const FontCatalogRecord& record) {
+    LOG_I("  Indexed: %s (id %08lx, \"%s\" \"%s\", %u glyphs, %u upem, %lu codepoints)\n",
+          record.path, (unsigned long)record.fontId, record.family, record.subfamily,
+          record.glyphCount, record.unitsPerEm, (unsigned long)record.codepointCount);
+    if (!(record.flags & FONT_FLAG_COVERAGE)) {
+        LOG_W("  No usable Unicode cmap in %s\n", record.path);
+    }
+    if (record.flags & FONT_FLAG_NO_OUTLINES) {
+        LOG_W("  No outline glyphs in %s\n", record.path);
+    }
+}
 
-                        } else if (currentItem.type == MENU_LABEL && currentItem.fontIndex == -2) {
-                            bool newState = !currentItem.selected;
-                            for (size_t i = 0; i < fontEnabledLocal.size(); i++) {
-                                fontEnabledLocal[i] = newState;
-                            }
-                            for (auto& item : items) {
-                                if (item.type == MENU_CHECKBOX && item.fontIndex >= 0) {
-                                    item.selected = newState;
-                                } else if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                                    item.selected = newState;
-                                }
-                            }
-                            renderUnifiedSetupScreen(items, cursorIndex);
+// Index the fonts beginFontScan() left pending, into scanRecords only: the open catalog
+// is not touched, so this may run in a task while the setup screen uses the catalog
+void indexPendingFonts() {
+    if (scanPending == 0) return;
+    uint32_t startMs = millis();
+    for (size_t i = 0; i < scanRecords.size(); i++) {
+        FontCatalogRecord& record = scanRecords[i];
+        if (record.indexVersion == FONT_INDEX_VERSION) continue;
+        spiBusTake(); // Per font: setup screen frames go out between two fonts
+        File file = SD.open(record.path);
+        bool opened = file;
+        if (opened) {
+            FontSource src = sdFontSource(file);
+            indexFontFile(src, fontRelativePath(record.path), record);
+            file.close();
+        }
+        spiBusGive();
+        if (spiBusMutex) vTaskDelay(1); // Let a waiting setup() take the bus
+        if (!opened) {
+            LOG_W("  Cannot open %s for indexing\n", record.path);
+            continue;
+        }
+        logIndexedFont(record);
+    }
 
-                        } else if (currentItem.type == MENU_CHECKBOX) {
-                            if (currentItem.fontIndex == -3) {
-                                allowDifferentFontLocal = !allowDifferentFontLocal;
-                                currentItem.selected = allowDifferentFontLocal;
-                            } else if (currentItem.fontIndex == -4) {
-                                allowDifferentModeLocal = !allowDifferentModeLocal;
-                                currentItem.selected = allowDifferentModeLocal;
-                            } else if (currentItem.fontIndex >= 0) {
-                                fontEnabledLocal[currentItem.fontIndex] = !fontEnabledLocal[currentItem.fontIndex];
-                                currentItem.selected = fontEnabledLocal[currentItem.fontIndex];
+    uint32_t elapsedMs = millis() - startMs;
+    LOG_I("Indexed %d fonts in %lu ms (%.1f fonts/s)\n", scanPending,
+          (unsigned long)elapsedMs, elapsedMs ? scanPending * 1000.0f / elapsedMs : 0.0f);
+}
 
-                                bool allSelected = true;
-                                for (bool enabled : fontEnabledLocal) {
-                                    if (!enabled) {
-                                        allSelected = false;
-                                        break;
-                                    }
-                                }
-                                for (auto& item : items) {
-                                    if (item.type == MENU_LABEL && item.fontIndex == -2) {
-                                        item.selected = allSelected;
-                                        break;
-                                    }
-                                }
-                            }
-                            renderUnifiedSetupScreen(items, cursorIndex);
+// Write the indexed records, keeping enable flags changed in the catalog since
+// beginFontScan() (config import, setup screen)
+void finishFontScan() {
+    if (scanPending == 0) return;
+    if (catalogFontCount() == (int)scanRecords.size()) {
+        for (size_t i = 0; i < scanRecords.size(); i++) {
+            scanRecords[i].flags = (scanRecords[i].flags & ~FONT_FLAG_ENABLED) |
+                                   (fontEnabledAt(i) ? FONT_FLAG_ENABLED : 0);
+        }
+    }
+    writeFontCatalog(scanRecords);
+    std::vector<FontCatalogRecord>().swap(scanRecords);
+    scanPending = 0;
+}
 
-                        } else if (currentItem.type == MENU_PAGE_NAV) {
-                            if (currentItem.value == -1) {
-                                pagination.currentPage--;
-                            } else {
-                                pagination.currentPage++;
-                            }
-                            buildUnifiedMenu(items, pagination, selectedInterval, fontEnabledLocal, allowDifferentFontLocal, allowDifferentModeLocal);
-                            cursorIndex = 12;
-                            renderUnifiedSetupScreen(items, cursorIndex);
-                        }
+// Catalog, enumeration and indexing in one go (wakes; cold boots use the background scan)
+void scanFonts(bool enumerate) {
+    WakePhaseScope phase(PHASE_SCAN_FONTS);
+    beginFontScan(enumerate);
+    indexPendingFonts();
+    finishFontScan();
+}
 
-                        delay(200);
-                    }
-                }
-            }
+// ========================================
+// v3.1: Background Font Scan (cold boot)
+// ========================================
+// A cold boot mounts the SD card and scans /fonts in a task: the enumeration runs while
+// the splash waits 5 s for the debug-mode presses, the indexing of new fonts continues
+// while setupScreenUnified() waits for buttons. setup() waits for the catalog after the
+// splash and for the indexing after "Confirm", so the first specimen follows right away.
+// The task never draws; while it indexes it only touches scanRecords and font files.
+// SD and display share the SPI bus (see SPI Bus Lock), logging goes through logMutex,
+// metrics through metricMux, and the SD.begin time is recorded by the waiting loop task.
+// Fonts not indexed yet show their file name in the setup list.
+
+const EventBits_t SCAN_CATALOG_READY = 0x01;   // SD mounted, catalog open (or SD failed)
+const EventBits_t SCAN_INDEX_DONE = 0x02;      // scanRecords indexed
+const uint32_t FONT_SCAN_STACK = 8192;
+
+EventGroupHandle_t backgroundScanEvents = nullptr;
+bool backgroundSdOk = false;
+uint32_t backgroundSdBeginUs = 0;
+
+void runBackgroundScan() {
+    spiBusTake();
+    uint32_t startUs = micros();
+    backgroundSdOk = SD.begin();
+    backgroundSdBeginUs = micros() - startUs;
+    if (backgroundSdOk) {
+        // Check if /fonts directory exists
+        if (!SD.exists("/fonts")) {
+            LOG_W("WARNING: /fonts directory not found\n");
+            LOG_I("Creating /fonts directory...\n");
+            SD.mkdir("/fonts");
         }
+        beginFontScan(true);
+    }
+    spiBusGive();
+    if (backgroundScanEvents) xEventGroupSetBits(backgroundScanEvents, SCAN_CATALOG_READY);
+    if (backgroundSdOk) indexPendingFonts();
+    if (backgroundScanEvents) xEventGroupSetBits(backgroundScanEvents, SCAN_INDEX_DONE);
+}
 
-        delay(50);
+void backgroundScanTask(void* arg) {
+    runBackgroundScan();
+    vTaskDelete(nullptr);
+}
+
+void startBackgroundScan() {
+    spiBusMutex = xSemaphoreCreateMutex();
+    logMutex = xSemaphoreCreateRecursiveMutex();
+    backgroundScanEvents = xEventGroupCreate();
+    if (!backgroundScanEvents ||
+        xTaskCreatePinnedToCore(backgroundScanTask, "fontScan", FONT_SCAN_STACK, nullptr, 1,
+                                nullptr, 0) != pdPASS) {
+        LOG_W("WARNING: No background scan task, scanning now\n");
+        runBackgroundScan();
+    }
+}
+
+// Wait for the SD mount and the catalog; false: SD card failed. The caller holds the SPI
+// bus from here until finishBackgroundScan().
+bool waitForFontCatalog() {
+    if (backgroundScanEvents) {
+        xEventGroupWaitBits(backgroundScanEvents, SCAN_CATALOG_READY, pdFALSE, pdTRUE, portMAX_DELAY);
     }
+    profileRecord(PHASE_SD_BEGIN, backgroundSdBeginUs);
+    spiBusTake();
+    return backgroundSdOk;
+}
 
-    Serial.println("=== Unified Setup Complete ===\n");
+// Wait for the indexing and write the final catalog
+void finishBackgroundScan() {
+    spiBusGive();
+    if (backgroundScanEvents) {
+        EventBits_t bits = xEventGroupGetBits(backgroundScanEvents);
+        if (!(bits & SCAN_INDEX_DONE)) LOG_I("Waiting for font indexing...\n");
+        xEventGroupWaitBits(backgroundScanEvents, SCAN_INDEX_DONE, pdFALSE, pdTRUE, portMAX_DELAY);
+        vEventGroupDelete(backgroundScanEvents);
+        backgroundScanEvents = nullptr;
+    }
+    // Single task again: no bus or log locking
+    if (spiBusMutex) vSemaphoreDelete(spiBusMutex);
+    if (logMutex) vSemaphoreDelete(logMutex);
+    spiBusMutex = nullptr;
+    logMutex = nullptr;
+    finishFontScan();
 }
 
 // ========================================
-// v2.1: Setup Screen - Interval Selection (OLD - DEPRECATED)
+// v3.1: Label and Glyph Sizes
 // ========================================
+// The label cache from createRender(24) draws at the face's active FT_Size. The large
+// glyph is scaled at a second FT_Size of the same face and rasterized into a fixed PSRAM
+// buffer, so a render never resizes the label size and the font is not reloaded for the
+// labels. Both sizes belong to the face and are freed with it by canvas.unloadFont().
+
+const int GLYPH_BITMAP_MAX = 512;               // Pixels per side (glyphs are scaled to 400)
+const char* LABEL_WARM_CHARS = "U+0123456789ABCDEF";
+
+FT_Size labelSize = nullptr;                    // Active size after createRender(24)
+FT_Size glyphSize = nullptr;                    // Set per render for the 400px glyph
+uint8_t* glyphBitmapBuffer = nullptr;           // GLYPH_BITMAP_MAX^2, 8bpp, allocated once
+
+// Label cache and glyph size for a freshly loaded font. Draws the U+XXXX characters and
+// the font's own label once above the canvas (fully clipped), so the first render does
+// not fill the cache. Measuring would not: textWidth() does not go through it.
+bool createFontRenderSizes() {
+    LOG_D("Creating render cache for labels (size=24, cache=64)...\n");
+    esp_err_t renderResult24 = canvas.createRender(24, 64);
+    LOG_D("createRender(24) returned: %d\n", renderResult24);
+    if (renderResult24 != ESP_OK) {
+        LOG_E("ERROR: Failed to create render cache for size 24\n");
+        return false;
+    }
 
-// Interactive interval selection screen
-// Returns: selected interval in minutes (5, 10, or 15)
-int setupScreenIntervalSelection() {
-    Serial.println("\n=== Setup Screen: Interval Selection ===");
+    FT_Face face = getFontFaceFromCanvas();
+    labelSize = face ? face->size : nullptr;
+    glyphSize = nullptr;
+    if (!face || FT_New_Size(face, &glyphSize) != 0) {
+        METRIC_INC(M_FT_ERRORS);
+        LOG_E("ERROR: Failed to create glyph size\n");
+        glyphSize = nullptr;
+        canvas.destoryRender(24);
+        return false;
+    }
+    FT_Activate_Size(labelSize);
+    if (!glyphBitmapBuffer) {
+        glyphBitmapBuffer = (uint8_t*)heap_caps_malloc(GLYPH_BITMAP_MAX * GLYPH_BITMAP_MAX, MALLOC_CAP_SPIRAM);
+    }
 
-    // Build menu items
-    std::vector<MenuItem> items;
+    char name[LABEL_TEXT_MAX];
+    fontDisplayName(activeFont(currentFontIndex), name, sizeof(name));
+    canvas.setTextSize(24);
+    canvas.setTextDatum(BL_DATUM);
+    canvas.drawString(LABEL_WARM_CHARS, 0, -40);
+    canvas.drawString(name, 0, -40);
+    return true;
+}
 
-    // Item 0: Confirm button
-    items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+// Load font at current index
+bool loadCurrentFont() {
+    TRACE_SCOPE("loadCurrentFont");
+    WakePhaseScope phase(PHASE_LOAD_FONT);
+    if (activeFontCount() == 0) {
+        LOG_E("ERROR: No fonts available\n");
+        return false;
+    }
 
-    // Items 1-3: Radio buttons for intervals (different in debug mode)
-    if (rtcState.debugMode) {
-        // Debug mode: shorter intervals for testing (5, 2, 1 min)
-        items.push_back({MENU_RADIO, "5 min", "", false, 5, -1});
-        items.push_back({MENU_RADIO, "2 min", "", false, 2, -1});
-        items.push_back({MENU_RADIO, "1 min", "", true, 1, -1}); // Default: 1 min
+    // Unload previous font if loaded - IMPORTANT: destroy render first!
+    if (fontLoaded) {
+        LOG_D("Unloading previous font...\n");
+        canvas.destoryRender(24);           // Free label cache
+        canvas.unloadFont();                // Then unload font
+        fontLoaded = false;
+        delay(100);  // Give system time to free memory
+    }
+
+    // v2.2.1: Check if the catalog has the font (SD not available but cache might be)
+    const char* fontPath = "";
+    const FontCatalogRecord* record = activeFont(currentFontIndex);
+    if (record && !fontUsable(record)) {
+        LOG_D("Skipping unusable font %s (flags %02x)\n", record->path, record->flags);
+        return false;
+    }
+    if (record) {
+        fontPath = record->path;
+        LOG_D("\n=== Loading font: %s ===\n", fontPath);
     } else {
-        // Normal mode: standard intervals (15, 10, 5 min)
-        items.push_back({MENU_RADIO, "5 min", "", false, 5, -1});
-        items.push_back({MENU_RADIO, "10 min", "", false, 10, -1});
-        items.push_back({MENU_RADIO, "15 min", "", true, 15, -1}); // Default: 15 min
+        LOG_D("\n=== Loading font index %d (SD unavailable - cache only) ===\n", currentFontIndex);
     }
 
-    int cursorIndex = 0; // Start at "Confirm"
-    int scrollOffset = 0; // No scroll needed (only 4 items)
-    int selectedIntervalIndex = 3; // Default interval (last option)
+    // ========================================
+    // Battery Optimization: Check font cache first
+    // ========================================
 
-    // Initial render with full refresh to clear boot screen
-    renderMenuScreen("", items, cursorIndex, scrollOffset, true);
+    // 1. Check if this font is already cached in RAM
+    uint32_t fontId = currentFontId();
+    for (auto& entry : fontCache) {
+        if (entry.fontId == fontId) {
+            LOG_D("Cache HIT: Loading font %d from RAM (SD not needed!)\n", currentFontIndex);
+            esp_err_t loadResult = canvas.loadFont(entry.data, entry.size);
+            if (loadResult == ESP_OK) {
+                METRIC_INC(M_FONT_CACHE_HIT);
+                LOG_D("Font loaded from cache (%d bytes)\n", entry.size);
+                // Move to end (LRU - most recently used)
+                FontCacheEntry temp = entry;
+                fontCache.erase(std::find_if(fontCache.begin(), fontCache.end(),
+                    [&](const FontCacheEntry& e) { return e.fontId == fontId; }));
+                fontCache.push_back(temp);
 
-    // Navigation loop
-    bool confirmed = false;
-    while (!confirmed) {
-        M5.update();
+                // Create render cache for labels
+                if (!createFontRenderSizes()) {
+                    canvas.unloadFont();
+                    return false;
+                }
 
-        // Button UP (BtnL): Move cursor up
-        if (M5.BtnL.wasPressed()) {
-            Serial.println("BtnL pressed - moving up");
-            cursorIndex--;
-            if (cursorIndex < 0) {
-                cursorIndex = items.size() - 1; // Wrap around to bottom
+                fontLoaded = true;
+                LOG_D("=== Font loaded from cache successfully! ===\n\n");
+                return true;
+            } else {
+                LOG_W("WARNING: Cache load failed, falling back to SD\n");
+                // Continue to SD load below
+                break;
             }
-            renderMenuScreen("", items, cursorIndex, scrollOffset);
-            delay(200);
         }
+    }
 
-        // Button DOWN (BtnR): Move cursor down
-        if (M5.BtnR.wasPressed()) {
-            Serial.println("BtnR pressed - moving down");
-            cursorIndex++;
-            if (cursorIndex >= items.size()) {
-                cursorIndex = 0; // Wrap around to top
+    // 2. Cache MISS - load from SD
+    METRIC_INC(M_FONT_CACHE_MISS);
+    LOG_D("RAM cache MISS for font %d\n", currentFontIndex);
+    LOG_D("Loading font %d from SD\n", currentFontIndex);
+
+    // Check if SD is available and path is valid
+    if (fontPath[0] == '\0') {
+        LOG_E("ERROR: Font path is empty!\n");
+        LOG_D("Cannot load font - device needs reset with SD card\n");
+        return false;
+    }
+
+    // Check if file exists on SD
+    if (!SD.exists(fontPath)) {
+        LOG_E("ERROR: Font file does not exist on SD!\n");
+        rtcState.fontRescanPending = true; // Manifest is stale
+        return false;
+    }
+
+    File fontFile = SD.open(fontPath);
+    if (!fontFile) {
+        LOG_E("ERROR: Cannot open font file!\n");
+        return false;
+    }
+    size_t fontFileSize = fontFile.size();
+    LOG_D("Font file size: %d bytes\n", fontFileSize);
+
+    // 3. Decide if we should cache this font
+    bool shouldCache = (fontFileSize <= MAX_FONT_CACHE_SIZE);
+    uint8_t* fontData = nullptr;
+
+    if (shouldCache) {
+        // 4. Make room in cache if needed (LRU eviction)
+        while (totalCacheSize + fontFileSize > MAX_FONT_CACHE_SIZE && !fontCache.empty()) {
+            // Remove oldest entry (front of vector = least recently used)
+            LOG_D("Evicting font %08lx from cache (%d bytes) to make room\n",
+                  (unsigned long)fontCache[0].fontId, fontCache[0].size);
+            totalCacheSize -= fontCache[0].size;
+            free(fontCache[0].data);
+            fontCache.erase(fontCache.begin());
+            METRIC_INC(M_FONT_CACHE_EVICT);
+        }
+
+        // 5. Try to allocate cache memory
+        if (totalCacheSize + fontFileSize <= MAX_FONT_CACHE_SIZE) {
+            fontData = (uint8_t*)malloc(fontFileSize);
+            if (fontData) {
+                // Read font into cache
+                METRIC_ADD(M_SD_BYTES_READ, fontFile.read(fontData, fontFileSize));
+                LOG_D("Font read into cache buffer (%d bytes)\n", fontFileSize);
+            } else {
+                LOG_W("WARNING: malloc failed for font cache, loading directly from SD\n");
+                shouldCache = false;
             }
-            renderMenuScreen("", items, cursorIndex, scrollOffset);
-            delay(200);
+        } else {
+            LOG_W("WARNING: Not enough cache space, loading directly from SD\n");
+            shouldCache = false;
         }
+    } else {
+        LOG_D("Font too large to cache (>%d bytes), loading directly from SD\n", MAX_FONT_CACHE_SIZE);
+    }
 
-        // Button CENTER (BtnP): Select/Confirm
-        if (M5.BtnP.wasPressed()) {
-            if (cursorIndex == 0) {
-                // Confirm button pressed - exit
-                confirmed = true;
-                Serial.println("Confirm pressed - exiting interval selection");
-            } else {
-                // Radio button pressed - deselect all, select current
-                for (int i = 1; i < items.size(); i++) {
-                    items[i].selected = false;
-                }
-                items[cursorIndex].selected = true;
-                selectedIntervalIndex = cursorIndex;
-                renderMenuScreen("", items, cursorIndex, scrollOffset);
-                Serial.printf("Selected: %s\n", items[cursorIndex].label.c_str());
-            }
-            delay(200);
+    fontFile.close();
+
+    // 6. Load font (either from cache buffer or SD)
+    esp_err_t loadResult;
+    if (shouldCache && fontData) {
+        LOG_D("Loading font from cache buffer...\n");
+        loadResult = canvas.loadFont(fontData, fontFileSize);
+
+        if (loadResult == ESP_OK) {
+            // Successfully loaded from cache buffer - add to cache list
+            fontCache.push_back({fontId, fontData, fontFileSize});
+            totalCacheSize += fontFileSize;
+            LOG_D("Font cached successfully! (Total cache: %d/%d bytes, %d fonts)\n",
+                  totalCacheSize, MAX_FONT_CACHE_SIZE, fontCache.size());
+        } else {
+            LOG_E("ERROR: Failed to load font from cache buffer\n");
+            METRIC_INC(M_FONT_LOAD_ERRORS);
+            free(fontData);
+            markFontUnusable(currentFontIndex, "load failed");
+            return false;
+        }
+    } else {
+        // Load directly from SD (no caching)
+        LOG_D("Loading font directly from SD...\n");
+        loadResult = canvas.loadFont(String(fontPath), SD); // M5EPD only takes a String path
+        if (loadResult != ESP_OK) {
+            LOG_E("ERROR: Failed to load font from SD\n");
+            METRIC_INC(M_FONT_LOAD_ERRORS);
+            markFontUnusable(currentFontIndex, "load failed");
+            return false;
         }
+        METRIC_ADD(M_SD_BYTES_READ, fontFileSize);
+        LOG_D("Font loaded from SD successfully (not cached)\n");
+    }
 
-        delay(50);
+    // Create render cache for label size (24px)
+    // Note: Large glyph rendering uses direct FreeType API (drawPixel/drawLine),
+    // so we only need cache for small label text
+    if (!createFontRenderSizes()) {
+        canvas.unloadFont();
+        return false;
     }
 
-    int selectedInterval = items[selectedIntervalIndex].value;
-    Serial.printf("Interval selection confirmed: %d minutes\n", selectedInterval);
-    return selectedInterval;
+    fontLoaded = true;
+    LOG_D("=== Font loaded successfully! ===\n\n");
+    return true;
 }
 
-// ========================================
-// v2.1: Setup Screen - Font Selection
-// ========================================
-
-// Forward declarations needed for font selection
-extern std::vector<String> fontPaths;
-
-// Extract font name from path
-String getFontName(const String& path) {
-    int lastSlash = path.lastIndexOf('/');
-    String filename = path.substring(lastSlash + 1);
-    int lastDot = filename.lastIndexOf('.');
-    if (lastDot > 0) {
-        filename = filename.substring(0, lastDot);
+// v3.1: Load the current font or, if it fails (and is marked unusable), the next active
+// font that loads
+bool loadUsableFont() {
+    for (int attempts = 0; attempts < activeFontCount(); attempts++) {
+        if (loadCurrentFont()) return true;
+        currentFontIndex = (currentFontIndex + 1) % activeFontCount();
     }
-    return filename;
+    return false;
 }
 
-// Interactive font selection screen with scroll
-// Modifies config.fontEnabled based on user selection
-void setupScreenFontSelection() {
-    Serial.println("\n=== Setup Screen: Font Selection ===");
+// Free all cached fonts (useful for cleanup or memory pressure)
+void clearFontCache() {
+    LOG_I("Clearing font cache (%d fonts, %d bytes)...\n", fontCache.size(), totalCacheSize);
+    for (auto& entry : fontCache) {
+        free(entry.data);
+    }
+    fontCache.clear();
+    totalCacheSize = 0;
+    LOG_I("Font cache cleared\n");
+}
 
-    // Build menu items
-    std::vector<MenuItem> items;
+// ========================================
+// STEP 2+3: Outline Parsing and Rendering
+// ========================================
 
-    // Item 0: Confirm button
-    items.push_back({MENU_CONFIRM, "Confirm", "", false, 0, -1});
+// Maximum points/segments we can store (adjust if needed)
+#define MAX_OUTLINE_POINTS 200
+#define MAX_OUTLINE_SEGMENTS 200
 
-    // Items 1..N: Checkboxes for each font (all enabled by default)
-    for (size_t i = 0; i < fontPaths.size(); i++) {
-        // Extract font name from path
-        String fontName = getFontName(fontPaths[i]);
-        String displayName = shortenTextIfNeeded(fontName, UI_MAX_TEXT_WIDTH);
-        bool enabled = config.fontEnabled[i];
-        items.push_back({MENU_CHECKBOX, fontName, displayName, enabled, 0, i});
-    }
+// Point storage for outline rendering
+struct OutlinePoint {
+    float x, y;
+    bool is_control; // true = control point, false = on-curve point
+};
 
-    int cursorIndex = 0; // Start at "Confirm"
-    int scrollOffset = 0;
-    const int maxVisibleItems = 8; // Max items visible on screen
-    bool firstMove = true; // Flag to detect first cursor move
+// Segment types
+enum SegmentType {
+    SEG_MOVE,
+    SEG_LINE,
+    SEG_CONIC,
+    SEG_CUBIC
+};
 
-    // Initial render with full refresh to clear previous screen
-    renderMenuScreen("", items, cursorIndex, scrollOffset, true);
+// Segment storage
+struct OutlineSegment {
+    SegmentType type;
+    float x, y;           // Endpoint (or start for MOVE)
+    float cx, cy;         // Control point 1 (for CONIC/CUBIC)
+    float cx2, cy2;       // Control point 2 (for CUBIC only)
+};
 
-    // Navigation loop
-    bool confirmed = false;
-    while (!confirmed) {
-        M5.update();
+// Global storage for parsed outline
+OutlinePoint g_outline_points[MAX_OUTLINE_POINTS];
+OutlineSegment g_outline_segments[MAX_OUTLINE_SEGMENTS];
+int g_num_points = 0;
+int g_num_segments = 0;
 
-        bool cursorMoved = false;
+// Callback context for outline decomposition
+struct OutlineDecomposeContext {
+    int segment_count;
+    int moveto_count;
+    int lineto_count;
+    int conicto_count;
+    int cubicto_count;
+    float scale;          // Scale factor from font units to pixels
+    float offset_x;       // X offset for centering
+    float offset_y;       // Y offset for centering
+};
 
-        // Button UP (BtnL): Move cursor up
-        if (M5.BtnL.wasPressed()) {
-            Serial.println("BtnL pressed - moving up");
+// Callback: MoveTo (start new contour)
+int outlineMoveTo(const FT_Vector* to, void* user) {
+    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
+    ctx->segment_count++;
+    ctx->moveto_count++;
 
-            // First move away from Confirm: deselect all fonts
-            if (firstMove && cursorIndex == 0) {
-                Serial.println("First move from Confirm - deselecting all fonts");
-                for (size_t i = 1; i < items.size(); i++) {
-                    items[i].selected = false;
-                }
-                firstMove = false;
-            }
+    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
+        g_outline_segments[g_num_segments].type = SEG_MOVE;
+        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_num_segments++;
+    }
 
-            cursorIndex--;
-            if (cursorIndex < 0) {
-                cursorIndex = items.size() - 1; // Wrap to last item
-            }
-            cursorMoved = true;
-            delay(200);
-        }
+    // Save on-curve point
+    if (g_num_points < MAX_OUTLINE_POINTS) {
+        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_points[g_num_points].is_control = false; // On-curve
+        g_num_points++;
+    }
+    return 0;
+}
 
-        // Button DOWN (BtnR): Move cursor down
-        if (M5.BtnR.wasPressed()) {
-            Serial.println("BtnR pressed - moving down");
+// Callback: LineTo (straight line segment)
+int outlineLineTo(const FT_Vector* to, void* user) {
+    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
+    ctx->segment_count++;
+    ctx->lineto_count++;
 
-            // First move away from Confirm: deselect all fonts
-            if (firstMove && cursorIndex == 0) {
-                Serial.println("First move from Confirm - deselecting all fonts");
-                for (size_t i = 1; i < items.size(); i++) {
-                    items[i].selected = false;
-                }
-                firstMove = false;
-            }
+    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
+        g_outline_segments[g_num_segments].type = SEG_LINE;
+        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_num_segments++;
+    }
 
-            cursorIndex++;
-            // Wrap around: if at last item, go back to Confirm
-            if (cursorIndex >= items.size()) {
-                cursorIndex = 0;
-            }
+    // Save on-curve point
+    if (g_num_points < MAX_OUTLINE_POINTS) {
+        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_points[g_num_points].is_control = false; // On-curve
+        g_num_points++;
+    }
+    return 0;
+}
 
-            cursorMoved = true;
-            delay(200);
-        }
+// Callback: ConicTo (quadratic Bézier curve - TrueType)
+int outlineConicTo(const FT_Vector* control, const FT_Vector* to, void* user) {
+    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
+    ctx->segment_count++;
+    ctx->conicto_count++;
 
-        // Update scroll offset if cursor moved
-        if (cursorMoved) {
-            // Auto-scroll logic: keep cursor in visible area
-            if (cursorIndex < scrollOffset) {
-                // Cursor moved above visible area - scroll up
-                scrollOffset = cursorIndex;
-            } else if (cursorIndex >= scrollOffset + maxVisibleItems) {
-                // Cursor moved below visible area - scroll down
-                scrollOffset = cursorIndex - maxVisibleItems + 1;
-            }
+    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
+        g_outline_segments[g_num_segments].type = SEG_CONIC;
+        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_segments[g_num_segments].cx = control->x * ctx->scale + ctx->offset_x;
+        g_outline_segments[g_num_segments].cy = -control->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_num_segments++;
+    }
 
-            renderMenuScreen("", items, cursorIndex, scrollOffset);
-        }
+    // Save control point (off-curve)
+    if (g_num_points < MAX_OUTLINE_POINTS) {
+        g_outline_points[g_num_points].x = control->x * ctx->scale + ctx->offset_x;
+        g_outline_points[g_num_points].y = -control->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_points[g_num_points].is_control = true; // Off-curve (control)
+        g_num_points++;
+    }
 
-        // Button CENTER (BtnP): Toggle checkbox or confirm
-        if (M5.BtnP.wasPressed()) {
-            if (cursorIndex == 0) {
-                // Confirm button pressed - save and exit
-                confirmed = true;
-                Serial.println("Confirm pressed - saving font selections");
+    // Save endpoint (on-curve)
+    if (g_num_points < MAX_OUTLINE_POINTS) {
+        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_points[g_num_points].is_control = false; // On-curve
+        g_num_points++;
+    }
+    return 0;
+}
 
-                // Update config.fontEnabled from items
-                for (size_t i = 0; i < fontPaths.size(); i++) {
-                    config.fontEnabled[i] = items[i + 1].selected; // +1 because item 0 is Confirm
-                }
+// Callback: CubicTo (cubic Bézier curve - PostScript/OpenType)
+int outlineCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user) {
+    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
+    ctx->segment_count++;
+    ctx->cubicto_count++;
 
-                // Count enabled fonts
-                int enabledCount = 0;
-                for (bool enabled : config.fontEnabled) {
-                    if (enabled) enabledCount++;
-                }
-                Serial.printf("Fonts enabled: %d/%d\n", enabledCount, fontPaths.size());
+    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
+        g_outline_segments[g_num_segments].type = SEG_CUBIC;
+        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_segments[g_num_segments].cx = control1->x * ctx->scale + ctx->offset_x;
+        g_outline_segments[g_num_segments].cy = -control1->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_segments[g_num_segments].cx2 = control2->x * ctx->scale + ctx->offset_x;
+        g_outline_segments[g_num_segments].cy2 = -control2->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_num_segments++;
+    }
 
-            } else {
-                // Checkbox pressed - toggle
-                items[cursorIndex].selected = !items[cursorIndex].selected;
-                renderMenuScreen("", items, cursorIndex, scrollOffset);
-                Serial.printf("Toggled: %s -> %s\n",
-                             items[cursorIndex].label.c_str(),
-                             items[cursorIndex].selected ? "enabled" : "disabled");
-            }
-            delay(200);
-        }
+    // Save control point 1 (off-curve)
+    if (g_num_points < MAX_OUTLINE_POINTS) {
+        g_outline_points[g_num_points].x = control1->x * ctx->scale + ctx->offset_x;
+        g_outline_points[g_num_points].y = -control1->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_points[g_num_points].is_control = true; // Off-curve
+        g_num_points++;
+    }
 
-        delay(50);
+    // Save control point 2 (off-curve)
+    if (g_num_points < MAX_OUTLINE_POINTS) {
+        g_outline_points[g_num_points].x = control2->x * ctx->scale + ctx->offset_x;
+        g_outline_points[g_num_points].y = -control2->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_points[g_num_points].is_control = true; // Off-curve
+        g_num_points++;
     }
 
-    Serial.println("=== Font Selection Complete ===\n");
+    // Save endpoint (on-curve)
+    if (g_num_points < MAX_OUTLINE_POINTS) {
+        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
+        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
+        g_outline_points[g_num_points].is_control = false; // On-curve
+        g_num_points++;
+    }
+    return 0;
 }
 
 // ========================================
-// FT_Face Access Workaround
+// Helper: Find a valid glyph in the current font
 // ========================================
-// M5EPD_Canvas inherits from TFT_eSPI which has protected static _font_face
-// We use external symbol access to bypass protected access control
-
-// External declarations to access TFT_eSPI protected statics
-// This is a memory hack but works without modifying the library
-extern "C" {
-    // These symbols exist in TFT_eSPI compiled code
-    // We're just accessing them directly via linker
-}
-
-// Helper struct matching font_face_t from font_render.h
-struct font_face_accessor {
-    FT_Face ft_face;
-    uint16_t pixel_size;
-};
 
-// Access function using symbol name mangling knowledge
-FT_Face getFontFaceFromCanvas() {
-    // TFT_eSPI::_font_face is a static member
-    // We can access it via external linkage using the mangled name
-    // But this is compiler-specific and fragile
+// Try to find a glyph that exists in the font, starting from the preferred codepoint
+// Returns the found codepoint, or 0 if no valid glyph found
+uint32_t findValidGlyph(uint32_t preferredCodepoint) {
+    FT_Face face = getFontFaceFromCanvas();
+    if (!face) {
+        return 0;
+    }
 
-    // ALTERNATIVE: Use the canvas object directly as a memory accessor
-    // Cast canvas to access its parent class protected members
-    // This works because M5EPD_Canvas IS-A TFT_eSPI
+    // First try the preferred codepoint
+    FT_UInt glyph_index = FT_Get_Char_Index(face, preferredCodepoint);
+    if (glyph_index != 0) {
+        return preferredCodepoint; // Found!
+    }
 
-    // SIMPLEST WORKAROUND: Access via canvas's internal methods
-    // The font is already loaded, we just need the FT_Face pointer
+    LOG_D("Glyph U+%04X not in font, searching for alternative...\n", preferredCodepoint);
 
-    // For now, use a friend class hack via template specialization
-    // Actually, let's try the reinterpret_cast approach
+    // v2.2: Try to find ANY valid glyph in enabled Unicode ranges
+    for (int i = 0; i < numGlyphRanges; i++) {
+        // Skip disabled ranges
+        if (i >= config.rangeEnabled.size() || !config.rangeEnabled[i]) {
+            continue;
+        }
 
-    // HACK: Get pointer to TFT_eSPI's static _font_face via memory layout
-    // This assumes the symbol is accessible via linker (it should be)
+        for (uint32_t codepoint = glyphRanges[i].start; codepoint <= glyphRanges[i].end; codepoint++) {
+            glyph_index = FT_Get_Char_Index(face, codepoint);
+            if (glyph_index != 0) {
+                LOG_D("Found alternative glyph: U+%04X from %s\n", codepoint, glyphRanges[i].name);
+                return codepoint;
+            }
+        }
+    }
 
-    // Import the external symbol (defined in TFT_eSPI compiled code)
-    extern font_face_t _ZN8TFT_eSPI10_font_faceE; // mangled name for TFT_eSPI::_font_face
+    // If still nothing, try the first glyph in the font (usually space or .notdef)
+    FT_UInt agindex;
+    FT_ULong charcode = FT_Get_First_Char(face, &agindex);
+    if (agindex != 0 && charcode != 0) {
+        LOG_D("Found first available glyph in font: U+%04lX (index %u)\n", charcode, agindex);
+        return (uint32_t)charcode;
+    }
 
-    return _ZN8TFT_eSPI10_font_faceE.ft_face;
+    LOG_E("ERROR: No valid glyphs found in font!\n");
+    return 0; // No glyphs found at all
 }
 
-// Refresh logic state
-uint8_t partialRefreshCount = 0;
-unsigned long firstPartialAfterFullTime = 0;
-bool hasPartialSinceLastFull = false;
-const uint8_t MAX_PARTIAL_BEFORE_FULL = 5;
-const unsigned long FULL_REFRESH_TIMEOUT_MS = 10000; // 10 seconds from first partial
-
-// Power management state
-unsigned long lastFullRefreshTime = 0;
-unsigned long lastButtonActivityTime = 0;
-const unsigned long DEEP_SLEEP_TIMEOUT_MS = 10000; // 10 seconds from last full refresh
-bool isAutoWakeSession = false; // Flag: if true, skip idle wait and sleep immediately after render
-bool isFirstRenderAfterWake = false; // Flag: if true, do double full refresh to eliminate wake artifacts
-
-// Touch screen state (v3.0)
-bool touchEnabled = false; // Touch is enabled only when device is awake (not during auto-wake, boot, shutdown)
-int16_t touchStartX = 0;
-int16_t touchStartY = 0;
-unsigned long touchStartTime = 0;
-bool touchWasPressed = false;
-bool touchStartValid = false; // Flag to track if we have valid start coordinates (filter GT911 spurious (0,0))
-bool longPressFired = false; // Prevent multiple toggle on single long press
-
-// Touch gesture thresholds (v3.0)
-const int16_t TAP_MAX_MOVEMENT = 20;           // Maximum movement for tap
-const unsigned long LONG_PRESS_DURATION = 800; // 800ms for mode toggle
+// ========================================
+// STEP 1+2: FT_Face Access and Outline Decompose Test
+// ========================================
 
-// Screen divided into 3 vertical zones (180px each), with 90px margins top/bottom for labels
-const int16_t ZONE_TOP_MARGIN = 90;            // Leave top area free for labels
-const int16_t ZONE_BOTTOM_MARGIN = 870;        // 960 - 90 = 870, leave bottom area free
-const int16_t ZONE_LEFT_MIN = 0;
-const int16_t ZONE_LEFT_MAX = 180;
-const int16_t ZONE_CENTER_MIN = 180;
-const int16_t ZONE_CENTER_MAX = 360;
-const int16_t ZONE_RIGHT_MIN = 360;
-const int16_t ZONE_RIGHT_MAX = 540;
+// Test function to access FT_Face and print glyph outline info
+void testGlyphOutlineAccess(uint32_t codepoint) {
+    LOG_D("\n=== STEP 1: Testing FT_Face Access ===\n");
 
-// View mode enumeration
-// Font management
-std::vector<String> fontPaths;
-int currentFontIndex = 0;
-bool fontLoaded = false;
+    // Get FT_Face from protected member via external symbol access
+    FT_Face face = getFontFaceFromCanvas();
+    if (!face) {
+        LOG_E("ERROR: FT_Face is NULL (font not loaded?)\n");
+        return;
+    }
 
-// Glyph rendering
-const int GLYPH_SIZE = 375; // Balanced size for specimen display
-uint32_t currentGlyphCodepoint = 0x0041; // Start with 'A'
+    LOG_D("✓ FT_Face accessed successfully!\n");
+    LOG_D("  Font family: %s\n", face->family_name);
+    LOG_D("  Font style: %s\n", face->style_name);
+    LOG_D("  Num glyphs in font: %ld\n", face->num_glyphs);
 
-// STEP 5: Current view mode
-ViewMode currentViewMode = BITMAP;  // Start in bitmap mode (default)
+    // Load the glyph for the current codepoint
+    FT_UInt glyph_index = FT_Get_Char_Index(face, codepoint);
+    if (glyph_index == 0) {
+        LOG_W("WARNING: Glyph U+%04X not found in font\n", codepoint);
+        return;
+    }
 
-// Scan microSD for font files
-void scanFonts() {
-    fontPaths.clear();
+    LOG_D("  Glyph index for U+%04X: %u\n", codepoint, glyph_index);
 
-    File fontsDir = SD.open("/fonts");
-    if (!fontsDir) {
-        Serial.println("ERROR: Cannot open /fonts directory");
+    // Load glyph with FT_LOAD_NO_SCALE to get raw outline data
+    FT_Error error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_SCALE);
+    if (error) {
+        METRIC_INC(M_FT_ERRORS);
+        LOG_E("ERROR: Failed to load glyph (error %d)\n", error);
         return;
     }
 
-    Serial.println("\n=== Scanning for fonts ===");
-    File entry;
-    while (entry = fontsDir.openNextFile()) {
-        if (!entry.isDirectory()) {
-            String filename = String(entry.name());
-            // Skip macOS hidden files (._*)
-            if (filename.startsWith("._")) {
-                Serial.printf("  Skipping hidden file: %s\n", filename.c_str());
-                entry.close();
-                continue;
-            }
-            if (filename.endsWith(".ttf") || filename.endsWith(".otf") ||
-                filename.endsWith(".TTF") || filename.endsWith(".OTF")) {
-                String fullPath = "/fonts/" + filename;
-                fontPaths.push_back(fullPath);
-                Serial.printf("  Found: %s\n", fullPath.c_str());
-            }
-        }
-        entry.close();
+    // Check if glyph has outline data
+    if (face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
+        LOG_W("WARNING: Glyph is not outline format (format=%c%c%c%c)\n",
+             (face->glyph->format >> 24) & 0xFF,
+             (face->glyph->format >> 16) & 0xFF,
+             (face->glyph->format >> 8) & 0xFF,
+             face->glyph->format & 0xFF);
+        return;
     }
-    fontsDir.close();
 
-    Serial.printf("Total fonts found: %d\n", fontPaths.size());
-}
+    // Access outline data
+    FT_Outline* outline = &face->glyph->outline;
 
-// Load font at current index
-bool loadCurrentFont() {
-    if (fontPaths.empty()) {
-        Serial.println("ERROR: No fonts available");
-        return false;
-    }
+    LOG_D("\n✓ Glyph U+%04X outline data:\n", codepoint);
+    LOG_D("  Contours: %d\n", outline->n_contours);
+    LOG_D("  Points: %d\n", outline->n_points);
+    LOG_D("  Flags available: %s\n", outline->flags ? "yes" : "no");
 
-    // Unload previous font if loaded - IMPORTANT: destroy render first!
-    if (fontLoaded) {
-        Serial.println("Unloading previous font...");
-        canvas.destoryRender(24);           // Free label cache
-        canvas.unloadFont();                // Then unload font
-        fontLoaded = false;
-        delay(100);  // Give system time to free memory
+    // Show first few points as proof (Step 1 verification)
+    if (outline->n_points > 0) {
+        LOG_D("\n  First 5 points (raw font units):\n");
+        int max_points = outline->n_points < 5 ? outline->n_points : 5;
+        for (int i = 0; i < max_points; i++) {
+            char point_type = (outline->tags[i] & FT_CURVE_TAG_ON) ? 'O' : 'C'; // O=on-curve, C=control
+            LOG_V("    [%d] (%ld, %ld) [%c]\n",
+                 i,
+                 outline->points[i].x,
+                 outline->points[i].y,
+                 point_type);
+        }
     }
 
-    // v2.2.1: Check if fontPaths is empty (SD not available but cache might be)
-    String fontPath = "";
-    if (currentFontIndex < fontPaths.size()) {
-        fontPath = fontPaths[currentFontIndex];
-        Serial.printf("\n=== Loading font: %s ===\n", fontPath.c_str());
-    } else {
-        Serial.printf("\n=== Loading font index %d (SD unavailable - cache only) ===\n", currentFontIndex);
-    }
+    LOG_D("\n=== STEP 1: FT_Face Access SUCCESS! ===\n");
 
     // ========================================
-    // Battery Optimization: Check font cache first
+    // STEP 2: Decompose outline into segments
     // ========================================
+    LOG_D("\n=== STEP 2: Decomposing Outline ===\n");
 
-    // 1. Check if this font is already cached in RAM
-    for (auto& entry : fontCache) {
-        if (entry.fontIndex == currentFontIndex) {
-            Serial.printf("Cache HIT: Loading font %d from RAM (SD not needed!)\n", currentFontIndex);
-            esp_err_t loadResult = canvas.loadFont(entry.data, entry.size);
-            if (loadResult == ESP_OK) {
-                Serial.printf("Font loaded from cache (%d bytes)\n", entry.size);
-                // Move to end (LRU - most recently used)
-                FontCacheEntry temp = entry;
-                fontCache.erase(std::find_if(fontCache.begin(), fontCache.end(),
-                    [&](const FontCacheEntry& e) { return e.fontIndex == currentFontIndex; }));
-                fontCache.push_back(temp);
+    // Setup callback function table
+    FT_Outline_Funcs callbacks;
+    callbacks.move_to = (FT_Outline_MoveToFunc)outlineMoveTo;
+    callbacks.line_to = (FT_Outline_LineToFunc)outlineLineTo;
+    callbacks.conic_to = (FT_Outline_ConicToFunc)outlineConicTo;
+    callbacks.cubic_to = (FT_Outline_CubicToFunc)outlineCubicTo;
+    callbacks.shift = 0;  // No coordinate shift
+    callbacks.delta = 0;  // No coordinate delta
 
-                // Create render cache for labels
-                esp_err_t renderResult24 = canvas.createRender(24, 64);
-                if (renderResult24 != ESP_OK) {
-                    Serial.println("ERROR: Failed to create render cache for size 24");
-                    canvas.unloadFont();
-                    return false;
-                }
+    // Context to track decomposition stats
+    OutlineDecomposeContext ctx = {0, 0, 0, 0, 0};
 
-                fontLoaded = true;
-                Serial.println("=== Font loaded from cache successfully! ===\n");
-                return true;
-            } else {
-                Serial.println("WARNING: Cache load failed, falling back to SD");
-                // Continue to SD load below
-                break;
-            }
+    // Decompose outline into segments
+    LOG_D("\nDecomposing %d contours into segments:\n", outline->n_contours);
+    LOG_D("(Coordinates in font units, not yet scaled to pixels)\n\n");
+
+    FT_Error decompose_error = FT_Outline_Decompose(outline, &callbacks, &ctx);
+
+    if (decompose_error) {
+        METRIC_INC(M_FT_ERRORS);
+        LOG_E("ERROR: FT_Outline_Decompose failed (error %d)\n", decompose_error);
+    } else {
+        LOG_D("\n✓ Outline decomposition complete!\n");
+        LOG_D("  Total segments: %d\n", ctx.segment_count);
+        LOG_D("  - MoveTo (contour start): %d\n", ctx.moveto_count);
+        LOG_D("  - LineTo (straight lines): %d\n", ctx.lineto_count);
+        LOG_D("  - ConicTo (quadratic Bézier): %d\n", ctx.conicto_count);
+        LOG_D("  - CubicTo (cubic Bézier): %d\n", ctx.cubicto_count);
+
+        // Determine font type from curve usage
+        if (ctx.conicto_count > 0 && ctx.cubicto_count == 0) {
+            LOG_D("  Font type: TrueType (quadratic Bézier curves)\n");
+        } else if (ctx.cubicto_count > 0 && ctx.conicto_count == 0) {
+            LOG_D("  Font type: PostScript/OpenType (cubic Bézier curves)\n");
+        } else if (ctx.conicto_count == 0 && ctx.cubicto_count == 0) {
+            LOG_D("  Font type: Simple polygonal outline (no curves)\n");
+        } else {
+            LOG_D("  Font type: Mixed (both quadratic and cubic curves - rare!)\n");
         }
     }
 
-    // 2. Cache MISS - load from SD
-    Serial.printf("RAM cache MISS for font %d\n", currentFontIndex);
-    Serial.printf("Loading font %d from SD\n", currentFontIndex);
+    LOG_D("\n=== STEP 2: Outline Decompose SUCCESS! ===\n\n");
+}
 
-    // Check if SD is available and path is valid
-    if (fontPath.isEmpty()) {
-        Serial.println("ERROR: Font path is empty!");
-        Serial.println("Cannot load font - device needs reset with SD card");
+// ========================================
+// STEP 3: Parse and Render Outline
+// ========================================
+
+// Parse glyph outline and store scaled segments
+bool parseGlyphOutline(uint32_t codepoint) {
+    TRACE_SCOPE("parseGlyphOutline");
+    // Reset storage
+    g_num_segments = 0;
+    g_num_points = 0;
+
+    // Get FT_Face
+    FT_Face face = getFontFaceFromCanvas();
+    if (!face) {
+        LOG_E("ERROR: FT_Face is NULL\n");
+        return false;
+    }
+
+    // Load glyph
+    FT_UInt glyph_index = FT_Get_Char_Index(face, codepoint);
+    if (glyph_index == 0) {
+        LOG_W("WARNING: Glyph U+%04X not found\n", codepoint);
         return false;
     }
 
-    // Check if file exists on SD
-    if (!SD.exists(fontPath)) {
-        Serial.println("ERROR: Font file does not exist on SD!");
+    FT_Error error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_SCALE);
+    if (error) {
+        METRIC_INC(M_FT_ERRORS);
+        LOG_E("ERROR: Failed to load glyph (error %d)\n", error);
         return false;
     }
 
-    File fontFile = SD.open(fontPath);
-    if (!fontFile) {
-        Serial.println("ERROR: Cannot open font file!");
+    if (face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
+        LOG_W("WARNING: Glyph is not outline format\n");
         return false;
     }
-    size_t fontFileSize = fontFile.size();
-    Serial.printf("Font file size: %d bytes\n", fontFileSize);
 
-    // 3. Decide if we should cache this font
-    bool shouldCache = (fontFileSize <= MAX_FONT_CACHE_SIZE);
-    uint8_t* fontData = nullptr;
+    FT_Outline* outline = &face->glyph->outline;
 
-    if (shouldCache) {
-        // 4. Make room in cache if needed (LRU eviction)
-        while (totalCacheSize + fontFileSize > MAX_FONT_CACHE_SIZE && !fontCache.empty()) {
-            // Remove oldest entry (front of vector = least recently used)
-            Serial.printf("Evicting font %d from cache (%d bytes) to make room\n",
-                          fontCache[0].fontIndex, fontCache[0].size);
-            totalCacheSize -= fontCache[0].size;
-            free(fontCache[0].data);
-            fontCache.erase(fontCache.begin());
-        }
+    // Calculate bounding box for scaling
+    FT_BBox bbox;
+    FT_Outline_Get_CBox(outline, &bbox);
 
-        // 5. Try to allocate cache memory
-        if (totalCacheSize + fontFileSize <= MAX_FONT_CACHE_SIZE) {
-            fontData = (uint8_t*)malloc(fontFileSize);
-            if (fontData) {
-                // Read font into cache
-                fontFile.read(fontData, fontFileSize);
-                Serial.printf("Font read into cache buffer (%d bytes)\n", fontFileSize);
-            } else {
-                Serial.println("WARNING: malloc failed for font cache, loading directly from SD");
-                shouldCache = false;
-            }
-        } else {
-            Serial.println("WARNING: Not enough cache space, loading directly from SD");
-            shouldCache = false;
-        }
-    } else {
-        Serial.printf("Font too large to cache (>%d bytes), loading directly from SD\n", MAX_FONT_CACHE_SIZE);
-    }
+    float width = bbox.xMax - bbox.xMin;
+    float height = bbox.yMax - bbox.yMin;
 
-    fontFile.close();
+    // Target size: 400px (scale each glyph to fill screen optimally)
+    float target_size = 400.0f;
+    float scale = target_size / (width > height ? width : height);
 
-    // 6. Load font (either from cache buffer or SD)
-    esp_err_t loadResult;
-    if (shouldCache && fontData) {
-        Serial.println("Loading font from cache buffer...");
-        loadResult = canvas.loadFont(fontData, fontFileSize);
+    // Center on display (540x960 vertical)
+    int centerX = 270;
+    int centerY = 480;
 
-        if (loadResult == ESP_OK) {
-            // Successfully loaded from cache buffer - add to cache list
-            fontCache.push_back({currentFontIndex, fontData, fontFileSize});
-            totalCacheSize += fontFileSize;
-            Serial.printf("Font cached successfully! (Total cache: %d/%d bytes, %d fonts)\n",
-                          totalCacheSize, MAX_FONT_CACHE_SIZE, fontCache.size());
-        } else {
-            Serial.println("ERROR: Failed to load font from cache buffer");
-            free(fontData);
-            return false;
-        }
-    } else {
-        // Load directly from SD (no caching)
-        Serial.println("Loading font directly from SD...");
-        loadResult = canvas.loadFont(fontPath, SD);
-        if (loadResult != ESP_OK) {
-            Serial.println("ERROR: Failed to load font from SD");
-            return false;
-        }
-        Serial.println("Font loaded from SD successfully (not cached)");
-    }
+    // Calculate center of glyph bounding box
+    float bbox_center_x = (bbox.xMin + bbox.xMax) / 2.0f;
+    float bbox_center_y = (bbox.yMin + bbox.yMax) / 2.0f;
 
-    // Create render cache for label size (24px)
-    // Note: Large glyph rendering uses direct FreeType API (drawPixel/drawLine),
-    // so we only need cache for small label text
-    Serial.printf("Creating render cache for labels (size=24, cache=64)...\n");
-    esp_err_t renderResult24 = canvas.createRender(24, 64);
-    Serial.printf("createRender(24) returned: %d\n", renderResult24);
+    // Offset to center the glyph on display
+    // Y axis is flipped (font coords increase upward, screen coords increase downward)
+    float offset_x = centerX - bbox_center_x * scale;
+    float offset_y = centerY + bbox_center_y * scale; // Y is negated in callbacks, so add here
 
-    if (renderResult24 != ESP_OK) {
-        Serial.println("ERROR: Failed to create render cache for size 24");
-        canvas.unloadFont();
+    LOG_D("Parsing outline: scale=%.4f, offset=(%.1f, %.1f)\n", scale, offset_x, offset_y);
+
+    // Setup callback context
+    OutlineDecomposeContext ctx = {0, 0, 0, 0, 0, scale, offset_x, offset_y};
+
+    // Setup callbacks
+    FT_Outline_Funcs callbacks;
+    callbacks.move_to = (FT_Outline_MoveToFunc)outlineMoveTo;
+    callbacks.line_to = (FT_Outline_LineToFunc)outlineLineTo;
+    callbacks.conic_to = (FT_Outline_ConicToFunc)outlineConicTo;
+    callbacks.cubic_to = (FT_Outline_CubicToFunc)outlineCubicTo;
+    callbacks.shift = 0;
+    callbacks.delta = 0;
+
+    // Decompose outline
+    FT_Error decompose_error = FT_Outline_Decompose(outline, &callbacks, &ctx);
+    if (decompose_error) {
+        METRIC_INC(M_FT_ERRORS);
+        LOG_E("ERROR: FT_Outline_Decompose failed (error %d)\n", decompose_error);
         return false;
     }
 
-    fontLoaded = true;
-    Serial.println("=== Font loaded successfully! ===\n");
+    LOG_D("Parsed %d segments (MoveTo:%d LineTo:%d Conic:%d Cubic:%d)\n",
+         g_num_segments, ctx.moveto_count, ctx.lineto_count,
+         ctx.conicto_count, ctx.cubicto_count);
+
     return true;
 }
 
-// Free all cached fonts (useful for cleanup or memory pressure)
-void clearFontCache() {
-    Serial.printf("Clearing font cache (%d fonts, %d bytes)...\n", fontCache.size(), totalCacheSize);
-    for (auto& entry : fontCache) {
-        free(entry.data);
+// Helper function to draw a dashed line
+void drawDashedLine(float x1, float y1, float x2, float y2, uint8_t color) {
+    // Calculate line length and direction
+    float dx = x2 - x1;
+    float dy = y2 - y1;
+    float length = sqrt(dx * dx + dy * dy);
+
+    if (length < 0.5f) return; // Too short to draw
+
+    // Normalize direction
+    dx /= length;
+    dy /= length;
+
+    // Dash pattern: 10 pixels on, 5 pixels off (longer for better visibility)
+    float dash_length = 10.0f;
+    float gap_length = 5.0f;
+    float pattern_length = dash_length + gap_length;
+
+    float distance = 0.0f;
+    bool drawing = true;
+
+    while (distance < length) {
+        float segment_length = drawing ? dash_length : gap_length;
+        float end_distance = distance + segment_length;
+        if (end_distance > length) end_distance = length;
+
+        if (drawing) {
+            float sx = x1 + dx * distance;
+            float sy = y1 + dy * distance;
+            float ex = x1 + dx * end_distance;
+            float ey = y1 + dy * end_distance;
+            canvas.drawLine(sx, sy, ex, ey, color);
+        }
+
+        distance = end_distance;
+        drawing = !drawing;
     }
-    fontCache.clear();
-    totalCacheSize = 0;
-    Serial.println("Font cache cleared");
 }
 
 // ========================================
-// STEP 2+3: Outline Parsing and Rendering
+// v3.1: Energy Governor
 // ========================================
-
-// Maximum points/segments we can store (adjust if needed)
-#define MAX_OUTLINE_POINTS 200
-#define MAX_OUTLINE_SEGMENTS 200
-
-// Point storage for outline rendering
-struct OutlinePoint {
-    float x, y;
-    bool is_control; // true = control point, false = on-curve point
+// Scales the work done per wake with the remaining charge. Above 30% nothing changes.
+// Below that, auto-wakes get rarer, stop switching fonts, use a single GC16 instead of
+// the double wake refresh, and show frames pre-rendered during the last interactive
+// session instead of loading a font and running FreeType (see prerenderAutoWakeFrames()).
+
+enum PowerTier {
+    TIER_NORMAL = 0,
+    TIER_SAVER,
+    TIER_CRITICAL
 };
 
-// Segment types
-enum SegmentType {
-    SEG_MOVE,
-    SEG_LINE,
-    SEG_CONIC,
-    SEG_CUBIC
+struct GovernorPolicy {
+    const char* name;
+    uint8_t intervalMultiplier;   // Applied to the scheduled sleep
+    bool allowFontSwitch;         // Auto-wake may pick another font (if config allows)
+    bool allowModeSwitch;         // Auto-wake may toggle bitmap/outline (if config allows)
+    bool singleWakeRefresh;       // One GC16 on the first render after wake instead of two
+    bool usePrerenderedFrames;    // Auto-wake shows a frame rendered ahead of time
 };
 
-// Segment storage
-struct OutlineSegment {
-    SegmentType type;
-    float x, y;           // Endpoint (or start for MOVE)
-    float cx, cy;         // Control point 1 (for CONIC/CUBIC)
-    float cx2, cy2;       // Control point 2 (for CUBIC only)
+const GovernorPolicy GOVERNOR_POLICIES[] = {
+    // name        interval  font   mode   1xGC16 prerender
+    {"NORMAL",     1,        true,  true,  false, false},
+    {"SAVER",      2,        false, true,  true,  true},
+    {"CRITICAL",   4,        false, false, true,  true},
 };
 
-// Global storage for parsed outline
-OutlinePoint g_outline_points[MAX_OUTLINE_POINTS];
-OutlineSegment g_outline_segments[MAX_OUTLINE_SEGMENTS];
-int g_num_points = 0;
-int g_num_segments = 0;
+const float GOVERNOR_SAVER_PCT = 30.0;      // Below: TIER_SAVER
+const float GOVERNOR_CRITICAL_PCT = 15.0;   // Below: TIER_CRITICAL
+const float GOVERNOR_HYSTERESIS_PCT = 3.0;  // Needed above a threshold to step back up
 
-// Callback context for outline decomposition
-struct OutlineDecomposeContext {
-    int segment_count;
-    int moveto_count;
-    int lineto_count;
-    int conicto_count;
-    int cubicto_count;
-    float scale;          // Scale factor from font units to pixels
-    float offset_x;       // X offset for centering
-    float offset_y;       // Y offset for centering
-};
+PowerTier powerTier = TIER_NORMAL;
 
-// Callback: MoveTo (start new contour)
-int outlineMoveTo(const FT_Vector* to, void* user) {
-    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
-    ctx->segment_count++;
-    ctx->moveto_count++;
+const GovernorPolicy& governor() {
+    return GOVERNOR_POLICIES[powerTier];
+}
 
-    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
-        g_outline_segments[g_num_segments].type = SEG_MOVE;
-        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_num_segments++;
-    }
+// Tier for a battery level, with hysteresis so noise around a threshold does not flap.
+// Pure function.
+PowerTier powerTierFor(float percentage, PowerTier previous) {
+    float saverUp = GOVERNOR_SAVER_PCT + (previous >= TIER_SAVER ? GOVERNOR_HYSTERESIS_PCT : 0);
+    float criticalUp = GOVERNOR_CRITICAL_PCT + (previous >= TIER_CRITICAL ? GOVERNOR_HYSTERESIS_PCT : 0);
+    if (percentage < criticalUp) return TIER_CRITICAL;
+    if (percentage < saverUp) return TIER_SAVER;
+    return TIER_NORMAL;
+}
 
-    // Save on-curve point
-    if (g_num_points < MAX_OUTLINE_POINTS) {
-        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_points[g_num_points].is_control = false; // On-curve
-        g_num_points++;
+void updatePowerTier(float percentage) {
+    PowerTier previous = (PowerTier)min((int)rtcState.powerTier, (int)TIER_CRITICAL);
+    powerTier = powerTierFor(percentage, previous);
+    rtcState.powerTier = powerTier;
+    if (powerTier != previous) {
+        LOG_I("Energy governor: %s -> %s (battery %.1f%%)\n",
+              GOVERNOR_POLICIES[previous].name, governor().name, percentage);
+    } else {
+        LOG_I("Energy governor: %s (battery %.1f%%)\n", governor().name, percentage);
     }
-    return 0;
 }
 
-// Callback: LineTo (straight line segment)
-int outlineLineTo(const FT_Vector* to, void* user) {
-    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
-    ctx->segment_count++;
-    ctx->lineto_count++;
+// Render into the canvas without pushing to the EPD (pre-rendering)
+bool renderToCanvasOnly = false;
 
-    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
-        g_outline_segments[g_num_segments].type = SEG_LINE;
-        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_num_segments++;
+// ========================================
+// v3.1: Cancellable Renders
+// ========================================
+// Renders started by user input can be abandoned when newer input arrives (e.g. fast
+// BtnR scrolling): there is no point finishing rasterization or pushing a frame that
+// is about to be replaced. Renders from setup() and auto-wake are never cancelled.
+
+// Forward declarations (event queue is defined with the state machine below)
+void pollInputEvents();
+extern int eventQueueCount;
+
+bool renderCancellable = false;   // Set by the dispatcher for user-triggered renders
+bool renderCancelled = false;     // Latched once newer input is seen
+bool frameOwed = false;           // A render was abandoned: the panel may not match the app state
+unsigned long lastSupersedePollTime = 0;
+const unsigned long SUPERSEDE_POLL_INTERVAL_MS = 15; // Input poll rate during a render
+
+// Returns true if newer input is queued and the current render should stop.
+// Polls buttons/touch at most every SUPERSEDE_POLL_INTERVAL_MS (events stay queued).
+bool renderSuperseded() {
+    if (!renderCancellable) return false;
+    if (renderCancelled) return true;
+
+    if (millis() - lastSupersedePollTime >= SUPERSEDE_POLL_INTERVAL_MS) {
+        lastSupersedePollTime = millis();
+        pollInputEvents();
     }
 
-    // Save on-curve point
-    if (g_num_points < MAX_OUTLINE_POINTS) {
-        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_points[g_num_points].is_control = false; // On-curve
-        g_num_points++;
+    if (eventQueueCount > 0) {
+        renderCancelled = true;
+        METRIC_INC(M_RENDERS_CANCELLED);
+        LOG_D("Render superseded by newer input - aborting\n");
     }
-    return 0;
+    return renderCancelled;
 }
 
-// Callback: ConicTo (quadratic Bézier curve - TrueType)
-int outlineConicTo(const FT_Vector* control, const FT_Vector* to, void* user) {
-    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
-    ctx->segment_count++;
-    ctx->conicto_count++;
+// ========================================
+// v3.1: Progressive Refresh (1-bit preview, grayscale settle)
+// ========================================
+// While the user is browsing, a glyph is first shown as a thresholded black/white
+// preview with UPDATE_MODE_DU (much faster than GL16). Once input has been quiet for
+// SETTLE_QUIET_MS, the event loop upgrades the same frame in place to 16 levels (GL16).
+// The canvas keeps the grayscale frame; the preview is thresholded while packing it
+// for the 1bpp transfer (pushFrame), so it costs a quarter of a 4bpp push.
+
+const bool PROGRESSIVE_REFRESH_ENABLED = true;
+
+bool settlePending = false;        // Preview on screen, grayscale upgrade still owed
+unsigned long lastPreviewTime = 0;
+
+// What the last settled glyph frame showed (compared with the live state before sleep)
+int displayedFontIndex = -1;
+uint32_t displayedGlyphCodepoint = 0;
+ViewMode displayedViewMode = BITMAP;
+
+void markGlyphDisplayed() {
+    displayShowsState = true;
+    displayedFontIndex = currentFontIndex;
+    displayedGlyphCodepoint = currentGlyphCodepoint;
+    displayedViewMode = currentViewMode;
+}
 
-    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
-        g_outline_segments[g_num_segments].type = SEG_CONIC;
-        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_segments[g_num_segments].cx = control->x * ctx->scale + ctx->offset_x;
-        g_outline_segments[g_num_segments].cy = -control->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_num_segments++;
-    }
+// Normal operation: GL16 partial refresh with auto-full after N renders or timeout
+void pushGlyphPartial() {
+    pushFrame(UPDATE_MODE_GL16);
+    markGlyphDisplayed();
 
-    // Save control point (off-curve)
-    if (g_num_points < MAX_OUTLINE_POINTS) {
-        g_outline_points[g_num_points].x = control->x * ctx->scale + ctx->offset_x;
-        g_outline_points[g_num_points].y = -control->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_points[g_num_points].is_control = true; // Off-curve (control)
-        g_num_points++;
+    // Track first partial after full refresh
+    if (!hasPartialSinceLastFull) {
+        firstPartialAfterFullTime = millis();
+        hasPartialSinceLastFull = true;
+        LOG_D("First partial after full - starting 10s timer\n");
     }
 
-    // Save endpoint (on-curve)
-    if (g_num_points < MAX_OUTLINE_POINTS) {
-        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_points[g_num_points].is_control = false; // On-curve
-        g_num_points++;
+    partialRefreshCount++;
+    METRIC_INC(M_EPD_PARTIAL_UPDATES);
+
+    // Trigger full refresh if:
+    // (A) 5 partials reached OR (B) 10s passed since first partial
+    // AND at least 10s passed since last full refresh (prevents too frequent full refreshes)
+    unsigned long timeSinceFirstPartial = millis() - firstPartialAfterFullTime;
+    unsigned long timeSinceLastFull = millis() - lastFullRefreshTime;
+
+    if ((partialRefreshCount >= MAX_PARTIAL_BEFORE_FULL || timeSinceFirstPartial >= FULL_REFRESH_TIMEOUT_MS) &&
+        timeSinceLastFull >= FULL_REFRESH_TIMEOUT_MS) {
+
+        LOG_D("Full refresh triggered (count=%d, time since first partial=%lums, time since last full=%lums)\n",
+              partialRefreshCount, timeSinceFirstPartial, timeSinceLastFull);
+        epdUpdateFull(UPDATE_MODE_GC16);
+
+        partialRefreshCount = 0;
+        hasPartialSinceLastFull = false;
+        lastFullRefreshTime = millis();
     }
-    return 0;
 }
 
-// Callback: CubicTo (cubic Bézier curve - PostScript/OpenType)
-int outlineCubicTo(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user) {
-    OutlineDecomposeContext* ctx = (OutlineDecomposeContext*)user;
-    ctx->segment_count++;
-    ctx->cubicto_count++;
+// Grayscale upgrade of the preview currently on screen (called from the event loop)
+void settleGlyphFrame() {
+    if (!settlePending) return;
+    settlePending = false;
+    LOG_D("Input quiet - settling preview to 16-level grayscale\n");
+    pushGlyphPartial();
+}
 
-    if (g_num_segments < MAX_OUTLINE_SEGMENTS) {
-        g_outline_segments[g_num_segments].type = SEG_CUBIC;
-        g_outline_segments[g_num_segments].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_segments[g_num_segments].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_segments[g_num_segments].cx = control1->x * ctx->scale + ctx->offset_x;
-        g_outline_segments[g_num_segments].cy = -control1->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_segments[g_num_segments].cx2 = control2->x * ctx->scale + ctx->offset_x;
-        g_outline_segments[g_num_segments].cy2 = -control2->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_num_segments++;
-    }
+// Push the finished glyph frame to the EPD with smart refresh
+// (double GC16 after wake, DU preview while browsing, otherwise GL16 partial)
+void presentGlyphFrame() {
+    profileEnd(PHASE_RENDER);
+    if (renderToCanvasOnly) return;
 
-    // Save control point 1 (off-curve)
-    if (g_num_points < MAX_OUTLINE_POINTS) {
-        g_outline_points[g_num_points].x = control1->x * ctx->scale + ctx->offset_x;
-        g_outline_points[g_num_points].y = -control1->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_points[g_num_points].is_control = true; // Off-curve
-        g_num_points++;
+    // Check if this is first render after wake (needs double full refresh for clean display)
+    if (isFirstRenderAfterWake && governor().singleWakeRefresh) {
+        // Energy governor: one GC16 is enough to show the specimen
+        LOG_D("First render after wake: single full refresh (energy governor)\n");
+        pushFrame(UPDATE_MODE_GC16);
+        markGlyphDisplayed();
+        isFirstRenderAfterWake = false;
+        settlePending = false;
+        partialRefreshCount = 0;
+        hasPartialSinceLastFull = false;
+        lastFullRefreshTime = millis();
+        return;
     }
 
-    // Save control point 2 (off-curve)
-    if (g_num_points < MAX_OUTLINE_POINTS) {
-        g_outline_points[g_num_points].x = control2->x * ctx->scale + ctx->offset_x;
-        g_outline_points[g_num_points].y = -control2->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_points[g_num_points].is_control = true; // Off-curve
-        g_num_points++;
+    if (isFirstRenderAfterWake) {
+        LOG_D("First render after wake: double full refresh\n");
+        pushFrame(UPDATE_MODE_GC16);
+        if (renderSuperseded()) {
+            // Newer input pending: skip the second pass, the next render repeats the double refresh
+            return;
+        }
+        epdUpdateFull(UPDATE_MODE_GC16); // Second pass to eliminate wake artifacts
+        markGlyphDisplayed();
+        isFirstRenderAfterWake = false; // Reset flag
+        settlePending = false;
+        partialRefreshCount = 0;
+        hasPartialSinceLastFull = false;
+        lastFullRefreshTime = millis();
+        return;
     }
 
-    // Save endpoint (on-curve)
-    if (g_num_points < MAX_OUTLINE_POINTS) {
-        g_outline_points[g_num_points].x = to->x * ctx->scale + ctx->offset_x;
-        g_outline_points[g_num_points].y = -to->y * ctx->scale + ctx->offset_y; // Flip Y
-        g_outline_points[g_num_points].is_control = false; // On-curve
-        g_num_points++;
+    // User is browsing: fast black/white preview now, grayscale once input goes quiet
+    if (PROGRESSIVE_REFRESH_ENABLED && renderCancellable) {
+        pushFrame(UPDATE_MODE_DU, FRAME_DEPTH_1BPP);
+        settlePending = true;
+        lastPreviewTime = millis();
+        // DU leaves ghosting too: make sure the periodic GC16 cleanup timer is running
+        if (!hasPartialSinceLastFull) {
+            firstPartialAfterFullTime = millis();
+            hasPartialSinceLastFull = true;
+        }
+        return;
     }
-    return 0;
+
+    settlePending = false;
+    pushGlyphPartial();
 }
 
-// ========================================
-// Helper: Find a valid glyph in the current font
-// ========================================
+// Label text for the glyph screens: font name, name shortened to the 480px label width
+// (30px margins; bitmap textSize=3 is calibrated to match FreeType 24px) and "U+XXXX".
+// Fixed buffers only: this runs on every render.
+void prepareGlyphLabels(char* fontName, char* displayFontName, char* codepointStr, size_t codepointSize) {
+    fontDisplayName(activeFont(currentFontIndex), fontName, LABEL_TEXT_MAX);
+    shortenTextInto(fontName, 480, 3, displayFontName, LABEL_TEXT_MAX);
+    snprintf(codepointStr, codepointSize, "U+%04X", currentGlyphCodepoint);
+}
 
-// Try to find a glyph that exists in the font, starting from the preferred codepoint
-// Returns the found codepoint, or 0 if no valid glyph found
-uint32_t findValidGlyph(uint32_t preferredCodepoint) {
-    FT_Face face = getFontFaceFromCanvas();
-    if (!face) {
-        return 0;
+// Render outline on canvas
+void renderGlyphOutline() {
+    TRACE_SCOPE("renderGlyphOutline");
+    if (!fontLoaded) {
+        LOG_E("ERROR: No font loaded\n");
+        return;
     }
 
-    // First try the preferred codepoint
-    FT_UInt glyph_index = FT_Get_Char_Index(face, preferredCodepoint);
-    if (glyph_index != 0) {
-        return preferredCodepoint; // Found!
+    LOG_D("\n=== STEP 3: Rendering Outline ===\n");
+
+    // Parse outline (populates g_outline_segments)
+    if (!parseGlyphOutline(currentGlyphCodepoint)) {
+        LOG_E("ERROR: Failed to parse outline\n");
+        return;
     }
+    if (renderSuperseded()) return;
+
+    // Clear canvas - white background
+    canvas.fillCanvas(0); // 0 = white
 
-    Serial.printf("Glyph U+%04X not in font, searching for alternative...\n", preferredCodepoint);
+    // Draw outline segments
+    float curr_x = 0, curr_y = 0;
+    int lines_drawn = 0;
 
-    // v2.2: Try to find ANY valid glyph in enabled Unicode ranges
-    for (int i = 0; i < numGlyphRanges; i++) {
-        // Skip disabled ranges
-        if (i >= config.rangeEnabled.size() || !config.rangeEnabled[i]) {
-            continue;
+    for (int i = 0; i < g_num_segments; i++) {
+        OutlineSegment& seg = g_outline_segments[i];
+        if ((i & 15) == 0 && renderSuperseded()) return;
+
+        switch (seg.type) {
+            case SEG_MOVE:
+                curr_x = seg.x;
+                curr_y = seg.y;
+                break;
+
+            case SEG_LINE:
+                canvas.drawLine(curr_x, curr_y, seg.x, seg.y, 12); // 12 = dark gray
+                curr_x = seg.x;
+                curr_y = seg.y;
+                lines_drawn++;
+                break;
+
+            case SEG_CONIC:
+                // Approximate quadratic Bézier with line segments
+                {
+                    int steps = 10;
+                    for (int t = 1; t <= steps; t++) {
+                        float u = t / (float)steps;
+                        float u1 = 1.0f - u;
+                        // Quadratic Bézier: B(t) = (1-t)²P0 + 2(1-t)t·P1 + t²P2
+                        float bx = u1*u1*curr_x + 2*u1*u*seg.cx + u*u*seg.x;
+                        float by = u1*u1*curr_y + 2*u1*u*seg.cy + u*u*seg.y;
+                        canvas.drawLine(curr_x, curr_y, bx, by, 12); // Dark gray outline
+                        curr_x = bx;
+                        curr_y = by;
+                        lines_drawn++;
+                    }
+                }
+                break;
+
+            case SEG_CUBIC:
+                // Approximate cubic Bézier with line segments
+                {
+                    int steps = 15;
+                    for (int t = 1; t <= steps; t++) {
+                        float u = t / (float)steps;
+                        float u1 = 1.0f - u;
+                        // Cubic Bézier: B(t) = (1-t)³P0 + 3(1-t)²t·P1 + 3(1-t)t²P2 + t³P3
+                        float bx = u1*u1*u1*curr_x + 3*u1*u1*u*seg.cx + 3*u1*u*u*seg.cx2 + u*u*u*seg.x;
+                        float by = u1*u1*u1*curr_y + 3*u1*u1*u*seg.cy + 3*u1*u*u*seg.cy2 + u*u*u*seg.y;
+                        canvas.drawLine(curr_x, curr_y, bx, by, 12); // Dark gray outline
+                        curr_x = bx;
+                        curr_y = by;
+                        lines_drawn++;
+                    }
+                }
+                break;
         }
+    }
 
-        for (uint32_t codepoint = glyphRanges[i].start; codepoint <= glyphRanges[i].end; codepoint++) {
-            glyph_index = FT_Get_Char_Index(face, codepoint);
-            if (glyph_index != 0) {
-                Serial.printf("Found alternative glyph: U+%04X from %s\n", codepoint, glyphRanges[i].name);
-                return codepoint;
+    LOG_D("Drew %d line segments\n", lines_drawn);
+
+    // ========================================
+    // STEP 7: Draw construction lines (dashed lines from control points to anchors)
+    // ========================================
+
+    int construction_lines_drawn = 0;
+
+    // For each segment with control points, draw dashed lines
+    for (int i = 0; i < g_num_segments; i++) {
+        OutlineSegment& seg = g_outline_segments[i];
+
+        if (seg.type == SEG_CONIC) {
+            // Quadratic Bézier: draw dashed line from start point to control point to end point
+            // We need to find the start point (previous segment's endpoint or last MOVE)
+            float start_x = 0, start_y = 0;
+
+            // Find the start point
+            if (i > 0) {
+                if (g_outline_segments[i-1].type == SEG_MOVE) {
+                    start_x = g_outline_segments[i-1].x;
+                    start_y = g_outline_segments[i-1].y;
+                } else {
+                    start_x = g_outline_segments[i-1].x;
+                    start_y = g_outline_segments[i-1].y;
+                }
+            }
+
+            // Draw dashed line from start to control point
+            drawDashedLine(start_x, start_y, seg.cx, seg.cy, 15); // Black for visibility
+            construction_lines_drawn++;
+
+            // Draw dashed line from control point to end
+            drawDashedLine(seg.cx, seg.cy, seg.x, seg.y, 15);
+            construction_lines_drawn++;
+
+        } else if (seg.type == SEG_CUBIC) {
+            // Cubic Bézier: draw dashed lines for both control points
+            float start_x = 0, start_y = 0;
+
+            if (i > 0) {
+                if (g_outline_segments[i-1].type == SEG_MOVE) {
+                    start_x = g_outline_segments[i-1].x;
+                    start_y = g_outline_segments[i-1].y;
+                } else {
+                    start_x = g_outline_segments[i-1].x;
+                    start_y = g_outline_segments[i-1].y;
+                }
             }
+
+            // Draw dashed line from start to first control point
+            drawDashedLine(start_x, start_y, seg.cx, seg.cy, 15);
+            construction_lines_drawn++;
+
+            // Draw dashed line from first control point to second control point
+            drawDashedLine(seg.cx, seg.cy, seg.cx2, seg.cy2, 15);
+            construction_lines_drawn++;
+
+            // Draw dashed line from second control point to end
+            drawDashedLine(seg.cx2, seg.cy2, seg.x, seg.y, 15);
+            construction_lines_drawn++;
         }
     }
 
-    // If still nothing, try the first glyph in the font (usually space or .notdef)
-    FT_UInt agindex;
-    FT_ULong charcode = FT_Get_First_Char(face, &agindex);
-    if (agindex != 0 && charcode != 0) {
-        Serial.printf("Found first available glyph in font: U+%04lX (index %u)\n", charcode, agindex);
-        return (uint32_t)charcode;
-    }
+    LOG_D("Drew %d construction lines\n", construction_lines_drawn);
 
-    Serial.println("ERROR: No valid glyphs found in font!");
-    return 0; // No glyphs found at all
-}
+    // ========================================
+    // STEP 4: Draw on-curve and off-curve points
+    // ========================================
 
-// ========================================
-// STEP 1+2: FT_Face Access and Outline Decompose Test
-// ========================================
+    int on_curve_count = 0;
+    int off_curve_count = 0;
 
-// Test function to access FT_Face and print glyph outline info
-void testGlyphOutlineAccess(uint32_t codepoint) {
-    Serial.println("\n=== STEP 1: Testing FT_Face Access ===");
+    for (int i = 0; i < g_num_points; i++) {
+        OutlinePoint& pt = g_outline_points[i];
 
-    // Get FT_Face from protected member via external symbol access
-    FT_Face face = getFontFaceFromCanvas();
-    if (!face) {
-        Serial.println("ERROR: FT_Face is NULL (font not loaded?)");
-        return;
+        if (pt.is_control) {
+            // Off-curve point (control point): hollow circle
+            canvas.drawCircle(pt.x, pt.y, 4, 15); // Outer circle (black)
+            canvas.fillCircle(pt.x, pt.y, 3, 0);  // Inner fill (white) - creates hollow effect
+            off_curve_count++;
+        } else {
+            // On-curve point (anchor point): filled circle
+            canvas.fillCircle(pt.x, pt.y, 4, 15); // Filled black circle
+            on_curve_count++;
+        }
     }
 
-    Serial.printf("✓ FT_Face accessed successfully!\n");
-    Serial.printf("  Font family: %s\n", face->family_name);
-    Serial.printf("  Font style: %s\n", face->style_name);
-    Serial.printf("  Num glyphs in font: %ld\n", face->num_glyphs);
+    LOG_D("Drew %d points: %d on-curve (filled), %d off-curve (hollow)\n",
+         g_num_points, on_curve_count, off_curve_count);
 
-    // Load the glyph for the current codepoint
-    FT_UInt glyph_index = FT_Get_Char_Index(face, codepoint);
-    if (glyph_index == 0) {
-        Serial.printf("WARNING: Glyph U+%04X not found in font\n", codepoint);
-        return;
+    // Draw labels (font name, Unicode) - same as bitmap mode
+    char fontName[LABEL_TEXT_MAX];
+    char displayFontName[LABEL_TEXT_MAX];
+    char codepointStr[12];
+    prepareGlyphLabels(fontName, displayFontName, codepointStr, sizeof(codepointStr));
+
+    if (renderSuperseded()) return;
+    canvas.setTextSize(24);
+    canvas.setTextColor(15);
+    canvas.setTextDatum(TC_DATUM);
+    canvas.drawString(displayFontName, 270, 30); // Top label
+
+    canvas.setTextDatum(BC_DATUM);
+    canvas.drawString(codepointStr, 270, 930); // Bottom label
+
+    if (renderSuperseded()) return;
+    presentGlyphFrame();
+
+    LOG_D("Rendered outline: U+%04X with font %s\n",
+         currentGlyphCodepoint, fontName);
+
+    LOG_D("=== STEP 3: Outline Rendered ===\n\n");
+}
+
+// v3.1: Enabled glyph ranges as a bit mask (first 6 if none, as below)
+uint32_t enabledRangeMask() {
+    uint32_t mask = 0;
+    for (int i = 0; i < numGlyphRanges && i < (int)config.rangeEnabled.size(); i++) {
+        if (config.rangeEnabled[i]) mask |= 1UL << i;
     }
+    return mask ? mask : 0x3F;
+}
 
-    Serial.printf("  Glyph index for U+%04X: %u\n", codepoint, glyph_index);
+// v3.1: Does the font support an enabled range? (true when the catalog does not know)
+bool fontSupportsEnabledRanges(const FontCatalogRecord* record) {
+    if (!record || !(record->flags & FONT_FLAG_COVERAGE)) return true;
+    return (record->scriptRanges & enabledRangeMask()) != 0;
+}
 
-    // Load glyph with FT_LOAD_NO_SCALE to get raw outline data
-    FT_Error error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_SCALE);
-    if (error) {
-        Serial.printf("ERROR: Failed to load glyph (error %d)\n", error);
-        return;
-    }
+// v3.1: Does the font map anything in an enabled range? (true when the catalog does not
+// know). Looser than fontSupportsEnabledRanges(): a few mapped codepoints are enough.
+bool fontCoversEnabledRanges(const FontCatalogRecord* record) {
+    if (!record || !(record->flags & FONT_FLAG_COVERAGE)) return true;
+    return (record->rangeCoverage & enabledRangeMask()) != 0;
+}
 
-    // Check if glyph has outline data
-    if (face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
-        Serial.printf("WARNING: Glyph is not outline format (format=%c%c%c%c)\n",
-                     (face->glyph->format >> 24) & 0xFF,
-                     (face->glyph->format >> 16) & 0xFF,
-                     (face->glyph->format >> 8) & 0xFF,
-                     face->glyph->format & 0xFF);
-        return;
+// v3.1: Random active font, preferring fonts that support an enabled range (catalog
+// scripts), so an auto-wake rarely loads a font only to find nothing to show
+int randomSupportedFontIndex() {
+    int index = random(0, activeFontCount());
+    for (int tries = 1; tries < 8 && !fontSupportsEnabledRanges(activeFont(index)); tries++) {
+        index = random(0, activeFontCount());
     }
+    return index;
+}
 
-    // Access outline data
-    FT_Outline* outline = &face->glyph->outline;
+// v3.1: The codepoint, or the nearest mapped one in its range (wrapping to the range
+// start) through the font's cmap; 0 if the range has none
+uint32_t mappedCodepointInRange(uint32_t codepoint, const UnicodeRange& range) {
+    FT_Face face = getFontFaceFromCanvas();
+    if (!face) return 0;
+    if (FT_Get_Char_Index(face, codepoint) != 0) return codepoint;
+    FT_UInt glyph = 0;
+    FT_ULong next = FT_Get_Next_Char(face, codepoint, &glyph);
+    if (glyph != 0 && next <= range.end) return next;
+    next = FT_Get_Next_Char(face, range.start - 1, &glyph);
+    if (glyph != 0 && next < codepoint) return next;
+    return 0;
+}
 
-    Serial.printf("\n✓ Glyph U+%04X outline data:\n", codepoint);
-    Serial.printf("  Contours: %d\n", outline->n_contours);
-    Serial.printf("  Points: %d\n", outline->n_points);
-    Serial.printf("  Flags available: %s\n", outline->flags ? "yes" : "no");
+// Generate random glyph codepoint from common ranges
+uint32_t getRandomGlyphCodepoint() {
+    // Re-seed with more entropy each time for better randomness
+    randomSeed(analogRead(0) ^ millis() ^ micros());
 
-    // Show first few points as proof (Step 1 verification)
-    if (outline->n_points > 0) {
-        Serial.println("\n  First 5 points (raw font units):");
-        int max_points = outline->n_points < 5 ? outline->n_points : 5;
-        for (int i = 0; i < max_points; i++) {
-            char point_type = (outline->tags[i] & FT_CURVE_TAG_ON) ? 'O' : 'C'; // O=on-curve, C=control
-            Serial.printf("    [%d] (%ld, %ld) [%c]\n",
-                         i,
-                         outline->points[i].x,
-                         outline->points[i].y,
-                         point_type);
-        }
+    // v2.2: Enabled ranges (v3.1: as a bit mask, no allocation per glyph)
+    uint32_t ranges = enabledRangeMask();
+    if (std::find(config.rangeEnabled.begin(), config.rangeEnabled.end(), true) == config.rangeEnabled.end()) {
+        LOG_W("WARNING: No ranges enabled, using defaults\n");
     }
 
-    Serial.println("\n=== STEP 1: FT_Face Access SUCCESS! ===");
+    // v3.1: Intersect with the scripts the current font supports (catalog), else with
+    // the ranges it covers at all
+    const FontCatalogRecord* record = activeFont(currentFontIndex);
+    if (record && (record->flags & FONT_FLAG_COVERAGE)) {
+        if (ranges & record->scriptRanges) {
+            ranges &= record->scriptRanges;
+        } else if (ranges & record->rangeCoverage) {
+            ranges &= record->rangeCoverage;
+        }
+    }
 
-    // ========================================
-    // STEP 2: Decompose outline into segments
-    // ========================================
-    Serial.println("\n=== STEP 2: Decomposing Outline ===");
+    // Pick random enabled range (the n-th set bit)
+    int enabledCount = __builtin_popcount(ranges);
+    int n = random(0, enabledCount);
+    int rangeIndex = 0;
+    while (!(ranges & (1UL << rangeIndex)) || n-- > 0) rangeIndex++;
+    const UnicodeRange& range = glyphRanges[rangeIndex];
 
-    // Setup callback function table
-    FT_Outline_Funcs callbacks;
-    callbacks.move_to = (FT_Outline_MoveToFunc)outlineMoveTo;
-    callbacks.line_to = (FT_Outline_LineToFunc)outlineLineTo;
-    callbacks.conic_to = (FT_Outline_ConicToFunc)outlineConicTo;
-    callbacks.cubic_to = (FT_Outline_CubicToFunc)outlineCubicTo;
-    callbacks.shift = 0;  // No coordinate shift
-    callbacks.delta = 0;  // No coordinate delta
+    // Pick random codepoint in range
+    uint32_t preferredCodepoint = random(range.start, range.end + 1);
 
-    // Context to track decomposition stats
-    OutlineDecomposeContext ctx = {0, 0, 0, 0, 0};
+    LOG_D("Random glyph: U+%04X from %s (range %d/%d enabled)\n",
+          preferredCodepoint, range.name, rangeIndex + 1, enabledCount);
 
-    // Decompose outline into segments
-    Serial.printf("\nDecomposing %d contours into segments:\n", outline->n_contours);
-    Serial.println("(Coordinates in font units, not yet scaled to pixels)\n");
+    // Verify the glyph exists in the current font, or take the nearest one in the same
+    // range; the full fallback scan only runs if the range has none at all
+    uint32_t validCodepoint = mappedCodepointInRange(preferredCodepoint, range);
+    if (validCodepoint == 0) {
+        validCodepoint = findValidGlyph(preferredCodepoint);
+    }
+    if (validCodepoint == 0) {
+        LOG_E("ERROR: No valid glyphs found in font, skipping to next font\n");
+        markFontUnusable(currentFontIndex, "no valid glyph");
+        return 0; // Signal to skip this font
+    }
 
-    FT_Error decompose_error = FT_Outline_Decompose(outline, &callbacks, &ctx);
+    if (validCodepoint != preferredCodepoint) {
+        LOG_D("Using alternative glyph: U+%04X\n", validCodepoint);
+    }
 
-    if (decompose_error) {
-        Serial.printf("ERROR: FT_Outline_Decompose failed (error %d)\n", decompose_error);
-    } else {
-        Serial.println("\n✓ Outline decomposition complete!");
-        Serial.printf("  Total segments: %d\n", ctx.segment_count);
-        Serial.printf("  - MoveTo (contour start): %d\n", ctx.moveto_count);
-        Serial.printf("  - LineTo (straight lines): %d\n", ctx.lineto_count);
-        Serial.printf("  - ConicTo (quadratic Bézier): %d\n", ctx.conicto_count);
-        Serial.printf("  - CubicTo (cubic Bézier): %d\n", ctx.cubicto_count);
+    return validCodepoint;
+}
 
-        // Determine font type from curve usage
-        if (ctx.conicto_count > 0 && ctx.cubicto_count == 0) {
-            Serial.println("  Font type: TrueType (quadratic Bézier curves)");
-        } else if (ctx.cubicto_count > 0 && ctx.conicto_count == 0) {
-            Serial.println("  Font type: PostScript/OpenType (cubic Bézier curves)");
-        } else if (ctx.conicto_count == 0 && ctx.cubicto_count == 0) {
-            Serial.println("  Font type: Simple polygonal outline (no curves)");
-        } else {
-            Serial.println("  Font type: Mixed (both quadratic and cubic curves - rare!)");
+// v3.1: Random glyph from the fonts after the current one, once it had none. Fonts that
+// cover an enabled range go first (catalog, no load), then the others: findValidGlyph()
+// can still find a glyph outside the enabled ranges, so the filter never empties the set.
+// Returns 0 if no font has a glyph.
+uint32_t randomGlyphFromOtherFonts() {
+    int count = activeFontCount();
+    for (int pass = 0; pass < 2; pass++) {
+        for (int attempts = 0; attempts < count; attempts++) {
+            currentFontIndex = (currentFontIndex + 1) % count;
+            if (fontCoversEnabledRanges(activeFont(currentFontIndex)) != (pass == 0)) continue;
+            if (!loadCurrentFont()) continue;
+            uint32_t codepoint = getRandomGlyphCodepoint();
+            if (codepoint != 0) return codepoint;
+            LOG_I("No valid glyphs in this font, trying next...\n");
         }
     }
+    return 0;
+}
 
-    Serial.println("\n=== STEP 2: Outline Decompose SUCCESS! ===\n");
+// Render current glyph (bitmap mode - custom FreeType rendering)
+// Scaled outline in slot -> 8bpp coverage in glyphBitmapBuffer (top row first), cropped
+// to GLYPH_BITMAP_MAX. The smooth rasterizer works from its own fixed pool.
+FT_Error rasterizeGlyph(FT_GlyphSlot slot, FT_Bitmap& bitmap) {
+    if (slot->format != FT_GLYPH_FORMAT_OUTLINE) return FT_Err_Invalid_Glyph_Format;
+    FT_Outline* outline = &slot->outline;
+    FT_BBox box;
+    FT_Outline_Get_CBox(outline, &box);
+    box.xMin &= ~63;
+    box.yMin &= ~63;
+    box.xMax = (box.xMax + 63) & ~63;
+    box.yMax = (box.yMax + 63) & ~63;
+    FT_Outline_Translate(outline, -box.xMin, -box.yMin);
+
+    memset(&bitmap, 0, sizeof(bitmap));
+    bitmap.width = min((int)((box.xMax - box.xMin) >> 6), GLYPH_BITMAP_MAX);
+    bitmap.rows = min((int)((box.yMax - box.yMin) >> 6), GLYPH_BITMAP_MAX);
+    bitmap.pitch = bitmap.width;
+    bitmap.num_grays = 256;
+    bitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+    bitmap.buffer = glyphBitmapBuffer;
+    memset(glyphBitmapBuffer, 0, bitmap.rows * bitmap.pitch);
+    return FT_Outline_Get_Bitmap(slot->library, outline, &bitmap);
 }
 
-// ========================================
-// STEP 3: Parse and Render Outline
-// ========================================
+void renderGlyphBitmap() {
+    TRACE_SCOPE("renderGlyphBitmap");
+    if (!fontLoaded) {
+        LOG_E("ERROR: No font loaded\n");
+        return;
+    }
 
-// Parse glyph outline and store scaled segments
-bool parseGlyphOutline(uint32_t codepoint) {
-    // Reset storage
-    g_num_segments = 0;
-    g_num_points = 0;
+    LOG_D("\n=== Custom Bitmap Rendering ===\n");
 
-    // Get FT_Face
+    // Get FreeType face
     FT_Face face = getFontFaceFromCanvas();
-    if (!face) {
-        Serial.println("ERROR: FT_Face is NULL");
-        return false;
+
+    if (!face || !glyphSize || !glyphBitmapBuffer) {
+        LOG_E("ERROR: FT_Face or glyph buffer not available\n");
+        return;
     }
 
-    // Load glyph
-    FT_UInt glyph_index = FT_Get_Char_Index(face, codepoint);
+    // Load glyph with no scaling to get metrics
+    FT_UInt glyph_index = FT_Get_Char_Index(face, currentGlyphCodepoint);
     if (glyph_index == 0) {
-        Serial.printf("WARNING: Glyph U+%04X not found\n", codepoint);
-        return false;
+        LOG_W("WARNING: Glyph U+%04X not found\n", currentGlyphCodepoint);
+        return;
     }
 
     FT_Error error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_SCALE);
     if (error) {
-        Serial.printf("ERROR: Failed to load glyph (error %d)\n", error);
-        return false;
-    }
-
-    if (face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
-        Serial.println("WARNING: Glyph is not outline format");
-        return false;
+        METRIC_INC(M_FT_ERRORS);
+        LOG_E("ERROR: Failed to load glyph (error %d)\n", error);
+        return;
     }
 
-    FT_Outline* outline = &face->glyph->outline;
-
-    // Calculate bounding box for scaling
+    // Calculate bounding box
     FT_BBox bbox;
-    FT_Outline_Get_CBox(outline, &bbox);
+    FT_Outline_Get_CBox(&face->glyph->outline, &bbox);
 
     float width = bbox.xMax - bbox.xMin;
     float height = bbox.yMax - bbox.yMin;
 
     // Target size: 400px (scale each glyph to fill screen optimally)
     float target_size = 400.0f;
-    float scale = target_size / (width > height ? width : height);
 
-    // Center on display (540x960 vertical)
-    int centerX = 270;
-    int centerY = 480;
+    // Calculate pixel size needed to achieve target_size
+    // Formula: pixel_size = (target_size * units_per_EM) / max_glyph_dimension
+    float max_dim = (width > height ? width : height);
+    int pixel_size = (int)((target_size * face->units_per_EM) / max_dim);
 
-    // Calculate center of glyph bounding box
-    float bbox_center_x = (bbox.xMin + bbox.xMax) / 2.0f;
-    float bbox_center_y = (bbox.yMin + bbox.yMax) / 2.0f;
+    if (pixel_size < 1) pixel_size = 1;
+    if (pixel_size > 2000) pixel_size = 2000; // Safety limit (increased for small glyphs)
 
-    // Offset to center the glyph on display
-    // Y axis is flipped (font coords increase upward, screen coords increase downward)
-    float offset_x = centerX - bbox_center_x * scale;
-    float offset_y = centerY + bbox_center_y * scale; // Y is negated in callbacks, so add here
+    LOG_D("Glyph bbox: w=%.1f h=%.1f, units_per_EM=%d, pixel_size=%d\n",
+          width, height, face->units_per_EM, pixel_size);
 
-    Serial.printf("Parsing outline: scale=%.4f, offset=(%.1f, %.1f)\n", scale, offset_x, offset_y);
+    // Scale at the glyph size (the label size stays as createRender() left it), then
+    // rasterize into the fixed buffer: no hinting at 400px, and no FreeType bitmap buffer
+    FT_Bitmap glyphBitmap;
+    FT_Activate_Size(glyphSize);
+    error = FT_Set_Pixel_Sizes(face, 0, pixel_size);
+    if (!error) error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_BITMAP | FT_LOAD_NO_HINTING);
+    if (!error) error = rasterizeGlyph(face->glyph, glyphBitmap);
+    FT_Activate_Size(labelSize);
+    if (error) {
+        METRIC_INC(M_FT_ERRORS);
+        LOG_E("ERROR: Failed to render glyph (error %d)\n", error);
+        return;
+    }
 
-    // Setup callback context
-    OutlineDecomposeContext ctx = {0, 0, 0, 0, 0, scale, offset_x, offset_y};
+    FT_Bitmap* bitmap = &glyphBitmap;
+    if (renderSuperseded()) return;
 
-    // Setup callbacks
-    FT_Outline_Funcs callbacks;
-    callbacks.move_to = (FT_Outline_MoveToFunc)outlineMoveTo;
-    callbacks.line_to = (FT_Outline_LineToFunc)outlineLineTo;
-    callbacks.conic_to = (FT_Outline_ConicToFunc)outlineConicTo;
-    callbacks.cubic_to = (FT_Outline_CubicToFunc)outlineCubicTo;
-    callbacks.shift = 0;
-    callbacks.delta = 0;
+    LOG_D("Bitmap: %dx%d, pitch=%d, mode=%d\n",
+          bitmap->width, bitmap->rows, bitmap->pitch, bitmap->pixel_mode);
 
-    // Decompose outline
-    FT_Error decompose_error = FT_Outline_Decompose(outline, &callbacks, &ctx);
-    if (decompose_error) {
-        Serial.printf("ERROR: FT_Outline_Decompose failed (error %d)\n", decompose_error);
-        return false;
-    }
+    // Clear canvas
+    canvas.fillCanvas(0); // 0 = white
 
-    Serial.printf("Parsed %d segments (MoveTo:%d LineTo:%d Conic:%d Cubic:%d)\n",
-                 g_num_segments, ctx.moveto_count, ctx.lineto_count,
-                 ctx.conicto_count, ctx.cubicto_count);
+    // Calculate centering
+    int centerX = 270;
+    int centerY = 480;
+    int draw_x = centerX - bitmap->width / 2;
+    int draw_y = centerY - bitmap->rows / 2;
 
-    return true;
-}
+    // Draw bitmap on canvas (convert 8bpp grayscale to 4bpp)
+    for (unsigned int y = 0; y < bitmap->rows; y++) {
+        if ((y & 31) == 0 && renderSuperseded()) return;
+        for (unsigned int x = 0; x < bitmap->width; x++) {
+            unsigned char gray8 = bitmap->buffer[y * bitmap->pitch + x];
 
-// Helper function to draw a dashed line
-void drawDashedLine(float x1, float y1, float x2, float y2, uint8_t color) {
-    // Calculate line length and direction
-    float dx = x2 - x1;
-    float dy = y2 - y1;
-    float length = sqrt(dx * dx + dy * dy);
+            // Convert 8bpp (0-255) to 4bpp (0-15)
+            // 0 = white, 15 = black in M5EPD
+            unsigned char gray4 = (gray8 * 15) / 255;
 
-    if (length < 0.5f) return; // Too short to draw
+            int screen_x = draw_x + x;
+            int screen_y = draw_y + y;
 
-    // Normalize direction
-    dx /= length;
-    dy /= length;
+            // Bounds check
+            if (screen_x >= 0 && screen_x < 540 && screen_y >= 0 && screen_y < 960) {
+                canvas.drawPixel(screen_x, screen_y, gray4);
+            }
+        }
+    }
 
-    // Dash pattern: 10 pixels on, 5 pixels off (longer for better visibility)
-    float dash_length = 10.0f;
-    float gap_length = 5.0f;
-    float pattern_length = dash_length + gap_length;
+    // Draw labels
+    char fontName[LABEL_TEXT_MAX];
+    char displayFontName[LABEL_TEXT_MAX];
+    char codepointStr[12];
+    prepareGlyphLabels(fontName, displayFontName, codepointStr, sizeof(codepointStr));
 
-    float distance = 0.0f;
-    bool drawing = true;
+    if (renderSuperseded()) return;
+    canvas.setTextSize(24);
+    canvas.setTextColor(15);
+    canvas.setTextDatum(TC_DATUM);
+    canvas.drawString(displayFontName, centerX, 30);
 
-    while (distance < length) {
-        float segment_length = drawing ? dash_length : gap_length;
-        float end_distance = distance + segment_length;
-        if (end_distance > length) end_distance = length;
+    canvas.setTextSize(24);
+    canvas.setTextColor(15);
+    canvas.setTextDatum(BC_DATUM);
+    canvas.drawString(codepointStr, centerX, 930);
 
-        if (drawing) {
-            float sx = x1 + dx * distance;
-            float sy = y1 + dy * distance;
-            float ex = x1 + dx * end_distance;
-            float ey = y1 + dy * end_distance;
-            canvas.drawLine(sx, sy, ex, ey, color);
-        }
+    if (renderSuperseded()) return;
+    presentGlyphFrame();
 
-        distance = end_distance;
-        drawing = !drawing;
-    }
+    LOG_D("Rendered bitmap: U+%04X with font %s\n",
+          currentGlyphCodepoint, fontName);
 }
 
-// Render outline on canvas
-void renderGlyphOutline() {
-    if (!fontLoaded) {
-        Serial.println("ERROR: No font loaded");
-        return;
+// ========================================
+// STEP 5: Unified Render Function (chooses bitmap or outline)
+// ========================================
+
+void renderGlyph() {
+    TRACE_SCOPE("renderGlyph");
+    settlePending = false; // Canvas is about to be redrawn: the old preview can no longer settle
+
+    profileBegin(PHASE_RENDER);
+    METRIC_INC(M_RENDERS);
+    uint32_t allocsBefore = HEAP_ALLOC_COUNT();
+    {
+        NoAllocScope noAlloc("renderGlyph");
+        if (currentViewMode == BITMAP) {
+            renderGlyphBitmap();
+        } else {
+            renderGlyphOutline();
+        }
     }
+    METRIC_SET(M_RENDER_ALLOCS, HEAP_ALLOC_COUNT() - allocsBefore); // FreeType internals included
+    profileEnd(PHASE_RENDER); // Abandoned renders (presentGlyphFrame() ends it otherwise)
+    clearFontLoadFailures(currentFontIndex);
+}
 
-    Serial.println("\n=== STEP 3: Rendering Outline ===");
+// Move |delta| fonts forward (delta > 0) or backward (delta < 0) and render only the
+// final target. Coalesced BtnR/BtnL presses arrive here as one call with |delta| > 1:
+// intermediate fonts are not loaded. From the target, the search keeps going in the same
+// direction until a font that has the current glyph is found (same rule as one step).
+void stepFont(int delta) {
+    if (activeFontCount() == 0 || delta == 0) return;
 
-    // Parse outline (populates g_outline_segments)
-    if (!parseGlyphOutline(currentGlyphCodepoint)) {
-        Serial.println("ERROR: Failed to parse outline");
-        return;
+    int numFonts = activeFontCount();
+    int direction = (delta > 0) ? 1 : -1;
+    int startIndex = currentFontIndex;
+    int candidate = ((currentFontIndex + delta) % numFonts + numFonts) % numFonts;
+
+    // Try to find a font that has the current glyph
+    for (int attempts = 0; attempts < numFonts; attempts++) {
+        currentFontIndex = candidate;
+        LOG_D("Trying font %d/%d\n", currentFontIndex + 1, numFonts);
+
+        // v3.1: The catalog's validity flags and cmap coverage rule most fonts out without
+        // loading them
+        if (!fontUsable(activeFont(currentFontIndex))) {
+            LOG_D("Font %d is marked unusable, skipping...\n", currentFontIndex + 1);
+        } else if (!fontMayCover(activeFont(currentFontIndex), currentGlyphCodepoint)) {
+            LOG_D("Font %d doesn't cover U+%04X (catalog), skipping...\n",
+                  currentFontIndex + 1, currentGlyphCodepoint);
+        } else if (loadCurrentFont()) {
+            // Check if this font has the current glyph
+            FT_Face face = getFontFaceFromCanvas();
+            if (face) {
+                FT_UInt glyph_index = FT_Get_Char_Index(face, currentGlyphCodepoint);
+                if (glyph_index != 0) {
+                    // Found a font with this glyph!
+                    LOG_D("Font %d has glyph U+%04X\n", currentFontIndex + 1, currentGlyphCodepoint);
+                    renderGlyph();
+                    return;
+                } else {
+                    LOG_D("Font %d doesn't have glyph U+%04X, skipping...\n",
+                          currentFontIndex + 1, currentGlyphCodepoint);
+                }
+            }
+        }
+
+        candidate = (candidate + direction + numFonts) % numFonts;
     }
 
-    // Clear canvas - white background
-    canvas.fillCanvas(0); // 0 = white
+    // Tried all fonts
+    LOG_D("No font has this glyph! Returning to original font.\n");
+    currentFontIndex = startIndex;
+    loadCurrentFont();
+    renderGlyph();
+}
 
-    // Draw outline segments
-    float curr_x = 0, curr_y = 0;
-    int lines_drawn = 0;
+// Change to next font (skip fonts that don't have the current glyph)
+void nextFont() {
+    stepFont(1);
+}
 
-    for (int i = 0; i < g_num_segments; i++) {
-        OutlineSegment& seg = g_outline_segments[i];
+// Change to previous font (skip fonts that don't have the current glyph)
+void previousFont() {
+    stepFont(-1);
+}
+
+// Generate and display new random glyph
+void randomGlyph() {
+    if (!fontLoaded) return;
+
+    currentGlyphCodepoint = getRandomGlyphCodepoint();
+
+    // If no valid glyph found in current font, try next font
+    if (currentGlyphCodepoint == 0) {
+        LOG_D("No valid glyphs in current font, switching to next font\n");
+        nextFont(); // This will automatically skip fonts without glyphs
+        return;
+    }
 
-        switch (seg.type) {
-            case SEG_MOVE:
-                curr_x = seg.x;
-                curr_y = seg.y;
-                break;
+    renderGlyph();
+}
 
-            case SEG_LINE:
-                canvas.drawLine(curr_x, curr_y, seg.x, seg.y, 12); // 12 = dark gray
-                curr_x = seg.x;
-                curr_y = seg.y;
-                lines_drawn++;
-                break;
+// Change to random font AND random glyph (used for auto-wake)
+void randomFont() {
+    if (activeFontCount() == 0) return;
 
-            case SEG_CONIC:
-                // Approximate quadratic Bézier with line segments
-                {
-                    int steps = 10;
-                    for (int t = 1; t <= steps; t++) {
-                        float u = t / (float)steps;
-                        float u1 = 1.0f - u;
-                        // Quadratic Bézier: B(t) = (1-t)²P0 + 2(1-t)t·P1 + t²P2
-                        float bx = u1*u1*curr_x + 2*u1*u*seg.cx + u*u*seg.x;
-                        float by = u1*u1*curr_y + 2*u1*u*seg.cy + u*u*seg.y;
-                        canvas.drawLine(curr_x, curr_y, bx, by, 12); // Dark gray outline
-                        curr_x = bx;
-                        curr_y = by;
-                        lines_drawn++;
-                    }
-                }
-                break;
+    // Pick a random font index (v3.1: one that supports an enabled range, if any)
+    currentFontIndex = randomSupportedFontIndex();
+    LOG_I("Random font selected: %d/%d\n", currentFontIndex + 1, activeFontCount());
 
-            case SEG_CUBIC:
-                // Approximate cubic Bézier with line segments
-                {
-                    int steps = 15;
-                    for (int t = 1; t <= steps; t++) {
-                        float u = t / (float)steps;
-                        float u1 = 1.0f - u;
-                        // Cubic Bézier: B(t) = (1-t)³P0 + 3(1-t)²t·P1 + 3(1-t)t²P2 + t³P3
-                        float bx = u1*u1*u1*curr_x + 3*u1*u1*u*seg.cx + 3*u1*u*u*seg.cx2 + u*u*u*seg.x;
-                        float by = u1*u1*u1*curr_y + 3*u1*u1*u*seg.cy + 3*u1*u*u*seg.cy2 + u*u*u*seg.y;
-                        canvas.drawLine(curr_x, curr_y, bx, by, 12); // Dark gray outline
-                        curr_x = bx;
-                        curr_y = by;
-                        lines_drawn++;
-                    }
-                }
-                break;
-        }
+    // Load the font and generate random glyph
+    if (loadUsableFont()) {
+        currentGlyphCodepoint = getRandomGlyphCodepoint();
+        renderGlyph();
     }
+}
 
-    Serial.printf("Drew %d line segments\n", lines_drawn);
+// Touch screen utilities (v3.0)
+// Returns: 0=left zone, 1=center zone, 2=right zone, -1=invalid
+int getTouchZone(int16_t x, int16_t y) {
+    // Check Y is within active area (exclude top/bottom 90px for labels)
+    if (y < ZONE_TOP_MARGIN || y > ZONE_BOTTOM_MARGIN) return -1;
 
-    // ========================================
-    // STEP 7: Draw construction lines (dashed lines from control points to anchors)
-    // ========================================
+    // Check X zone
+    if (x >= ZONE_LEFT_MIN && x < ZONE_LEFT_MAX) return 0;      // Left: previous font
+    if (x >= ZONE_CENTER_MIN && x < ZONE_CENTER_MAX) return 1;  // Center: random glyph
+    if (x >= ZONE_RIGHT_MIN && x < ZONE_RIGHT_MAX) return 2;    // Right: next font
+    return -1; // Out of bounds
+}
 
-    int construction_lines_drawn = 0;
+// Helper function for setup screen touch: returns index of tapped menu item (-1 if none)
+int getMenuItemAtTouch(int16_t touchY, const std::vector<MenuItem>& items) {
+    // Calculate menu layout (same logic as renderUnifiedSetupScreen)
+    const int headerBottom = 30 + 24;  // Y=30 + text height
+    const int footerTop = 930 - 24;    // Y=930 - text height
+    const int availableHeight = footerTop - headerBottom;
 
-    // For each segment with control points, draw dashed lines
-    for (int i = 0; i < g_num_segments; i++) {
-        OutlineSegment& seg = g_outline_segments[i];
+    int totalItemHeight = items.size() * UI_LINE_HEIGHT;
+    int flexSpace = max(0, (availableHeight - totalItemHeight) / 2);
+    int startY = headerBottom + flexSpace;
 
-        if (seg.type == SEG_CONIC) {
-            // Quadratic Bézier: draw dashed line from start point to control point to end point
-            // We need to find the start point (previous segment's endpoint or last MOVE)
-            float start_x = 0, start_y = 0;
+    // Check which item was tapped
+    for (int i = 0; i < items.size(); i++) {
+        int itemY = startY + i * UI_LINE_HEIGHT;
+        int itemBottom = itemY + UI_LINE_HEIGHT;
 
-            // Find the start point
-            if (i > 0) {
-                if (g_outline_segments[i-1].type == SEG_MOVE) {
-                    start_x = g_outline_segments[i-1].x;
-                    start_y = g_outline_segments[i-1].y;
-                } else {
-                    start_x = g_outline_segments[i-1].x;
-                    start_y = g_outline_segments[i-1].y;
-                }
-            }
+        if (touchY >= itemY && touchY < itemBottom) {
+            return i;  // Found the tapped item
+        }
+    }
 
-            // Draw dashed line from start to control point
-            drawDashedLine(start_x, start_y, seg.cx, seg.cy, 15); // Black for visibility
-            construction_lines_drawn++;
+    return -1;  // No item at this Y coordinate
+}
 
-            // Draw dashed line from control point to end
-            drawDashedLine(seg.cx, seg.cy, seg.x, seg.y, 15);
-            construction_lines_drawn++;
+void enableTouch() {
+    if (!touchEnabled) {
+        // Initialize GT911 touch controller: SDA=21, SCL=22, INT=36
+        if (M5.TP.begin(21, 22, 36) != ESP_OK) {
+            LOG_E("ERROR: Touch pad initialization failed\n");
+            return;
+        }
+        M5.TP.SetRotation(90); // Match display rotation
+        touchEnabled = true;
+        LOG_I("Touch screen enabled (GT911 initialized)\n");
+    }
+}
 
-        } else if (seg.type == SEG_CUBIC) {
-            // Cubic Bézier: draw dashed lines for both control points
-            float start_x = 0, start_y = 0;
+void disableTouch() {
+    if (touchEnabled) {
+        touchEnabled = false;
+        LOG_I("Touch screen disabled\n");
+    }
+}
 
-            if (i > 0) {
-                if (g_outline_segments[i-1].type == SEG_MOVE) {
-                    start_x = g_outline_segments[i-1].x;
-                    start_y = g_outline_segments[i-1].y;
-                } else {
-                    start_x = g_outline_segments[i-1].x;
-                    start_y = g_outline_segments[i-1].y;
-                }
-            }
+// Check battery level and return percentage (0-100)
+float getBatteryPercentage() {
+    // Take average of 5 readings to reduce ADC noise
+    uint32_t voltageSum = 0;
+    for (int i = 0; i < 5; i++) {
+        voltageSum += M5.getBatteryVoltage();
+        delay(10); // Small delay between readings
+    }
+    uint32_t voltage = voltageSum / 5;
+    LOG_I("Battery voltage: %dmV (averaged)\n", voltage);
 
-            // Draw dashed line from start to first control point
-            drawDashedLine(start_x, start_y, seg.cx, seg.cy, 15);
-            construction_lines_drawn++;
+    // LiPo voltage range: 4200mV (100%) to 3300mV (0%)
+    // 5% threshold = ~3345mV
+    if (voltage >= 4200) return 100.0;
+    if (voltage <= 3300) return 0.0;
 
-            // Draw dashed line from first control point to second control point
-            drawDashedLine(seg.cx, seg.cy, seg.cx2, seg.cy2, 15);
-            construction_lines_drawn++;
+    float percentage = ((float)(voltage - 3300) / (4200 - 3300)) * 100.0;
+    return percentage;
+}
 
-            // Draw dashed line from second control point to end
-            drawDashedLine(seg.cx2, seg.cy2, seg.x, seg.y, 15);
-            construction_lines_drawn++;
+// ========================================
+// v3.1: Battery Estimator
+// ========================================
+// getBatteryPercentage() costs ~60ms per wake (6 ADC reads, 5x delay(10)) and maps voltage
+// linearly. The estimator keeps a filtered state in rtcState and only touches the ADC every
+// BATTERY_SAMPLE_EVERY_WAKES wakes (every wake when low). In between, it extrapolates with
+// the measured drain rate. Percent comes from a LiPo discharge curve.
+
+const uint8_t BATTERY_SAMPLE_EVERY_WAKES = 4;
+const float BATTERY_ALWAYS_SAMPLE_BELOW_PCT = 12.0; // Keep the 5% shutdown honest
+const float BATTERY_VOLTAGE_ALPHA = 0.4;            // EMA weight of a new voltage sample
+const float BATTERY_DRAIN_ALPHA = 0.3;              // EMA weight of a new drain-rate measurement
+const int BATTERY_SAMPLES = 4;
+
+// Light-load LiPo discharge curve (mV -> %), descending voltage
+const uint16_t LIPO_CURVE_MV[] =  {4200, 4150, 4110, 4080, 4020, 3980, 3950, 3910, 3870, 3850, 3840,
+                                   3820, 3800, 3790, 3770, 3750, 3730, 3710, 3690, 3610, 3300};
+const uint8_t  LIPO_CURVE_PCT[] = {100,  95,   90,   85,   80,   75,   70,   65,   60,   55,   50,
+                                   45,   40,   35,   30,   25,   20,   15,   10,   5,    0};
+const int LIPO_CURVE_POINTS = sizeof(LIPO_CURVE_MV) / sizeof(LIPO_CURVE_MV[0]);
+
+// Pure function
+float lipoPercentForVoltage(float mv) {
+    if (mv >= LIPO_CURVE_MV[0]) return 100.0;
+    if (mv <= LIPO_CURVE_MV[LIPO_CURVE_POINTS - 1]) return 0.0;
+    for (int i = 1; i < LIPO_CURVE_POINTS; i++) {
+        if (mv >= LIPO_CURVE_MV[i]) {
+            float t = (mv - LIPO_CURVE_MV[i]) / (float)(LIPO_CURVE_MV[i - 1] - LIPO_CURVE_MV[i]);
+            return LIPO_CURVE_PCT[i] + t * (LIPO_CURVE_PCT[i - 1] - LIPO_CURVE_PCT[i]);
         }
     }
+    return 0.0;
+}
 
-    Serial.printf("Drew %d construction lines\n", construction_lines_drawn);
+// RTC wall clock as seconds since 2000-01-01 (0 if the clock is not valid)
+uint32_t rtcSecondsSince2000() {
+    if (!rtcClockValid()) return 0;
+    rtc_date_t date;
+    rtc_time_t time;
+    M5.RTC.getDate(&date);
+    M5.RTC.getTime(&time);
+
+    // Days from civil date (proleptic Gregorian)
+    int y = date.year - (date.mon <= 2 ? 1 : 0);
+    int era = y / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (date.mon + (date.mon > 2 ? -3 : 9)) + 2) / 5 + date.day - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int32_t days = era * 146097 + doe - 730425; // 730425 = days from 0000-03-01 to 2000-01-01
+    if (days < 0) return 0;
+    return (uint32_t)days * 86400 + time.hour * 3600 + time.min * 60 + time.sec;
+}
 
-    // ========================================
-    // STEP 4: Draw on-curve and off-curve points
-    // ========================================
+float estimatedBatteryPercent(const BatteryEstimate& est, uint32_t now) {
+    if (!est.valid) return 0.0;
+    float pct = est.sampledPct;
+    if (est.drainPctPerHour > 0 && now > est.sampleTime && est.sampleTime != 0) {
+        pct -= est.drainPctPerHour * (now - est.sampleTime) / 3600.0;
+    }
+    return max(pct, 0.0f);
+}
 
-    int on_curve_count = 0;
-    int off_curve_count = 0;
+// Hours until 0% at the current drain rate (-1 if unknown)
+float batteryHoursToEmpty() {
+    const BatteryEstimate& est = rtcState.battery;
+    if (!est.valid || est.drainPctPerHour <= 0) return -1;
+    return estimatedBatteryPercent(est, rtcSecondsSince2000()) / est.drainPctPerHour;
+}
 
-    for (int i = 0; i < g_num_points; i++) {
-        OutlinePoint& pt = g_outline_points[i];
+// Per-wake battery reading: ADC every N wakes, extrapolated otherwise.
+// Returns percent; voltageMv receives the filtered voltage.
+float readBatteryEstimate(uint32_t* voltageMv) {
+    BatteryEstimate& est = rtcState.battery;
+    uint32_t now = rtcSecondsSince2000();
+    float predicted = estimatedBatteryPercent(est, now);
+
+    bool sample = !est.valid ||
+                  ++est.wakesSinceSample >= BATTERY_SAMPLE_EVERY_WAKES ||
+                  predicted < BATTERY_ALWAYS_SAMPLE_BELOW_PCT;
+
+    if (sample) {
+        M5.BatteryADCBegin();
+        uint32_t sum = 0;
+        for (int i = 0; i < BATTERY_SAMPLES; i++) {
+            sum += M5.getBatteryVoltage();
+        }
+        float mv = sum / (float)BATTERY_SAMPLES;
 
-        if (pt.is_control) {
-            // Off-curve point (control point): hollow circle
-            canvas.drawCircle(pt.x, pt.y, 4, 15); // Outer circle (black)
-            canvas.fillCircle(pt.x, pt.y, 3, 0);  // Inner fill (white) - creates hollow effect
-            off_curve_count++;
+        if (!est.valid) {
+            est.filteredMv = mv;
         } else {
-            // On-curve point (anchor point): filled circle
-            canvas.fillCircle(pt.x, pt.y, 4, 15); // Filled black circle
-            on_curve_count++;
+            est.filteredMv += BATTERY_VOLTAGE_ALPHA * (mv - est.filteredMv);
+        }
+        float pct = lipoPercentForVoltage(est.filteredMv);
+
+        // Drain rate between samples; rising charge means USB: forget the rate
+        if (est.valid && est.sampleTime != 0 && now > est.sampleTime + 600) {
+            float hours = (now - est.sampleTime) / 3600.0;
+            float rate = (est.sampledPct - pct) / hours;
+            if (rate < 0) {
+                est.drainPctPerHour = 0;
+            } else if (est.drainPctPerHour <= 0) {
+                est.drainPctPerHour = rate;
+            } else {
+                est.drainPctPerHour += BATTERY_DRAIN_ALPHA * (rate - est.drainPctPerHour);
+            }
         }
-    }
-
-    Serial.printf("Drew %d points: %d on-curve (filled), %d off-curve (hollow)\n",
-                 g_num_points, on_curve_count, off_curve_count);
 
-    // Draw labels (font name, Unicode) - same as bitmap mode
-    String fontName = getFontName(fontPaths[currentFontIndex]);
-    char codepointStr[32];
-    sprintf(codepointStr, "U+%04X", currentGlyphCodepoint);
+        est.valid = true;
+        est.sampledPct = pct;
+        est.sampleTime = now;
+        est.wakesSinceSample = 0;
+        predicted = pct;
+        LOG_I("Battery sampled: %.0fmV raw, %.0fmV filtered, %.1f%%\n", mv, est.filteredMv, pct);
+    } else {
+        LOG_I("Battery estimated: %.1f%% (no ADC, sample in %d wakes)\n",
+              predicted, BATTERY_SAMPLE_EVERY_WAKES - est.wakesSinceSample);
+    }
 
-    // Truncate font name if it exceeds margins (30px left + 30px right = 480px max)
-    // Note: shortenTextIfNeeded() uses bitmap font textSize=3 for measurement (calibrated to match FreeType 24px)
-    String displayFontName = shortenTextIfNeeded(fontName, 480, 3);
+    float tte = batteryHoursToEmpty();
+    if (tte >= 0) {
+        LOG_I("Battery drain %.2f%%/h, time to empty ~%.0fh\n", est.drainPctPerHour, tte);
+    }
 
-    // Reload font for label rendering to ensure correct state
-    canvas.loadFont(fontPaths[currentFontIndex], SD);
-    canvas.createRender(24, 64); // Recreate 24px cache
-    canvas.setTextSize(24);
-    canvas.setTextColor(15);
-    canvas.setTextDatum(TC_DATUM);
-    canvas.drawString(displayFontName, 270, 30); // Top label
+    *voltageMv = (uint32_t)est.filteredMv;
+    return predicted;
+}
 
-    canvas.setTextDatum(BC_DATUM);
-    canvas.drawString(codepointStr, 270, 930); // Bottom label
+// Log battery data to .battery file on SD card
+void logBatteryData(uint32_t voltage, float percentage, bool isReset) {
+    File file = SD.open("/.battery", FILE_APPEND);
+    if (!file) {
+        LOG_W("WARNING: Could not open .battery file for logging\n");
+        return;
+    }
 
-    // Check if this is first render after wake (needs double full refresh for clean display)
-    if (isFirstRenderAfterWake) {
-        Serial.println("First render after wake: double full refresh");
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-        M5.EPD.UpdateFull(UPDATE_MODE_GC16); // Second pass to eliminate wake artifacts
-        isFirstRenderAfterWake = false; // Reset flag
-        partialRefreshCount = 0;
-        hasPartialSinceLastFull = false;
-        lastFullRefreshTime = millis();
+    if (isReset) {
+        // Write reset separator with timestamp (uptime resets to 0)
+        file.println();
+        file.println("=== RESET ===");
+        file.println();
+        LOG_I("Battery log: RESET marker written\n");
     } else {
-        // Normal operation: partial refresh with auto-full after N renders or timeout
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GL16);
+        // Calculate total uptime: accumulated time in RTC + current session time
+        uint64_t totalMillis = rtcState.totalMillis + millis();
+        uint32_t totalSeconds = totalMillis / 1000; // Convert to seconds
+        uint32_t days = totalSeconds / (24 * 60 * 60);
+        uint32_t hours = (totalSeconds % (24 * 60 * 60)) / (60 * 60);
+        uint32_t minutes = (totalSeconds % (60 * 60)) / 60;
+        uint32_t seconds = totalSeconds % 60;
 
-        // Track first partial after full refresh
-        if (!hasPartialSinceLastFull) {
-            firstPartialAfterFullTime = millis();
-            hasPartialSinceLastFull = true;
-            Serial.println("First partial after full - starting 10s timer");
+        // Format: "DDd HHh MMm SSs | 4236mV | 100.0% | BITMAP | OFF | 312h"
+        // OFF/DEEP = sleep path that preceded this wake, last column = estimated time to empty
+        char line[104];
+        char emptyIn[12] = "?";
+        float hoursToEmpty = batteryHoursToEmpty();
+        if (hoursToEmpty >= 0) {
+            snprintf(emptyIn, sizeof(emptyIn), "%dh", (int)hoursToEmpty);
         }
+        snprintf(line, sizeof(line), "%02lud %02luh %02lum %02lus | %4lumV | %5.1f%% | %s | %s | %s",
+                 days, hours, minutes, seconds, voltage, percentage,
+                 currentViewMode == BITMAP ? "BITMAP" : "OUTLINE",
+                 poweredOffWake ? "OFF" : "DEEP",
+                 emptyIn);
+
+        file.println(line);
+        LOG_I("Battery log: %s\n", line);
+    }
+
+    file.close();
+}
+
+// Display low battery icon and shutdown
+void lowBatteryShutdown() {
+    LOG_E("\n!!! LOW BATTERY - SHUTTING DOWN !!!\n");
+
+    // Clear screen with full refresh
+    epdLeaveOneBitMode();
+    M5.EPD.Clear(true);
+    delay(1000); // Wait for Clear() to complete physically on e-ink
 
-        partialRefreshCount++;
+    canvas.fillCanvas(0); // White background
+
+    // Draw battery icon (stylized AA battery shape)
+    // Battery body: 120x60 rectangle centered at (270, 480)
+    int battX = 210;  // Left edge
+    int battY = 450;  // Top edge
+    int battW = 120;  // Width
+    int battH = 60;   // Height
+    int tipW = 10;    // Width of protruding tip
+    int tipH = 20;    // Height of tip (centered)
 
-        // Trigger full refresh if:
-        // (A) 5 partials reached OR (B) 10s passed since first partial
-        // AND at least 10s passed since last full refresh (prevents too frequent full refreshes)
-        unsigned long timeSinceFirstPartial = millis() - firstPartialAfterFullTime;
-        unsigned long timeSinceLastFull = millis() - lastFullRefreshTime;
+    // Draw main battery body (hollow rectangle)
+    canvas.fillRect(battX, battY, battW, battH, 15);           // Black outline
+    canvas.fillRect(battX + 3, battY + 3, battW - 6, battH - 6, 0); // White inside
 
-        if ((partialRefreshCount >= MAX_PARTIAL_BEFORE_FULL || timeSinceFirstPartial >= FULL_REFRESH_TIMEOUT_MS) &&
-            timeSinceLastFull >= FULL_REFRESH_TIMEOUT_MS) {
+    // Draw battery tip (right side protrusion)
+    int tipX = battX + battW;
+    int tipY = battY + (battH - tipH) / 2;
+    canvas.fillRect(tipX, tipY, tipW, tipH, 15); // Black tip
 
-            Serial.printf("Full refresh triggered (count=%d, time since first partial=%lums, time since last full=%lums)\n",
-                          partialRefreshCount, timeSinceFirstPartial, timeSinceLastFull);
-            M5.EPD.UpdateFull(UPDATE_MODE_GC16);
+    // Draw very thin red bar on left side (5% indicator)
+    int barW = 6; // Very thin bar
+    int barH = battH - 12; // Leave margin
+    int barX = battX + 6;
+    int barY = battY + 6;
+    canvas.fillRect(barX, barY, barW, barH, 12); // Gray-ish (simulating red on grayscale)
 
-            partialRefreshCount = 0;
-            hasPartialSinceLastFull = false;
-            lastFullRefreshTime = millis();
-        }
-    }
+    // Push to display with full refresh
+    pushFrame(UPDATE_MODE_GC16);
 
-    Serial.printf("Rendered outline: U+%04X with font %s\n",
-                 currentGlyphCodepoint,
-                 getFontName(fontPaths[currentFontIndex]).c_str());
+    // Wait for e-ink refresh to physically complete (~500ms), then immediate shutdown
+    delay(500); // Hardware refresh completion
 
-    Serial.println("=== STEP 3: Outline Rendered ===\n");
+    // Complete shutdown (only RTC stays powered)
+    LOG_I("Entering complete shutdown...\n");
+    M5.shutdown();
 }
 
-// Generate random glyph codepoint from common ranges
-uint32_t getRandomGlyphCodepoint() {
-    // Re-seed with more entropy each time for better randomness
-    randomSeed(analogRead(0) ^ millis() ^ micros());
+// ========================================
+// v3.1: Power-Off Sleep (RTC alarm)
+// ========================================
+// Instead of ESP32 deep sleep with GPIO2 held (main power stays on), program the BM8563
+// timer for the next wake and cut main power with M5.shutdown(seconds). The RTC powers the
+// device back on. RTC memory is lost, so rtcState is persisted to NVS before power-off
+// and restored by setup(). On USB power the board cannot switch itself off: we fall
+// back to deep sleep.
+
+enum SleepMode {
+    SLEEP_DEEP,       // ESP32 deep sleep, main power held (v2.x behavior)
+    SLEEP_POWER_OFF   // Main power cut, BM8563 alarm powers back on
+};
+const SleepMode SLEEP_MODE = SLEEP_POWER_OFF;
+
+const char* POWEROFF_NVS_NAMESPACE = "pspec";
+const uint8_t POWEROFF_RECORD_VERSION = 7;  // v2: + wake profile, v3: + latency histograms, v4/5: + metrics, v6: + font ID, v7: + rescan flag
+#define BM8563_REG_CONTROL2  0x01
+#define BM8563_FLAG_AF       0x08  // Alarm flag
+#define BM8563_FLAG_TF       0x04  // Timer flag (used by M5.shutdown(seconds))
+const uint32_t BM8563_MAX_TIMER_SECONDS = 255 * 60; // Countdown timer limit (1/60 Hz source)
+
+// Save rtcState to NVS and mark it as pending for the next power-on
+bool savePowerOffRecord() {
+    Preferences prefs;
+    if (!prefs.begin(POWEROFF_NVS_NAMESPACE, false)) return false;
+    bool ok = prefs.putBytes("state", &rtcState, sizeof(rtcState)) == sizeof(rtcState);
+    ok = ok && prefs.putBytes("profile", wakeProfile, sizeof(wakeProfile)) == sizeof(wakeProfile);
+    ok = ok && prefs.putBytes("latency", latencyStats, sizeof(latencyStats)) == sizeof(latencyStats);
+#if METRICS_ENABLED
+    ok = ok && prefs.putBytes("metrics", metricValues, sizeof(metricValues)) == sizeof(metricValues);
+#endif
+    ok = ok && prefs.putUChar("ver", POWEROFF_RECORD_VERSION) == 1;
+    ok = ok && prefs.putBool("armed", ok) == 1;
+    prefs.end();
+    return ok;
+}
 
-    // v2.2: Build list of enabled ranges
-    std::vector<int> enabledRanges;
-    for (int i = 0; i < numGlyphRanges; i++) {
-        if (i < config.rangeEnabled.size() && config.rangeEnabled[i]) {
-            enabledRanges.push_back(i);
-        }
+void clearPowerOffRecord() {
+    Preferences prefs;
+    if (prefs.begin(POWEROFF_NVS_NAMESPACE, false)) {
+        prefs.putBool("armed", false);
+        prefs.end();
     }
+}
 
-    // If no ranges enabled, fallback to first 6 (safety)
-    if (enabledRanges.empty()) {
-        Serial.println("WARNING: No ranges enabled, using defaults");
-        for (int i = 0; i < 6 && i < numGlyphRanges; i++) {
-            enabledRanges.push_back(i);
+// Restore rtcState if the last shutdown was a power-off sleep. The record is consumed, so
+// a later power-on (e.g. after the user shutdown screen) is a normal cold boot. A reset
+// also reports a power-on to the ESP32, so it can only reach setup while the device is
+// awake: during power-off sleep there is nothing running to reset.
+bool restorePowerOffRecord() {
+    Preferences prefs;
+    if (!prefs.begin(POWEROFF_NVS_NAMESPACE, false)) return false;
+
+    bool restored = false;
+    if (prefs.getBool("armed", false) &&
+        prefs.getUChar("ver", 0) == POWEROFF_RECORD_VERSION &&
+        prefs.getBytesLength("state") == sizeof(rtcState)) {
+        restored = prefs.getBytes("state", &rtcState, sizeof(rtcState)) == sizeof(rtcState);
+        if (prefs.getBytesLength("profile") == sizeof(wakeProfile)) {
+            prefs.getBytes("profile", wakeProfile, sizeof(wakeProfile));
+        }
+        if (prefs.getBytesLength("latency") == sizeof(latencyStats)) {
+            prefs.getBytes("latency", latencyStats, sizeof(latencyStats));
         }
+#if METRICS_ENABLED
+        if (prefs.getBytesLength("metrics") == sizeof(metricValues)) {
+            prefs.getBytes("metrics", metricValues, sizeof(metricValues));
+        }
+#endif
     }
+    prefs.putBool("armed", false);
+    prefs.end();
+    return restored && rtcState.isValid;
+}
 
-    // Pick random enabled range
-    int randomIndex = random(0, enabledRanges.size());
-    int rangeIndex = enabledRanges[randomIndex];
-    const UnicodeRange& range = glyphRanges[rangeIndex];
-
-    // Pick random codepoint in range
-    uint32_t preferredCodepoint = random(range.start, range.end + 1);
-
-    Serial.printf("Random glyph: U+%04X from %s (range %d/%d enabled)\n",
-                  preferredCodepoint, range.name, rangeIndex + 1, enabledRanges.size());
-
-    // Verify the glyph exists in the current font, or find an alternative
-    uint32_t validCodepoint = findValidGlyph(preferredCodepoint);
-    if (validCodepoint == 0) {
-        Serial.println("ERROR: No valid glyphs found in font, skipping to next font");
-        return 0; // Signal to skip this font
-    }
+// True if the BM8563 timer/alarm powered the device on (clears the flags)
+bool rtcAlarmFired() {
+    uint8_t flags = M5.RTC.readReg(BM8563_REG_CONTROL2);
+    M5.RTC.clearIRQ();
+    M5.RTC.disableIRQ();
+    return (flags & (BM8563_FLAG_AF | BM8563_FLAG_TF)) != 0;
+}
 
-    if (validCodepoint != preferredCodepoint) {
-        Serial.printf("Using alternative glyph: U+%04X\n", validCodepoint);
+// Cut main power until the next wake. Returns only if power stayed on (USB connected).
+void powerOffUntilNextWake(uint32_t sleepSeconds) {
+    if (!savePowerOffRecord()) {
+        LOG_W("WARNING: Could not save power-off record - using deep sleep\n");
+        return;
     }
 
-    return validCodepoint;
+    LOG_I(">>> Powering off, RTC alarm in %lus\n", sleepSeconds);
+    epdStandBy();
+    delay(100); // Give serial time to flush
+    if (sleepSeconds <= BM8563_MAX_TIMER_SECONDS) {
+        M5.shutdown(sleepSeconds);
+    } else {
+        // Beyond the BM8563 countdown range (quiet hours): daily hour:minute alarm instead
+        rtc_time_t now;
+        M5.RTC.getTime(&now);
+        uint32_t wakeMinute = (now.hour * 60 + now.min + (now.sec + sleepSeconds) / 60) % MINUTES_PER_DAY;
+        rtc_time_t wakeAt(wakeMinute / 60, wakeMinute % 60, 0);
+        M5.shutdown(wakeAt);
+    }
+
+    // Still running: main power is supplied externally (USB)
+    delay(1000);
+    LOG_I("Still powered (USB?) - falling back to deep sleep\n");
+    clearPowerOffRecord();
+    M5.RTC.clearIRQ();
+    M5.RTC.disableIRQ();
 }
 
-// Convert Unicode codepoint to UTF-8 string
-String codepointToString(uint32_t codepoint) {
-    String result = "";
-
-    if (codepoint <= 0x7F) {
-        // 1-byte UTF-8
-        result += (char)codepoint;
-    } else if (codepoint <= 0x7FF) {
-        // 2-byte UTF-8
-        result += (char)(0xC0 | (codepoint >> 6));
-        result += (char)(0x80 | (codepoint & 0x3F));
-    } else if (codepoint <= 0xFFFF) {
-        // 3-byte UTF-8
-        result += (char)(0xE0 | (codepoint >> 12));
-        result += (char)(0x80 | ((codepoint >> 6) & 0x3F));
-        result += (char)(0x80 | (codepoint & 0x3F));
-    } else if (codepoint <= 0x10FFFF) {
-        // 4-byte UTF-8
-        result += (char)(0xF0 | (codepoint >> 18));
-        result += (char)(0x80 | ((codepoint >> 12) & 0x3F));
-        result += (char)(0x80 | ((codepoint >> 6) & 0x3F));
-        result += (char)(0x80 | (codepoint & 0x3F));
-    }
+// ========================================
+// v3.1: Pre-rendered Auto-Wake Frames
+// ========================================
+// In the governor's low-battery tiers, the last interactive session (font already in
+// RAM) renders the next few auto-wake specimens into RLE files on SD. An auto-wake then
+// only reads ~20-40KB instead of loading a font file and running FreeType.
+
+#define PRERENDER_DIR "/.frames"
+const int PRERENDER_FRAME_COUNT = 4;
+const uint32_t PRERENDER_MAGIC = 0x32465250; // "PRF2" (v2: font ID instead of index)
+
+struct PrerenderHeader {
+    uint32_t magic;
+    uint32_t fontId;
+    uint32_t codepoint;
+    uint8_t viewMode;
+    uint8_t reserved[3];
+    uint32_t frameBytes;   // Decoded size (must match the canvas)
+};
 
-    return result;
+String prerenderPath(int slot) {
+    return String(PRERENDER_DIR) + "/" + String(slot) + ".rle";
 }
 
-// Render current glyph (bitmap mode - custom FreeType rendering)
-void renderGlyphBitmap() {
-    if (!fontLoaded) {
-        Serial.println("ERROR: No font loaded");
-        return;
+// Canvas -> (count, byte) run-length pairs. Glyph frames are mostly white.
+bool writePrerenderedFrame(int slot) {
+    const uint8_t* frame = (const uint8_t*)canvas.frameBuffer();
+    const uint32_t frameBytes = 540 * 960 / 2;
+
+    File file = SD.open(prerenderPath(slot), FILE_WRITE);
+    if (!file) return false;
+
+    PrerenderHeader header = {PRERENDER_MAGIC, currentFontId(), currentGlyphCodepoint,
+                              (uint8_t)currentViewMode, {0, 0, 0}, frameBytes};
+    file.write((const uint8_t*)&header, sizeof(header));
+
+    uint8_t out[512];
+    size_t outLen = 0;
+    size_t total = sizeof(header);
+    for (uint32_t i = 0; i < frameBytes; ) {
+        uint8_t value = frame[i];
+        uint8_t run = 1;
+        while (i + run < frameBytes && run < 255 && frame[i + run] == value) run++;
+        out[outLen++] = run;
+        out[outLen++] = value;
+        i += run;
+        if (outLen == sizeof(out)) {
+            file.write(out, outLen);
+            total += outLen;
+            outLen = 0;
+        }
     }
+    file.write(out, outLen);
+    total += outLen;
+    file.close();
 
-    Serial.println("\n=== Custom Bitmap Rendering ===");
-
-    // Get FreeType face
-    FT_Face face = getFontFaceFromCanvas();
+    LOG_I("Pre-rendered slot %d: U+%04X %s, %u bytes\n", slot, currentGlyphCodepoint,
+          currentViewMode == BITMAP ? "BITMAP" : "OUTLINE", total);
+    return true;
+}
 
-    if (!face) {
-        Serial.println("ERROR: FT_Face not available");
-        return;
+bool readPrerenderedFrame(int slot, PrerenderHeader& header) {
+    uint8_t* frame = (uint8_t*)canvas.frameBuffer();
+    const uint32_t frameBytes = 540 * 960 / 2;
+
+    File file = SD.open(prerenderPath(slot), FILE_READ);
+    if (!file) return false;
+
+    bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              header.magic == PRERENDER_MAGIC && header.frameBytes == frameBytes;
+
+    uint8_t in[512];
+    uint32_t pos = 0;
+    while (ok && pos < frameBytes) {
+        int len = file.read(in, sizeof(in));
+        if (len < 2) break;
+        METRIC_ADD(M_SD_BYTES_READ, len);
+        for (int i = 0; i + 1 < len && pos < frameBytes; i += 2) {
+            uint32_t run = min((uint32_t)in[i], frameBytes - pos);
+            memset(frame + pos, in[i + 1], run);
+            pos += run;
+        }
     }
+    file.close();
+    return ok && pos == frameBytes;
+}
 
-    // Load glyph with no scaling to get metrics
-    FT_UInt glyph_index = FT_Get_Char_Index(face, currentGlyphCodepoint);
-    if (glyph_index == 0) {
-        Serial.printf("WARNING: Glyph U+%04X not found\n", currentGlyphCodepoint);
+// Called before sleep: fill the frame queue if the governor wants it. After an interactive
+// session (font loaded anyway) a partly used queue is refilled; an auto-wake only renders
+// ahead once the queue is empty, i.e. when it had to load a font itself.
+void prerenderAutoWakeFrames() {
+    if (!governor().usePrerenderedFrames || !fontLoaded) return;
+    int keep = isAutoWakeSession ? 1 : PRERENDER_FRAME_COUNT;
+    if (rtcState.prerenderedCount >= keep) {
+        LOG_D("Pre-rendered queue holds %d frames - nothing to render\n", rtcState.prerenderedCount);
         return;
     }
 
-    FT_Error error = FT_Load_Glyph(face, glyph_index, FT_LOAD_NO_SCALE);
-    if (error) {
-        Serial.printf("ERROR: Failed to load glyph (error %d)\n", error);
-        return;
+    unsigned long start = millis();
+    if (!SD.exists(PRERENDER_DIR)) {
+        SD.mkdir(PRERENDER_DIR);
     }
 
-    // Calculate bounding box
-    FT_BBox bbox;
-    FT_Outline_Get_CBox(&face->glyph->outline, &bbox);
-
-    float width = bbox.xMax - bbox.xMin;
-    float height = bbox.yMax - bbox.yMin;
-
-    // Target size: 400px (scale each glyph to fill screen optimally)
-    float target_size = 400.0f;
+    uint32_t savedCodepoint = currentGlyphCodepoint;
+    ViewMode savedMode = currentViewMode;
+    renderToCanvasOnly = true;
+    renderCancellable = false;
 
-    // Calculate pixel size needed to achieve target_size
-    // Formula: pixel_size = (target_size * units_per_EM) / max_glyph_dimension
-    float max_dim = (width > height ? width : height);
-    int pixel_size = (int)((target_size * face->units_per_EM) / max_dim);
+    int made = 0;
+    for (int slot = 0; slot < PRERENDER_FRAME_COUNT; slot++) {
+        if (config.allowDifferentMode && governor().allowModeSwitch) {
+            currentViewMode = ((esp_random() % 2) == 0) ? BITMAP : OUTLINE;
+        }
+        currentGlyphCodepoint = getRandomGlyphCodepoint();
+        if (currentGlyphCodepoint == 0) break;
+        renderGlyph();
+        if (!writePrerenderedFrame(slot)) break;
+        made++;
+    }
 
-    if (pixel_size < 1) pixel_size = 1;
-    if (pixel_size > 2000) pixel_size = 2000; // Safety limit (increased for small glyphs)
+    renderToCanvasOnly = false;
+    currentGlyphCodepoint = savedCodepoint;
+    currentViewMode = savedMode;
+    rtcState.prerenderedCount = made;
+    rtcState.prerenderedNext = 0;
+    LOG_I("Pre-rendered %d auto-wake frames in %lums\n", made, millis() - start);
+}
 
-    Serial.printf("Glyph bbox: w=%.1f h=%.1f, units_per_EM=%d, pixel_size=%d\n",
-                  width, height, face->units_per_EM, pixel_size);
+// Auto-wake: show the next queued frame. Returns false if none is usable.
+bool showPrerenderedFrame() {
+    if (!governor().usePrerenderedFrames || rtcState.prerenderedCount == 0) return false;
 
-    // Set pixel size and load glyph for rendering
-    error = FT_Set_Pixel_Sizes(face, 0, pixel_size);
-    if (error) {
-        Serial.printf("ERROR: Failed to set pixel size (error %d)\n", error);
-        return;
-    }
+    int slot = rtcState.prerenderedNext;
+    rtcState.prerenderedNext++;
+    rtcState.prerenderedCount--;
 
-    error = FT_Load_Glyph(face, glyph_index, FT_LOAD_RENDER);
-    if (error) {
-        Serial.printf("ERROR: Failed to render glyph (error %d)\n", error);
-        return;
+    PrerenderHeader header;
+    int fontIndex = -1;
+    if (!readPrerenderedFrame(slot, header) || (fontIndex = fontIndexForId(header.fontId)) < 0) {
+        LOG_W("WARNING: Pre-rendered slot %d unusable, dropping queue\n", slot);
+        rtcState.prerenderedCount = 0;
+        return false;
     }
 
-    FT_Bitmap* bitmap = &face->glyph->bitmap;
+    currentFontIndex = fontIndex;
+    currentGlyphCodepoint = header.codepoint;
+    currentViewMode = (ViewMode)header.viewMode;
+    presentGlyphFrame();
+    return true;
+}
 
-    Serial.printf("Bitmap: %dx%d, pitch=%d, mode=%d\n",
-                  bitmap->width, bitmap->rows, bitmap->pitch, bitmap->pixel_mode);
+// Save state and enter deep sleep
+void enterDeepSleep() {
+    profileBegin(PHASE_SLEEP_ENTRY);
+    LOG_I("\n>>> Preparing for deep sleep...\n");
 
-    // Clear canvas
-    canvas.fillCanvas(0); // 0 = white
+    // v3.0: Disable touch screen before sleep to save power
+    disableTouch();
 
-    // Calculate centering
-    int centerX = 270;
-    int centerY = 480;
-    int draw_x = centerX - bitmap->width / 2;
-    int draw_y = centerY - bitmap->rows / 2;
+    // Accumulate current session time to total uptime (only in debug mode, for battery logging)
+    if (rtcState.debugMode) {
+        uint32_t currentMillis = millis();
+        LOG_D("DEBUG: Before accumulation: rtcState.totalMillis=%llu, millis()=%lu\n",
+              rtcState.totalMillis, currentMillis);
+        rtcState.totalMillis += currentMillis;
+        LOG_D("DEBUG: After accumulation: rtcState.totalMillis=%llu\n", rtcState.totalMillis);
 
-    // Draw bitmap on canvas (convert 8bpp grayscale to 4bpp)
-    for (unsigned int y = 0; y < bitmap->rows; y++) {
-        for (unsigned int x = 0; x < bitmap->width; x++) {
-            unsigned char gray8 = bitmap->buffer[y * bitmap->pitch + x];
+        uint32_t totalMinutes = rtcState.totalMillis / 60000;
+        LOG_I("Accumulated uptime: %lu minutes (%lud %02luh %02lum)\n",
+              totalMinutes,
+              totalMinutes / (24 * 60),
+              (totalMinutes % (24 * 60)) / 60,
+              totalMinutes % 60);
+    }
 
-            // Convert 8bpp (0-255) to 4bpp (0-15)
-            // 0 = white, 15 = black in M5EPD
-            unsigned char gray4 = (gray8 * 15) / 255;
+    // Never sleep on a 1-bit preview: the canvas still holds the grayscale frame
+    settleGlyphFrame();
 
-            int screen_x = draw_x + x;
-            int screen_y = draw_y + y;
+    // Save current state to RTC memory
+    rtcState.isValid = true;
+    rtcState.currentFontIndex = currentFontIndex;
+    rtcState.currentFontId = currentFontId();
+    rtcState.currentGlyphCodepoint = currentGlyphCodepoint;
+    rtcState.viewMode = currentViewMode;  // STEP 5: Save view mode
+    saveScheduleToRtc();
 
-            // Bounds check
-            if (screen_x >= 0 && screen_x < 540 && screen_y >= 0 && screen_y < 960) {
-                canvas.drawPixel(screen_x, screen_y, gray4);
-            }
-        }
+    // v3.1: Next auto-wake from the schedule (quiet hours, per-period intervals)
+    uint32_t sleepSeconds = nextWakeSeconds();
+    if (governor().intervalMultiplier > 1) {
+        sleepSeconds = min(sleepSeconds * governor().intervalMultiplier, (uint32_t)(MINUTES_PER_DAY - 1) * 60);
+        LOG_I("Energy governor %s: sleep stretched to %lus\n", governor().name, sleepSeconds);
     }
+    rtcState.plannedSleepSeconds = sleepSeconds;
 
-    // Draw labels
-    String fontName = getFontName(fontPaths[currentFontIndex]);
-    char codepointStr[32];
-    sprintf(codepointStr, "U+%04X", currentGlyphCodepoint);
-
-    // Truncate font name if it exceeds margins (30px left + 30px right = 480px max)
-    // Note: shortenTextIfNeeded() uses bitmap font textSize=3 for measurement (calibrated to match FreeType 24px)
-    String displayFontName = shortenTextIfNeeded(fontName, 480, 3);
-
-    // IMPORTANT: After using FT_Set_Pixel_Sizes() directly for large glyph rendering,
-    // we need to reload font at size 24 for label rendering
-    // (FreeType state was modified, so we must reset it)
-    canvas.loadFont(fontPaths[currentFontIndex], SD);
-    canvas.createRender(24, 64); // Recreate 24px cache
-    canvas.setTextSize(24);
-    canvas.setTextColor(15);
-    canvas.setTextDatum(TC_DATUM);
-    canvas.drawString(displayFontName, centerX, 30);
+    // v3.1: Next button wake can skip SD/font/render if the panel already shows this state
+    rtcState.displayMatchesState = displayShowsState &&
+                                   displayedFontIndex == currentFontIndex &&
+                                   displayedGlyphCodepoint == currentGlyphCodepoint &&
+                                   displayedViewMode == currentViewMode;
+    LOG_I("State saved: font=%d, glyph=U+%04X, mode=%s\n",
+          rtcState.currentFontIndex, rtcState.currentGlyphCodepoint,
+          currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+    LOG_I("Display matches saved state: %s\n", rtcState.displayMatchesState ? "yes" : "no");
 
-    canvas.setTextSize(24);
-    canvas.setTextColor(15);
-    canvas.setTextDatum(BC_DATUM);
-    canvas.drawString(codepointStr, centerX, 930);
+    // v3.1: Low battery: render the next auto-wake frames now, while the font is loaded
+    prerenderAutoWakeFrames();
 
-    // Check if this is first render after wake (needs double full refresh for clean display)
-    if (isFirstRenderAfterWake) {
-        Serial.println("First render after wake: double full refresh");
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-        M5.EPD.UpdateFull(UPDATE_MODE_GC16); // Second pass to eliminate wake artifacts
-        isFirstRenderAfterWake = false; // Reset flag
-        partialRefreshCount = 0;
-        hasPartialSinceLastFull = false;
-        lastFullRefreshTime = millis();
-    } else {
-        // Normal operation: partial refresh with auto-full after N renders or timeout
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GL16);
+    // v3.1: Metrics snapshot (counters are already in RTC memory, gauges sampled now)
+    sampleMetricGauges();
+    if (rtcState.debugMode && SD.cardType() != CARD_NONE) {
+        appendMetricsToSD(rtcState.totalMillis / 1000);
+    }
 
-        // Track first partial after full refresh
-        if (!hasPartialSinceLastFull) {
-            firstPartialAfterFullTime = millis();
-            hasPartialSinceLastFull = true;
-            Serial.println("First partial after full - starting 10s timer");
-        }
+    // v3.1: Full power-off with RTC alarm (does not return unless on USB power)
+    if (SLEEP_MODE == SLEEP_POWER_OFF) {
+        profileEnd(PHASE_SLEEP_ENTRY); // Recorded before the NVS record is written
+        powerOffUntilNextWake(sleepSeconds);
+    }
 
-        partialRefreshCount++;
+    // Put display controller in standby (already done if power-off fell back to deep sleep)
+    epdStandBy();
 
-        // Trigger full refresh if:
-        // (A) 5 partials reached OR (B) 10s passed since first partial
-        // AND at least 10s passed since last full refresh (prevents too frequent full refreshes)
-        unsigned long timeSinceFirstPartial = millis() - firstPartialAfterFullTime;
-        unsigned long timeSinceLastFull = millis() - lastFullRefreshTime;
+    // Keep GPIO2 (M5EPD_MAIN_PWR_PIN) HIGH during deep sleep to maintain power
+    gpio_hold_en((gpio_num_t)M5EPD_MAIN_PWR_PIN);
+    gpio_deep_sleep_hold_en();
+    LOG_I("GPIO hold enabled\n");
 
-        if ((partialRefreshCount >= MAX_PARTIAL_BEFORE_FULL || timeSinceFirstPartial >= FULL_REFRESH_TIMEOUT_MS) &&
-            timeSinceLastFull >= FULL_REFRESH_TIMEOUT_MS) {
+    // Configure wake sources:
+    // 1) GPIO38 (center button press) - user interaction
+    // 2) Timer (schedule) - auto refresh
+    esp_sleep_enable_ext0_wakeup(GPIO_NUM_38, LOW); // Wake when button pressed (goes LOW)
 
-            Serial.printf("Full refresh triggered (count=%d, time since first partial=%lums, time since last full=%lums)\n",
-                          partialRefreshCount, timeSinceFirstPartial, timeSinceLastFull);
-            M5.EPD.UpdateFull(UPDATE_MODE_GC16);
+    // Enable timer wakeup from the schedule (config interval unless a period says otherwise)
+    uint64_t wakeup_time_us = sleepSeconds * 1000000ULL; // seconds to microseconds
+    esp_sleep_enable_timer_wakeup(wakeup_time_us);
+    LOG_I("Wake sources configured: GPIO38 (button) + Timer (%lus)\n", sleepSeconds);
 
-            partialRefreshCount = 0;
-            hasPartialSinceLastFull = false;
-            lastFullRefreshTime = millis();
-        }
-    }
+    LOG_I(">>> Entering deep sleep now...\n\n");
+    profileEnd(PHASE_SLEEP_ENTRY);
+    delay(100); // Give serial time to flush
 
-    Serial.printf("Rendered bitmap: U+%04X with font %s\n",
-                  currentGlyphCodepoint, fontName.c_str());
+    // Enter deep sleep
+    esp_deep_sleep_start();
 }
 
 // ========================================
-// STEP 5: Unified Render Function (chooses bitmap or outline)
+// Shutdown Screen with QR Code
 // ========================================
 
-void renderGlyph() {
-    if (currentViewMode == BITMAP) {
-        renderGlyphBitmap();
-    } else {
-        renderGlyphOutline();
-    }
-}
-
-// Change to next font (skip fonts that don't have the current glyph)
-void nextFont() {
-    if (fontPaths.empty()) return;
-
-    int startIndex = currentFontIndex;
-    int attempts = 0;
-
-    // Try to find a font that has the current glyph
-    do {
-        currentFontIndex = (currentFontIndex + 1) % fontPaths.size();
-        attempts++;
-
-        Serial.printf("Trying font %d/%d\n", currentFontIndex + 1, fontPaths.size());
+// Draw QR code at specified position with specified pixel size
+// Note: pixelSizeX can be different from pixelSizeY to compensate for display aspect ratio
+void drawQRCode(int centerX, int centerY, int pixelSizeY, int pixelSizeX = 0) {
+    if (pixelSizeX == 0) pixelSizeX = pixelSizeY; // Default to square if not specified
 
-        if (loadCurrentFont()) {
-            // Check if this font has the current glyph
-            FT_Face face = getFontFaceFromCanvas();
-            if (face) {
-                FT_UInt glyph_index = FT_Get_Char_Index(face, currentGlyphCodepoint);
-                if (glyph_index != 0) {
-                    // Found a font with this glyph!
-                    Serial.printf("Font %d has glyph U+%04X\n", currentFontIndex + 1, currentGlyphCodepoint);
-                    renderGlyph();
-                    return;
-                } else {
-                    Serial.printf("Font %d doesn't have glyph U+%04X, skipping...\n",
-                                  currentFontIndex + 1, currentGlyphCodepoint);
-                }
-            }
-        }
+    int qrDisplayWidth = QR_SIZE * pixelSizeX;
+    int qrDisplayHeight = QR_SIZE * pixelSizeY;
+    int startX = centerX - qrDisplayWidth / 2;
+    int startY = centerY - qrDisplayHeight / 2;
 
-        // Check if we've tried all fonts
-        if (attempts >= fontPaths.size()) {
-            Serial.println("No font has this glyph! Returning to original font.");
-            currentFontIndex = startIndex;
-            loadCurrentFont();
-            renderGlyph();
-            return;
+    LOG_D("QR Code: size=%d×%d, pixelSize=%d×%d, display=%d×%d, start=(%d,%d)\n",
+          QR_SIZE, QR_SIZE, pixelSizeX, pixelSizeY, qrDisplayWidth, qrDisplayHeight, startX, startY);
+    LOG_D("Canvas: width=%d, height=%d\n", canvas.width(), canvas.height());
+
+#if LOG_LEVEL >= LOG_LEVEL_VERBOSE
+    // Debug: print ALL 29 rows to verify complete QR data (verbose builds only; the rows are
+    // not even built unless the runtime level is verbose too)
+    LOG_V("Complete QR code data:\n");
+    for (int row = 0; row < QR_SIZE && logLevel >= LOG_LEVEL_VERBOSE; row++) {
+        char rowText[QR_SIZE * 3 + 1]; // "█" is 3 bytes in UTF-8
+        int len = 0;
+        for (int x = 0; x < QR_SIZE; x++) {
+            int byteIndex = row * 4 + (x / 8);
+            int bitIndex = 7 - (x % 8);
+            uint8_t byte = pgm_read_byte(&qrcode_data[byteIndex]);
+            bool isBlack = (byte >> bitIndex) & 1;
+            len += sprintf(rowText + len, "%s", isBlack ? "█" : " ");
         }
-    } while (true);
-}
-
-// Change to previous font (skip fonts that don't have the current glyph)
-void previousFont() {
-    if (fontPaths.empty()) return;
-
-    int startIndex = currentFontIndex;
-    int attempts = 0;
+        LOG_V("Row %2d: %s\n", row, rowText);
+    }
+#endif
 
-    // Try to find a font that has the current glyph
-    do {
-        currentFontIndex--;
-        if (currentFontIndex < 0) {
-            currentFontIndex = fontPaths.size() - 1;
-        }
-        attempts++;
+    // Draw QR code pixel by pixel
+    int blackModules = 0;
+    int pixelsDrawn = 0;
 
-        Serial.printf("Trying font %d/%d\n", currentFontIndex + 1, fontPaths.size());
+    for (int moduleY = 0; moduleY < QR_SIZE; moduleY++) {
+        for (int moduleX = 0; moduleX < QR_SIZE; moduleX++) {
+            // Read bit from PROGMEM
+            int byteIndex = moduleY * 4 + (moduleX / 8);
+            int bitIndex = 7 - (moduleX % 8);
+            uint8_t byte = pgm_read_byte(&qrcode_data[byteIndex]);
+            bool isBlack = (byte >> bitIndex) & 1;
 
-        if (loadCurrentFont()) {
-            // Check if this font has the current glyph
-            FT_Face face = getFontFaceFromCanvas();
-            if (face) {
-                FT_UInt glyph_index = FT_Get_Char_Index(face, currentGlyphCodepoint);
-                if (glyph_index != 0) {
-                    // Found a font with this glyph!
-                    Serial.printf("Font %d has glyph U+%04X\n", currentFontIndex + 1, currentGlyphCodepoint);
-                    renderGlyph();
-                    return;
-                } else {
-                    Serial.printf("Font %d doesn't have glyph U+%04X, skipping...\n",
-                                  currentFontIndex + 1, currentGlyphCodepoint);
+            // Draw this module as pixelSizeX × pixelSizeY block using drawPixel
+            if (isBlack) {
+                blackModules++;
+                int baseX = startX + moduleX * pixelSizeX;
+                int baseY = startY + moduleY * pixelSizeY;
+
+                // Fill the pixelSizeX × pixelSizeY rectangle pixel by pixel
+                for (int dy = 0; dy < pixelSizeY; dy++) {
+                    for (int dx = 0; dx < pixelSizeX; dx++) {
+                        canvas.drawPixel(baseX + dx, baseY + dy, 15);
+                        pixelsDrawn++;
+                    }
                 }
             }
         }
-
-        // Check if we've tried all fonts
-        if (attempts >= fontPaths.size()) {
-            Serial.println("No font has this glyph! Returning to original font.");
-            currentFontIndex = startIndex;
-            loadCurrentFont();
-            renderGlyph();
-            return;
-        }
-    } while (true);
-}
-
-// Generate and display new random glyph
-void randomGlyph() {
-    if (!fontLoaded) return;
-
-    currentGlyphCodepoint = getRandomGlyphCodepoint();
-
-    // If no valid glyph found in current font, try next font
-    if (currentGlyphCodepoint == 0) {
-        Serial.println("No valid glyphs in current font, switching to next font");
-        nextFont(); // This will automatically skip fonts without glyphs
-        return;
     }
-
-    renderGlyph();
+    LOG_D("QR Code drawing complete: %d black modules, %d pixels drawn\n", blackModules, pixelsDrawn);
 }
 
-// Change to random font AND random glyph (used for auto-wake)
-void randomFont() {
-    if (fontPaths.empty()) return;
+// Show shutdown screen with QR code and power off
+void shutdownWithScreen() {
+    LOG_I("\n=== Shutdown Requested (Long Press) ===\n");
 
-    // Pick a random font index
-    currentFontIndex = random(0, fontPaths.size());
-    Serial.printf("Random font selected: %d/%d\n", currentFontIndex + 1, fontPaths.size());
+    // Use existing canvas but unload any FreeType font
+    canvas.unloadFont(); // Remove FreeType renderer
+    canvas.fillCanvas(0); // White background
 
-    // Load the font and generate random glyph
-    if (loadCurrentFont()) {
-        currentGlyphCodepoint = getRandomGlyphCodepoint();
-        renderGlyph();
-    }
-}
+    // Draw QR code first
+    LOG_I("Drawing QR code...\n");
+    drawQRCode(270, 480, 6, 6); // QR code: 6×6 px per module
 
-// Touch screen utilities (v3.0)
-// Returns: 0=left zone, 1=center zone, 2=right zone, -1=invalid
-int getTouchZone(int16_t x, int16_t y) {
-    // Check Y is within active area (exclude top/bottom 90px for labels)
-    if (y < ZONE_TOP_MARGIN || y > ZONE_BOTTOM_MARGIN) return -1;
+    // Draw text with built-in bitmap font (no FreeType)
+    LOG_I("Drawing text labels...\n");
+    canvas.setFreeFont(NULL); // Force use of built-in font
+    canvas.setTextFont(1); // Font 1 = default bitmap font
+    canvas.setTextSize(2); // Bitmap font size 2 = 16px height
+    canvas.setTextColor(15); // Black text
 
-    // Check X zone
-    if (x >= ZONE_LEFT_MIN && x < ZONE_LEFT_MAX) return 0;      // Left: previous font
-    if (x >= ZONE_CENTER_MIN && x < ZONE_CENTER_MAX) return 1;  // Center: random glyph
-    if (x >= ZONE_RIGHT_MIN && x < ZONE_RIGHT_MAX) return 2;    // Right: next font
-    return -1; // Out of bounds
-}
+    // Top label: "PaperSpecimen"
+    canvas.setTextDatum(TC_DATUM);
+    canvas.drawString("PaperSpecimen", 270, 30);
+    LOG_I("Top label drawn\n");
 
-// Helper function for setup screen touch: returns index of tapped menu item (-1 if none)
-int getMenuItemAtTouch(int16_t touchY, const std::vector<MenuItem>& items) {
-    // Calculate menu layout (same logic as renderUnifiedSetupScreen)
-    const int headerBottom = 30 + 24;  // Y=30 + text height
-    const int footerTop = 930 - 24;    // Y=930 - text height
-    const int availableHeight = footerTop - headerBottom;
+    // Bottom label: "v3.0.1" (or "v3.0.1*" in debug mode)
+    canvas.setTextDatum(BC_DATUM);
+    canvas.drawString(rtcState.debugMode ? "v3.0.1*" : "v3.0.1", 270, 930);
+    LOG_I("Bottom label drawn\n");
 
-    int totalItemHeight = items.size() * UI_LINE_HEIGHT;
-    int flexSpace = max(0, (availableHeight - totalItemHeight) / 2);
-    int startY = headerBottom + flexSpace;
+    // Full refresh to clear any ghosting
+    pushFrame(UPDATE_MODE_GC16);
+    LOG_I("Shutdown screen displayed with QR code\n");
 
-    // Check which item was tapped
-    for (int i = 0; i < items.size(); i++) {
-        int itemY = startY + i * UI_LINE_HEIGHT;
-        int itemBottom = itemY + UI_LINE_HEIGHT;
+    delay(2000); // Show for 2 seconds
 
-        if (touchY >= itemY && touchY < itemBottom) {
-            return i;  // Found the tapped item
-        }
-    }
+    // Deep sleep indefinitely (no timer wake)
+    LOG_I("Entering deep sleep (shutdown mode)\n");
 
-    return -1;  // No item at this Y coordinate
-}
+    // Configure wake on button press only
+    esp_sleep_enable_ext0_wakeup(GPIO_NUM_38, 0); // GPIO38 = center button, LOW = pressed
 
-void enableTouch() {
-    if (!touchEnabled) {
-        // Initialize GT911 touch controller: SDA=21, SCL=22, INT=36
-        if (M5.TP.begin(21, 22, 36) != ESP_OK) {
-            Serial.println("ERROR: Touch pad initialization failed");
-            return;
-        }
-        M5.TP.SetRotation(90); // Match display rotation
-        touchEnabled = true;
-        Serial.println("Touch screen enabled (GT911 initialized)");
-    }
-}
+    // Put display to sleep
+    M5.EPD.Sleep();
 
-void disableTouch() {
-    if (touchEnabled) {
-        touchEnabled = false;
-        Serial.println("Touch screen disabled");
-    }
+    // Power management
+    digitalWrite(M5EPD_MAIN_PWR_PIN, LOW);
+    gpio_hold_en((gpio_num_t)M5EPD_MAIN_PWR_PIN);
+    gpio_deep_sleep_hold_en();
+
+    delay(100);
+    esp_deep_sleep_start();
 }
 
-// Check battery level and return percentage (0-100)
-float getBatteryPercentage() {
-    // Take average of 5 readings to reduce ADC noise
-    uint32_t voltageSum = 0;
-    for (int i = 0; i < 5; i++) {
-        voltageSum += M5.getBatteryVoltage();
-        delay(10); // Small delay between readings
-    }
-    uint32_t voltage = voltageSum / 5;
-    Serial.printf("Battery voltage: %dmV (averaged)\n", voltage);
+// ========================================
+// v3.1: Deferred Wake Init
+// ========================================
+// A button wake whose panel still shows the saved glyph skips SD, config, font load and
+// render in setup(). The first input event finishes that work before it is handled.
 
-    // LiPo voltage range: 4200mV (100%) to 3300mV (0%)
-    // 5% threshold = ~3345mV
-    if (voltage >= 4200) return 100.0;
-    if (voltage <= 3300) return 0.0;
+bool deferredWakeInit = false;  // SD/config/fonts not loaded yet (fast button wake)
 
-    float percentage = ((float)(voltage - 3300) / (4200 - 3300)) * 100.0;
-    return percentage;
+// Rebuild the active font table from the catalog enable flags
+void applyFontConfig() {
+    LOG_I("\n=== Applying Config ===\n");
+    rebuildActiveFonts();
+    LOG_I("Active fonts: %d of %d\n", activeFontCount(), catalogFontCount());
 }
 
-// Log battery data to .battery file on SD card
-void logBatteryData(uint32_t voltage, float percentage, bool isReset) {
-    File file = SD.open("/.battery", FILE_APPEND);
-    if (!file) {
-        Serial.println("WARNING: Could not open .battery file for logging");
-        return;
+// Mount SD, load config and the current font (work skipped by a fast button wake)
+void completeDeferredWake() {
+    if (!deferredWakeInit) return;
+    deferredWakeInit = false;
+
+    unsigned long start = millis();
+    LOG_I("\n=== Deferred wake init (first input) ===\n");
+
+    profileBegin(PHASE_SD_BEGIN);
+    bool sdOk = SD.begin();
+    profileEnd(PHASE_SD_BEGIN);
+    if (!sdOk) {
+        LOG_E("✗ ERROR: SD card not available at wake!\n");
+        epdLeaveOneBitMode();
+        M5.EPD.Clear(true); // Full refresh to clear previous font specimen
+        canvas.fillCanvas(15);
+        canvas.setTextColor(0);
+        canvas.setTextDatum(CC_DATUM);
+        canvas.setTextSize(3);
+        canvas.drawString("SD CARD ERROR", 270, 400);
+        canvas.setTextSize(2);
+        canvas.drawString("Insert SD card and reset", 270, 500);
+        pushFrame(UPDATE_MODE_GC16);
+        while(1) delay(1000); // halt
     }
+    scanFonts(true); // Button wake: the user may have changed the card
 
-    if (isReset) {
-        // Write reset separator with timestamp (uptime resets to 0)
-        file.println();
-        file.println("=== RESET ===");
-        file.println();
-        Serial.println("Battery log: RESET marker written");
-    } else {
-        // Calculate total uptime: accumulated time in RTC + current session time
-        uint64_t totalMillis = rtcState.totalMillis + millis();
-        uint32_t totalSeconds = totalMillis / 1000; // Convert to seconds
-        uint32_t days = totalSeconds / (24 * 60 * 60);
-        uint32_t hours = (totalSeconds % (24 * 60 * 60)) / (60 * 60);
-        uint32_t minutes = (totalSeconds % (60 * 60)) / 60;
-        uint32_t seconds = totalSeconds % 60;
-
-        // Format: "DDd HHh MMm SSs | 4236mV | 100.0% | BITMAP"
-        char line[80];
-        snprintf(line, sizeof(line), "%02lud %02luh %02lum %02lus | %4lumV | %5.1f%% | %s",
-                 days, hours, minutes, seconds, voltage, percentage,
-                 currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+    uint8_t wakeInterval = config.wakeIntervalMinutes;
+    if (!loadConfig()) {
+        LOG_W("WARNING: Config file missing after wake - using defaults\n");
+        initDefaultConfig();
+        config.wakeIntervalMinutes = wakeInterval;
+    }
+    applyFontConfig();
 
-        file.println(line);
-        Serial.printf("Battery log: %s\n", line);
+    currentFontIndex = savedFontIndex();
+    if (activeFontCount() == 0 || !loadUsableFont()) {
+        LOG_E("ERROR: Failed to restore font\n");
     }
 
-    file.close();
+    LOG_I("Deferred wake init done in %lums\n", millis() - start);
 }
 
-// Display low battery icon and shutdown
-void lowBatteryShutdown() {
-    Serial.println("\n!!! LOW BATTERY - SHUTTING DOWN !!!");
+// ========================================
+// v3.1: Event Queue and App State Machine
+// ========================================
+// loop() no longer acts on buttons/touch/timers inline. Inputs and timer deadlines are
+// turned into AppEvents, queued, and dispatched one at a time by the state machine.
+// No blocking debounce delays: M5 buttons are edge-detected, touch gestures are tracked
+// across loop iterations. The event types, evaluateTimers() and appStateForEvent() live in
+// include/app_events.h (no hardware access) and are unit-tested on the host.
+
+// Fixed-size ring buffer (no heap allocation in the main loop)
+const int EVENT_QUEUE_SIZE = 16;
+AppEvent eventQueue[EVENT_QUEUE_SIZE];
+int eventQueueHead = 0;
+int eventQueueCount = 0;
+
+AppState appState = STATE_IDLE;
+
+const unsigned long SHUTDOWN_PRESS_THRESHOLD = 5000; // BtnP held 5s = shutdown
+const unsigned long LONG_PRESS_THRESHOLD = 800;      // BtnP held 800ms = toggle view mode
+const unsigned long LOOP_IDLE_DELAY_MS = 10;         // Poll interval when the queue is empty
+
+bool prefetchPending = false; // Set after each user render, cleared once neighbours are cached
+
+// BtnP press tracking (press duration decides short/long/shutdown)
+unsigned long btnPressStartTime = 0;
+bool btnPWasDown = false;
+bool btnPShutdownFired = false;
+
+bool pushEvent(AppEventType type, AppEventSource source) {
+    if (eventQueueCount >= EVENT_QUEUE_SIZE) {
+        LOG_W("WARNING: Event queue full, dropping %s\n", appEventName(type));
+        return false;
+    }
+    int tail = (eventQueueHead + eventQueueCount) % EVENT_QUEUE_SIZE;
+    eventQueue[tail] = {type, source, millis()};
+    eventQueueCount++;
+    return true;
+}
 
-    // Clear screen with full refresh
-    M5.EPD.Clear(true);
-    delay(1000); // Wait for Clear() to complete physically on e-ink
+bool popEvent(AppEvent& ev) {
+    if (eventQueueCount == 0) return false;
+    ev = eventQueue[eventQueueHead];
+    eventQueueHead = (eventQueueHead + 1) % EVENT_QUEUE_SIZE;
+    eventQueueCount--;
+    return true;
+}
 
-    canvas.fillCanvas(0); // White background
+// Touch gesture tracking: emits events on tap release or long press threshold
+void pollTouchEvents() {
+    if (!touchEnabled || !M5.TP.available()) return;
+
+    // Check if finger is currently touching (not released)
+    if (!M5.TP.isFingerUp()) {
+        M5.TP.update(); // Update touch data
+        tp_finger_t finger = M5.TP.readFinger(0); // Read first touch point
+
+        if (!touchWasPressed) {
+            // Touch just started
+            touchWasPressed = true;
+            touchStartTime = millis();
+            touchStartValid = false; // Not valid yet
+            longPressFired = false;
+
+            // Try to get valid coordinates (filter spurious (0,0) readings)
+            // M5Paper screen: 540x960, valid range X:[1-540], Y:[1-960]
+            if (finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
+                touchStartX = finger.x;
+                touchStartY = finger.y;
+                touchStartValid = true;
+                LOG_D("Touch started at (%d, %d)\n", finger.x, finger.y);
+            } else {
+                // Invalid coordinates - wait for next update
+                LOG_D("Touch started: waiting for valid coordinates (got %d, %d)\n", finger.x, finger.y);
+            }
+        } else {
+            // Touch is held - if we don't have valid start yet, try to get it now
+            if (!touchStartValid && finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
+                touchStartX = finger.x;
+                touchStartY = finger.y;
+                touchStartValid = true;
+                LOG_D("Touch coordinates now valid: (%d, %d)\n", finger.x, finger.y);
+            }
 
-    // Draw battery icon (stylized AA battery shape)
-    // Battery body: 120x60 rectangle centered at (270, 480)
-    int battX = 210;  // Left edge
-    int battY = 450;  // Top edge
-    int battW = 120;  // Width
-    int battH = 60;   // Height
-    int tipW = 10;    // Width of protruding tip
-    int tipH = 20;    // Height of tip (centered)
+            // Long press in center zone → toggle view mode (fires while still held)
+            // Debug mode: long press left/right zone → latency screen
+            if (touchStartValid && !longPressFired &&
+                millis() - touchStartTime >= LONG_PRESS_DURATION) {
+                int zone = getTouchZone(touchStartX, touchStartY);
+                if (zone == 1) {
+                    longPressFired = true; // Prevent multiple toggles
+                    pushEvent(EVT_TOGGLE_MODE, SRC_TOUCH);
+                } else if ((zone == 0 || zone == 2) && rtcState.debugMode) {
+                    longPressFired = true;
+                    pushEvent(EVT_SHOW_LATENCY, SRC_TOUCH);
+                }
+            }
+        }
+    } else if (touchWasPressed) {
+        // Finger was released - process gesture (only if we got valid start coordinates)
+        touchWasPressed = false;
 
-    // Draw main battery body (hollow rectangle)
-    canvas.fillRect(battX, battY, battW, battH, 15);           // Black outline
-    canvas.fillRect(battX + 3, battY + 3, battW - 6, battH - 6, 0); // White inside
+        if (!touchStartValid) {
+            // Never got valid coordinates during this touch
+            LOG_D("Touch released: ignored (never got valid coordinates)\n");
+            return;
+        }
+        if (longPressFired) return; // Long press already handled
+
+        M5.TP.update(); // Get final coordinates
+        tp_finger_t finger = M5.TP.readFinger(0);
+
+        unsigned long touchDuration = millis() - touchStartTime;
+        int16_t deltaX = finger.x - touchStartX;
+        int16_t deltaY = finger.y - touchStartY;
+
+        // Check for tap (short duration, minimal movement)
+        if (touchDuration < LONG_PRESS_DURATION &&
+            abs(deltaX) < TAP_MAX_MOVEMENT && abs(deltaY) < TAP_MAX_MOVEMENT) {
+            int zone = getTouchZone(touchStartX, touchStartY);
+            if (zone == 0) {
+                pushEvent(EVT_PREV_FONT, SRC_TOUCH);     // Left zone → Previous font
+            } else if (zone == 1) {
+                pushEvent(EVT_RANDOM_GLYPH, SRC_TOUCH);  // Center zone → Random glyph
+            } else if (zone == 2) {
+                pushEvent(EVT_NEXT_FONT, SRC_TOUCH);     // Right zone → Next font
+            } else {
+                LOG_D("Touch ignored: invalid zone (x=%d, y=%d)\n", touchStartX, touchStartY);
+            }
+        } else {
+            // Not a tap (too much movement or too long without reaching long press threshold)
+            LOG_D("Touch ignored: not a tap (duration=%lums, movement=%d,%d)\n",
+                 touchDuration, deltaX, deltaY);
+        }
+    }
+}
 
-    // Draw battery tip (right side protrusion)
-    int tipX = battX + battW;
-    int tipY = battY + (battH - tipH) / 2;
-    canvas.fillRect(tipX, tipY, tipW, tipH, 15); // Black tip
+// Translate button edges and touch gestures into queued events (never blocks)
+void pollInputEvents() {
+    M5.update(); // Update button states
 
-    // Draw very thin red bar on left side (5% indicator)
-    int barW = 6; // Very thin bar
-    int barH = battH - 12; // Leave margin
-    int barX = battX + 6;
-    int barY = battY + 6;
-    canvas.fillRect(barX, barY, barW, barH, 12); // Gray-ish (simulating red on grayscale)
+    // Button L (Wheel DOWN): Previous font (keep same glyph)
+    if (M5.BtnL.wasPressed()) {
+        pushEvent(EVT_PREV_FONT, SRC_BUTTON);
+    }
 
-    // Push to display with full refresh
-    canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+    // Button R (Wheel UP): Next font (keep same glyph)
+    if (M5.BtnR.wasPressed()) {
+        pushEvent(EVT_NEXT_FONT, SRC_BUTTON);
+    }
+
+    // Button P: very long press (5s) = shutdown, long press = toggle view, short press = random glyph
+    if (M5.BtnP.isPressed()) {
+        if (!btnPWasDown) {
+            // Button just pressed
+            btnPressStartTime = millis();
+            btnPWasDown = true;
+            btnPShutdownFired = false;
+        } else if (!btnPShutdownFired && millis() - btnPressStartTime >= SHUTDOWN_PRESS_THRESHOLD) {
+            // Still held after 5s: shutdown fires without waiting for release
+            btnPShutdownFired = true;
+            pushEvent(EVT_SHUTDOWN, SRC_BUTTON);
+        }
+    } else if (btnPWasDown) {
+        // Button just released
+        unsigned long pressDuration = millis() - btnPressStartTime;
+        btnPWasDown = false;
+        if (!btnPShutdownFired) {
+            pushEvent(pressDuration >= LONG_PRESS_THRESHOLD ? EVT_TOGGLE_MODE : EVT_RANDOM_GLYPH, SRC_BUTTON);
+        }
+    }
 
-    // Wait for e-ink refresh to physically complete (~500ms), then immediate shutdown
-    delay(500); // Hardware refresh completion
+    pollTouchEvents();
+}
 
-    // Complete shutdown (only RTC stays powered)
-    Serial.println("Entering complete shutdown...");
-    M5.shutdown();
+// Queue the next expired timer deadline (only when no input is waiting)
+void pollTimerEvents() {
+    TimerSnapshot snapshot = {
+        millis(),
+        lastFullRefreshTime,
+        firstPartialAfterFullTime,
+        lastButtonActivityTime,
+        lastPreviewTime,
+        hasPartialSinceLastFull,
+        isAutoWakeSession,
+        prefetchPending,
+        settlePending
+    };
+    AppEventType type = evaluateTimers(snapshot);
+    if (type != EVT_NONE) {
+        pushEvent(type, SRC_TIMER);
+    }
 }
 
-// Save state and enter deep sleep
-void enterDeepSleep() {
-    Serial.println("\n>>> Preparing for deep sleep...");
+// Read a font file into the RAM cache without loading it into the canvas, so the next
+// BtnL/BtnR press is a cache HIT. Reads in chunks and gives up as soon as input is pending:
+// prefetching must never delay a user action. Never evicts the font currently on screen.
+bool prefetchFont(int fontIndex) {
+    if (fontIndex < 0 || fontIndex >= activeFontCount()) return false;
 
-    // v3.0: Disable touch screen before sleep to save power
-    disableTouch();
+    const FontCatalogRecord* record = activeFont(fontIndex);
+    if (!record) return false;
+    uint32_t fontId = record->fontId;
+    for (auto& entry : fontCache) {
+        if (entry.fontId == fontId) return true; // Already cached
+    }
 
-    // Accumulate current session time to total uptime (only in debug mode, for battery logging)
-    if (rtcState.debugMode) {
-        uint32_t currentMillis = millis();
-        Serial.printf("DEBUG: Before accumulation: rtcState.totalMillis=%llu, millis()=%lu\n",
-                      rtcState.totalMillis, currentMillis);
-        rtcState.totalMillis += currentMillis;
-        Serial.printf("DEBUG: After accumulation: rtcState.totalMillis=%llu\n", rtcState.totalMillis);
+    File fontFile = SD.open(record->path);
+    if (!fontFile) return false;
+    size_t fontFileSize = fontFile.size();
+    if (fontFileSize > MAX_FONT_CACHE_SIZE) {
+        fontFile.close();
+        return false;
+    }
 
-        uint32_t totalMinutes = rtcState.totalMillis / 60000;
-        Serial.printf("Accumulated uptime: %lu minutes (%lud %02luh %02lum)\n",
-                      totalMinutes,
-                      totalMinutes / (24 * 60),
-                      (totalMinutes % (24 * 60)) / 60,
-                      totalMinutes % 60);
+    // Make room (LRU first), skipping the font the canvas is using right now
+    uint32_t activeId = currentFontId();
+    while (totalCacheSize + fontFileSize > MAX_FONT_CACHE_SIZE) {
+        auto victim = std::find_if(fontCache.begin(), fontCache.end(),
+            [activeId](const FontCacheEntry& e) { return e.fontId != activeId; });
+        if (victim == fontCache.end()) {
+            fontFile.close();
+            return false;
+        }
+        totalCacheSize -= victim->size;
+        free(victim->data);
+        fontCache.erase(victim);
+        METRIC_INC(M_FONT_CACHE_EVICT);
     }
 
-    // Save current state to RTC memory
-    rtcState.isValid = true;
-    rtcState.currentFontIndex = currentFontIndex;
-    rtcState.currentGlyphCodepoint = currentGlyphCodepoint;
-    rtcState.viewMode = currentViewMode;  // STEP 5: Save view mode
-    Serial.printf("State saved: font=%d, glyph=U+%04X, mode=%s\n",
-                  rtcState.currentFontIndex, rtcState.currentGlyphCodepoint,
-                  currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+    uint8_t* fontData = (uint8_t*)malloc(fontFileSize);
+    if (!fontData) {
+        fontFile.close();
+        return false;
+    }
 
-    // Put display controller in standby
-    M5.EPD.StandBy();
-    Serial.println("Display controller in StandBy");
+    const size_t CHUNK_SIZE = 16384;
+    size_t offset = 0;
+    while (offset < fontFileSize) {
+        size_t chunk = min(CHUNK_SIZE, fontFileSize - offset);
+        if (fontFile.read(fontData + offset, chunk) != chunk) break;
+        offset += chunk;
 
-    // Keep GPIO2 (M5EPD_MAIN_PWR_PIN) HIGH during deep sleep to maintain power
-    gpio_hold_en((gpio_num_t)M5EPD_MAIN_PWR_PIN);
-    gpio_deep_sleep_hold_en();
-    Serial.println("GPIO hold enabled");
+        pollInputEvents();
+        if (eventQueueCount > 0) break; // User is waiting - abort
+    }
+    fontFile.close();
+    METRIC_ADD(M_SD_BYTES_READ, offset);
 
-    // Configure wake sources:
-    // 1) GPIO38 (center button press) - user interaction
-    // 2) Timer (config interval) - auto refresh
-    esp_sleep_enable_ext0_wakeup(GPIO_NUM_38, LOW); // Wake when button pressed (goes LOW)
+    if (offset < fontFileSize) {
+        free(fontData);
+        return false;
+    }
 
-    // Enable timer wakeup from config (5, 10, or 15 minutes)
-    uint64_t wakeup_time_us = config.wakeIntervalMinutes * 60 * 1000000ULL; // minutes to microseconds
-    esp_sleep_enable_timer_wakeup(wakeup_time_us);
-    Serial.printf("Wake sources configured: GPIO38 (button) + Timer (%dmin)\n", config.wakeIntervalMinutes);
+    // Insert on the LRU side: an actual cache HIT moves it to the back
+    fontCache.insert(fontCache.begin(), {fontId, fontData, fontFileSize});
+    totalCacheSize += fontFileSize;
+    METRIC_INC(M_FONT_PREFETCHED);
+    LOG_D("Prefetched font %d (%d bytes, cache %d/%d bytes)\n",
+          fontIndex, fontFileSize, totalCacheSize, MAX_FONT_CACHE_SIZE);
+    return true;
+}
 
-    Serial.println(">>> Entering deep sleep now...\n");
-    delay(100); // Give serial time to flush
+// Prefetch the fonts BtnR/BtnL would move to next
+void prefetchAdjacentFonts() {
+    if (activeFontCount() < 2) return;
+    int next = (currentFontIndex + 1) % activeFontCount();
+    int prev = (currentFontIndex - 1 + activeFontCount()) % activeFontCount();
+    if (!prefetchFont(next)) return;
+    if (prev != next) prefetchFont(prev);
+}
 
-    // Enter deep sleep
-    esp_deep_sleep_start();
+// Fold queued events that would be immediately overwritten into the one being dispatched:
+// consecutive NEXT/PREV become a single net font step, repeated RANDOM_GLYPH becomes one
+// render, and TOGGLE_MODE pairs cancel out. Returns the net font step for NEXT/PREV,
+// the number of toggles for TOGGLE_MODE, and 1 otherwise.
+int coalesceQueuedEvents(const AppEvent& ev) {
+    int net = (ev.type == EVT_PREV_FONT) ? -1 : 1;
+
+    while (eventQueueCount > 0) {
+        AppEventType queued = eventQueue[eventQueueHead].type;
+        if ((ev.type == EVT_NEXT_FONT || ev.type == EVT_PREV_FONT) &&
+            (queued == EVT_NEXT_FONT || queued == EVT_PREV_FONT)) {
+            net += (queued == EVT_NEXT_FONT) ? 1 : -1;
+        } else if (queued == ev.type && (ev.type == EVT_RANDOM_GLYPH || ev.type == EVT_TOGGLE_MODE)) {
+            net++;
+        } else {
+            break;
+        }
+        AppEvent dropped;
+        popEvent(dropped);
+    }
+    return net;
 }
 
-// ========================================
-// Shutdown Screen with QR Code
-// ========================================
+// Latency screen (see Input Latency Histograms); any input returns to the glyph
+bool latencyScreenShown = false;
 
-// Draw QR code at specified position with specified pixel size
-// Note: pixelSizeX can be different from pixelSizeY to compensate for display aspect ratio
-void drawQRCode(int centerX, int centerY, int pixelSizeY, int pixelSizeX = 0) {
-    if (pixelSizeX == 0) pixelSizeX = pixelSizeY; // Default to square if not specified
+// Histogram row for an event (-1 = not an input action)
+int latencyActionFor(const AppEvent& ev) {
+    bool touch = (ev.source == SRC_TOUCH);
+    switch (ev.type) {
+        case EVT_PREV_FONT:    return touch ? LAT_TAP_LEFT : LAT_BTN_L;
+        case EVT_NEXT_FONT:    return touch ? LAT_TAP_RIGHT : LAT_BTN_R;
+        case EVT_RANDOM_GLYPH: return touch ? LAT_TAP_CENTER : LAT_BTN_P;
+        case EVT_TOGGLE_MODE:  return touch ? LAT_TOUCH_LONG : LAT_BTN_P_LONG;
+        default:               return -1;
+    }
+}
 
-    int qrDisplayWidth = QR_SIZE * pixelSizeX;
-    int qrDisplayHeight = QR_SIZE * pixelSizeY;
-    int startX = centerX - qrDisplayWidth / 2;
-    int startY = centerY - qrDisplayHeight / 2;
+// Debug screen: p50/p90 per stage and the edge-to-pixels histogram, built-in bitmap font
+void showLatencyScreen() {
+    LOG_I("\n=== Latency Screen ===\n");
+    dumpLatencyStats(Serial);
 
-    Serial.printf("QR Code: size=%d×%d, pixelSize=%d×%d, display=%d×%d, start=(%d,%d)\n",
-                  QR_SIZE, QR_SIZE, pixelSizeX, pixelSizeY, qrDisplayWidth, qrDisplayHeight, startX, startY);
-    Serial.printf("Canvas: width=%d, height=%d\n", canvas.width(), canvas.height());
+    // Labels need the bitmap font: drop FreeType, the next input reloads it
+    if (fontLoaded) {
+        canvas.destoryRender(24);
+        canvas.unloadFont();
+        fontLoaded = false;
+    }
+    settlePending = false;
+    canvas.fillCanvas(0);
+    canvas.setFreeFont(NULL);
+    canvas.setTextFont(1);
+    canvas.setTextSize(2);
+    canvas.setTextColor(15);
 
-    // Debug: print ALL 29 rows to verify complete QR data
-    Serial.println("Complete QR code data:");
-    for (int row = 0; row < QR_SIZE; row++) {
-        Serial.printf("Row %2d: ", row);
-        for (int x = 0; x < QR_SIZE; x++) {
-            int byteIndex = row * 4 + (x / 8);
-            int bitIndex = 7 - (x % 8);
-            uint8_t byte = pgm_read_byte(&qrcode_data[byteIndex]);
-            bool isBlack = (byte >> bitIndex) & 1;
-            Serial.print(isBlack ? "█" : " ");
+    canvas.setTextDatum(TC_DATUM);
+    canvas.drawString("Input latency (ms)", 270, 30);
+
+    canvas.setTextDatum(TL_DATUM);
+    char line[64];
+    int y = 90;
+    canvas.drawString("p50/p90    n  queue  handler   pixels", 12, y);
+    y += 30;
+    for (int a = 0; a < LAT_ACTION_COUNT; a++) {
+        const LatencyHistogram* h = latencyStats[a];
+        if (h[LAT_STAGE_QUEUE].count == 0) continue;
+        char stages[LAT_STAGE_COUNT][12];
+        for (int st = 0; st < LAT_STAGE_COUNT; st++) {
+            if (h[st].count == 0) {
+                snprintf(stages[st], sizeof(stages[st]), "-");
+            } else {
+                snprintf(stages[st], sizeof(stages[st]), "%lu/%lu",
+                         latencyPercentile(h[st], 50), latencyPercentile(h[st], 90));
+            }
+        }
+        snprintf(line, sizeof(line), "%-7s %4u %6s %8s %8s", LATENCY_ACTION_NAMES[a],
+                 h[LAT_STAGE_QUEUE].count, stages[0], stages[1], stages[2]);
+        canvas.drawString(line, 12, y);
+        y += 26;
+    }
+
+    y += 30;
+    canvas.drawString("Edge to pixels histogram", 12, y);
+    y += 30;
+    canvas.drawString("<ms      25  50 100 200 400 800 1600   >", 12, y);
+    y += 30;
+    int rows = 0;
+    for (int a = 0; a < LAT_ACTION_COUNT; a++) {
+        const LatencyHistogram& h = latencyStats[a][LAT_STAGE_PIXELS];
+        if (h.count == 0) continue;
+        rows++;
+        int len = snprintf(line, sizeof(line), "%-7s", LATENCY_ACTION_NAMES[a]);
+        for (int b = 0; b < LATENCY_BUCKETS && len < (int)sizeof(line); b++) {
+            len += snprintf(line + len, sizeof(line) - len, b == LATENCY_BUCKETS - 2 ? "%5u" : "%4u", h.buckets[b]);
         }
-        Serial.println();
+        canvas.drawString(line, 12, y);
+        y += 26;
+    }
+    if (rows == 0) {
+        canvas.drawString("(no samples yet)", 12, y);
     }
 
-    // Draw QR code pixel by pixel
-    int blackModules = 0;
-    int pixelsDrawn = 0;
+    canvas.setTextDatum(BC_DATUM);
+    canvas.drawString("Any input returns", 270, 930);
 
-    for (int moduleY = 0; moduleY < QR_SIZE; moduleY++) {
-        for (int moduleX = 0; moduleX < QR_SIZE; moduleX++) {
-            // Read bit from PROGMEM
-            int byteIndex = moduleY * 4 + (moduleX / 8);
-            int bitIndex = 7 - (moduleX % 8);
-            uint8_t byte = pgm_read_byte(&qrcode_data[byteIndex]);
-            bool isBlack = (byte >> bitIndex) & 1;
+    pushFrame(UPDATE_MODE_GC16);
+    partialRefreshCount = 0;
+    hasPartialSinceLastFull = false;
+    lastFullRefreshTime = millis();
+    latencyScreenShown = true;
+}
 
-            // Draw this module as pixelSizeX × pixelSizeY block using drawPixel
-            if (isBlack) {
-                blackModules++;
-                int baseX = startX + moduleX * pixelSizeX;
-                int baseY = startY + moduleY * pixelSizeY;
+void dispatchEvent(const AppEvent& ev) {
+    TRACE_SCOPE(appEventName(ev.type));
+    appState = appStateForEvent(ev.type);
 
-                // Fill the pixelSizeX × pixelSizeY rectangle pixel by pixel
-                for (int dy = 0; dy < pixelSizeY; dy++) {
-                    for (int dx = 0; dx < pixelSizeX; dx++) {
-                        canvas.drawPixel(baseX + dx, baseY + dy, 15);
-                        pixelsDrawn++;
-                    }
-                }
+    if (isUserInputEvent(ev.type)) {
+        lastButtonActivityTime = millis();
+        isAutoWakeSession = false; // User interaction: cancel auto-wake session immediate sleep
+
+        // Fast button wake: fonts are needed from here on (shutdown only draws built-in text)
+        if (ev.type != EVT_SHUTDOWN) {
+            completeDeferredWake();
+            if (!fontLoaded && activeFontCount() > 0) {
+                loadCurrentFont(); // Auto-wake showed a pre-rendered frame without loading it
             }
         }
+
+        // Latency screen up: any input (except shutdown) just returns to the glyph
+        if (latencyScreenShown && ev.type != EVT_SHUTDOWN) {
+            latencyScreenShown = false;
+            coalesceQueuedEvents(ev);
+            LOG_I("\n>>> Leaving latency screen\n");
+            renderGlyph();
+            frameOwed = false;
+            appState = STATE_IDLE;
+            return;
+        }
     }
-    Serial.printf("QR Code drawing complete: %d black modules, %d pixels drawn\n", blackModules, pixelsDrawn);
-}
 
-// Show shutdown screen with QR code and power off
-void shutdownWithScreen() {
-    Serial.println("\n=== Shutdown Requested (Long Press) ===");
+    // User renders may be abandoned by newer input (see renderSuperseded())
+    renderCancellable = (appState == STATE_RENDERING);
+    renderCancelled = false;
 
-    // Use existing canvas but unload any FreeType font
-    canvas.unloadFont(); // Remove FreeType renderer
-    canvas.fillCanvas(0); // White background
+    int latencyAction = latencyActionFor(ev);
+    unsigned long handlerStart = millis();
+    if (latencyAction >= 0) {
+        recordLatency(latencyAction, LAT_STAGE_QUEUE, handlerStart - ev.timestamp);
+    }
 
-    // Draw QR code first
-    Serial.println("Drawing QR code...");
-    drawQRCode(270, 480, 6, 6); // QR code: 6×6 px per module
+    switch (ev.type) {
+        case EVT_PREV_FONT:
+        case EVT_NEXT_FONT: {
+            int step = coalesceQueuedEvents(ev);
+            LOG_I("\n>>> %s - Font step %+d\n", ev.source == SRC_TOUCH ? "Touch TAP" : "Button L/R", step);
+            if (step != 0) {
+                stepFont(step);
+                prefetchPending = true;
+            } else if (frameOwed) {
+                // Presses cancel out, but an abandoned render left a stale or partial frame
+                renderGlyph();
+            }
+            break;
+        }
 
-    // Draw text with built-in bitmap font (no FreeType)
-    Serial.println("Drawing text labels...");
-    canvas.setFreeFont(NULL); // Force use of built-in font
-    canvas.setTextFont(1); // Font 1 = default bitmap font
-    canvas.setTextSize(2); // Bitmap font size 2 = 16px height
-    canvas.setTextColor(15); // Black text
+        case EVT_RANDOM_GLYPH:
+            coalesceQueuedEvents(ev);
+            LOG_I("\n>>> %s - Random glyph\n", ev.source == SRC_TOUCH ? "Touch TAP CENTER" : "Button P (PUSH)");
+            randomGlyph();
+            break;
 
-    // Top label: "PaperSpecimen"
-    canvas.setTextDatum(TC_DATUM);
-    canvas.drawString("PaperSpecimen", 270, 30);
-    Serial.println("Top label drawn");
+        case EVT_TOGGLE_MODE:
+            LOG_I("\n>>> %s - Toggle view mode\n", ev.source == SRC_TOUCH ? "Touch LONG PRESS (center)" : "Button P LONG PRESS");
+            if (coalesceQueuedEvents(ev) % 2 == 0) {
+                if (frameOwed) {
+                    LOG_I("Toggles cancel out - re-rendering the abandoned frame\n");
+                    renderGlyph();
+                } else {
+                    LOG_I("Toggles cancel out - nothing to render\n");
+                }
+                break;
+            }
+            currentViewMode = (currentViewMode == BITMAP) ? OUTLINE : BITMAP;
+            LOG_I("Switched to %s mode\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+            renderGlyph();
+            break;
 
-    // Bottom label: "v3.0.1" (or "v3.0.1*" in debug mode)
-    canvas.setTextDatum(BC_DATUM);
-    canvas.drawString(rtcState.debugMode ? "v3.0.1*" : "v3.0.1", 270, 930);
-    Serial.println("Bottom label drawn");
+        case EVT_SETTLE_DUE:
+            settleGlyphFrame();
+            break;
 
-    // Full refresh to clear any ghosting
-    canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-    Serial.println("Shutdown screen displayed with QR code");
+        case EVT_FULL_REFRESH_DUE:
+            LOG_I(">>> Auto full refresh after timeout (time since first partial=%lums, time since last full=%lums)\n",
+                  millis() - firstPartialAfterFullTime, millis() - lastFullRefreshTime);
+            if (settlePending) {
+                // Controller RAM still holds the 1-bit preview: reload the grayscale frame first
+                settlePending = false;
+                pushFrame(UPDATE_MODE_NONE, FRAME_DEPTH_4BPP);
+            }
+            epdUpdateFull(UPDATE_MODE_GC16);
+            partialRefreshCount = 0;
+            hasPartialSinceLastFull = false;
+            lastFullRefreshTime = millis(); // Track for power management
+            break;
 
-    delay(2000); // Show for 2 seconds
+        case EVT_PREFETCH_DUE:
+            prefetchPending = false;
+            prefetchAdjacentFonts();
+            break;
 
-    // Deep sleep indefinitely (no timer wake)
-    Serial.println("Entering deep sleep (shutdown mode)");
+        case EVT_SLEEP_DUE:
+            if (isAutoWakeSession) {
+                LOG_I(">>> Auto-wake session: entering deep sleep immediately after refresh\n");
+            }
+            enterDeepSleep(); // This function never returns (enters deep sleep)
+            break;
 
-    // Configure wake on button press only
-    esp_sleep_enable_ext0_wakeup(GPIO_NUM_38, 0); // GPIO38 = center button, LOW = pressed
+        case EVT_SHUTDOWN:
+            shutdownWithScreen(); // This function never returns
+            break;
 
-    // Put display to sleep
-    M5.EPD.Sleep();
+        case EVT_SHOW_LATENCY:
+            showLatencyScreen();
+            break;
 
-    // Power management
-    digitalWrite(M5EPD_MAIN_PWR_PIN, LOW);
-    gpio_hold_en((gpio_num_t)M5EPD_MAIN_PWR_PIN);
-    gpio_deep_sleep_hold_en();
+        default:
+            break;
+    }
 
-    delay(100);
-    esp_deep_sleep_start();
+    if (renderCancelled) {
+        frameOwed = true;
+        LOG_I("Render abandoned - newer input will be rendered next\n");
+    } else if (appState == STATE_RENDERING) {
+        frameOwed = false;
+    }
+    if (!renderCancelled && latencyAction >= 0) {
+        recordLatency(latencyAction, LAT_STAGE_HANDLER, millis() - handlerStart);
+        if (rtcState.debugMode) {
+            M5.EPD.CheckAFSR(); // Blocks until the panel update is done
+            recordLatency(latencyAction, LAT_STAGE_PIXELS, millis() - ev.timestamp);
+        }
+    }
+    renderCancellable = false;
+    appState = STATE_IDLE;
 }
 
 void setup() {
+    profileBegin(PHASE_WAKE_TOTAL);
+
     // Check wake reason BEFORE initializing anything (to decide if Serial is needed)
     esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
+
+    // v3.1: Power-on after a power-off sleep looks like a cold boot to the ESP32.
+    // Treat it as a button wake for now; the RTC flags tell timer wakes apart after M5.begin().
+    if (wakeup_reason == ESP_SLEEP_WAKEUP_UNDEFINED && restorePowerOffRecord()) {
+        poweredOffWake = true;
+        wakeup_reason = ESP_SLEEP_WAKEUP_EXT0;
+    }
     bool isWakeFromSleep = (wakeup_reason == ESP_SLEEP_WAKEUP_TIMER || wakeup_reason == ESP_SLEEP_WAKEUP_EXT0);
+    if (isWakeFromSleep) {
+        METRIC_INC(M_WAKES);
+    }
 
     // Determine if Serial should be enabled:
     // - Always enable on cold boot (needed for setup and debug mode trigger)
@@ -3376,7 +6683,10 @@ void setup() {
 
     // Initialize M5Paper with minimal power consumption
     // Parameters: touchEnable, SDEnable, SerialEnable, BatteryADCEnable, I2CEnable
+    profileBegin(PHASE_M5_BEGIN);
     M5.begin(false, true, enableSerial, false, true);
+    profileEnd(PHASE_M5_BEGIN);
+    logLevel = !enableSerial ? LOG_LEVEL_NONE : (rtcState.debugMode ? LOG_LEVEL_VERBOSE : LOG_LEVEL_INFO);
     // false: Touch disabled (saves power)
     // true:  SD enabled (needed for fonts)
     // enableSerial: Serial enabled conditionally (for debugging in debug mode or cold boot)
@@ -3385,11 +6695,21 @@ void setup() {
 
     M5.RTC.begin();
 
+    if (poweredOffWake && rtcAlarmFired()) {
+        wakeup_reason = ESP_SLEEP_WAKEUP_TIMER;
+    }
+
+    // v3.1: Button wake while the panel still shows the saved glyph: nothing to redraw,
+    // SD/config/font loading is deferred until the first input (completeDeferredWake())
+    bool fastButtonWake = (wakeup_reason == ESP_SLEEP_WAKEUP_EXT0) &&
+                          rtcState.isValid && rtcState.displayMatchesState;
+
     // Setup Serial only if enabled
     if (enableSerial) {
         Serial.begin(115200);
         delay(100); // Wait for serial to be ready
     }
+    traceRecording = rtcState.debugMode; // v3.1: Scope trace (cold boot: set again below)
 
     // Determine wake source
     bool isAutoWake = false;
@@ -3398,8 +6718,9 @@ void setup() {
         // Woke from timer (auto-wake)
         isAutoWake = true;
         isAutoWakeSession = true; // Flag to skip idle wait and sleep immediately
-        Serial.println("\n\n=== PaperSpecimen Auto-Wake (Timer) ===");
-        Serial.println("Woke by ESP32 timer (configured interval)");
+        LOG_I("\n\n=== PaperSpecimen Auto-Wake (Timer) ===\n");
+        LOG_I("%s\n", poweredOffWake ? "Powered on by RTC alarm (configured interval)"
+                                     : "Woke by ESP32 timer (configured interval)");
         if (!enableSerial) {
             // Serial not initialized - debug mode is off
         }
@@ -3407,18 +6728,21 @@ void setup() {
         // Woke from button press
         isAutoWake = false;
         isAutoWakeSession = false; // Normal behavior: wait for user interaction
-        Serial.println("\n\n=== PaperSpecimen Wake from Deep Sleep (Button) ===");
-        Serial.println("Woke by GPIO38 (center button)");
+        LOG_I("\n\n=== PaperSpecimen Wake from Deep Sleep (Button) ===\n");
+        LOG_I("%s\n", poweredOffWake ? "Powered on by button (state restored from NVS)"
+                                     : "Woke by GPIO38 (center button)");
     } else {
         // Cold boot (reset or first power on)
         isAutoWakeSession = false; // Normal behavior: wait for user interaction
-        Serial.println("\n\n=== PaperSpecimen Cold Boot ===");
+        LOG_I("\n\n=== PaperSpecimen Cold Boot ===\n");
     }
 
     // Wake from sleep: reactivate hardware
     if (isWakeFromSleep) {
         // Set flag for double full refresh on first render (eliminates wake artifacts)
-        isFirstRenderAfterWake = true;
+        // Not needed on a fast button wake: the panel was never touched. After a power-off the
+        // controller lost its image buffer, so the first real render still needs it.
+        isFirstRenderAfterWake = !fastButtonWake || poweredOffWake;
 
         // Disable GPIO hold to allow normal operation
         gpio_deep_sleep_hold_dis();
@@ -3426,11 +6750,11 @@ void setup() {
 
         // Wake display controller
         M5.EPD.Active();
-        Serial.println("Display controller reactivated");
+        LOG_I("Display controller reactivated\n");
 
         // DEBUG: Print RTC state immediately after wake
-        Serial.printf("DEBUG: rtcState.totalMillis = %llu (isValid=%d)\n",
-                      rtcState.totalMillis, rtcState.isValid);
+        LOG_D("DEBUG: rtcState.totalMillis = %llu (isValid=%d)\n",
+              rtcState.totalMillis, rtcState.isValid);
 
         // If this is a timer wake, we need to load config first to know the sleep duration
         // For now, we'll add the sleep time later after config is loaded
@@ -3440,20 +6764,20 @@ void setup() {
     float batteryLevel = 0.0;
     uint32_t batteryVoltage = 0;
     if (isWakeFromSleep) {
-        M5.BatteryADCBegin(); // Initialize battery ADC
-        batteryVoltage = M5.getBatteryVoltage();
-        batteryLevel = getBatteryPercentage();
-        Serial.printf("Battery level: %.1f%%\n", batteryLevel);
+        // v3.1: Filtered estimate, ADC only every few wakes
+        batteryLevel = readBatteryEstimate(&batteryVoltage);
+        LOG_I("Battery level: %.1f%%\n", batteryLevel);
+        updatePowerTier(batteryLevel);
     }
 
     // WiFi and Bluetooth are disabled by default (not initialized)
     // WiFi.mode(WIFI_OFF);  // Removed: WiFi library not included
     // btStop();             // Removed: Bluetooth library not included
-    Serial.println("WiFi and Bluetooth not initialized (power saving)");
+    LOG_I("WiFi and Bluetooth not initialized (power saving)\n");
 
     // Disable external power (sensors like SHT30 temperature/humidity)
     M5.disableEXTPower();
-    Serial.println("External sensors power disabled");
+    LOG_I("External sensors power disabled\n");
 
     // Set display to VERTICAL orientation
     M5.EPD.SetRotation(90);
@@ -3468,9 +6792,11 @@ void setup() {
     }
 
     // Show boot message ONLY on cold boot (not on wake from sleep)
+    bool coldBootSdOk = false;
     if (!isWakeFromSleep) {
+        epdLeaveOneBitMode();
         M5.EPD.Clear(true);     // Clear with full refresh
-        Serial.println("Display initialized (vertical orientation)");
+        LOG_I("Display initialized (vertical orientation)\n");
 
         canvas.fillCanvas(0); // white background
         canvas.setTextSize(2); // Bitmap font size 2 = 16px height (consistent with UI)
@@ -3487,11 +6813,14 @@ void setup() {
         canvas.setTextDatum(BC_DATUM);
         canvas.drawString("v3.0.1", 270, 930);  // Boot splash always shows "v3.0.1" (asterisk appears after activation)
 
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-        Serial.println("Boot splash v3.0.1 with QR code displayed");
+        pushFrame(UPDATE_MODE_GC16);
+        LOG_I("Boot splash v3.0.1 with QR code displayed\n");
+
+        // v3.1: SD mount and font scan run in the background during the 5 s window
+        startBackgroundScan();
 
         // Wait 5 seconds and detect button presses to enter debug mode
-        Serial.println("Waiting 5 seconds for debug mode trigger (2+ button presses)...");
+        LOG_I("Waiting 5 seconds for debug mode trigger (2+ button presses)...\n");
         int buttonPressCount = 0;
         unsigned long startTime = millis();
         bool lastButtonState = false;
@@ -3503,29 +6832,36 @@ void setup() {
             // Detect rising edge (button press)
             if (currentButtonState && !lastButtonState) {
                 buttonPressCount++;
-                Serial.printf("Button press detected (%d/2)\n", buttonPressCount);
+                LOG_I("Button press detected (%d/2)\n", buttonPressCount);
             }
 
             lastButtonState = currentButtonState;
             delay(50); // Check every 50ms
         }
+        coldBootSdOk = waitForFontCatalog(); // Usually done well within the 5 s
 
         // Activate debug mode if 2 or more presses detected
         if (buttonPressCount >= 2) {
             rtcState.debugMode = true;
-            Serial.println("\n*** DEBUG MODE ACTIVATED ***");
-            Serial.println("Debug mode will persist across wake cycles until device reset");
+            traceRecording = true;
+            logLevel = LOG_LEVEL_VERBOSE;
+            LOG_I("\n*** DEBUG MODE ACTIVATED ***\n");
+            LOG_I("Debug mode will persist across wake cycles until device reset\n");
 
             // Log reset marker to battery log (only in debug mode)
             logBatteryData(0, 0.0, true); // isReset=true
         } else {
             rtcState.debugMode = false;
-            Serial.println("Normal mode (debug mode not activated)");
+            LOG_I("Normal mode (debug mode not activated)\n");
             delay(100); // Allow serial buffer to flush
-            Serial.end(); // Disable serial immediately in normal mode to save CPU
+            {
+                LogLock logLock; // The font scan task may still be logging
+                logLevel = LOG_LEVEL_NONE;
+                Serial.end(); // Disable serial immediately in normal mode to save CPU
+            }
         }
     } else {
-        Serial.println("Skipping boot screen (wake from sleep)");
+        LOG_I("Skipping boot screen (wake from sleep)\n");
     }
 
     // Initialize refresh tracking
@@ -3546,7 +6882,7 @@ void setup() {
         }
         seed ^= millis() ^ micros();
         randomSeed(seed);
-        Serial.printf("Random seed initialized: 0x%08X\n", seed);
+        LOG_I("Random seed initialized: 0x%08X\n", seed);
     }
 
     // v2.2.1: SD card access conditional on boot type and cache validity
@@ -3555,10 +6891,10 @@ void setup() {
     bool sdAvailable = false;
 
     if (!isWakeFromSleep) {
-        // COLD BOOT: SD card is mandatory
-        Serial.println("\n=== Testing microSD (required for cold boot) ===");
-        if (!SD.begin()) {
-            Serial.println("ERROR: microSD initialization failed!");
+        // COLD BOOT: SD card is mandatory (mounted and scanned by the background scan)
+        if (!coldBootSdOk) {
+            LOG_E("ERROR: microSD initialization failed!\n");
+            epdLeaveOneBitMode();
             M5.EPD.Clear(true); // Full refresh to clear boot splash
             canvas.fillCanvas(15);
             canvas.setTextColor(0);
@@ -3568,25 +6904,16 @@ void setup() {
             canvas.setTextSize(2);
             canvas.drawString("Please insert microSD", 270, 500);
             canvas.drawString("with /fonts directory", 270, 540);
-            canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+            pushFrame(UPDATE_MODE_GC16);
             while(1) delay(1000); // halt
         }
-        Serial.println("microSD initialized successfully");
+        LOG_I("microSD initialized successfully\n");
         sdAvailable = true;
 
-        // Check if /fonts directory exists
-        if (!SD.exists("/fonts")) {
-            Serial.println("WARNING: /fonts directory not found");
-            Serial.println("Creating /fonts directory...");
-            SD.mkdir("/fonts");
-        }
-
-        // Scan for font files
-        scanFonts();
-
         // Check if fonts were found
-        if (fontPaths.empty()) {
-            Serial.println("ERROR: No fonts found!");
+        if (catalogFontCount() == 0) {
+            LOG_E("ERROR: No fonts found!\n");
+            epdLeaveOneBitMode();
             M5.EPD.Clear(true); // Full refresh to clear boot splash
             canvas.fillCanvas(15);
             canvas.setTextColor(0);
@@ -3596,20 +6923,26 @@ void setup() {
             canvas.setTextSize(2);
             canvas.drawString("Add .ttf or .otf files", 270, 500);
             canvas.drawString("to /fonts directory", 270, 540);
-            canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+            pushFrame(UPDATE_MODE_GC16);
             while(1) delay(1000); // halt
         }
+    } else if (fastButtonWake) {
+        // FAST BUTTON WAKE: SD is mounted on first input
+        LOG_I("Fast button wake: display already current, SD and fonts deferred\n");
     } else {
         // WAKE FROM SLEEP: SD required
-        Serial.println("\n=== Testing microSD (required) ===");
+        LOG_I("\n=== Testing microSD (required) ===\n");
+        profileBegin(PHASE_SD_BEGIN);
         sdAvailable = SD.begin();
+        profileEnd(PHASE_SD_BEGIN);
 
         if (sdAvailable) {
-            Serial.println("microSD available");
-            scanFonts();
+            LOG_I("microSD available\n");
+            scanFonts(!isAutoWake); // Auto-wake: catalog only
         } else {
-            Serial.println("✗ ERROR: SD card not available at wake!");
+            LOG_E("✗ ERROR: SD card not available at wake!\n");
 
+            epdLeaveOneBitMode();
             M5.EPD.Clear(true); // Full refresh to clear previous font specimen
             canvas.fillCanvas(15);
             canvas.setTextColor(0);
@@ -3618,7 +6951,7 @@ void setup() {
             canvas.drawString("SD CARD ERROR", 270, 400);
             canvas.setTextSize(2);
             canvas.drawString("Insert SD card and reset", 270, 500);
-            canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+            pushFrame(UPDATE_MODE_GC16);
             while(1) delay(1000); // halt
         }
     }
@@ -3626,62 +6959,72 @@ void setup() {
     // v2.2: Config handling
     if (!isWakeFromSleep) {
         // COLD BOOT: Always run unified setup screen
-        Serial.println("\n=== Cold Boot: Running Setup ===");
+        LOG_I("\n=== Cold Boot: Running Setup ===\n");
+
+        // v3.1: Keep the options section (schedule, clock) across the setup screen.
+        // The text file wins on cold boot (it may have been edited on a computer).
+        AppConfig previousConfig;
+        bool hadConfig = importConfigFromSD() || loadConfigFromNvs();
+        if (hadConfig) {
+            previousConfig = config;
+        }
 
         // Initialize default config
-        initDefaultConfig(fontPaths.size());
+        initDefaultConfig(); // Font choice stays in the catalog: setup pre-selects it
+        if (hadConfig) {
+            config.schedule = previousConfig.schedule;
+            config.intervalOverrideMinutes = previousConfig.intervalOverrideMinutes;
+            config.pendingClockSet = previousConfig.pendingClockSet;
+        }
+        initScheduleClock();
 
         // Unified setup screen (interval + font selection in one)
         setupScreenUnified();
+        finishBackgroundScan(); // Indexing ran during the setup screen
 
-        // Save config to SD (will be used for wake from sleep)
+        // Save config to NVS (used on wake) and the SD text copy
         if (saveConfig()) {
-            Serial.println("Setup complete - config saved for wake cycles");
+            LOG_I("Setup complete - config saved for wake cycles\n");
         } else {
-            Serial.println("WARNING: Failed to save config file");
+            LOG_W("WARNING: Failed to save config file\n");
         }
+    } else if (fastButtonWake) {
+        // FAST BUTTON WAKE: only the sleep schedule is needed until the config is loaded
+        loadScheduleFromRtc();
     } else {
         // WAKE FROM SLEEP: Load config from previous session
-        Serial.println("\n=== Wake from Sleep: Loading Config ===");
+        LOG_I("\n=== Wake from Sleep: Loading Config ===\n");
         bool configLoaded = loadConfig();
 
         if (!configLoaded) {
             // Should not happen - use defaults
-            Serial.println("WARNING: Config file missing after wake - using defaults");
-            initDefaultConfig(fontPaths.size());
+            LOG_W("WARNING: Config file missing after wake - using defaults\n");
+            initDefaultConfig();
         } else {
-            Serial.println("Config loaded successfully");
+            LOG_I("Config loaded successfully\n");
         }
     }
 
-    // Apply config: filter fontPaths to only enabled fonts (always, for both cold boot and wake)
-    Serial.println("\n=== Applying Config ===");
-    std::vector<String> enabledFontPaths;
-    for (size_t i = 0; i < fontPaths.size() && i < config.fontEnabled.size(); i++) {
-        if (config.fontEnabled[i]) {
-            enabledFontPaths.push_back(fontPaths[i]);
-            Serial.printf("  Enabled: %s\n", fontPaths[i].c_str());
-        } else {
-            Serial.printf("  Disabled: %s\n", fontPaths[i].c_str());
-        }
+    // Apply config: active font table from the catalog flags (cold boot and full wake;
+    // a fast button wake does this in completeDeferredWake())
+    if (!fastButtonWake) {
+        applyFontConfig();
     }
 
-    // Replace fontPaths with filtered list
-    fontPaths = enabledFontPaths;
-    Serial.printf("Active fonts: %d\n", fontPaths.size());
-
     // Check if at least one font is enabled
-    if (fontPaths.empty()) {
-        Serial.println("ERROR: No fonts enabled in config!");
+    if (!fastButtonWake && activeFontCount() == 0) {
+        // v3.1: Enabled fonts may all be marked unusable (see Font Catalog)
+        bool allUnusable = catalogEnabledCount() > 0;
+        LOG_E("ERROR: %s\n", allUnusable ? "All enabled fonts are unusable!" : "No fonts enabled in config!");
         canvas.fillCanvas(15);
         canvas.setTextColor(0);
         canvas.setTextDatum(CC_DATUM);
         canvas.setTextSize(3);
-        canvas.drawString("NO FONTS ENABLED", 270, 400);
+        canvas.drawString(allUnusable ? "NO USABLE FONTS" : "NO FONTS ENABLED", 270, 400);
         canvas.setTextSize(2);
-        canvas.drawString("Delete /paperspecimen.cfg", 270, 500);
-        canvas.drawString("and restart to reconfigure", 270, 540);
-        canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+        canvas.drawString("Press reset now and select", 270, 500);
+        canvas.drawString(allUnusable ? "other fonts in setup" : "fonts in setup", 270, 540);
+        pushFrame(UPDATE_MODE_GC16);
         while(1) delay(1000); // halt
     }
 
@@ -3689,25 +7032,25 @@ void setup() {
     if (isWakeFromSleep && rtcState.isValid) {
         // STEP 5: Restore view mode from RTC memory
         currentViewMode = rtcState.viewMode;
-        Serial.printf("Restored view mode: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+        LOG_I("Restored view mode: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
 
         // Add sleep duration to total uptime (only for timer wakes, not button wakes)
         if (isAutoWake) {
-            uint64_t sleepMillis = (uint64_t)config.wakeIntervalMinutes * 60 * 1000;
-            Serial.printf("DEBUG: Adding sleep time to uptime: %llu ms (%d minutes)\n",
-                          sleepMillis, config.wakeIntervalMinutes);
+            uint64_t sleepMillis = (uint64_t)rtcState.plannedSleepSeconds * 1000;
+            LOG_D("DEBUG: Adding sleep time to uptime: %llu ms (%lu s scheduled)\n",
+                  sleepMillis, rtcState.plannedSleepSeconds);
             rtcState.totalMillis += sleepMillis;
-            Serial.printf("DEBUG: Updated rtcState.totalMillis = %llu\n", rtcState.totalMillis);
+            LOG_D("DEBUG: Updated rtcState.totalMillis = %llu\n", rtcState.totalMillis);
         }
 
         // Calculate and display current uptime (accumulated + current session)
         uint64_t currentTotalMillis = rtcState.totalMillis + millis();
         uint32_t totalMinutes = currentTotalMillis / 60000;
-        Serial.printf("Uptime: %lu minutes (%lud %02luh %02lum)\n",
-                      totalMinutes,
-                      totalMinutes / (24 * 60),
-                      (totalMinutes % (24 * 60)) / 60,
-                      totalMinutes % 60);
+        LOG_I("Uptime: %lu minutes (%lud %02luh %02lum)\n",
+              totalMinutes,
+              totalMinutes / (24 * 60),
+              (totalMinutes % (24 * 60)) / 60,
+              totalMinutes % 60);
 
         // Log battery data to .battery file (only in debug mode)
         if (rtcState.debugMode) {
@@ -3716,107 +7059,101 @@ void setup() {
 
         if (isAutoWake) {
             // Auto-wake from RTC alarm: randomize based on config settings
-            Serial.println("\n=== Auto-wake: Applying randomization settings ===");
-            Serial.printf("Allow different font: %s\n", config.allowDifferentFont ? "yes" : "no");
-            Serial.printf("Allow different mode: %s\n", config.allowDifferentMode ? "yes" : "no");
-
-            // Randomize font if allowed
-            if (config.allowDifferentFont) {
-                currentFontIndex = random(0, fontPaths.size());
-                Serial.printf("Random font selected: %d/%d\n", currentFontIndex + 1, fontPaths.size());
+            LOG_I("\n=== Auto-wake: Applying randomization settings ===\n");
+            LOG_I("Allow different font: %s\n", config.allowDifferentFont ? "yes" : "no");
+            LOG_I("Allow different mode: %s\n", config.allowDifferentMode ? "yes" : "no");
+
+            // Randomize font if allowed (energy governor may pin the font to skip a font load)
+            if (config.allowDifferentFont && governor().allowFontSwitch) {
+                currentFontIndex = randomSupportedFontIndex();
+                LOG_I("Random font selected: %d/%d\n", currentFontIndex + 1, activeFontCount());
             } else {
                 // Keep current font from RTC memory
-                currentFontIndex = rtcState.currentFontIndex;
-                if (currentFontIndex >= fontPaths.size()) {
-                    Serial.println("WARNING: Saved font index out of range, resetting to 0");
-                    currentFontIndex = 0;
-                }
-                Serial.printf("Keeping current font: %d/%d\n", currentFontIndex + 1, fontPaths.size());
+                currentFontIndex = savedFontIndex();
+                LOG_I("Keeping current font: %d/%d\n", currentFontIndex + 1, activeFontCount());
             }
 
             // Randomize mode if allowed
-            if (config.allowDifferentMode) {
+            if (config.allowDifferentMode && governor().allowModeSwitch) {
                 // Use ESP32 hardware RNG instead of Arduino random() which has issues after deep sleep
                 currentViewMode = ((esp_random() % 2) == 0) ? BITMAP : OUTLINE;
-                Serial.printf("Random mode selected: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+                LOG_I("Random mode selected: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
             } else {
                 // Keep current mode from RTC memory (already restored above)
-                Serial.printf("Keeping current mode: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+                LOG_I("Keeping current mode: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
             }
 
-            // Load font and generate random glyph
-            if (loadCurrentFont()) {
+            // Energy governor: show a frame rendered during the last session if one is left,
+            // otherwise load font and generate random glyph
+            if (showPrerenderedFrame()) {
+                LOG_I("Auto-wake: pre-rendered frame shown (no font load, no FreeType)\n");
+            } else if (loadUsableFont()) {
                 currentGlyphCodepoint = getRandomGlyphCodepoint();
 
                 // If no valid glyph found, try other fonts
-                int attempts = 0;
-                while (currentGlyphCodepoint == 0 && attempts < fontPaths.size()) {
-                    Serial.println("No valid glyphs in this font, trying next...");
-                    currentFontIndex = (currentFontIndex + 1) % fontPaths.size();
-                    if (loadCurrentFont()) {
-                        currentGlyphCodepoint = getRandomGlyphCodepoint();
-                    }
-                    attempts++;
+                if (currentGlyphCodepoint == 0) {
+                    LOG_I("No valid glyphs in this font, trying next...\n");
+                    currentGlyphCodepoint = randomGlyphFromOtherFonts();
                 }
 
                 if (currentGlyphCodepoint != 0) {
                     renderGlyph();
                 } else {
-                    Serial.println("WARNING: No fonts with valid glyphs, skipping render");
+                    LOG_W("WARNING: No fonts with valid glyphs, skipping render\n");
                 }
             }
         } else {
             // Button wake: restore previous state
-            Serial.println("\n=== Restoring state from RTC memory ===");
+            LOG_I("\n=== Restoring state from RTC memory ===\n");
             currentFontIndex = rtcState.currentFontIndex;
             currentGlyphCodepoint = rtcState.currentGlyphCodepoint;
 
-            // Validate font index
-            if (currentFontIndex >= fontPaths.size()) {
-                Serial.println("WARNING: Saved font index out of range, resetting to 0");
-                currentFontIndex = 0;
-            }
+            if (fastButtonWake) {
+                // Panel already shows this glyph: no render, no refresh
+                deferredWakeInit = true;
+                markGlyphDisplayed();
+                LOG_I("Restored: font=%d, glyph=U+%04X (display unchanged)\n",
+                      currentFontIndex + 1, currentGlyphCodepoint);
+            } else {
+                // Find the saved font in the current scan (by font ID)
+                currentFontIndex = savedFontIndex();
 
-            Serial.printf("Restored: font=%d/%d, glyph=U+%04X\n",
-                          currentFontIndex + 1, fontPaths.size(), currentGlyphCodepoint);
+                LOG_I("Restored: font=%d/%d, glyph=U+%04X\n",
+                      currentFontIndex + 1, activeFontCount(), currentGlyphCodepoint);
 
-            // Load the font and render the glyph
-            if (loadCurrentFont()) {
-                renderGlyph();
-            } else {
-                Serial.println("ERROR: Failed to restore font");
+                // Load the font and render the glyph
+                if (loadCurrentFont()) {
+                    renderGlyph();
+                } else {
+                    LOG_E("ERROR: Failed to restore font\n");
+                }
             }
         }
     } else {
         // Cold boot: Load first font and display random glyph
-        Serial.println("\n=== Loading initial font ===");
+        LOG_I("\n=== Loading initial font ===\n");
 
         // Randomize initial view mode if allowed (applies to cold boot only)
         if (config.allowDifferentMode) {
             // Use ESP32 hardware RNG for better randomness
             currentViewMode = ((esp_random() % 2) == 0) ? BITMAP : OUTLINE;
-            Serial.printf("Initial random mode selected: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+            LOG_I("Initial random mode selected: %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
         } else {
             // Keep default BITMAP mode
-            Serial.printf("Initial mode (default): %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
+            LOG_I("Initial mode (default): %s\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
         }
 
-        if (loadCurrentFont()) {
+        if (loadUsableFont()) {
             currentGlyphCodepoint = getRandomGlyphCodepoint();
 
             // If no valid glyph found in first font, try fonts until we find one with glyphs
-            int attempts = 0;
-            while (currentGlyphCodepoint == 0 && attempts < fontPaths.size()) {
-                Serial.println("No valid glyphs in this font, trying next...");
-                currentFontIndex = (currentFontIndex + 1) % fontPaths.size();
-                if (loadCurrentFont()) {
-                    currentGlyphCodepoint = getRandomGlyphCodepoint();
-                }
-                attempts++;
+            if (currentGlyphCodepoint == 0) {
+                LOG_I("No valid glyphs in this font, trying next...\n");
+                currentGlyphCodepoint = randomGlyphFromOtherFonts();
             }
 
             if (currentGlyphCodepoint == 0) {
-                Serial.println("CRITICAL ERROR: No fonts with valid glyphs found!");
+                LOG_E("CRITICAL ERROR: No fonts with valid glyphs found!\n");
                 // Show error on screen
                 canvas.fillCanvas(15);
                 canvas.setTextColor(0);
@@ -3824,21 +7161,21 @@ void setup() {
                 canvas.setTextSize(2);
                 canvas.drawString("NO COMPATIBLE FONTS", 270, 400);
                 canvas.drawString("Check font files", 270, 450);
-                canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
+                pushFrame(UPDATE_MODE_GC16);
                 while(1) delay(1000); // Halt
             }
 
             renderGlyph();
 
             // Full refresh after first render to clear boot screen ghosting
-            Serial.println("Initial full refresh to clear boot screen ghosting");
-            M5.EPD.UpdateFull(UPDATE_MODE_GC16);
+            LOG_I("Initial full refresh to clear boot screen ghosting\n");
+            epdUpdateFull(UPDATE_MODE_GC16);
             lastFullRefreshTime = millis();
 
             // STEP 1 TEST: Try to access FT_Face outline data
             testGlyphOutlineAccess(currentGlyphCodepoint);
         } else {
-            Serial.println("ERROR: Failed to load initial font");
+            LOG_E("ERROR: Failed to load initial font\n");
             canvas.fillCanvas(15);
             canvas.setTextColor(0);
             canvas.setTextDatum(CC_DATUM);
@@ -3846,8 +7183,8 @@ void setup() {
             canvas.drawString("FONT LOAD ERROR", 270, 400);
             canvas.drawString("Check Serial output", 270, 450);
             canvas.drawString("for details", 270, 480);
-            canvas.pushCanvas(0, 0, UPDATE_MODE_GC16);
-            Serial.println("\n!!! HALTED - Check font files !!!");
+            pushFrame(UPDATE_MODE_GC16);
+            LOG_E("\n!!! HALTED - Check font files !!!\n");
             while(1) delay(1000); // halt
         }
     }
@@ -3856,232 +7193,77 @@ void setup() {
     // Touch is disabled during auto-wake (timer wake) to save power
     if (!isAutoWakeSession) {
         enableTouch();
-        Serial.println("  Touch: Tap left=prev font | center=random glyph (long press=mode toggle) | right=next font");
+        LOG_I("  Touch: Tap left=prev font | center=random glyph (long press=mode toggle) | right=next font\n");
     } else {
-        Serial.println("Touch disabled (auto-wake session)");
-    }
-
-    Serial.println("\n=== Setup Complete ===");
-    Serial.println("Controls:");
-    Serial.println("  Wheel UP (BtnR): Next font");
-    Serial.println("  Wheel DOWN (BtnL): Previous font");
-    Serial.println("  Wheel PUSH (BtnP): Random glyph");
-    Serial.println("");
-}
-
-void loop() {
-    M5.update(); // Update button states
-
-    // v3.0: Touch screen polling and gesture detection
-    if (touchEnabled && M5.TP.available()) {
-        // Check if finger is currently touching (not released)
-        if (!M5.TP.isFingerUp()) {
-            M5.TP.update(); // Update touch data
-            tp_finger_t finger = M5.TP.readFinger(0); // Read first touch point
-
-            if (!touchWasPressed) {
-                // Touch just started
-                touchWasPressed = true;
-                touchStartTime = millis();
-                touchStartValid = false; // Not valid yet
-                longPressFired = false;
-
-                // Try to get valid coordinates (filter spurious (0,0) readings)
-                // M5Paper screen: 540x960, valid range X:[1-540], Y:[1-960]
-                if (finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
-                    touchStartX = finger.x;
-                    touchStartY = finger.y;
-                    touchStartValid = true;
-                    Serial.printf("Touch started at (%d, %d)\n", finger.x, finger.y);
-                } else {
-                    // Invalid coordinates - wait for next update
-                    Serial.printf("Touch started: waiting for valid coordinates (got %d, %d)\n", finger.x, finger.y);
-                }
-            } else {
-                // Touch is held - if we don't have valid start yet, try to get it now
-                if (!touchStartValid && finger.x > 0 && finger.x <= 540 && finger.y > 0 && finger.y <= 960) {
-                    touchStartX = finger.x;
-                    touchStartY = finger.y;
-                    touchStartValid = true;
-                    Serial.printf("Touch coordinates now valid: (%d, %d)\n", finger.x, finger.y);
-                }
-
-                // Check for long press in center zone (only if we have valid start coordinates)
-                if (touchStartValid) {
-                    unsigned long touchDuration = millis() - touchStartTime;
-                    int zone = getTouchZone(touchStartX, touchStartY);
-
-                    if (touchDuration >= LONG_PRESS_DURATION && !longPressFired && zone == 1) {
-                        // Long press detected in center zone → Toggle view mode
-                        longPressFired = true; // Prevent multiple toggles
-                        lastButtonActivityTime = millis();
-                        isAutoWakeSession = false;
-
-                        Serial.println("\n>>> Touch LONG PRESS (center) - Toggle view mode");
-                        currentViewMode = (currentViewMode == BITMAP) ? OUTLINE : BITMAP;
-                        Serial.printf("Switched to %s mode\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
-                        renderGlyph();
-                    }
-                }
-            }
-        } else if (touchWasPressed) {
-            // Finger was released - process gesture (only if we got valid start coordinates)
-            touchWasPressed = false;
-
-            if (!touchStartValid) {
-                // Never got valid coordinates during this touch
-                Serial.println("Touch released: ignored (never got valid coordinates)");
-                return; // Skip gesture processing
-            }
-
-            M5.TP.update(); // Get final coordinates
-            tp_finger_t finger = M5.TP.readFinger(0);
-
-            unsigned long touchDuration = millis() - touchStartTime;
-            int16_t deltaX = finger.x - touchStartX;
-            int16_t deltaY = finger.y - touchStartY;
-
-            Serial.printf("Touch released: duration=%lums, delta=(%d, %d), startX=%d\n",
-                         touchDuration, deltaX, deltaY, touchStartX);
-
-            if (!longPressFired) { // Only process tap if long press didn't fire
-                // Check for tap (short duration, minimal movement)
-                if (touchDuration < LONG_PRESS_DURATION &&
-                    abs(deltaX) < TAP_MAX_MOVEMENT && abs(deltaY) < TAP_MAX_MOVEMENT) {
-
-                    // Determine which zone was tapped
-                    int zone = getTouchZone(touchStartX, touchStartY);
-
-                    lastButtonActivityTime = millis();
-                    isAutoWakeSession = false;
-
-                    if (zone == 0) {
-                        // Left zone → Previous font
-                        Serial.println("\n>>> Touch TAP LEFT - Previous font");
-                        previousFont();
-                    } else if (zone == 1) {
-                        // Center zone → Random glyph
-                        Serial.println("\n>>> Touch TAP CENTER - Random glyph");
-                        randomGlyph();
-                    } else if (zone == 2) {
-                        // Right zone → Next font
-                        Serial.println("\n>>> Touch TAP RIGHT - Next font");
-                        nextFont();
-                    } else {
-                        Serial.printf("Touch ignored: invalid zone (x=%d, y=%d)\n", touchStartX, touchStartY);
-                    }
-
-                    delay(300); // Debounce
-                } else {
-                    // Not a tap (too much movement or too long without reaching long press threshold)
-                    Serial.printf("Touch ignored: not a tap (duration=%lums, movement=%d,%d)\n",
-                                 touchDuration, deltaX, deltaY);
-                }
-            }
-        }
-    }
-
-    // Auto full refresh after 10s timeout if there was at least 1 partial
-    // AND at least 10s passed since last full refresh
-    unsigned long timeSinceFirstPartial = millis() - firstPartialAfterFullTime;
-    unsigned long timeSinceLastFull = millis() - lastFullRefreshTime;
-
-    if (hasPartialSinceLastFull &&
-        timeSinceFirstPartial >= FULL_REFRESH_TIMEOUT_MS &&
-        timeSinceLastFull >= FULL_REFRESH_TIMEOUT_MS) {
-        Serial.printf(">>> Auto full refresh after timeout (time since first partial=%lums, time since last full=%lums)\n",
-                      timeSinceFirstPartial, timeSinceLastFull);
-        M5.EPD.UpdateFull(UPDATE_MODE_GC16);
-        partialRefreshCount = 0;
-        hasPartialSinceLastFull = false;
-        lastFullRefreshTime = millis(); // Track for power management
-    }
-
-    // Power management: Enter deep sleep based on context
-    // Special case: Auto-wake session (timer wake) - sleep immediately after refresh
-    if (isAutoWakeSession && millis() - lastFullRefreshTime >= 1000) {
-        // Give 1000ms for double full refresh (first render after wake: ~900ms)
-        // or 200ms for subsequent partial refresh
-        // No need to wait 10s idle time - this is automatic operation
-        Serial.println(">>> Auto-wake session: entering deep sleep immediately after refresh");
-        enterDeepSleep(); // This function never returns (enters deep sleep)
+        LOG_I("Touch disabled (auto-wake session)\n");
     }
 
-    // Normal case: Enter deep sleep after 10s from last full refresh if no button activity
-    unsigned long timeSinceFullRefresh = millis() - lastFullRefreshTime;
-    unsigned long timeSinceButtonActivity = millis() - lastButtonActivityTime;
+    LOG_I("\n=== Setup Complete ===\n");
+    LOG_I("Controls:\n");
+    LOG_I("  Wheel UP (BtnR): Next font\n");
+    LOG_I("  Wheel DOWN (BtnL): Previous font\n");
+    LOG_I("  Wheel PUSH (BtnP): Random glyph\n");
+    LOG_I("\n");
 
-    // Enter deep sleep only if:
-    // 1) 10 seconds passed since last full refresh
-    // 2) No button activity after the last full refresh
-    if (!isAutoWakeSession &&
-        timeSinceFullRefresh >= DEEP_SLEEP_TIMEOUT_MS &&
-        lastButtonActivityTime <= lastFullRefreshTime) {
-        enterDeepSleep(); // This function never returns (enters deep sleep)
+    // v3.1: Wake-phase profile (totals accumulate across sleep cycles)
+    if (isWakeFromSleep) {
+        profileEnd(PHASE_WAKE_TOTAL);
+    } else {
+        phaseStartUs[PHASE_WAKE_TOTAL] = 0; // Cold boot waits for setup screens
     }
-
-    // Button L (Wheel DOWN): Previous font (keep same glyph)
-    if (M5.BtnL.wasPressed()) {
-        lastButtonActivityTime = millis();
-        isAutoWakeSession = false; // User interaction: cancel auto-wake session immediate sleep
-        Serial.println("\n>>> Button L (DOWN) pressed - Previous font");
-        previousFont();
-        delay(300); // Simple delay to prevent multiple triggers
+    if (rtcState.debugMode) {
+        LOG_I("\n=== Wake Profile ===\n");
+        dumpWakeProfile(Serial);
+        if (SD.cardType() != CARD_NONE) { // Not mounted on a fast button wake
+            writeWakeProfileToSD();
+        }
     }
+}
 
-    // Button R (Wheel UP): Next font (keep same glyph)
-    if (M5.BtnR.wasPressed()) {
-        lastButtonActivityTime = millis();
-        isAutoWakeSession = false; // User interaction: cancel auto-wake session immediate sleep
-        Serial.println("\n>>> Button R (UP) pressed - Next font");
-        nextFont();
-        delay(300); // Simple delay to prevent multiple triggers
+// v3.1: Debug console commands: 'm' metrics, 'p' wake profile, 'l' input latency,
+// 't' scope trace as JSON, 'T' scope trace to /.trace.json
+void handleSerialCommand(int c) {
+    switch (c) {
+        case 'm':
+            sampleMetricGauges();
+            Serial.println("\n=== Metrics ===");
+            dumpMetrics(Serial);
+            break;
+        case 'p':
+            Serial.println("\n=== Wake Profile ===");
+            dumpWakeProfile(Serial);
+            break;
+        case 'l':
+            Serial.println("\n=== Input Latency ===");
+            dumpLatencyStats(Serial);
+            break;
+        case 't':
+            exportTraceJson(Serial);
+            break;
+        case 'T':
+            writeTraceToSD();
+            break;
+        default:
+            break;
     }
+}
 
-    // STEP 5: Button P - Very long press (5s) = shutdown, Long press = toggle view, Short press = random glyph
-    static unsigned long btnPressStartTime = 0;
-    static bool btnPWasDown = false;
-    const unsigned long SHUTDOWN_PRESS_THRESHOLD = 5000; // 5 seconds for shutdown
-    const unsigned long LONG_PRESS_THRESHOLD = 800; // 800ms for long press
+void loop() {
+    pollInputEvents();
 
-    if (M5.BtnP.isPressed() && !btnPWasDown) {
-        // Button just pressed
-        btnPressStartTime = millis();
-        btnPWasDown = true;
+    if (rtcState.debugMode && Serial.available()) {
+        handleSerialCommand(Serial.read());
     }
 
-    // Check for shutdown (5 seconds) while button is held
-    if (M5.BtnP.isPressed() && btnPWasDown) {
-        unsigned long pressDuration = millis() - btnPressStartTime;
-        if (pressDuration >= SHUTDOWN_PRESS_THRESHOLD) {
-            // Very long press (5s): Shutdown with screen
-            btnPWasDown = false; // Reset state
-            shutdownWithScreen(); // This function never returns
-        }
+    // Input always wins: timer deadlines are only re-evaluated when nothing is queued
+    if (eventQueueCount == 0) {
+        pollTimerEvents();
     }
 
-    if (!M5.BtnP.isPressed() && btnPWasDown) {
-        // Button just released
-        unsigned long pressDuration = millis() - btnPressStartTime;
-        btnPWasDown = false;
-        lastButtonActivityTime = millis();
-        isAutoWakeSession = false; // User interaction: cancel auto-wake session immediate sleep
-
-        if (pressDuration >= LONG_PRESS_THRESHOLD) {
-            // Long press (800ms): Toggle view mode
-            Serial.println("\n>>> Button P LONG PRESS - Toggle view mode");
-            currentViewMode = (currentViewMode == BITMAP) ? OUTLINE : BITMAP;
-            Serial.printf("Switched to %s mode\n", currentViewMode == BITMAP ? "BITMAP" : "OUTLINE");
-
-            // Re-render with new mode
-            renderGlyph();
-        } else {
-            // Short press: Random glyph
-            Serial.println("\n>>> Button P (PUSH) pressed - Random glyph");
-            randomGlyph();
-        }
-        delay(300); // Simple delay to prevent multiple triggers
+    AppEvent ev;
+    if (popEvent(ev)) {
+        dispatchEvent(ev);
+    } else {
+        delay(LOOP_IDLE_DELAY_MS);
     }
-
-    delay(50); // Reduced delay for more responsive buttons
-}
\ No newline at end of file
+}
@@ -0,0 +1,123 @@
+// Host tests for the event/timer rules in include/app_events.h (pio test -e native)
+
+#include <unity.h>
+#include "app_events.h"
+
+void setUp(void) {}
+void tearDown(void) {}
+
+// Interactive session, nothing pending, everything happened long ago
+static TimerSnapshot quietSnapshot(unsigned long now) {
+    TimerSnapshot t = {};
+    t.now = now;
+    t.lastFullRefreshTime = now;
+    t.firstPartialAfterFullTime = now;
+    t.lastButtonActivityTime = now;
+    t.lastPreviewTime = now;
+    return t;
+}
+
+void test_state_for_event(void) {
+    TEST_ASSERT_EQUAL(STATE_RENDERING, appStateForEvent(EVT_NEXT_FONT));
+    TEST_ASSERT_EQUAL(STATE_RENDERING, appStateForEvent(EVT_PREV_FONT));
+    TEST_ASSERT_EQUAL(STATE_RENDERING, appStateForEvent(EVT_RANDOM_GLYPH));
+    TEST_ASSERT_EQUAL(STATE_RENDERING, appStateForEvent(EVT_TOGGLE_MODE));
+    TEST_ASSERT_EQUAL(STATE_RENDERING, appStateForEvent(EVT_SHOW_LATENCY));
+    TEST_ASSERT_EQUAL(STATE_REFRESHING, appStateForEvent(EVT_SETTLE_DUE));
+    TEST_ASSERT_EQUAL(STATE_REFRESHING, appStateForEvent(EVT_FULL_REFRESH_DUE));
+    TEST_ASSERT_EQUAL(STATE_PREFETCHING, appStateForEvent(EVT_PREFETCH_DUE));
+    TEST_ASSERT_EQUAL(STATE_SLEEPING, appStateForEvent(EVT_SHUTDOWN));
+    TEST_ASSERT_EQUAL(STATE_SLEEPING, appStateForEvent(EVT_SLEEP_DUE));
+    TEST_ASSERT_EQUAL(STATE_IDLE, appStateForEvent(EVT_NONE));
+}
+
+void test_user_input_events(void) {
+    TEST_ASSERT_TRUE(isUserInputEvent(EVT_NEXT_FONT));
+    TEST_ASSERT_TRUE(isUserInputEvent(EVT_SHUTDOWN));
+    TEST_ASSERT_FALSE(isUserInputEvent(EVT_SETTLE_DUE));
+    TEST_ASSERT_FALSE(isUserInputEvent(EVT_SLEEP_DUE));
+}
+
+void test_nothing_due_right_after_activity(void) {
+    TEST_ASSERT_EQUAL(EVT_NONE, evaluateTimers(quietSnapshot(100000)));
+}
+
+void test_settle_waits_for_quiet_input(void) {
+    TimerSnapshot t = quietSnapshot(100000);
+    t.settlePending = true;
+    t.lastPreviewTime = t.now - SETTLE_QUIET_MS;
+    t.lastButtonActivityTime = t.now - SETTLE_QUIET_MS + 1;
+    TEST_ASSERT_EQUAL(EVT_NONE, evaluateTimers(t));
+    t.lastButtonActivityTime = t.now - SETTLE_QUIET_MS;
+    TEST_ASSERT_EQUAL(EVT_SETTLE_DUE, evaluateTimers(t));
+}
+
+void test_settle_beats_full_refresh(void) {
+    TimerSnapshot t = quietSnapshot(100000);
+    t.settlePending = true;
+    t.lastPreviewTime = t.lastButtonActivityTime = t.now - SETTLE_QUIET_MS;
+    t.hasPartialSinceLastFull = true;
+    t.firstPartialAfterFullTime = t.lastFullRefreshTime = t.now - FULL_REFRESH_TIMEOUT_MS;
+    TEST_ASSERT_EQUAL(EVT_SETTLE_DUE, evaluateTimers(t));
+}
+
+void test_full_refresh_after_timeout(void) {
+    TimerSnapshot t = quietSnapshot(100000);
+    t.hasPartialSinceLastFull = true;
+    t.lastFullRefreshTime = t.now - FULL_REFRESH_TIMEOUT_MS;
+    t.firstPartialAfterFullTime = t.now - FULL_REFRESH_TIMEOUT_MS + 1;
+    TEST_ASSERT_EQUAL(EVT_NONE, evaluateTimers(t));
+    t.firstPartialAfterFullTime = t.now - FULL_REFRESH_TIMEOUT_MS;
+    TEST_ASSERT_EQUAL(EVT_FULL_REFRESH_DUE, evaluateTimers(t));
+}
+
+void test_auto_wake_sleeps_after_refresh(void) {
+    TimerSnapshot t = quietSnapshot(100000);
+    t.isAutoWakeSession = true;
+    t.lastFullRefreshTime = t.now - 999;
+    TEST_ASSERT_EQUAL(EVT_NONE, evaluateTimers(t));
+    t.lastFullRefreshTime = t.now - 1000;
+    TEST_ASSERT_EQUAL(EVT_SLEEP_DUE, evaluateTimers(t));
+}
+
+void test_interactive_sleep_needs_no_input_since_refresh(void) {
+    TimerSnapshot t = quietSnapshot(100000);
+    t.lastFullRefreshTime = t.now - DEEP_SLEEP_TIMEOUT_MS;
+    t.lastButtonActivityTime = t.lastFullRefreshTime + 1;
+    TEST_ASSERT_NOT_EQUAL(EVT_SLEEP_DUE, evaluateTimers(t));
+    t.lastButtonActivityTime = t.lastFullRefreshTime;
+    TEST_ASSERT_EQUAL(EVT_SLEEP_DUE, evaluateTimers(t));
+}
+
+void test_prefetch_when_idle(void) {
+    TimerSnapshot t = quietSnapshot(100000);
+    t.prefetchPending = true;
+    t.lastButtonActivityTime = t.now - PREFETCH_IDLE_MS + 1;
+    TEST_ASSERT_EQUAL(EVT_NONE, evaluateTimers(t));
+    t.lastButtonActivityTime = t.now - PREFETCH_IDLE_MS;
+    TEST_ASSERT_EQUAL(EVT_PREFETCH_DUE, evaluateTimers(t));
+    t.isAutoWakeSession = true;
+    TEST_ASSERT_NOT_EQUAL(EVT_PREFETCH_DUE, evaluateTimers(t));
+}
+
+void test_deadlines_survive_millis_wrap(void) {
+    TimerSnapshot t = quietSnapshot(500);
+    t.isAutoWakeSession = true;
+    t.lastFullRefreshTime = 0UL - 600; // 1100 ms ago, before the counter wrapped
+    TEST_ASSERT_EQUAL(EVT_SLEEP_DUE, evaluateTimers(t));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_state_for_event);
+    RUN_TEST(test_user_input_events);
+    RUN_TEST(test_nothing_due_right_after_activity);
+    RUN_TEST(test_settle_waits_for_quiet_input);
+    RUN_TEST(test_settle_beats_full_refresh);
+    RUN_TEST(test_full_refresh_after_timeout);
+    RUN_TEST(test_auto_wake_sleeps_after_refresh);
+    RUN_TEST(test_interactive_sleep_needs_no_input_since_refresh);
+    RUN_TEST(test_prefetch_when_idle);
+    RUN_TEST(test_deadlines_survive_millis_wrap);
+    return UNITY_END();
+}
@@ -0,0 +1,268 @@
+// Host tests for the sfnt/cmap indexer in include/font_index.h (pio test -e native).
+// The catalog record of a fixture font must match what FreeType reads from the same bytes.
+
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_TRUETYPE_TABLES_H
+#include "font_index.h"
+
+#ifndef FONT_FIXTURE_DIR
+#define FONT_FIXTURE_DIR "test/fixtures/fonts"
+#endif
+
+static FT_Library library;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static std::vector<uint8_t> loadFixture(const char* name) {
+    std::vector<uint8_t> data;
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", FONT_FIXTURE_DIR, name);
+    FILE* file = fopen(path, "rb");
+    if (!file) return data;
+    uint8_t chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + got);
+    fclose(file);
+    return data;
+}
+
+static size_t readMemory(void* handle, uint32_t offset, uint8_t* out, size_t len) {
+    const std::vector<uint8_t>* data = (const std::vector<uint8_t>*)handle;
+    if (offset > data->size()) return 0;
+    size_t n = std::min(len, data->size() - offset);
+    memcpy(out, data->data() + offset, n);
+    return n;
+}
+
+static FontCatalogRecord indexBuffer(std::vector<uint8_t>& data, const char* name) {
+    FontCatalogRecord record;
+    memset(&record, 0, sizeof(record));
+    FontSource src = {&data, (uint32_t)data.size(), readMemory};
+    indexFontFile(src, name, record);
+    return record;
+}
+
+// Hide the format 12 subtables (unknown platform), leaving FreeType and the indexer the
+// BMP format 4 one
+static void hideFormat12(std::vector<uint8_t>& data) {
+    SfntDirectory dir;
+    parseSfntDirectory(data.data() + 12, readBE16(data.data() + 4) * 16, dir);
+    const SfntTableEntry* cmap = findSfntTable(dir, SFNT_TAG('c', 'm', 'a', 'p'));
+    TEST_ASSERT_NOT_NULL(cmap);
+    uint8_t* table = data.data() + cmap->offset;
+    for (int i = 0; i < readBE16(table + 2); i++) {
+        uint8_t* encoding = table + 4 + i * 8;
+        if (readBE16(table + readBE32(encoding + 4)) == 12) {
+            encoding[0] = encoding[1] = 0xFF; // platformID
+        }
+    }
+}
+
+// Coverage, counts and metadata of the record against FreeType's Unicode charmap
+static void assertMatchesFreeType(std::vector<uint8_t>& data, const FontCatalogRecord& record) {
+    FT_Face face;
+    TEST_ASSERT_EQUAL(0, FT_New_Memory_Face(library, data.data(), data.size(), 0, &face));
+    TEST_ASSERT_EQUAL(0, FT_Select_Charmap(face, FT_ENCODING_UNICODE));
+
+    uint32_t count = 0, rangeCoverage = 0;
+    uint8_t bmpPages[32] = {0};
+    uint16_t rangeGlyphs[32] = {0};
+    FT_UInt glyph;
+    for (FT_ULong c = FT_Get_First_Char(face, &glyph); glyph != 0; c = FT_Get_Next_Char(face, c, &glyph)) {
+        count++;
+        if (c <= 0xFFFF) bmpPages[(c >> 8) / 8] |= 1 << ((c >> 8) % 8);
+        for (int i = 0; i < numGlyphRanges; i++) {
+            if (c >= glyphRanges[i].start && c <= glyphRanges[i].end) {
+                rangeCoverage |= 1UL << i;
+                rangeGlyphs[i]++;
+            }
+        }
+    }
+
+    TEST_ASSERT_TRUE(record.flags & FONT_FLAG_COVERAGE);
+    TEST_ASSERT_FALSE(record.flags & (FONT_FLAG_NO_OUTLINES | FONT_FLAG_EMPTY_CMAP));
+    TEST_ASSERT_EQUAL(count, record.codepointCount);
+    TEST_ASSERT_EQUAL_HEX32(rangeCoverage, record.rangeCoverage);
+    TEST_ASSERT_EQUAL_MEMORY(bmpPages, record.bmpPages, sizeof(bmpPages));
+    TEST_ASSERT_EQUAL_MEMORY(rangeGlyphs, record.rangeGlyphs, sizeof(rangeGlyphs));
+    TEST_ASSERT_EQUAL(face->num_glyphs, record.glyphCount);
+    TEST_ASSERT_EQUAL(face->units_per_EM, record.unitsPerEm);
+    TEST_ASSERT_EQUAL_STRING(face->family_name, record.family);
+
+    TT_OS2* os2 = (TT_OS2*)FT_Get_Sfnt_Table(face, FT_SFNT_OS2);
+    TEST_ASSERT_NOT_NULL(os2);
+    TEST_ASSERT_EQUAL(os2->usWeightClass, record.weightClass);
+    TEST_ASSERT_EQUAL_HEX32(os2->ulUnicodeRange1, record.unicodeRanges[0]);
+    TEST_ASSERT_EQUAL_HEX32(os2->ulUnicodeRange2, record.unicodeRanges[1]);
+    FT_Done_Face(face);
+}
+
+void test_format12_matches_freetype(void) {
+    std::vector<uint8_t> data = loadFixture("DejaVuSansMono.ttf");
+    TEST_ASSERT_TRUE(data.size() > 0);
+    FontCatalogRecord record = indexBuffer(data, "DejaVuSansMono.ttf");
+    assertMatchesFreeType(data, record);
+    TEST_ASSERT_TRUE(record.codepointCount > 0);
+}
+
+void test_format4_matches_freetype(void) {
+    std::vector<uint8_t> data = loadFixture("DejaVuSansMono.ttf");
+    TEST_ASSERT_TRUE(data.size() > 0);
+    hideFormat12(data);
+    FontCatalogRecord record = indexBuffer(data, "DejaVuSansMono.ttf");
+    assertMatchesFreeType(data, record);
+}
+
+void test_scripts_are_covered_ranges(void) {
+    std::vector<uint8_t> data = loadFixture("DejaVuSansMono.ttf");
+    FontCatalogRecord record = indexBuffer(data, "DejaVuSansMono.ttf");
+    TEST_ASSERT_EQUAL_HEX32(0, record.scriptRanges & ~record.rangeCoverage);
+    TEST_ASSERT_TRUE(record.scriptRanges & 0x3F); // Basic Latin
+}
+
+// OS/2 ulUnicodeRange bits up to 59 and their BMP blocks (OpenType spec, OS/2 table)
+struct SpecBlock {
+    uint8_t bit;
+    uint32_t start;
+    uint32_t end;
+};
+
+static const SpecBlock OS2_RANGE_BLOCKS[] = {
+    {0, 0x0000, 0x007F},   // Basic Latin
+    {1, 0x0080, 0x00FF},   // Latin-1 Supplement
+    {2, 0x0100, 0x017F},   // Latin Extended-A
+    {3, 0x0180, 0x024F},   // Latin Extended-B
+    {4, 0x0250, 0x02AF},   // IPA Extensions
+    {4, 0x1D00, 0x1DBF},   // Phonetic Extensions (+ Supplement)
+    {5, 0x02B0, 0x02FF},   // Spacing Modifier Letters
+    {6, 0x0300, 0x036F},   // Combining Diacritical Marks
+    {7, 0x0370, 0x03FF},   // Greek and Coptic
+    {8, 0x2C80, 0x2CFF},   // Coptic
+    {9, 0x0400, 0x052F},   // Cyrillic (+ Supplement)
+    {10, 0x0530, 0x058F},  // Armenian
+    {11, 0x0590, 0x05FF},  // Hebrew
+    {12, 0xA500, 0xA63F},  // Vai
+    {13, 0x0600, 0x06FF},  // Arabic
+    {13, 0x0750, 0x077F},  // Arabic Supplement
+    {14, 0x07C0, 0x07FF},  // NKo
+    {15, 0x0900, 0x097F},  // Devanagari
+    {16, 0x0980, 0x09FF},  // Bengali
+    {17, 0x0A00, 0x0A7F},  // Gurmukhi
+    {18, 0x0A80, 0x0AFF},  // Gujarati
+    {19, 0x0B00, 0x0B7F},  // Oriya
+    {20, 0x0B80, 0x0BFF},  // Tamil
+    {21, 0x0C00, 0x0C7F},  // Telugu
+    {22, 0x0C80, 0x0CFF},  // Kannada
+    {23, 0x0D00, 0x0D7F},  // Malayalam
+    {24, 0x0E00, 0x0E7F},  // Thai
+    {25, 0x0E80, 0x0EFF},  // Lao
+    {26, 0x10A0, 0x10FF},  // Georgian
+    {26, 0x2D00, 0x2D2F},  // Georgian Supplement
+    {27, 0x1B00, 0x1B7F},  // Balinese
+    {28, 0x1100, 0x11FF},  // Hangul Jamo
+    {29, 0x1E00, 0x1EFF},  // Latin Extended Additional
+    {30, 0x1F00, 0x1FFF},  // Greek Extended
+    {31, 0x2000, 0x206F},  // General Punctuation
+    {31, 0x2E00, 0x2E7F},  // Supplemental Punctuation
+    {32, 0x2070, 0x209F},  // Superscripts And Subscripts
+    {33, 0x20A0, 0x20CF},  // Currency Symbols
+    {34, 0x20D0, 0x20FF},  // Combining Diacritical Marks For Symbols
+    {35, 0x2100, 0x214F},  // Letterlike Symbols
+    {36, 0x2150, 0x218F},  // Number Forms
+    {37, 0x2190, 0x21FF},  // Arrows
+    {38, 0x2200, 0x22FF},  // Mathematical Operators
+    {39, 0x2300, 0x23FF},  // Miscellaneous Technical
+    {40, 0x2400, 0x243F},  // Control Pictures
+    {41, 0x2440, 0x245F},  // Optical Character Recognition
+    {42, 0x2460, 0x24FF},  // Enclosed Alphanumerics
+    {43, 0x2500, 0x257F},  // Box Drawing
+    {44, 0x2580, 0x259F},  // Block Elements
+    {45, 0x25A0, 0x25FF},  // Geometric Shapes
+    {46, 0x2600, 0x26FF},  // Miscellaneous Symbols
+    {47, 0x2700, 0x27BF},  // Dingbats
+    {48, 0x3000, 0x303F},  // CJK Symbols And Punctuation
+    {49, 0x3040, 0x309F},  // Hiragana
+    {50, 0x30A0, 0x30FF},  // Katakana
+    {51, 0x3100, 0x312F},  // Bopomofo
+    {52, 0x3130, 0x318F},  // Hangul Compatibility Jamo
+    {54, 0x3200, 0x32FF},  // Enclosed CJK Letters And Months
+    {55, 0x3300, 0x33FF},  // CJK Compatibility
+    {56, 0xAC00, 0xD7AF},  // Hangul Syllables
+    {59, 0x4E00, 0x9FFF},  // CJK Unified Ideographs
+    {59, 0x3400, 0x4DBF},  // CJK Unified Ideographs Extension A
+};
+
+// Every glyph range lies inside a block of its OS/2 bit, so script detection reads the
+// right ulUnicodeRange bit
+void test_glyph_range_os2_bits_match_spec(void) {
+    TEST_ASSERT_TRUE(numGlyphRanges <= 32); // One bit each in rangeCoverage/scriptRanges
+    for (int i = 0; i < numGlyphRanges; i++) {
+        bool inBlock = false;
+        for (size_t k = 0; k < sizeof(OS2_RANGE_BLOCKS) / sizeof(OS2_RANGE_BLOCKS[0]); k++) {
+            const SpecBlock& block = OS2_RANGE_BLOCKS[k];
+            if (block.bit == glyphRanges[i].os2Bit && glyphRanges[i].start >= block.start &&
+                glyphRanges[i].end <= block.end) {
+                inBlock = true;
+            }
+        }
+        TEST_ASSERT_TRUE_MESSAGE(inBlock, glyphRanges[i].name);
+    }
+}
+
+void test_font_id_depends_on_path(void) {
+    std::vector<uint8_t> data = loadFixture("DejaVuSansMono.ttf");
+    FontCatalogRecord a = indexBuffer(data, "DejaVuSansMono.ttf");
+    FontCatalogRecord b = indexBuffer(data, "DejaVuSansMono.ttf");
+    FontCatalogRecord renamed = indexBuffer(data, "Mono.ttf");
+    FontCatalogRecord copy1 = indexBuffer(data, "mono/DejaVuSansMono.ttf");
+    FontCatalogRecord copy2 = indexBuffer(data, "backup/DejaVuSansMono.ttf");
+    TEST_ASSERT_NOT_EQUAL(0, a.fontId);
+    TEST_ASSERT_EQUAL_HEX32(a.fontId, b.fontId);
+    TEST_ASSERT_NOT_EQUAL(a.fontId, renamed.fontId);
+    TEST_ASSERT_NOT_EQUAL(copy1.fontId, copy2.fontId);
+    TEST_ASSERT_NOT_EQUAL(a.fontId, copy1.fontId);
+}
+
+void test_not_a_font_is_unusable(void) {
+    const char text[] = "This is not a font file, just some text.";
+    std::vector<uint8_t> data(text, text + sizeof(text));
+    FontCatalogRecord record = indexBuffer(data, "notes.ttf");
+    TEST_ASSERT_NOT_EQUAL(0, record.fontId);
+    TEST_ASSERT_FALSE(record.flags & FONT_FLAG_COVERAGE);
+    TEST_ASSERT_TRUE(record.flags & FONT_FLAG_NO_OUTLINES);
+    TEST_ASSERT_TRUE(record.flags & FONT_FLAG_EMPTY_CMAP);
+    TEST_ASSERT_EQUAL(0, record.codepointCount);
+}
+
+// Re-indexing a record that held another font gives the same fields as a fresh record
+void test_reindex_clears_previous_font(void) {
+    std::vector<uint8_t> font = loadFixture("DejaVuSansMono.ttf");
+    const char text[] = "This is not a font file, just some text.";
+    std::vector<uint8_t> data(text, text + sizeof(text));
+    FontCatalogRecord record = indexBuffer(font, "notes.ttf");
+    FontSource src = {&data, (uint32_t)data.size(), readMemory};
+    indexFontFile(src, "notes.ttf", record);
+    FontCatalogRecord fresh = indexBuffer(data, "notes.ttf");
+    TEST_ASSERT_EQUAL(fresh.flags, record.flags);
+    TEST_ASSERT_EQUAL_MEMORY(&fresh, &record, sizeof(record));
+}
+
+int main() {
+    FT_Init_FreeType(&library);
+    UNITY_BEGIN();
+    RUN_TEST(test_format12_matches_freetype);
+    RUN_TEST(test_format4_matches_freetype);
+    RUN_TEST(test_scripts_are_covered_ranges);
+    RUN_TEST(test_glyph_range_os2_bits_match_spec);
+    RUN_TEST(test_font_id_depends_on_path);
+    RUN_TEST(test_not_a_font_is_unusable);
+    RUN_TEST(test_reindex_clears_previous_font);
+    int failures = UNITY_END();
+    FT_Done_FreeType(library);
+    return failures;
+}
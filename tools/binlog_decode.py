@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Decode PaperSpecimen binary logs (firmware built with -DLOG_BINARY=1).
+
+Usage:
+    python3 tools/binlog_decode.py capture.bin
+    python3 tools/binlog_decode.py /dev/ttyUSB0    (needs pyserial)
+
+Frames start with 0x00 followed by 'F' (format definition) or 'L' (log call).
+Any other byte is plain text (serial console dumps) and is passed through.
+"""
+import re
+import struct
+import sys
+
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D", 5: "V"}
+CONVERSION = re.compile(r"%([-+ #0]*)(\d+|\*)?(\.\d+)?(hh|h|ll|l|z|j|t)?([diouxXcsfFeEgGp%])")
+
+
+def to_python_format(fmt):
+    def fix(m):
+        flags, width, precision, _, conv = m.groups()
+        if conv == "u":
+            conv = "d"
+        elif conv == "p":
+            conv = "x"
+        return "%" + (flags or "") + (width or "") + (precision or "") + conv
+    return CONVERSION.sub(fix, fmt)
+
+
+def decode_args(payload):
+    args, pos = [], 0
+    while pos < len(payload):
+        tag = chr(payload[pos])
+        pos += 1
+        if tag == "i" and pos + 4 <= len(payload):
+            args.append(struct.unpack_from("<i", payload, pos)[0]); pos += 4
+        elif tag == "q" and pos + 8 <= len(payload):
+            args.append(struct.unpack_from("<q", payload, pos)[0]); pos += 8
+        elif tag == "d" and pos + 8 <= len(payload):
+            args.append(struct.unpack_from("<d", payload, pos)[0]); pos += 8
+        elif tag == "s" and pos < len(payload):
+            n = payload[pos]
+            args.append(payload[pos + 1:pos + 1 + n].decode("utf-8", "replace")); pos += 1 + n
+        else:
+            break  # Truncated frame
+    return args
+
+
+def format_message(fmt, args):
+    # %u of a negative int32 came from an unsigned value: show it unsigned
+    convs = [m.group(5) for m in CONVERSION.finditer(fmt) if m.group(5) != "%"]
+    fixed = []
+    for conv, value in zip(convs, args):
+        if conv in "uxXo" and isinstance(value, int) and value < 0:
+            value &= 0xFFFFFFFF
+        fixed.append(value)
+    try:
+        return to_python_format(fmt) % tuple(fixed)
+    except (TypeError, ValueError):
+        return "%s %r\n" % (fmt.rstrip("\n"), args)
+
+
+def decode(stream, out, live=False):
+    formats = {}
+    data = b""
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            if live:
+                continue  # Serial read timed out, keep listening
+            break
+        data += chunk
+        pos = 0
+        while pos < len(data):
+            if data[pos] != 0:
+                end = data.find(b"\x00", pos)
+                end = len(data) if end < 0 else end
+                out.write(data[pos:end].decode("utf-8", "replace"))
+                pos = end
+                continue
+            if pos + 3 > len(data) or pos + 3 + data[pos + 2] > len(data):
+                break  # Wait for the rest of the frame
+            kind, length = chr(data[pos + 1]), data[pos + 2]
+            body = data[pos + 3:pos + 3 + length]
+            pos += 3 + length
+            if kind == "F":
+                addr = struct.unpack_from("<I", body, 0)[0]
+                formats[addr] = body[4:].decode("utf-8", "replace")
+            elif kind == "L" and len(body) >= 9:
+                level, addr, millis = struct.unpack_from("<BII", body, 0)
+                fmt = formats.get(addr, "<unknown format 0x%08x>\n" % addr)
+                text = format_message(fmt, decode_args(body[9:]))
+                out.write("[%9.3f %s] %s" % (millis / 1000.0, LEVELS.get(level, "?"), text))
+        data = data[pos:]
+        out.flush()
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    path = sys.argv[1]
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        import serial
+        decode(serial.Serial(path, 115200, timeout=0.1), sys.stdout, live=True)
+    else:
+        with open(path, "rb") as stream:
+            decode(stream, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()